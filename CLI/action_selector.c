@@ -254,24 +254,23 @@ json_t *create_json_member_entry(psabpf_action_selector_context_t *ctx, psabpf_a
     return member_root;
 }
 
-json_t *create_json_all_members(psabpf_action_selector_context_t *ctx)
+static int print_json_all_members(psabpf_action_selector_context_t *ctx, json_stream_t *stream)
 {
-    json_t *members_root = json_object();
-    if (members_root == NULL)
-        return NULL;
+    int ret = json_stream_open_object(stream, "member_refs");
+    if (ret != NO_ERROR)
+        return ret;
 
     psabpf_action_selector_member_context_t *member;
     while ((member = psabpf_action_selector_get_next_member(ctx)) != NULL) {
+        char idx_str[16];
+        snprintf(idx_str, sizeof(idx_str), "%u", psabpf_action_selector_get_member_reference(member));
         json_t *member_json = create_json_member_entry(ctx, member);
         psabpf_action_selector_member_free(member);
-        if (member_json == NULL) {
-            json_decref(members_root);
-            return NULL;
-        }
-        set_json_object_at_index(members_root, member_json, psabpf_action_selector_get_member_reference(member));
+        if ((ret = json_stream_write_new(stream, idx_str, member_json)) != NO_ERROR)
+            return ret;
     }
 
-    return members_root;
+    return json_stream_close(stream);
 }
 
 json_t *create_json_group_entry(psabpf_action_selector_context_t *ctx, psabpf_action_selector_group_context_t *group, json_t *member_refs)
@@ -300,24 +299,23 @@ json_t *create_json_group_entry(psabpf_action_selector_context_t *ctx, psabpf_ac
     return group_root;
 }
 
-json_t *create_json_all_groups(psabpf_action_selector_context_t *ctx)
+static int print_json_all_groups(psabpf_action_selector_context_t *ctx, json_stream_t *stream)
 {
-    json_t *groups_root = json_object();
-    if (groups_root == NULL)
-        return NULL;
+    int ret = json_stream_open_object(stream, "group_refs");
+    if (ret != NO_ERROR)
+        return ret;
 
     psabpf_action_selector_group_context_t *group;
     while ((group = psabpf_action_selector_get_next_group(ctx)) != NULL) {
+        char idx_str[16];
+        snprintf(idx_str, sizeof(idx_str), "%u", psabpf_action_selector_get_group_reference(group));
         json_t *group_entry = create_json_group_entry(ctx, group, NULL);
         psabpf_action_selector_group_free(group);
-        if (group_entry == NULL) {
-            json_decref(groups_root);
-            return NULL;
-        }
-        set_json_object_at_index(groups_root, group_entry, psabpf_action_selector_get_group_reference(group));
+        if ((ret = json_stream_write_new(stream, idx_str, group_entry)) != NO_ERROR)
+            return ret;
     }
 
-    return groups_root;
+    return json_stream_close(stream);
 }
 
 json_t *create_json_empty_group_action(psabpf_action_selector_context_t *ctx)
@@ -341,20 +339,24 @@ json_t *create_json_empty_group_action(psabpf_action_selector_context_t *ctx)
 int print_action_selector(psabpf_action_selector_context_t *ctx, const char *instance_name, get_mode_t mode, uint32_t reference)
 {
     int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance = json_object();
     json_t *members = NULL;
     json_t *groups = NULL;
-    json_t *empty_group_action = NULL;
+    json_stream_t stream;
 
-    bool failed = false;
-    if (mode == GET_MODE_ALL) {
-        members = create_json_all_members(ctx);
-        groups = create_json_all_groups(ctx);
-        empty_group_action = create_json_empty_group_action(ctx);
+    json_stream_init(&stream, stdout);
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_object(&stream, instance_name)) != NO_ERROR) {
+        fprintf(stderr, "failed to add JSON key %s\n", instance_name);
+        goto clean_up;
+    }
 
-        if (members == NULL || groups == NULL || empty_group_action == NULL)
-            failed = true;
+    if (mode == GET_MODE_ALL) {
+        /* Members and groups are printed while they are read */
+        ret = print_json_all_members(ctx, &stream);
+        if (ret == NO_ERROR)
+            ret = print_json_all_groups(ctx, &stream);
+        if (ret == NO_ERROR)
+            ret = json_stream_write_new(&stream, "empty_group_action", create_json_empty_group_action(ctx));
     } else if (mode == GET_MODE_MEMBER) {
         members = json_object();
         psabpf_action_selector_member_context_t member;
@@ -366,9 +368,11 @@ int print_action_selector(psabpf_action_selector_context_t *ctx, const char *ins
 
         if (members == NULL || ret != NO_ERROR || req_member == NULL) {
             json_decref(req_member);
-            failed = true;
+            ret = EINVAL;
         } else {
             set_json_object_at_index(members, req_member, reference);
+            ret = json_stream_write_new(&stream, "member_refs", members);
+            members = NULL;
         }
     } else if (mode == GET_MODE_GROUP) {
         members = json_object();
@@ -382,45 +386,29 @@ int print_action_selector(psabpf_action_selector_context_t *ctx, const char *ins
 
         if (members == NULL || ret != NO_ERROR || groups == NULL || req_group == NULL) {
             json_decref(req_group);
-            failed = true;
+            ret = EINVAL;
         } else {
             set_json_object_at_index(groups, req_group, reference);
+            ret = json_stream_write_new(&stream, "member_refs", members);
+            if (ret == NO_ERROR)
+                ret = json_stream_write_new(&stream, "group_refs", groups);
+            else
+                json_decref(groups);
+            members = NULL;
+            groups = NULL;
         }
-
     } else if (mode == GET_MODE_EMPTY_GROUP_ACTION) {
-        empty_group_action = create_json_empty_group_action(ctx);
-
-        if (empty_group_action == NULL)
-            failed = true;
+        ret = json_stream_write_new(&stream, "empty_group_action", create_json_empty_group_action(ctx));
     }
 
-    if (root == NULL || instance == NULL || failed) {
+    if (ret != NO_ERROR)
         fprintf(stderr, "failed to create JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
-
-    if (json_object_set(root, instance_name, instance)) {
-        fprintf(stderr, "failed to add JSON key %s\n", instance_name);
-        goto clean_up;
-    }
-
-    if (members != NULL)
-        json_object_set(instance, "member_refs", members);
-    if (groups != NULL)
-        json_object_set(instance, "group_refs", groups);
-    if (empty_group_action != NULL)
-        json_object_set(instance, "empty_group_action", empty_group_action);
-
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-    ret = NO_ERROR;
 
 clean_up:
-    json_decref(root);
-    json_decref(instance);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
     json_decref(members);
     json_decref(groups);
-    json_decref(empty_group_action);
 
     return ret;
 }
@@ -478,7 +466,7 @@ clean_up:
     psabpf_action_selector_member_free(&member);
     psabpf_action_free(&action);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -521,7 +509,7 @@ int do_action_selector_delete_member(int argc, char **argv)
 clean_up:
     psabpf_action_selector_member_free(&member);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -577,7 +565,7 @@ clean_up:
     psabpf_action_selector_member_free(&member);
     psabpf_action_free(&action);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -618,7 +606,7 @@ int do_action_selector_create_group(int argc, char **argv)
 clean_up:
     psabpf_action_selector_group_free(&group);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -661,7 +649,7 @@ int do_action_selector_delete_group(int argc, char **argv)
 clean_up:
     psabpf_action_selector_group_free(&group);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -723,7 +711,7 @@ clean_up:
     psabpf_action_selector_group_free(&group);
     psabpf_action_selector_member_free(&member);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -780,7 +768,7 @@ int do_action_selector_empty_group_action(int argc, char **argv)
 clean_up:
     psabpf_action_free(&action);
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -823,7 +811,7 @@ int do_action_selector_get(int argc, char **argv)
 
 clean_up:
     psabpf_action_selector_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
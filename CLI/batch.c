@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "table.h"
+
+#define BATCH_MAX_ARGS 4096
+
+static int first_error = NO_ERROR;
+
+void batch_report_status(unsigned line, int status)
+{
+    if (status == NO_ERROR) {
+        fprintf(stderr, "line %u: OK\n", line);
+        return;
+    }
+
+    /* cmd_select() returns -1 for unknown command */
+    fprintf(stderr, "line %u: failed: %s\n", line, status > 0 ? strerror(status) : "invalid command");
+    if (first_error == NO_ERROR)
+        first_error = status;
+}
+
+int run_batch(const char *file_name)
+{
+    char *args[BATCH_MAX_ARGS];
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned line_number = 0;
+    table_write_batch_t table_batch;
+
+    FILE *file = stdin;
+    if (strcmp(file_name, "-") != 0) {
+        file = fopen(file_name, "r");
+        if (file == NULL) {
+            int ret = errno;
+            fprintf(stderr, "failed to open %s: %s\n", file_name, strerror(ret));
+            return ret;
+        }
+    }
+
+    first_error = NO_ERROR;
+    /* BTF and maps of pipeline are loaded once */
+    cli_context_keep_between_commands(true);
+    table_write_batch_init(&table_batch);
+
+    while (getline(&line, &line_size, file) >= 0) {
+        line_number++;
+
+        int argc = split_command_line(line, args, BATCH_MAX_ARGS);
+        if (argc == 0)
+            continue;
+        if (argc < 0) {
+            table_write_batch_flush(&table_batch);
+            batch_report_status(line_number, EINVAL);
+            continue;
+        }
+
+        /* Consecutive writes to the same table are coalesced */
+        int ret = table_write_batch_add(&table_batch, argc, args, line_number);
+        if (ret == NO_ERROR)
+            continue;
+        if (ret == ENOTSUP) {
+            table_write_batch_flush(&table_batch);
+            ret = run_command(argc, args);
+            cli_context_command_finished();
+        }
+        batch_report_status(line_number, ret);
+    }
+
+    table_write_batch_free(&table_batch);
+    cli_context_keep_between_commands(false);
+
+    if (line != NULL)
+        free(line);
+    if (file != stdin)
+        fclose(file);
+
+    return first_error;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PSABPFCTL_BATCH_H
+#define __PSABPFCTL_BATCH_H
+
+#include "common.h"
+
+/* Executes commands from file ("-" for standard input), one per line. Returns the first error. */
+int run_batch(const char *file_name);
+
+/* Prints status of the command from given line of the batch file */
+void batch_report_status(unsigned line, int status);
+
+#endif  /* __PSABPFCTL_BATCH_H */
@@ -174,7 +174,7 @@ int do_clone_session_create(int argc, char **argv)
     ret = clone_session_create(&ctx, session_id);
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -205,7 +205,7 @@ int do_clone_session_delete(int argc, char **argv)
     ret = clone_session_delete(&ctx, session_id);
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -253,7 +253,7 @@ int do_clone_session_add_member(int argc, char **argv)
     ret = clone_session_add_member(&ctx, session_id, egress_port, instance, cos, truncate, plen_bytes);
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -287,7 +287,7 @@ int do_clone_session_del_member(int argc, char **argv)
     ret = clone_session_del_member(&ctx, session_id, egress_port, instance);
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -417,7 +417,7 @@ int do_clone_session_get(int argc, char **argv)
 
 clean_up:
     psabpf_clone_session_context_free(&session);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
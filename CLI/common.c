@@ -20,7 +20,7 @@
 #include <string.h>
 #include <errno.h>
 
-#include <gmp.h>  /* GNU LGPL v3 or GNU GPL v2, used only by function convert_number_to_bytes() */
+#include <gmp.h>  /* GNU LGPL v3 or GNU GPL v2, used only by function convert_number_to_bytes() for numbers wider than 64 bits */
 #include <jansson.h>
 
 #include "common.h"
@@ -38,6 +38,50 @@ bool is_keyword(const char *word, const char *str)
     return !memcmp(str, word, strlen(str));
 }
 
+int split_command_line(char *line, char **argv, int max_args)
+{
+    int argc = 0;
+    char *src = line, *dst = line;
+
+    while (true) {
+        while (isspace((unsigned char) *src))
+            src++;
+        if (*src == '\0' || *src == '#')
+            break;
+
+        if (argc >= max_args) {
+            fprintf(stderr, "too many arguments\n");
+            return -1;
+        }
+        argv[argc++] = dst;
+
+        char quote = '\0';
+        while (*src != '\0' && (quote != '\0' || !isspace((unsigned char) *src))) {
+            if (quote == '\0' && (*src == '\'' || *src == '"')) {
+                quote = *src++;
+            } else if (quote != '\0' && *src == quote) {
+                quote = '\0';
+                src++;
+            } else if (*src == '\\' && quote != '\'' && src[1] != '\0') {
+                *dst++ = src[1];
+                src += 2;
+            } else {
+                *dst++ = *src++;
+            }
+        }
+        if (quote != '\0') {
+            fprintf(stderr, "missing closing quote\n");
+            return -1;
+        }
+        /* dst never gets ahead of src, so terminator doesn't overwrite unread characters */
+        if (*src != '\0')
+            src++;
+        *dst++ = '\0';
+    }
+
+    return argc;
+}
+
 int parse_pipeline_id(int *argc, char ***argv, psabpf_context_t * psabpf_ctx)
 {
     if (*argc < 2) {
@@ -57,7 +101,7 @@ int parse_pipeline_id(int *argc, char ***argv, psabpf_context_t * psabpf_ctx)
         fprintf(stderr, "can't parse '%s'\n", **argv);
         return EINVAL;
     }
-    psabpf_context_set_pipeline(psabpf_ctx, id);
+    cli_context_set_pipeline(psabpf_ctx, id);
 
     if (!psabpf_pipeline_exists(psabpf_ctx)) {
         fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", id);
@@ -181,28 +225,108 @@ static int update_context(const char *data, size_t len, void *ctx, enum destinat
     return EPERM;
 }
 
-/* TODO: Is there any ready to use function for this purpose? */
-static bool is_valid_mac_address(const char * data)
+/* Parsers below write bytes in reverse order, like numbers (least significant byte first) */
+
+static bool parse_ipv4_address(const char *data, uint8_t bytes[4])
+{
+    for (int octet = 3; octet >= 0; octet--) {
+        unsigned value = 0, digits = 0;
+        while (*data >= '0' && *data <= '9') {
+            /* leading zeros are not allowed, like in inet_pton() */
+            if (digits == 1 && value == 0)
+                return false;
+            value = value * 10 + (*data - '0');
+            if (++digits > 3 || value > 255)
+                return false;
+            data++;
+        }
+        if (digits == 0)
+            return false;
+        bytes[octet] = value;
+
+        if (octet > 0 && *data++ != '.')
+            return false;
+    }
+
+    return *data == '\0';
+}
+
+static int hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/* 11:22:33:44:55:66 or 11-22-33-44-55-66 */
+static bool parse_mac_address(const char *data, uint8_t bytes[6])
+{
+    for (int i = 5; i >= 0; i--) {
+        int high = hex_digit_value(data[0]);
+        if (high < 0)
+            return false;
+        int low = hex_digit_value(data[1]);
+        if (low < 0)
+            return false;
+        bytes[i] = (uint8_t) (high << 4 | low);
+        data += 2;
+
+        if (i > 0 && *data != ':' && *data != '-')
+            return false;
+        if (i > 0)
+            data++;
+    }
+
+    return *data == '\0';
+}
+
+static bool parse_ipv6_address(const char *data, uint8_t bytes[16])
 {
-    if (strlen(data) != 2*6+5)  /* 11:22:33:44:55:66 */
+    uint8_t address[16];
+
+    if (strchr(data, ':') == NULL || inet_pton(AF_INET6, data, address) != 1)
         return false;
 
-    unsigned digits = 0, separators = 0, pos = 0;
-    unsigned separator_pos[] = {2, 5, 8, 11, 14};
-    while (*data) {
-        if (pos == separator_pos[separators]) {
-            if ((*data != ':') && (*data != '-'))
-                return false;
-            separators++;
-        } else if (isxdigit(*data)) {
-            digits++;
-        } else {
+    for (int i = 0; i < 16; i++)
+        bytes[i] = address[15 - i];
+
+    return true;
+}
+
+/* Accepts the same formats as mpz_set_str() with base 0 (decimal, 0x hex, 0b binary, 0 octal).
+ * Returns false when value doesn't fit into 64 bits or has other format, then GMP has to be used. */
+static bool parse_small_number(const char *data, uint64_t *value)
+{
+    unsigned base = 10;
+    uint64_t result = 0;
+
+    if (data[0] == '0' && (data[1] == 'x' || data[1] == 'X')) {
+        base = 16;
+        data += 2;
+    } else if (data[0] == '0' && (data[1] == 'b' || data[1] == 'B')) {
+        base = 2;
+        data += 2;
+    } else if (data[0] == '0' && data[1] != '\0') {
+        base = 8;
+        data += 1;
+    }
+    if (*data == '\0')
+        return false;
+
+    for (; *data != '\0'; data++) {
+        int digit = hex_digit_value(*data);
+        if (digit < 0 || (unsigned) digit >= base)
             return false;
-        }
-        if (separators > 5 || digits > 12)
+        if (result > (UINT64_MAX - digit) / base)
             return false;
-        data++; pos++;
+        result = result * base + digit;
     }
+
+    *value = result;
     return true;
 }
 
@@ -236,6 +360,25 @@ static int convert_number_to_bytes(const char *data, void *ctx, enum destination
             forced_len += 1;
     }
 
+    /* Fast path for values up to 64 bits */
+    uint64_t small_number;
+    if ((forced_len == 0 || forced_len <= sizeof(uint64_t)) && parse_small_number(data, &small_number)) {
+        uint8_t bytes[sizeof(uint64_t)];
+        len = 1;
+        while (len < sizeof(uint64_t) && (small_number >> (8 * len)) != 0)
+            len++;
+        if (forced_len != 0) {
+            if (len > forced_len) {
+                fprintf(stderr, "%s: do not fits into %zu bytes\n", data, forced_len);
+                return EPERM;
+            }
+            len = forced_len;
+        }
+        for (size_t i = 0; i < len; i++)
+            bytes[i] = (uint8_t) (small_number >> (8 * i));
+        return update_context((void *) bytes, len, ctx, ctx_type);
+    }
+
     mpz_init(number);
     if (mpz_set_str(number, data, 0) != 0) {
         fprintf(stderr, "%s: failed to parse number\n", data);
@@ -275,26 +418,19 @@ static int convert_number_to_bytes(const char *data, void *ctx, enum destination
 
 int translate_data_to_bytes(const char *data, void *ctx, enum destination_ctx_type_t ctx_type)
 {
-    /* Try parse as a IPv4 */
-    struct sockaddr_in sa_buffer;
-    if (inet_pton(AF_INET, data, &(sa_buffer.sin_addr)) == 1) {
-        sa_buffer.sin_addr.s_addr = htonl(sa_buffer.sin_addr.s_addr);
-        return update_context((void *) &(sa_buffer.sin_addr), sizeof(sa_buffer.sin_addr), ctx, ctx_type);
-    }
+    uint8_t bytes[16];
 
-    /* TODO: Try parse IPv6 (similar to IPv4) */
+    /* Try parse as a IPv4 */
+    if (parse_ipv4_address(data, bytes))
+        return update_context((void *) bytes, 4, ctx, ctx_type);
 
     /* Try parse as a MAC address */
-    if (is_valid_mac_address(data)) {
-        int v[6];
-        if (sscanf(data, "%x%*c%x%*c%x%*c%x%*c%x%*c%x",
-                   &(v[0]), &(v[1]), &(v[2]), &(v[3]), &(v[4]), &(v[5])) == 6) {
-            uint8_t bytes[6];
-            for (int i = 0; i < 6; i++)
-                bytes[i] = (uint8_t) v[5-i];
-            return update_context((void *) &(bytes[0]), 6, ctx, ctx_type);
-        }
-    }
+    if (parse_mac_address(data, bytes))
+        return update_context((void *) bytes, 6, ctx, ctx_type);
+
+    /* Try parse as a IPv6 */
+    if (parse_ipv6_address(data, bytes))
+        return update_context((void *) bytes, 16, ctx, ctx_type);
 
     /* Last chance: parse as number */
     return convert_number_to_bytes(data, ctx, ctx_type);
@@ -490,3 +626,268 @@ int parse_key_data(int *argc, char ***argv, psabpf_table_entry_t *entry)
 
     return NO_ERROR;
 }
+
+/******************************************************************************
+ * Pipeline contexts kept between commands (daemon and batch mode)
+ *****************************************************************************/
+
+typedef struct pipeline_context_slot {
+    psabpf_context_t ctx;
+    psabpf_context_t *borrower;  /* context of the command which currently uses BTF and maps */
+    struct pipeline_context_slot *next;
+} pipeline_context_slot_t;
+
+static bool keep_contexts = false;
+static pipeline_context_slot_t *context_slots = NULL;
+
+static void reset_context_slot(pipeline_context_slot_t *slot)
+{
+    psabpf_pipeline_id_t id = psabpf_context_get_pipeline(&slot->ctx);
+    psabpf_context_init(&slot->ctx);
+    psabpf_context_set_pipeline(&slot->ctx, id);
+    slot->borrower = NULL;
+}
+
+void cli_context_set_pipeline(psabpf_context_t *psabpf_ctx, psabpf_pipeline_id_t id)
+{
+    if (!keep_contexts) {
+        psabpf_context_set_pipeline(psabpf_ctx, id);
+        return;
+    }
+
+    pipeline_context_slot_t *slot = context_slots;
+    while (slot != NULL && psabpf_context_get_pipeline(&slot->ctx) != id)
+        slot = slot->next;
+
+    if (slot == NULL) {
+        slot = malloc(sizeof(pipeline_context_slot_t));
+        if (slot == NULL) {
+            psabpf_context_set_pipeline(psabpf_ctx, id);
+            return;
+        }
+        psabpf_context_init(&slot->ctx);
+        psabpf_context_set_pipeline(&slot->ctx, id);
+        slot->borrower = NULL;
+        slot->next = context_slots;
+        context_slots = slot;
+    }
+
+    /* Already used by the command, second context gets its own cache */
+    if (slot->borrower != NULL) {
+        psabpf_context_set_pipeline(psabpf_ctx, id);
+        return;
+    }
+
+    /* Pipeline might be reloaded by someone else since the last command */
+    psabpf_context_revalidate_cache(&slot->ctx);
+    psabpf_context_free(psabpf_ctx);
+    *psabpf_ctx = slot->ctx;
+    slot->borrower = psabpf_ctx;
+}
+
+void cli_context_free(psabpf_context_t *psabpf_ctx)
+{
+    for (pipeline_context_slot_t *slot = context_slots; slot != NULL; slot = slot->next) {
+        if (slot->borrower != psabpf_ctx)
+            continue;
+
+        if (psabpf_context_get_pipeline(psabpf_ctx) == psabpf_context_get_pipeline(&slot->ctx)) {
+            /* Caches might be created or extended by the command, take them back */
+            slot->ctx = *psabpf_ctx;
+            slot->borrower = NULL;
+            psabpf_context_init(psabpf_ctx);
+            return;
+        }
+
+        /* Pipeline changed, so caches of the slot have been already released */
+        reset_context_slot(slot);
+        break;
+    }
+
+    psabpf_context_free(psabpf_ctx);
+}
+
+/* Context not returned by a command can't be trusted, its caches are leaked rather than used */
+void cli_context_command_finished(void)
+{
+    for (pipeline_context_slot_t *slot = context_slots; slot != NULL; slot = slot->next) {
+        if (slot->borrower != NULL)
+            reset_context_slot(slot);
+    }
+}
+
+void cli_context_keep_between_commands(bool keep)
+{
+    keep_contexts = keep;
+    if (keep)
+        return;
+
+    while (context_slots != NULL) {
+        pipeline_context_slot_t *slot = context_slots;
+        context_slots = slot->next;
+        if (slot->borrower == NULL)
+            psabpf_context_free(&slot->ctx);
+        free(slot);
+    }
+}
+
+/******************************************************************************
+ * Streaming JSON output
+ *****************************************************************************/
+
+bool output_ndjson = false;
+
+static void json_stream_indent(json_stream_t *stream, unsigned depth)
+{
+    fputc('\n', stream->out);
+    for (unsigned i = 0; i < depth; i++)
+        fputs("    ", stream->out);
+}
+
+static int json_stream_write_key(json_stream_t *stream, const char *key)
+{
+    json_t *json_key = json_string(key);
+    if (json_key == NULL)
+        return ENOMEM;
+    int ret = json_dumpf(json_key, stream->out, JSON_ENCODE_ANY | JSON_ENSURE_ASCII);
+    json_decref(json_key);
+    if (ret != 0)
+        return EIO;
+    fputs(": ", stream->out);
+    return NO_ERROR;
+}
+
+/* Separator, indentation and key of the next item in the current container */
+static int json_stream_begin_item(json_stream_t *stream, const char *key)
+{
+    if (stream->depth > 0) {
+        if (stream->has_items[stream->depth - 1])
+            fputc(',', stream->out);
+        stream->has_items[stream->depth - 1] = true;
+        json_stream_indent(stream, stream->depth);
+    }
+    if (key != NULL)
+        return json_stream_write_key(stream, key);
+    return NO_ERROR;
+}
+
+static int json_stream_open(json_stream_t *stream, const char *key, bool array)
+{
+    if (stream->depth >= JSON_STREAM_MAX_DEPTH)
+        return EINVAL;
+
+    if (!stream->ndjson) {
+        int ret = json_stream_begin_item(stream, key);
+        if (ret != NO_ERROR)
+            return ret;
+        fputc(array ? '[' : '{', stream->out);
+    }
+
+    stream->is_array[stream->depth] = array;
+    stream->has_items[stream->depth] = false;
+    stream->depth++;
+
+    return NO_ERROR;
+}
+
+void json_stream_init(json_stream_t *stream, FILE *out)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->out = out;
+    stream->ndjson = output_ndjson;
+}
+
+int json_stream_open_object(json_stream_t *stream, const char *key)
+{
+    return json_stream_open(stream, key, false);
+}
+
+int json_stream_open_array(json_stream_t *stream, const char *key)
+{
+    return json_stream_open(stream, key, true);
+}
+
+int json_stream_close(json_stream_t *stream)
+{
+    if (stream->depth == 0)
+        return EINVAL;
+
+    stream->depth--;
+    if (!stream->ndjson) {
+        if (stream->has_items[stream->depth])
+            json_stream_indent(stream, stream->depth);
+        fputc(stream->is_array[stream->depth] ? ']' : '}', stream->out);
+    }
+
+    return NO_ERROR;
+}
+
+int json_stream_write_new(json_stream_t *stream, const char *key, json_t *value)
+{
+    int ret = NO_ERROR;
+    char *text = NULL;
+
+    if (value == NULL)
+        return ENOMEM;
+
+    if (stream->ndjson) {
+        /* One line per item, items of objects keep their key */
+        if (key != NULL) {
+            json_t *wrapper = json_object();
+            if (wrapper == NULL || json_object_set(wrapper, key, value) != 0) {
+                json_decref(wrapper);
+                ret = ENOMEM;
+                goto clean_up;
+            }
+            text = json_dumps(wrapper, JSON_COMPACT | JSON_ENSURE_ASCII);
+            json_decref(wrapper);
+        } else {
+            text = json_dumps(value, JSON_COMPACT | JSON_ENSURE_ASCII | JSON_ENCODE_ANY);
+        }
+        if (text == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        fputs(text, stream->out);
+        fputc('\n', stream->out);
+        goto clean_up;
+    }
+
+    ret = json_stream_begin_item(stream, key);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    text = json_dumps(value, JSON_INDENT(4) | JSON_ENSURE_ASCII | JSON_ENCODE_ANY);
+    if (text == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+    /* Strings in JSON can't contain new line, so every one of them starts a new line of output */
+    for (const char *line = text; *line != '\0';) {
+        const char *eol = strchr(line, '\n');
+        size_t len = eol != NULL ? (size_t) (eol - line) : strlen(line);
+        fwrite(line, 1, len, stream->out);
+        if (eol == NULL)
+            break;
+        json_stream_indent(stream, stream->depth);
+        line = eol + 1;
+    }
+
+clean_up:
+    if (text != NULL)
+        free(text);
+    json_decref(value);
+
+    return ret;
+}
+
+int json_stream_finish(json_stream_t *stream)
+{
+    while (stream->depth > 0)
+        json_stream_close(stream);
+
+    if (fflush(stream->out) != 0 || ferror(stream->out))
+        return EIO;
+
+    return NO_ERROR;
+}
@@ -48,6 +48,22 @@ typedef struct parser_keyword_value_pair {
 
 bool is_keyword(const char *word, const char *str);
 
+/* Executes command (arguments without program name), implemented in main.c */
+int run_command(int argc, char **argv);
+
+/* Splits line in place into arguments like shell does: words are separated with white spaces, can be quoted
+ * with '' or "", backslash escapes next character, # starts comment. Returns number of arguments, -1 on error. */
+int split_command_line(char *line, char **argv, int max_args);
+
+/* Use these instead of psabpf_context_set_pipeline() and psabpf_context_free() for pipeline context
+ * of a command. In daemon and batch mode BTF and opened maps of the pipeline are kept between commands. */
+void cli_context_set_pipeline(psabpf_context_t *psabpf_ctx, psabpf_pipeline_id_t id);
+void cli_context_free(psabpf_context_t *psabpf_ctx);
+/* Enables keeping contexts between commands, disabling releases them */
+void cli_context_keep_between_commands(bool keep);
+/* Must be called after every command when contexts are kept */
+void cli_context_command_finished(void);
+
 int parse_pipeline_id(int *argc, char ***argv, psabpf_context_t * psabpf_ctx);
 
 /* Optional values are not written when they are missing on command line, so they must be initialized */
@@ -74,4 +90,32 @@ char * convert_bin_data_to_hexstr(const void *data, size_t len);
 json_t *create_json_entry_key(psabpf_table_entry_t *entry);
 int parse_key_data(int *argc, char ***argv, psabpf_table_entry_t *entry);
 
+/* Streaming JSON output. Items are written as soon as they are available, so memory usage
+ * doesn't depend on the number of entries. Pretty output has the same format as json_dumpf()
+ * with JSON_INDENT(4). In NDJSON mode containers are omitted and every item is a separate line;
+ * items of objects are wrapped into an object with their key. */
+
+#define JSON_STREAM_MAX_DEPTH 8
+
+typedef struct json_stream {
+    FILE *out;
+    bool ndjson;
+    unsigned depth;
+    bool is_array[JSON_STREAM_MAX_DEPTH];
+    bool has_items[JSON_STREAM_MAX_DEPTH];
+} json_stream_t;
+
+/* Set by the --ndjson option */
+extern bool output_ndjson;
+
+void json_stream_init(json_stream_t *stream, FILE *out);
+/* key must be NULL inside arrays */
+int json_stream_open_object(json_stream_t *stream, const char *key);
+int json_stream_open_array(json_stream_t *stream, const char *key);
+int json_stream_close(json_stream_t *stream);
+/* Steals reference to value, also on error */
+int json_stream_write_new(json_stream_t *stream, const char *key, json_t *value);
+/* Closes all containers and flushes output */
+int json_stream_finish(json_stream_t *stream);
+
 #endif //P4C_COMMON_H
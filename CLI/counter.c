@@ -212,16 +212,21 @@ static int build_json_counter_entry(json_t *parent, psabpf_counter_context_t *ct
     return ret;
 }
 
-int build_json_counter_type(void *parent, psabpf_counter_type_t type)
+static const char *get_counter_type_name(psabpf_counter_type_t type)
 {
     if (type == PSABPF_COUNTER_TYPE_BYTES)
-        json_object_set_new(parent, "type", json_string("BYTES"));
+        return "BYTES";
     else if (type == PSABPF_COUNTER_TYPE_PACKETS)
-        json_object_set_new(parent, "type", json_string("PACKETS"));
+        return "PACKETS";
     else if (type == PSABPF_COUNTER_TYPE_BYTES_AND_PACKETS)
-        json_object_set_new(parent, "type", json_string("PACKETS_AND_BYTES"));
-    else
-        json_object_set_new(parent, "type", json_string("UNKNOWN"));
+        return "PACKETS_AND_BYTES";
+
+    return "UNKNOWN";
+}
+
+int build_json_counter_type(void *parent, psabpf_counter_type_t type)
+{
+    json_object_set_new(parent, "type", json_string(get_counter_type_name(type)));
 
     return NO_ERROR;
 }
@@ -230,55 +235,52 @@ static int print_json_counter(psabpf_counter_context_t *ctx, psabpf_counter_entr
                               const char *counter_name, bool entry_has_key)
 {
     int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
+    json_stream_t stream;
+    json_stream_init(&stream, stdout);
 
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
+    if (entry_has_key && (ret = psabpf_counter_get(ctx, entry)) != NO_ERROR)
+        return ret;
 
-    json_object_set(instance_name, "entries", entries);
-    if (json_object_set(root, counter_name, instance_name)) {
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_object(&stream, counter_name)) != NO_ERROR) {
         fprintf(stderr, "failed to add JSON key %s\n", counter_name);
         goto clean_up;
     }
-
-    build_json_counter_type(instance_name, psabpf_counter_get_type(ctx));
+    json_stream_open_array(&stream, "entries");
 
     if (entry_has_key) {
-        if ((ret = psabpf_counter_get(ctx, entry)) != NO_ERROR)
-            goto clean_up;
         json_t *current_obj = json_object();
         ret = build_json_counter_entry(current_obj, ctx, entry);
-        json_array_append_new(entries, current_obj);
+        if (ret == NO_ERROR)
+            ret = json_stream_write_new(&stream, NULL, current_obj);
+        else
+            json_decref(current_obj);
     } else {
         psabpf_counter_entry_t *iter;
         while ((iter = psabpf_counter_get_next(ctx)) != NULL) {
             json_t *current_obj = json_object();
             ret = build_json_counter_entry(current_obj, ctx, iter);
-            json_array_append_new(entries, current_obj);
             psabpf_counter_entry_free(iter);
+            if (ret == NO_ERROR)
+                ret = json_stream_write_new(&stream, NULL, current_obj);
+            else
+                json_decref(current_obj);
             if (ret != NO_ERROR)
                 break;
         }
     }
+    json_stream_close(&stream);
 
-    if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to build JSON: %s\n", strerror(ret));
-        goto clean_up;
-    }
-
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
+    int type_ret = json_stream_write_new(&stream, "type", json_string(get_counter_type_name(psabpf_counter_get_type(ctx))));
+    if (ret == NO_ERROR)
+        ret = type_ret;
 
-    ret = NO_ERROR;
+    if (ret != NO_ERROR)
+        fprintf(stderr, "failed to build JSON: %s\n", strerror(ret));
 
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
 
     return ret;
 }
@@ -317,7 +319,7 @@ int do_counter_get(int argc, char **argv)
 clean_up:
     psabpf_counter_entry_free(&entry);
     psabpf_counter_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -355,7 +357,7 @@ int do_counter_set(int argc, char **argv)
 clean_up:
     psabpf_counter_entry_free(&entry);
     psabpf_counter_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -390,7 +392,7 @@ int do_counter_reset(int argc, char **argv)
 clean_up:
     psabpf_counter_entry_free(&entry);
     psabpf_counter_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
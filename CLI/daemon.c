@@ -0,0 +1,653 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_MAX_LINE_LENGTH (1024 * 1024)
+#define DAEMON_MAX_ARGS 4096
+#define IO_BUFFER_SIZE 65536
+
+/******************************************************************************
+ * Common functions
+ *****************************************************************************/
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *ptr = data;
+
+    while (len > 0) {
+        ssize_t written = write(fd, ptr, len);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return errno;
+        }
+        ptr += written;
+        len -= written;
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_socket_path(int *argc, char ***argv, const char **socket_path)
+{
+    if (*argc < 1 || !is_keyword(**argv, "socket"))
+        return NO_ERROR;
+
+    NEXT_ARGP_RET();
+    *socket_path = **argv;
+    NEXT_ARGP();
+
+    return NO_ERROR;
+}
+
+static int fill_socket_address(struct sockaddr_un *addr, const char *socket_path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", socket_path);
+        return ENAMETOOLONG;
+    }
+    strcpy(addr->sun_path, socket_path);
+
+    return NO_ERROR;
+}
+
+static int connect_to_daemon(const char *socket_path, bool quiet)
+{
+    struct sockaddr_un addr;
+    if (fill_socket_address(&addr, socket_path) != NO_ERROR)
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        if (!quiet)
+            fprintf(stderr, "failed to connect to daemon at %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/******************************************************************************
+ * Daemon
+ *****************************************************************************/
+
+static bool daemon_mode = false;
+
+typedef struct daemon_client {
+    int fd;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+} daemon_client_t;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal_handler(int sig)
+{
+    (void) sig;
+    daemon_stop = 1;
+}
+
+static int create_listening_socket(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    struct stat sock_stat;
+
+    if (fill_socket_address(&addr, socket_path) != NO_ERROR)
+        return -1;
+
+    /* Socket might be left by daemon which was killed, but don't steal it from running one */
+    if (stat(socket_path, &sock_stat) == 0 && S_ISSOCK(sock_stat.st_mode)) {
+        int other = connect_to_daemon(socket_path, true);
+        if (other >= 0) {
+            close(other);
+            fprintf(stderr, "daemon is already running at %s\n", socket_path);
+            return -1;
+        }
+        unlink(socket_path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "failed to bind socket to %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* Daemon has the same privileges as user who started it, do not share them with others */
+    chmod(socket_path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+    if (listen(fd, DAEMON_MAX_CLIENTS) != 0) {
+        fprintf(stderr, "failed to listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        unlink(socket_path);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Standard output of the command goes directly to the client, standard error is collected in err_fd */
+static int execute_request(int client_fd, int err_fd, char *line)
+{
+    char *args[DAEMON_MAX_ARGS];
+    int ret = NO_ERROR;
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    if (saved_stdout < 0 || saved_stderr < 0 || ftruncate(err_fd, 0) != 0 || lseek(err_fd, 0, SEEK_SET) != 0) {
+        ret = errno;
+        if (saved_stdout >= 0)
+            close(saved_stdout);
+        if (saved_stderr >= 0)
+            close(saved_stderr);
+        return ret;
+    }
+    dup2(client_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+
+    int argc = split_command_line(line, args, DAEMON_MAX_ARGS);
+    char **cmd_args = args;
+    /* Output format is chosen by the client */
+    bool saved_ndjson = output_ndjson;
+    if (argc > 0 && strcmp(args[0], "--ndjson") == 0) {
+        output_ndjson = true;
+        argc--;
+        cmd_args++;
+    }
+    int cmd_ret = NO_ERROR;
+    if (argc < 0)
+        cmd_ret = EINVAL;
+    else if (argc > 0)
+        cmd_ret = run_command(argc, cmd_args);
+    output_ndjson = saved_ndjson;
+    cli_context_command_finished();
+
+    fflush(stdout);
+    fflush(stderr);
+    clearerr(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    off_t err_len = lseek(err_fd, 0, SEEK_END);
+    if (err_len < 0)
+        err_len = 0;
+
+    char trailer[64];
+    trailer[0] = '\0';
+    int trailer_len = snprintf(trailer + 1, sizeof(trailer) - 1, "%d %lld\n", cmd_ret, (long long) err_len) + 1;
+    ret = write_all(client_fd, trailer, trailer_len);
+
+    char buffer[4096];
+    for (off_t offset = 0; ret == NO_ERROR && offset < err_len;) {
+        ssize_t n = pread(err_fd, buffer, sizeof(buffer), offset);
+        if (n <= 0) {
+            ret = n < 0 ? errno : EIO;
+            break;
+        }
+        ret = write_all(client_fd, buffer, n);
+        offset += n;
+    }
+
+    return ret;
+}
+
+/* Returns false when connection should be closed */
+static bool serve_client(daemon_client_t *client, int err_fd)
+{
+    if (client->capacity - client->length < IO_BUFFER_SIZE / 4) {
+        size_t new_capacity = client->capacity == 0 ? IO_BUFFER_SIZE : 2 * client->capacity;
+        if (new_capacity > DAEMON_MAX_LINE_LENGTH + IO_BUFFER_SIZE) {
+            fprintf(stderr, "client sent too long line, disconnecting\n");
+            return false;
+        }
+        char *buffer = realloc(client->buffer, new_capacity);
+        if (buffer == NULL)
+            return false;
+        client->buffer = buffer;
+        client->capacity = new_capacity;
+    }
+
+    ssize_t n = read(client->fd, client->buffer + client->length, client->capacity - client->length);
+    if (n < 0)
+        return errno == EINTR || errno == EAGAIN;
+    if (n == 0)
+        return false;
+    client->length += n;
+
+    /* Every complete line is a request, responses are sent in the same order */
+    size_t start = 0;
+    char *eol;
+    while ((eol = memchr(client->buffer + start, '\n', client->length - start)) != NULL) {
+        *eol = '\0';
+        if (execute_request(client->fd, err_fd, client->buffer + start) != NO_ERROR)
+            return false;
+        start = eol - client->buffer + 1;
+    }
+    memmove(client->buffer, client->buffer + start, client->length - start);
+    client->length -= start;
+
+    return true;
+}
+
+static void close_client(daemon_client_t *client)
+{
+    close(client->fd);
+    if (client->buffer != NULL)
+        free(client->buffer);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+int do_daemon(int argc, char **argv)
+{
+    const char *socket_path = DAEMON_DEFAULT_SOCKET;
+    daemon_client_t clients[DAEMON_MAX_CLIENTS];
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+    unsigned n_clients = 0;
+    int ret = NO_ERROR;
+
+    if (argc > 0 && is_keyword(*argv, "help"))
+        return do_daemon_help(argc, argv);
+    if (daemon_mode) {
+        fprintf(stderr, "already in daemon mode\n");
+        return EPERM;
+    }
+    if (parse_socket_path(&argc, &argv, &socket_path) != NO_ERROR)
+        return EINVAL;
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    /* Standard error of commands, kept separated from their output */
+    FILE *err_file = tmpfile();
+    if (err_file == NULL) {
+        ret = errno;
+        fprintf(stderr, "failed to create temporary file: %s\n", strerror(ret));
+        return ret;
+    }
+
+    int listen_fd = create_listening_socket(socket_path);
+    if (listen_fd < 0) {
+        fclose(err_file);
+        return EINVAL;
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = daemon_signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    daemon_mode = true;
+    cli_context_keep_between_commands(true);
+    fprintf(stderr, "listening on %s\n", socket_path);
+
+    while (!daemon_stop) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (unsigned i = 0; i < n_clients; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(fds, n_clients + 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = errno;
+            fprintf(stderr, "poll failed: %s\n", strerror(ret));
+            break;
+        }
+
+        for (unsigned i = 0; i < n_clients; i++) {
+            if (fds[i + 1].revents == 0)
+                continue;
+            if (!serve_client(&clients[i], fileno(err_file)))
+                close_client(&clients[i]);
+        }
+
+        /* Remove closed connections */
+        unsigned kept = 0;
+        for (unsigned i = 0; i < n_clients; i++) {
+            if (clients[i].fd >= 0)
+                clients[kept++] = clients[i];
+        }
+        n_clients = kept;
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept(listen_fd, NULL, NULL);
+            if (client_fd < 0)
+                continue;
+            fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+            if (n_clients >= DAEMON_MAX_CLIENTS) {
+                fprintf(stderr, "too many clients, connection rejected\n");
+                close(client_fd);
+                continue;
+            }
+            memset(&clients[n_clients], 0, sizeof(daemon_client_t));
+            clients[n_clients].fd = client_fd;
+            n_clients++;
+        }
+    }
+
+    for (unsigned i = 0; i < n_clients; i++)
+        close_client(&clients[i]);
+    close(listen_fd);
+    unlink(socket_path);
+    fclose(err_file);
+    cli_context_keep_between_commands(false);
+    daemon_mode = false;
+
+    return ret;
+}
+
+/******************************************************************************
+ * Client
+ *****************************************************************************/
+
+enum response_state {
+    RESPONSE_OUTPUT,
+    RESPONSE_TRAILER,
+    RESPONSE_STDERR,
+};
+
+typedef struct response_reader {
+    enum response_state state;
+    char trailer[64];
+    size_t trailer_len;
+    unsigned long long stderr_left;
+    unsigned long completed;
+    int last_error;
+} response_reader_t;
+
+static int parse_response(response_reader_t *reader, const char *data, size_t len)
+{
+    while (len > 0) {
+        if (reader->state == RESPONSE_OUTPUT) {
+            const char *end = memchr(data, '\0', len);
+            size_t n = end != NULL ? (size_t) (end - data) : len;
+            fwrite(data, 1, n, stdout);
+            if (end != NULL) {
+                n++;
+                reader->state = RESPONSE_TRAILER;
+                reader->trailer_len = 0;
+            }
+            data += n;
+            len -= n;
+        } else if (reader->state == RESPONSE_TRAILER) {
+            char c = *data++;
+            len--;
+            if (c != '\n') {
+                if (reader->trailer_len >= sizeof(reader->trailer) - 1)
+                    return EPROTO;
+                reader->trailer[reader->trailer_len++] = c;
+                continue;
+            }
+            reader->trailer[reader->trailer_len] = '\0';
+            int cmd_ret;
+            if (sscanf(reader->trailer, "%d %llu", &cmd_ret, &reader->stderr_left) != 2)
+                return EPROTO;
+            if (cmd_ret != NO_ERROR)
+                reader->last_error = cmd_ret;
+            reader->state = RESPONSE_STDERR;
+        } else {
+            size_t n = reader->stderr_left < len ? reader->stderr_left : len;
+            fwrite(data, 1, n, stderr);
+            data += n;
+            len -= n;
+            reader->stderr_left -= n;
+        }
+
+        if (reader->state == RESPONSE_STDERR && reader->stderr_left == 0) {
+            reader->state = RESPONSE_OUTPUT;
+            reader->completed++;
+            fflush(stdout);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* Sends requests from input_fd (if valid) and send_buf, receives responses at the same time */
+static int exchange_with_daemon(int sock, int input_fd, char *send_buf, size_t send_len)
+{
+    char recv_buf[IO_BUFFER_SIZE];
+    response_reader_t reader = {};
+    unsigned long sent_requests = 0;
+    size_t send_offset = 0;
+    bool input_eof = input_fd < 0;
+    bool ends_with_new_line = true;
+    bool shut = false;
+    int ret = NO_ERROR;
+
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    while (true) {
+        if (input_eof && send_offset == send_len && !shut) {
+            if (!ends_with_new_line) {
+                send_buf[0] = '\n';
+                send_offset = 0;
+                send_len = 1;
+                ends_with_new_line = true;
+            } else {
+                shutdown(sock, SHUT_WR);
+                shut = true;
+            }
+        }
+        if (shut && reader.completed >= sent_requests)
+            break;
+
+        struct pollfd fds[2] = {
+                { .fd = sock, .events = POLLIN | (send_offset < send_len ? POLLOUT : 0) },
+                { .fd = input_fd, .events = POLLIN },
+        };
+        /* Read next requests when previous ones are sent */
+        nfds_t nfds = (!input_eof && send_offset == send_len) ? 2 : 1;
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = errno;
+            break;
+        }
+
+        if (fds[0].revents & POLLOUT) {
+            ssize_t n = write(sock, send_buf + send_offset, send_len - send_offset);
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                ret = errno;
+                break;
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                if (send_buf[send_offset + i] == '\n')
+                    sent_requests++;
+            }
+            if (n > 0)
+                send_offset += n;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(sock, recv_buf, sizeof(recv_buf));
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                ret = errno;
+                break;
+            }
+            if (n == 0) {
+                if (reader.completed < sent_requests || !shut) {
+                    fprintf(stderr, "connection closed by daemon\n");
+                    ret = ECONNRESET;
+                }
+                break;
+            }
+            if (n > 0 && (ret = parse_response(&reader, recv_buf, n)) != NO_ERROR) {
+                fprintf(stderr, "invalid response from daemon\n");
+                break;
+            }
+        }
+
+        if (nfds > 1 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(input_fd, send_buf, IO_BUFFER_SIZE);
+            if (n < 0 && errno != EINTR) {
+                ret = errno;
+                break;
+            }
+            if (n == 0) {
+                input_eof = true;
+            } else if (n > 0) {
+                send_offset = 0;
+                send_len = n;
+                ends_with_new_line = send_buf[n - 1] == '\n';
+            }
+        }
+    }
+
+    fflush(stdout);
+    if (ret != NO_ERROR)
+        return ret;
+
+    return reader.last_error;
+}
+
+int do_client(int argc, char **argv)
+{
+    const char *socket_path = DAEMON_DEFAULT_SOCKET;
+
+    if (argc > 0 && is_keyword(*argv, "help"))
+        return do_daemon_help(argc, argv);
+    if (daemon_mode) {
+        fprintf(stderr, "not available in daemon mode\n");
+        return EPERM;
+    }
+    if (parse_socket_path(&argc, &argv, &socket_path) != NO_ERROR)
+        return EINVAL;
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    int sock = connect_to_daemon(socket_path, false);
+    if (sock < 0)
+        return ECONNREFUSED;
+
+    char *send_buf = malloc(IO_BUFFER_SIZE);
+    if (send_buf == NULL) {
+        close(sock);
+        return ENOMEM;
+    }
+    int ret = exchange_with_daemon(sock, STDIN_FILENO, send_buf, 0);
+    free(send_buf);
+    close(sock);
+
+    return ret;
+}
+
+int daemon_forward_command(const char *socket_path, int argc, char **argv)
+{
+    /* Every argument is quoted, ' inside of it is replaced with '\'' */
+    size_t line_len = 11;
+    for (int i = 0; i < argc; i++) {
+        if (strchr(argv[i], '\n') != NULL) {
+            fprintf(stderr, "new line is not allowed in arguments\n");
+            return EINVAL;
+        }
+        line_len += 4 * strlen(argv[i]) + 3;
+    }
+
+    char *line = malloc(line_len);
+    if (line == NULL)
+        return ENOMEM;
+    size_t len = 0;
+    if (output_ndjson) {
+        memcpy(line, "--ndjson ", 9);
+        len = 9;
+    }
+    for (int i = 0; i < argc; i++) {
+        line[len++] = '\'';
+        for (const char *c = argv[i]; *c != '\0'; c++) {
+            if (*c == '\'') {
+                memcpy(line + len, "'\\''", 4);
+                len += 4;
+            } else {
+                line[len++] = *c;
+            }
+        }
+        line[len++] = '\'';
+        line[len++] = ' ';
+    }
+    line[len++] = '\n';
+
+    int ret = ECONNREFUSED;
+    int sock = connect_to_daemon(socket_path, false);
+    if (sock >= 0) {
+        ret = exchange_with_daemon(sock, -1, line, len);
+        close(sock);
+    }
+    free(line);
+
+    return ret;
+}
+
+int do_daemon_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+    fprintf(stderr,
+            "Usage: %1$s daemon [socket PATH]\n"
+            "       %1$s client [socket PATH]\n"
+            "       %1$s --socket PATH OBJECT COMMAND\n"
+            "\n"
+            "Daemon executes commands received over the socket (default %2$s), one per line,\n"
+            "and keeps BTF and maps of pipelines opened between them. Client sends commands read\n"
+            "from standard input without waiting for responses. With --socket a single command\n"
+            "is executed by the daemon.\n"
+            "",
+            program_name, DAEMON_DEFAULT_SOCKET);
+    return NO_ERROR;
+}
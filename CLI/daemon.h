@@ -0,0 +1,39 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PSABPFCTL_DAEMON_H
+#define __PSABPFCTL_DAEMON_H
+
+#include "common.h"
+
+#define DAEMON_DEFAULT_SOCKET "/run/psabpf-ctl.sock"
+
+/*
+ * Protocol: client sends commands, one per line, with the same grammar as on command line
+ * (without program name). For every line daemon responds, in the same order, with standard output
+ * of the command, then NUL byte, line "RETURN_CODE STDERR_LENGTH" and standard error of the command.
+ * Client doesn't have to wait for response before sending next command.
+ */
+
+int do_daemon(int argc, char **argv);
+int do_client(int argc, char **argv);
+int do_daemon_help(int argc, char **argv);
+
+/* Sends single command to the daemon and prints its output, used by --socket option */
+int daemon_forward_command(const char *socket_path, int argc, char **argv);
+
+#endif  /* __PSABPFCTL_DAEMON_H */
@@ -65,16 +65,11 @@ int get_digests_and_print(int argc, char **argv, bool only_single_entry)
         goto clean_up_psabpf;
     }
 
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        goto clean_up;
-    }
-
-    json_object_set(instance_name, "digests", entries);
-    if (json_object_set(root, digest_instance_name, instance_name)) {
+    json_stream_t stream;
+    json_stream_init(&stream, stdout);
+    json_stream_open_object(&stream, NULL);
+    if (json_stream_open_object(&stream, digest_instance_name) != NO_ERROR ||
+        json_stream_open_array(&stream, "digests") != NO_ERROR) {
         fprintf(stderr, "failed to add JSON key %s\n", digest_instance_name);
         goto clean_up;
     }
@@ -84,11 +79,13 @@ int get_digests_and_print(int argc, char **argv, bool only_single_entry)
         json_t *entry = json_object();
         if (entry == NULL) {
             fprintf(stderr, "failed to prepare digest message in JSON\n");
+            psabpf_digest_free(&digest);
             goto clean_up;
         }
         int ret = build_struct_json(entry, &ctx, &digest, (get_next_field_func_t) psabpf_digest_get_next_field);
-        json_array_append_new(entries, entry);
         psabpf_digest_free(&digest);
+        if (json_stream_write_new(&stream, NULL, entry) != NO_ERROR)
+            break;
 
         if (ret != NO_ERROR)
             break;
@@ -97,18 +94,15 @@ int get_digests_and_print(int argc, char **argv, bool only_single_entry)
             break;
     }
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-
     error_code = 0;
 
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && error_code == NO_ERROR)
+        error_code = EIO;
 
 clean_up_psabpf:
     psabpf_digest_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
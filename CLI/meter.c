@@ -174,49 +174,42 @@ json_t *create_json_meter_entry(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *m
 
 int print_meter(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry, const char *meter_name) {
     int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
+    json_stream_t stream;
 
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
-
-    if (json_object_set(root, meter_name, instance_name)) {
+    json_stream_init(&stream, stdout);
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_object(&stream, meter_name)) != NO_ERROR) {
         fprintf(stderr, "failed to add JSON key %s\n", meter_name);
         goto clean_up;
     }
-    json_object_set(instance_name, "entries", entries);
+    json_stream_open_array(&stream, "entries");
 
     if (entry != NULL) {
         json_t *parsed_entry = create_json_meter_entry(ctx, entry);
         if (parsed_entry == NULL) {
             fprintf(stderr, "failed to create table JSON entry\n");
+            ret = EINVAL;
             goto clean_up;
         }
-        json_array_append_new(entries, parsed_entry);
+        ret = json_stream_write_new(&stream, NULL, parsed_entry);
     } else {
         psabpf_meter_entry_t *current_entry;
         while ((current_entry = psabpf_meter_get_next(ctx)) != NULL) {
             json_t *parsed_entry = create_json_meter_entry(ctx, current_entry);
+            psabpf_meter_entry_free(current_entry);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON entry\n");
+                ret = EINVAL;
                 goto clean_up;
             }
-            json_array_append_new(entries, parsed_entry);
-            psabpf_meter_entry_free(current_entry);
+            if ((ret = json_stream_write_new(&stream, NULL, parsed_entry)) != NO_ERROR)
+                goto clean_up;
         }
     }
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-    ret = NO_ERROR;
-
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
 
     return ret;
 }
@@ -269,7 +262,7 @@ int do_meter_get(int argc, char **argv) {
 clean_up:
     psabpf_meter_entry_free(&entry);
     psabpf_meter_ctx_free(&meter_ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
     return error_code;
 }
 
@@ -311,7 +304,7 @@ int do_meter_update(int argc, char **argv) {
 clean_up:
     psabpf_meter_entry_free(&entry);
     psabpf_meter_ctx_free(&meter_ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
     return error_code;
 }
 
@@ -350,7 +343,7 @@ int do_meter_reset(int argc, char **argv) {
 clean_up:
     psabpf_meter_entry_free(&entry);
     psabpf_meter_ctx_free(&meter_ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
     return error_code;
 }
 
@@ -70,7 +70,7 @@ int do_multicast_create_group(int argc, char **argv)
 
 err:
     psabpf_mcast_grp_context_free(&mcast_grp);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -102,7 +102,7 @@ int do_multicast_delete_group(int argc, char **argv)
 
 err:
     psabpf_mcast_grp_context_free(&mcast_grp);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -162,7 +162,7 @@ int do_multicast_add_group_member(int argc, char **argv)
 err:
     psabpf_mcast_grp_member_free(&member);
     psabpf_mcast_grp_context_free(&mcast_grp);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -197,7 +197,7 @@ int do_multicast_del_group_member(int argc, char **argv)
 err:
     psabpf_mcast_grp_member_free(&member);
     psabpf_mcast_grp_context_free(&mcast_grp);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
@@ -321,7 +321,7 @@ int do_multicast_get(int argc, char **argv)
 
 clean_up:
     psabpf_mcast_grp_context_free(&group);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
 
     return ret;
 }
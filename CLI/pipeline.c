@@ -133,19 +133,19 @@ int do_pipeline_load(int argc, char **argv)
 
     if (psabpf_pipeline_exists(&ctx)) {
         fprintf(stderr, "pipeline id %u already exists\n", id);
-        psabpf_context_free(&ctx);
+        cli_context_free(&ctx);
         return EEXIST;
     }
 
     int ret = psabpf_pipeline_load(&ctx, file);
     if (ret) {
         fprintf(stdout, "An error occurred during pipeline load id %u\n", id);
-        psabpf_context_free(&ctx);
+        cli_context_free(&ctx);
         return ret;
     }
 
     fprintf(stdout, "Pipeline id %u successfully loaded!\n", id);
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
     return NO_ERROR;
 }
 
@@ -180,7 +180,7 @@ int do_pipeline_unload(int argc, char **argv)
 
     fprintf(stdout, "Pipeline id %u successfully unloaded!\n", id);
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
     return error;
 }
 
@@ -228,7 +228,7 @@ int do_pipeline_port_add(int argc, char **argv)
     }
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
     return ret;
 }
 
@@ -257,7 +257,7 @@ int do_pipeline_port_del(int argc, char **argv)
     }
 
 err:
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
     return ret;
 }
 
@@ -276,20 +276,68 @@ int do_pipeline_show(int argc, char **argv)
     }
 
     psabpf_context_init(&ctx);
-    psabpf_context_set_pipeline(&ctx, id);
+    cli_context_set_pipeline(&ctx, id);
 
     if (!psabpf_pipeline_exists(&ctx)) {
         fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", id);
-        psabpf_context_free(&ctx);
+        cli_context_free(&ctx);
         return ENOENT;
     }
 
     ret_code = print_pipeline_json(&ctx);
 
-    psabpf_context_free(&ctx);
+    cli_context_free(&ctx);
     return ret_code;
 }
 
+static int do_pipeline_snapshot_common(int argc, char **argv, bool restore)
+{
+    int error = NO_ERROR;
+    uint32_t id = 0;
+
+    if (parse_pipeline_id_without_pipe_keyword(&argc, &argv, &id) != NO_ERROR)
+        return EINVAL;
+
+    if (argc < 1) {
+        fprintf(stderr, "expected path to the snapshot file\n");
+        return EINVAL;
+    } else if (argc > 1) {
+        fprintf(stderr, "too many arguments\n");
+        return EINVAL;
+    }
+
+    char *file = *argv;
+
+    psabpf_context_t ctx;
+    psabpf_context_init(&ctx);
+    cli_context_set_pipeline(&ctx, id);
+
+    if (!psabpf_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist\n", id);
+        error = ENOENT;
+        goto err;
+    }
+
+    if (restore)
+        error = psabpf_pipeline_snapshot_restore(&ctx, file);
+    else
+        error = psabpf_pipeline_snapshot_save(&ctx, file);
+
+err:
+    cli_context_free(&ctx);
+    return error;
+}
+
+int do_pipeline_snapshot(int argc, char **argv)
+{
+    return do_pipeline_snapshot_common(argc, argv, false);
+}
+
+int do_pipeline_restore(int argc, char **argv)
+{
+    return do_pipeline_snapshot_common(argc, argv, true);
+}
+
 int do_pipeline_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
@@ -297,6 +345,8 @@ int do_pipeline_help(int argc, char **argv)
             "Usage: %1$s pipeline load id ID PATH\n"
             "       %1$s pipeline unload id ID\n"
             "       %1$s pipeline show id ID\n"
+            "       %1$s pipeline snapshot id ID PATH\n"
+            "       %1$s pipeline restore id ID PATH\n"
             "       %1$s add-port pipe id ID dev DEV\n"
             "       %1$s del-port pipe id ID dev DEV\n"
             "",
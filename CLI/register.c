@@ -117,47 +117,46 @@ static int get_and_print_register_json(psabpf_register_context_t *ctx, psabpf_re
                                        const char *register_name, bool entry_has_index)
 {
     int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-    if (root == NULL || instance_name == NULL || entries == NULL) {
+    json_stream_t stream;
+
+    if (entry_has_index && psabpf_register_get(ctx, entry) != NO_ERROR)
+        return EINVAL;
+
+    json_stream_init(&stream, stdout);
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_array(&stream, register_name)) != NO_ERROR) {
         fprintf(stderr, "failed to prepare JSON\n");
         goto clean_up;
     }
 
-    json_object_set(root, register_name, entries);
-
     if (entry_has_index) {
-        if (psabpf_register_get(ctx, entry) != NO_ERROR) {
-            goto clean_up;
-        }
         json_t *json_entry = json_object();
         ret = build_entry(ctx, entry, json_entry);
-        json_array_append_new(entries, json_entry);
+        if (ret == NO_ERROR)
+            ret = json_stream_write_new(&stream, NULL, json_entry);
+        else
+            json_decref(json_entry);
     } else {
         psabpf_register_entry_t *iter;
         while ((iter = psabpf_register_get_next(ctx)) != NULL) {
             json_t *json_entry = json_object();
             ret = build_entry(ctx, iter, json_entry);
-            json_array_append_new(entries, json_entry);
             psabpf_register_entry_free(iter);
+            if (ret == NO_ERROR)
+                ret = json_stream_write_new(&stream, NULL, json_entry);
+            else
+                json_decref(json_entry);
             if (ret != NO_ERROR)
                 break;
         }
     }
 
-    if (ret != NO_ERROR) {
+    if (ret != NO_ERROR)
         fprintf(stderr, "failed to build register JSON: %s\n", strerror(ret));
-        goto clean_up;
-    }
-
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-    ret = NO_ERROR;
 
 clean_up:
-    json_decref(entries);
-    json_decref(instance_name);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
 
     return ret;
 }
@@ -196,7 +195,7 @@ int do_register_get(int argc, char **argv)
 clean_up:
     psabpf_register_entry_free(&entry);
     psabpf_register_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -234,7 +233,7 @@ int do_register_set(int argc, char **argv) {
 clean_up:
     psabpf_register_entry_free(&entry);
     psabpf_register_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
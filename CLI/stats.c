@@ -0,0 +1,174 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <jansson.h>
+
+#include <psabpf_stats.h>
+#include "stats.h"
+
+/* Only non-empty buckets, key is the upper bound of the bucket (the last one has none) */
+static json_t *create_json_histogram(const psabpf_stats_entry_t *entry)
+{
+    json_t *histogram = json_object();
+    if (histogram == NULL)
+        return NULL;
+
+    for (unsigned i = 0; i < PSABPF_STATS_HISTOGRAM_BUCKETS; i++) {
+        char bucket_name[32];
+
+        if (entry->histogram[i] == 0)
+            continue;
+        if (i == PSABPF_STATS_HISTOGRAM_BUCKETS - 1)
+            snprintf(bucket_name, sizeof(bucket_name), ">=%llu", 1ULL << (i - 1));
+        else
+            snprintf(bucket_name, sizeof(bucket_name), "<%llu", 1ULL << i);
+        json_object_set_new(histogram, bucket_name, json_integer((json_int_t) entry->histogram[i]));
+    }
+
+    return histogram;
+}
+
+static json_t *create_json_stats_entry(const psabpf_stats_entry_t *entry, bool is_map_op)
+{
+    json_t *root = json_object();
+    if (root == NULL)
+        return NULL;
+
+    json_object_set_new(root, "calls", json_integer((json_int_t) entry->calls));
+    if (is_map_op)
+        json_object_set_new(root, "errors", json_integer((json_int_t) entry->errors));
+    else
+        json_object_set_new(root, "map_ops", json_integer((json_int_t) entry->map_ops));
+    json_object_set_new(root, "bytes", json_integer((json_int_t) entry->bytes));
+    json_object_set_new(root, "total_ns", json_integer((json_int_t) entry->total_ns));
+    json_object_set_new(root, "avg_ns", json_integer((json_int_t) (entry->total_ns / entry->calls)));
+    json_object_set_new(root, "max_ns", json_integer((json_int_t) entry->max_ns));
+    json_object_set_new(root, "latency_ns", create_json_histogram(entry));
+
+    return root;
+}
+
+static int print_stats_json(bool show_all)
+{
+    psabpf_stats_t *stats = malloc(sizeof(psabpf_stats_t));
+    json_t *root = json_object();
+    json_t *map_ops = json_object();
+    json_t *ops = json_object();
+    int ret = ENOMEM;
+
+    if (stats == NULL || root == NULL || map_ops == NULL || ops == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        json_decref(map_ops);
+        json_decref(ops);
+        goto clean_up;
+    }
+
+    psabpf_stats_get(stats);
+    json_object_set_new(root, "enabled", json_boolean(stats->enabled));
+    json_object_set_new(root, "map_operations", map_ops);
+    json_object_set_new(root, "operations", ops);
+
+    for (unsigned i = 0; i < PSABPF_STATS_MAP_OP_COUNT; i++) {
+        if (stats->map_ops[i].calls != 0)
+            json_object_set_new(map_ops, psabpf_stats_map_op_name(i), create_json_stats_entry(&stats->map_ops[i], true));
+        else if (show_all)
+            json_object_set_new(map_ops, psabpf_stats_map_op_name(i), json_null());
+    }
+    for (unsigned i = 0; i < PSABPF_STATS_OP_COUNT; i++) {
+        if (stats->ops[i].calls != 0)
+            json_object_set_new(ops, psabpf_stats_op_name(i), create_json_stats_entry(&stats->ops[i], false));
+        else if (show_all)
+            json_object_set_new(ops, psabpf_stats_op_name(i), json_null());
+    }
+
+    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
+    ret = NO_ERROR;
+
+clean_up:
+    json_decref(root);
+    free(stats);
+
+    return ret;
+}
+
+static int parse_no_arguments(int argc, char **argv)
+{
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+    return NO_ERROR;
+}
+
+int do_stats_show(int argc, char **argv)
+{
+    bool show_all = false;
+
+    if (argc > 0 && is_keyword(*argv, "all")) {
+        show_all = true;
+        NEXT_ARG();
+    }
+    if (parse_no_arguments(argc, argv) != NO_ERROR)
+        return EINVAL;
+
+    return print_stats_json(show_all);
+}
+
+int do_stats_enable(int argc, char **argv)
+{
+    if (parse_no_arguments(argc, argv) != NO_ERROR)
+        return EINVAL;
+
+    psabpf_stats_enable(true);
+    return NO_ERROR;
+}
+
+int do_stats_disable(int argc, char **argv)
+{
+    if (parse_no_arguments(argc, argv) != NO_ERROR)
+        return EINVAL;
+
+    psabpf_stats_enable(false);
+    return NO_ERROR;
+}
+
+int do_stats_reset(int argc, char **argv)
+{
+    if (parse_no_arguments(argc, argv) != NO_ERROR)
+        return EINVAL;
+
+    psabpf_stats_reset();
+    return NO_ERROR;
+}
+
+int do_stats_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+    fprintf(stderr,
+            "Usage: %1$s stats show [all]\n"
+            "       %1$s stats { enable | disable | reset }\n"
+            "\n"
+            "Statistics are collected by the process which executes commands, so they are useful\n"
+            "with a daemon (--socket) or in batch mode.\n"
+            "",
+            program_name);
+
+    return NO_ERROR;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PRECTL_STATS_H
+#define __PRECTL_STATS_H
+
+#include "common.h"
+
+int do_stats_help(int argc, char **argv);
+int do_stats_show(int argc, char **argv);
+int do_stats_enable(int argc, char **argv);
+int do_stats_disable(int argc, char **argv);
+int do_stats_reset(int argc, char **argv);
+
+static const struct cmd stats_cmds[] = {
+        {"help",    do_stats_help},
+        {"show",    do_stats_show},
+        {"enable",  do_stats_enable},
+        {"disable", do_stats_disable},
+        {"reset",   do_stats_reset},
+        {0}
+};
+
+#endif  /* __PRECTL_STATS_H */
@@ -25,6 +25,7 @@
 
 #include <psabpf.h>
 #include "table.h"
+#include "batch.h"
 #include "common.h"
 #include "counter.h"
 #include "meter.h"
@@ -480,7 +481,7 @@ static json_t *create_json_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_ent
     return entry_root;
 }
 
-static int build_json_table_metadata(psabpf_table_entry_ctx_t *ctx, json_t *parent)
+static int build_json_table_metadata(psabpf_table_entry_ctx_t *ctx, json_stream_t *stream)
 {
     if (psabpf_table_entry_ctx_is_indirect(ctx))
         return NO_ERROR;
@@ -511,9 +512,7 @@ static int build_json_table_metadata(psabpf_table_entry_ctx_t *ctx, json_t *pare
     }
     psabpf_table_entry_free(&entry);
 
-    json_object_set_new(parent, "DirectCounter", direct_counters);
-
-    return NO_ERROR;
+    return json_stream_write_new(stream, "DirectCounter", direct_counters);
 }
 
 enum table_print_mode {
@@ -526,46 +525,48 @@ static int print_json_table(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t
                             const char *table_name, enum table_print_mode mode)
 {
     int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
+    json_stream_t stream;
+    json_stream_init(&stream, stdout);
 
-    if (json_object_set(root, table_name, instance_name)) {
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_object(&stream, table_name)) != NO_ERROR) {
         fprintf(stderr, "failed to add JSON key %s\n", table_name);
         goto clean_up;
     }
 
     if (mode == PRINT_SINGLE_ENTRY || mode == PRINT_WHOLE_TABLE)
-        json_object_set(instance_name, "entries", entries);
+        json_stream_open_array(&stream, "entries");
 
     if (entry != NULL && mode == PRINT_SINGLE_ENTRY) {
         json_t *parsed_entry = create_json_entry(ctx, entry, false);
         if (parsed_entry == NULL) {
             fprintf(stderr, "failed to create table JSON entry\n");
+            ret = EINVAL;
             goto clean_up;
         }
-        json_array_append_new(entries, parsed_entry);
+        if ((ret = json_stream_write_new(&stream, NULL, parsed_entry)) != NO_ERROR)
+            goto clean_up;
     }
 
     if (mode == PRINT_WHOLE_TABLE) {
+        /* Every entry is printed as soon as it is read */
         psabpf_table_entry_t *current_entry;
         while ((current_entry = psabpf_table_entry_get_next(ctx)) != NULL) {
             json_t *parsed_entry = create_json_entry(ctx, current_entry, false);
+            psabpf_table_entry_free(current_entry);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON entry\n");
+                ret = EINVAL;
                 goto clean_up;
             }
-            json_array_append_new(entries, parsed_entry);
-            psabpf_table_entry_free(current_entry);
+            if ((ret = json_stream_write_new(&stream, NULL, parsed_entry)) != NO_ERROR)
+                goto clean_up;
         }
     }
 
+    if (mode == PRINT_SINGLE_ENTRY || mode == PRINT_WHOLE_TABLE)
+        json_stream_close(&stream);
+
     if (mode == PRINT_DEFAULT_ENTRY || mode == PRINT_WHOLE_TABLE) {
         psabpf_table_entry_t default_entry;
         psabpf_table_entry_init(&default_entry);
@@ -575,25 +576,25 @@ static int print_json_table(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t
             json_t *parsed_entry = create_json_entry(ctx, &default_entry, true);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON default entry\n");
+                psabpf_table_entry_free(&default_entry);
+                ret = EINVAL;
                 goto clean_up;
             }
-            json_object_set_new(instance_name, "default_action", parsed_entry);
+            ret = json_stream_write_new(&stream, "default_action", parsed_entry);
         }
         psabpf_table_entry_free(&default_entry);
+        if (ret != NO_ERROR)
+            goto clean_up;
     }
 
-    if (build_json_table_metadata(ctx, instance_name) != NO_ERROR) {
+    if ((ret = build_json_table_metadata(ctx, &stream)) != NO_ERROR) {
         fprintf(stderr, "failed to create table JSON entry metadata\n");
         goto clean_up;
     }
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-    ret = NO_ERROR;
-
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
 
     return ret;
 }
@@ -602,11 +603,40 @@ clean_up:
  * Command line table functions
  *****************************************************************************/
 
-enum table_write_type_t {
-    TABLE_ADD_NEW_ENTRY,
-    TABLE_UPDATE_EXISTING_ENTRY,
-    TABLE_SET_DEFAULT_ENTRY
-};
+static int parse_table_write(int *argc, char ***argv, psabpf_table_entry_ctx_t *ctx,
+                             psabpf_table_entry_t *entry, psabpf_action_t *action,
+                             enum table_write_type_t write_type)
+{
+    /* 2. Get action */
+    bool can_ba_last_arg = write_type == TABLE_SET_DEFAULT_ENTRY ? true : false;
+    if (parse_table_action(argc, argv, ctx, action, can_ba_last_arg) != NO_ERROR)
+        return EINVAL;
+
+    /* 3. Get key - default entry has no key */
+    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
+        if (parse_table_key(argc, argv, entry) != NO_ERROR)
+            return EINVAL;
+    }
+
+    /* 4. Get action parameters */
+    if (parse_action_data(argc, argv, ctx, entry, action) != NO_ERROR)
+        return EINVAL;
+
+    /* 5. Get entry priority - not applicable to default entry */
+    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
+        if (parse_entry_priority(argc, argv, entry) != NO_ERROR)
+            return EINVAL;
+    }
+
+    if (*argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", **argv);
+        return EINVAL;
+    }
+
+    psabpf_table_entry_action(entry, action);
+
+    return NO_ERROR;
+}
 
 int do_table_write(int argc, char **argv, enum table_write_type_t write_type)
 {
@@ -635,33 +665,9 @@ int do_table_write(int argc, char **argv, enum table_write_type_t write_type)
     if (parse_dst_table(&argc, &argv, &psabpf_ctx, &ctx, NULL, false) != NO_ERROR)
         goto clean_up;
 
-    /* 2. Get action */
-    bool can_ba_last_arg = write_type == TABLE_SET_DEFAULT_ENTRY ? true : false;
-    if (parse_table_action(&argc, &argv, &ctx, &action, can_ba_last_arg) != NO_ERROR)
-        goto clean_up;
-
-    /* 3. Get key - default entry has no key */
-    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
-        if (parse_table_key(&argc, &argv, &entry) != NO_ERROR)
-            goto clean_up;
-    }
-
-    /* 4. Get action parameters */
-    if (parse_action_data(&argc, &argv, &ctx, &entry, &action) != NO_ERROR)
-        goto clean_up;
-
-    /* 5. Get entry priority - not applicable to default entry */
-    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
-        if (parse_entry_priority(&argc, &argv, &entry) != NO_ERROR)
-            goto clean_up;
-    }
-
-    if (argc > 0) {
-        fprintf(stderr, "%s: unused argument\n", *argv);
+    /* 2-5. Get action, key, action parameters and priority */
+    if (parse_table_write(&argc, &argv, &ctx, &entry, &action, write_type) != NO_ERROR)
         goto clean_up;
-    }
-
-    psabpf_table_entry_action(&entry, &action);
 
     if (write_type == TABLE_ADD_NEW_ENTRY)
         error_code = psabpf_table_entry_add(&ctx, &entry);
@@ -674,11 +680,170 @@ clean_up:
     psabpf_action_free(&action);
     psabpf_table_entry_free(&entry);
     psabpf_table_entry_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
 
+/******************************************************************************
+ * Batch mode
+ *****************************************************************************/
+
+void table_write_batch_init(table_write_batch_t *batch)
+{
+    memset(batch, 0, sizeof(table_write_batch_t));
+}
+
+static void table_write_batch_close(table_write_batch_t *batch)
+{
+    if (!batch->opened)
+        return;
+
+    psabpf_table_entry_ctx_free(&batch->ctx);
+    cli_context_free(&batch->psabpf_ctx);
+    batch->opened = false;
+}
+
+void table_write_batch_free(table_write_batch_t *batch)
+{
+    table_write_batch_flush(batch);
+    table_write_batch_close(batch);
+    if (batch->entries != NULL)
+        free(batch->entries);
+    if (batch->entry_ptrs != NULL)
+        free(batch->entry_ptrs);
+    if (batch->lines != NULL)
+        free(batch->lines);
+    if (batch->status != NULL)
+        free(batch->status);
+    memset(batch, 0, sizeof(table_write_batch_t));
+}
+
+int table_write_batch_flush(table_write_batch_t *batch)
+{
+    int ret = NO_ERROR;
+
+    if (batch->n_entries == 0)
+        return NO_ERROR;
+
+    for (size_t i = 0; i < batch->n_entries; i++) {
+        batch->entry_ptrs[i] = &batch->entries[i];
+        batch->status[i] = -1;
+    }
+
+    if (batch->write_type == TABLE_ADD_NEW_ENTRY)
+        ret = psabpf_table_entry_add_batch(&batch->ctx, batch->entry_ptrs, batch->n_entries, batch->status);
+    else
+        ret = psabpf_table_entry_update_batch(&batch->ctx, batch->entry_ptrs, batch->n_entries, batch->status);
+
+    for (size_t i = 0; i < batch->n_entries; i++) {
+        /* Status is not set when the whole batch was rejected */
+        if (batch->status[i] < 0)
+            batch->status[i] = ret != NO_ERROR ? ret : EINVAL;
+        batch_report_status(batch->lines[i], batch->status[i]);
+        psabpf_table_entry_free(&batch->entries[i]);
+    }
+    batch->n_entries = 0;
+
+    return ret;
+}
+
+static bool table_write_batch_matches(table_write_batch_t *batch, enum table_write_type_t write_type,
+                                      const char *pipeline, const char *table, bool indirect)
+{
+    return batch->opened && batch->write_type == write_type && batch->indirect == indirect &&
+           strcmp(batch->pipeline, pipeline) == 0 && strcmp(batch->table, table) == 0;
+}
+
+static int table_write_batch_open(table_write_batch_t *batch, int *argc, char ***argv,
+                                  enum table_write_type_t write_type, bool indirect)
+{
+    if (batch->entries == NULL) {
+        batch->entries = malloc(TABLE_WRITE_BATCH_SIZE * sizeof(psabpf_table_entry_t));
+        batch->entry_ptrs = malloc(TABLE_WRITE_BATCH_SIZE * sizeof(psabpf_table_entry_t *));
+        batch->lines = malloc(TABLE_WRITE_BATCH_SIZE * sizeof(unsigned));
+        batch->status = malloc(TABLE_WRITE_BATCH_SIZE * sizeof(int));
+        if (batch->entries == NULL || batch->entry_ptrs == NULL || batch->lines == NULL || batch->status == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return ENOMEM;
+        }
+    }
+
+    const char *pipeline = (*argv)[1];
+    const char *table = (*argv)[2];
+    if (strlen(pipeline) >= sizeof(batch->pipeline) || strlen(table) >= sizeof(batch->table))
+        return ENAMETOOLONG;
+
+    psabpf_context_init(&batch->psabpf_ctx);
+    psabpf_table_entry_ctx_init(&batch->ctx);
+    batch->opened = true;
+
+    int ret = parse_pipeline_id(argc, argv, &batch->psabpf_ctx);
+    if (ret == NO_ERROR)
+        ret = parse_dst_table(argc, argv, &batch->psabpf_ctx, &batch->ctx, NULL, false);
+    if (ret != NO_ERROR) {
+        table_write_batch_close(batch);
+        return ret;
+    }
+
+    strcpy(batch->pipeline, pipeline);
+    strcpy(batch->table, table);
+    batch->write_type = write_type;
+    batch->indirect = indirect;
+
+    return NO_ERROR;
+}
+
+int table_write_batch_add(table_write_batch_t *batch, int argc, char **argv, unsigned line)
+{
+    enum table_write_type_t write_type;
+
+    /* table { add | update } pipe ID TABLE ... */
+    if (argc < 6 || !is_keyword(argv[0], "table") || !is_keyword(argv[2], "pipe"))
+        return ENOTSUP;
+    if (is_keyword(argv[1], "add"))
+        write_type = TABLE_ADD_NEW_ENTRY;
+    else if (is_keyword(argv[1], "update"))
+        write_type = TABLE_UPDATE_EXISTING_ENTRY;
+    else
+        return ENOTSUP;
+
+    argc -= 2;
+    argv += 2;
+    bool indirect = is_keyword(argv[3], "ref");
+    if (table_write_batch_matches(batch, write_type, argv[1], argv[2], indirect)) {
+        argc -= 3;
+        argv += 3;
+    } else {
+        table_write_batch_flush(batch);
+        table_write_batch_close(batch);
+        int ret = table_write_batch_open(batch, &argc, &argv, write_type, indirect);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    psabpf_table_entry_t *entry = &batch->entries[batch->n_entries];
+    psabpf_action_t action;
+    psabpf_table_entry_init(entry);
+    psabpf_action_init(&action);
+
+    int ret = parse_table_write(&argc, &argv, &batch->ctx, entry, &action, write_type);
+    psabpf_action_free(&action);
+    if (ret != NO_ERROR) {
+        psabpf_table_entry_free(entry);
+        /* Status of this command must be reported after the previous ones */
+        table_write_batch_flush(batch);
+        return ret;
+    }
+
+    batch->lines[batch->n_entries] = line;
+    batch->n_entries++;
+    if (batch->n_entries == TABLE_WRITE_BATCH_SIZE)
+        table_write_batch_flush(batch);
+
+    return NO_ERROR;
+}
+
 int do_table_add(int argc, char **argv)
 {
     return do_table_write(argc, argv, TABLE_ADD_NEW_ENTRY);
@@ -728,7 +893,7 @@ int do_table_delete(int argc, char **argv)
 clean_up:
     psabpf_table_entry_free(&entry);
     psabpf_table_entry_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -760,7 +925,7 @@ static int do_table_default_get(int argc, char **argv)
 
 clean_up:
     psabpf_table_entry_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -828,7 +993,7 @@ int do_table_get(int argc, char **argv)
 clean_up:
     psabpf_table_entry_free(&entry);
     psabpf_table_entry_ctx_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return error_code;
 }
@@ -27,6 +27,42 @@ int do_table_default(int argc, char **argv);
 int do_table_get(int argc, char **argv);
 int do_table_help(int argc, char **argv);
 
+enum table_write_type_t {
+    TABLE_ADD_NEW_ENTRY,
+    TABLE_UPDATE_EXISTING_ENTRY,
+    TABLE_SET_DEFAULT_ENTRY
+};
+
+/* Batch mode: consecutive "table add" or "table update" commands for the same table
+ * are parsed into entries, which are written with a single call to the batch API.
+ * The batch API reports a status per entry like single writes do (a repeated key of an add
+ * fails with EEXIST, LPM keys are matched exactly), so every line gets the same result. */
+#define TABLE_WRITE_BATCH_SIZE 4096
+
+typedef struct table_write_batch {
+    psabpf_context_t psabpf_ctx;
+    psabpf_table_entry_ctx_t ctx;
+    bool opened;
+    enum table_write_type_t write_type;
+    bool indirect;
+    char pipeline[32];
+    char table[256];
+    psabpf_table_entry_t *entries;
+    psabpf_table_entry_t **entry_ptrs;
+    unsigned *lines;
+    int *status;
+    size_t n_entries;
+} table_write_batch_t;
+
+void table_write_batch_init(table_write_batch_t *batch);
+/* Flushes pending entries */
+void table_write_batch_free(table_write_batch_t *batch);
+/* Returns ENOTSUP when command can't be batched, pending entries must be flushed before it is executed.
+ * On other error command failed and pending entries are already flushed. On success status
+ * of the command is reported with batch_report_status() when entries are flushed. */
+int table_write_batch_add(table_write_batch_t *batch, int argc, char **argv, unsigned line);
+int table_write_batch_flush(table_write_batch_t *batch);
+
 static const struct cmd table_cmds[] = {
         {"help",    do_table_help},
         {"add",     do_table_add},
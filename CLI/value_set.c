@@ -56,42 +56,38 @@ static int get_and_print_value_set_json(psabpf_value_set_context_t *ctx,
                                         const char *value_set_name)
 {
     int ret = NO_ERROR;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-    if (root == NULL || instance_name == NULL || entries == NULL) {
+    json_stream_t stream;
+
+    json_stream_init(&stream, stdout);
+    json_stream_open_object(&stream, NULL);
+    if ((ret = json_stream_open_array(&stream, value_set_name)) != NO_ERROR) {
         fprintf(stderr, "failed to prepare JSON\n");
         goto clean_up;
     }
 
-    json_object_set(root, value_set_name, entries);
-
     psabpf_table_entry_t *current_entry = NULL;
     while ((current_entry = psabpf_value_set_get_next_entry(ctx)) != NULL) {
         json_t *json_entry = json_object();
         json_t *key = create_json_entry_key(current_entry);
-        if (key == NULL) {
+        psabpf_table_entry_free(current_entry);
+        if (json_entry == NULL || key == NULL) {
             fprintf(stderr, "failed to build value_set value in JSON\n");
+            json_decref(json_entry);
+            json_decref(key);
             ret = EINVAL;
             break;
         }
         json_object_set_new(json_entry, "value", key);
-        json_array_append_new(entries, json_entry);
-        psabpf_table_entry_free(current_entry);
+        if ((ret = json_stream_write_new(&stream, NULL, json_entry)) != NO_ERROR)
+            break;
     }
 
-    if (ret != NO_ERROR) {
+    if (ret != NO_ERROR)
         fprintf(stderr, "failed to build value_set JSON: %s\n", strerror(ret));
-        goto clean_up;
-    }
-
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-    ret = NO_ERROR;
 
 clean_up:
-    json_decref(entries);
-    json_decref(instance_name);
-    json_decref(root);
+    if (json_stream_finish(&stream) != NO_ERROR && ret == NO_ERROR)
+        ret = EIO;
 
     return ret;
 }
@@ -127,7 +123,7 @@ int do_value_set_delete(int argc, char **argv)
 clean_up:
     psabpf_table_entry_free(&entry);
     psabpf_value_set_context_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -163,7 +159,7 @@ int do_value_set_insert(int argc, char **argv)
 clean_up:
     psabpf_table_entry_free(&entry);
     psabpf_value_set_context_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -196,7 +192,7 @@ int do_value_set_get(int argc, char **argv)
 clean_up:
     psabpf_table_entry_free(&entry);
     psabpf_value_set_context_free(&ctx);
-    psabpf_context_free(&psabpf_ctx);
+    cli_context_free(&psabpf_ctx);
 
     return ret;
 }
@@ -0,0 +1,701 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <jansson.h>
+
+#include <psabpf_stats.h>
+#include "bench.h"
+#include "../lib/psabpf_map_ops.h"
+
+/* Used by CLI/common.c */
+const char *program_name;
+
+static const bench_scenario_t scenarios[] = {
+        { "table-exact", "insert, update, dump, delete and clear of exact table", true, 0, bench_table_exact },
+        { "table-array", "insert, update, dump and clear of array table", true, 0, bench_table_array },
+        { "table-lpm", "insert, update, dump, delete and clear of LPM table", true, 0, bench_table_lpm },
+        { "table-ternary", "insert, update, dump, delete and clear of ternary table with 4 masks",
+          true, 0, bench_table_ternary },
+        { "table-exact-threads", "insert and get of exact tables from 1 to 8 threads, own or shared table",
+          true, 0, bench_table_exact_threads },
+        { "counter-scan", "set and read every entry of indexed counter", true, 0, bench_counter_scan },
+        { "register-scan", "set and read every entry of register", true, 0, bench_register_scan },
+        { "digest-drain", "read digests from full queue", true, 0, bench_digest_drain },
+        { "action-selector-churn", "add, group, ungroup and delete members of action selector",
+          false, 1024, bench_action_selector_churn },
+        { "pre-churn", "add and delete members of multicast groups and clone sessions",
+          false, 4096, bench_pre_churn },
+        { "ctx-open-close", "open and close of table, counter and action selector", false, 1000,
+          bench_ctx_open_close },
+        { "parse", "translation of command line values to bytes", false, 100000, bench_parse },
+        { 0 }
+};
+
+static const size_t default_sizes[] = { 1000, 100000, 1000000 };
+
+/******************************************************************************
+ * Counting of map operations
+ ******************************************************************************/
+
+static const psabpf_map_ops_t *backend_ops;
+/* Per thread, so phases measured in parallel count only their own map operations */
+static __thread uint64_t map_ops_counter;
+
+static int count_obj_get(const char *pathname)
+{
+    ++map_ops_counter;
+    return backend_ops->obj_get(pathname);
+}
+
+static int count_obj_pin(int fd, const char *pathname)
+{
+    ++map_ops_counter;
+    return backend_ops->obj_pin(fd, pathname);
+}
+
+static bool count_path_exists(const char *pathname)
+{
+    ++map_ops_counter;
+    return backend_ops->path_exists(pathname);
+}
+
+static int count_obj_get_info_by_fd(int fd, void *info, uint32_t *info_len)
+{
+    ++map_ops_counter;
+    return backend_ops->obj_get_info_by_fd(fd, info, info_len);
+}
+
+static int count_get_fd_by_id(uint32_t id)
+{
+    ++map_ops_counter;
+    return backend_ops->get_fd_by_id(id);
+}
+
+static int count_create_map(const struct bpf_create_map_attr *attr)
+{
+    ++map_ops_counter;
+    return backend_ops->create_map(attr);
+}
+
+static int count_lookup_elem(int fd, const void *key, void *value)
+{
+    ++map_ops_counter;
+    return backend_ops->lookup_elem(fd, key, value);
+}
+
+static int count_lookup_elem_flags(int fd, const void *key, void *value, uint64_t flags)
+{
+    ++map_ops_counter;
+    return backend_ops->lookup_elem_flags(fd, key, value, flags);
+}
+
+static int count_lookup_and_delete_elem(int fd, const void *key, void *value)
+{
+    ++map_ops_counter;
+    return backend_ops->lookup_and_delete_elem(fd, key, value);
+}
+
+static int count_update_elem(int fd, const void *key, const void *value, uint64_t flags)
+{
+    ++map_ops_counter;
+    return backend_ops->update_elem(fd, key, value, flags);
+}
+
+static int count_delete_elem(int fd, const void *key)
+{
+    ++map_ops_counter;
+    return backend_ops->delete_elem(fd, key);
+}
+
+static int count_get_next_key(int fd, const void *key, void *next_key)
+{
+    ++map_ops_counter;
+    return backend_ops->get_next_key(fd, key, next_key);
+}
+
+static int count_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                              uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    ++map_ops_counter;
+    return backend_ops->lookup_batch(fd, in_batch, out_batch, keys, values, count, opts);
+}
+
+static int count_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                         uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    ++map_ops_counter;
+    return backend_ops->lookup_and_delete_batch(fd, in_batch, out_batch, keys, values, count, opts);
+}
+
+static int count_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                              const struct bpf_map_batch_opts *opts)
+{
+    ++map_ops_counter;
+    return backend_ops->update_batch(fd, keys, values, count, opts);
+}
+
+static int count_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    ++map_ops_counter;
+    return backend_ops->delete_batch(fd, keys, count, opts);
+}
+
+static const psabpf_map_ops_t counting_map_ops = {
+        .obj_get = count_obj_get,
+        .obj_pin = count_obj_pin,
+        .path_exists = count_path_exists,
+        .obj_get_info_by_fd = count_obj_get_info_by_fd,
+        .get_fd_by_id = count_get_fd_by_id,
+        .create_map = count_create_map,
+
+        .lookup_elem = count_lookup_elem,
+        .lookup_elem_flags = count_lookup_elem_flags,
+        .lookup_and_delete_elem = count_lookup_and_delete_elem,
+        .update_elem = count_update_elem,
+        .delete_elem = count_delete_elem,
+        .get_next_key = count_get_next_key,
+
+        .lookup_batch = count_lookup_batch,
+        .lookup_and_delete_batch = count_lookup_and_delete_batch,
+        .update_batch = count_update_batch,
+        .delete_batch = count_delete_batch,
+};
+
+/******************************************************************************
+ * Results
+ ******************************************************************************/
+
+typedef struct bench_result {
+    const char *scenario;
+    const char *phase;
+    size_t size;
+    size_t items;
+    size_t calls;
+    size_t errors;
+    uint64_t elapsed_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    uint64_t map_ops;
+} bench_result_t;
+
+static bench_result_t *results;
+static size_t n_results;
+static size_t results_capacity;
+
+void bench_phase_begin(bench_phase_t *phase, const char *scenario, const char *name, size_t size)
+{
+    memset(phase, 0, sizeof(*phase));
+    phase->scenario = scenario;
+    phase->name = name;
+    phase->size = size;
+}
+
+void bench_call_begin(bench_phase_t *phase)
+{
+    phase->call_map_ops = map_ops_counter;
+    phase->call_start_ns = bench_now_ns();
+}
+
+void bench_call_end(bench_phase_t *phase, size_t items, int ret)
+{
+    uint64_t latency = bench_now_ns() - phase->call_start_ns;
+
+    phase->busy_ns += latency;
+    phase->map_ops += map_ops_counter - phase->call_map_ops;
+    phase->items += items;
+    if (ret != 0)
+        phase->errors += 1;
+
+    if (phase->calls == phase->latencies_capacity) {
+        size_t new_capacity = phase->latencies_capacity ? 2 * phase->latencies_capacity : 1024;
+        uint64_t *tmp = realloc(phase->latencies, new_capacity * sizeof(uint64_t));
+        if (tmp == NULL)
+            return;  /* call is counted, but its latency is lost */
+        phase->latencies = tmp;
+        phase->latencies_capacity = new_capacity;
+    }
+    phase->latencies[phase->calls++] = latency;
+}
+
+void bench_phase_merge(bench_phase_t *dst, bench_phase_t *src)
+{
+    dst->items += src->items;
+    dst->errors += src->errors;
+    dst->busy_ns += src->busy_ns;
+    dst->map_ops += src->map_ops;
+
+    if (src->calls == 0)
+        goto clean_up;
+    if (dst->calls + src->calls > dst->latencies_capacity) {
+        size_t new_capacity = dst->calls + src->calls;
+        uint64_t *tmp = realloc(dst->latencies, new_capacity * sizeof(uint64_t));
+        if (tmp == NULL)
+            goto clean_up;  /* items are counted, but latencies of calls are lost */
+        dst->latencies = tmp;
+        dst->latencies_capacity = new_capacity;
+    }
+    memcpy(&dst->latencies[dst->calls], src->latencies, src->calls * sizeof(uint64_t));
+    dst->calls += src->calls;
+
+clean_up:
+    free(src->latencies);
+    src->latencies = NULL;
+    src->latencies_capacity = 0;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t l = *(const uint64_t *) a, r = *(const uint64_t *) b;
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, unsigned p)
+{
+    if (n == 0)
+        return 0;
+    return sorted[(n - 1) * p / 100];
+}
+
+void bench_phase_end(bench_phase_t *phase)
+{
+    if (n_results == results_capacity) {
+        size_t new_capacity = results_capacity ? 2 * results_capacity : 64;
+        bench_result_t *tmp = realloc(results, new_capacity * sizeof(bench_result_t));
+        if (tmp == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            goto clean_up;
+        }
+        results = tmp;
+        results_capacity = new_capacity;
+    }
+
+    qsort(phase->latencies, phase->calls, sizeof(uint64_t), compare_latency);
+
+    bench_result_t *result = &results[n_results++];
+    result->scenario = phase->scenario;
+    result->phase = phase->name;
+    result->size = phase->size;
+    result->items = phase->items;
+    result->calls = phase->calls;
+    result->errors = phase->errors;
+    result->elapsed_ns = phase->wall_ns != 0 ? phase->wall_ns : phase->busy_ns;
+    result->p50_ns = percentile(phase->latencies, phase->calls, 50);
+    result->p99_ns = percentile(phase->latencies, phase->calls, 99);
+    result->max_ns = phase->calls > 0 ? phase->latencies[phase->calls - 1] : 0;
+    result->map_ops = phase->map_ops;
+
+clean_up:
+    free(phase->latencies);
+    phase->latencies = NULL;
+    phase->latencies_capacity = 0;
+}
+
+static double result_ops_per_sec(const bench_result_t *result)
+{
+    if (result->elapsed_ns == 0)
+        return 0;
+    return (double) result->items * 1e9 / (double) result->elapsed_ns;
+}
+
+static double result_syscalls_per_op(const bench_result_t *result)
+{
+    if (result->items == 0)
+        return 0;
+    return (double) result->map_ops / (double) result->items;
+}
+
+static void print_result_text(FILE *out, const bench_result_t *result)
+{
+    fprintf(out, "%-22s %-22s %9zu %9zu %12.0f %10lu %10lu %9.2f %7zu\n",
+           result->scenario, result->phase, result->size, result->items, result_ops_per_sec(result),
+           (unsigned long) result->p50_ns, (unsigned long) result->p99_ns,
+           result_syscalls_per_op(result), result->errors);
+    fflush(out);
+}
+
+static void print_header_text(FILE *out)
+{
+    fprintf(out, "%-22s %-22s %9s %9s %12s %10s %10s %9s %7s\n",
+           "scenario", "phase", "size", "ops", "ops/s", "p50 [ns]", "p99 [ns]", "sys/op", "errors");
+}
+
+/* Breakdown of all scenarios by operations of the library, see psabpf_stats.h */
+static void print_library_stats_text(FILE *out, const psabpf_stats_t *stats)
+{
+    fprintf(out, "\n%-44s %12s %12s %12s %10s %10s\n",
+            "library operation", "calls", "avg [ns]", "max [ns]", "sys/call", "bytes/call");
+    for (unsigned i = 0; i < PSABPF_STATS_OP_COUNT + PSABPF_STATS_MAP_OP_COUNT; i++) {
+        bool is_map_op = i >= PSABPF_STATS_OP_COUNT;
+        const psabpf_stats_entry_t *entry = is_map_op ? &stats->map_ops[i - PSABPF_STATS_OP_COUNT] : &stats->ops[i];
+        const char *name = is_map_op ? psabpf_stats_map_op_name(i - PSABPF_STATS_OP_COUNT) : psabpf_stats_op_name(i);
+        if (entry->calls == 0)
+            continue;
+        fprintf(out, "%-4s%-40s %12lu %12lu %12lu %10.2f %10.1f\n", is_map_op ? "map:" : "", name,
+                (unsigned long) entry->calls, (unsigned long) (entry->total_ns / entry->calls),
+                (unsigned long) entry->max_ns, (double) entry->map_ops / (double) entry->calls,
+                (double) entry->bytes / (double) entry->calls);
+    }
+}
+
+static json_t *create_json_library_stats(const psabpf_stats_t *stats)
+{
+    json_t *items = json_array();
+    if (items == NULL)
+        return NULL;
+
+    for (unsigned i = 0; i < PSABPF_STATS_OP_COUNT + PSABPF_STATS_MAP_OP_COUNT; i++) {
+        bool is_map_op = i >= PSABPF_STATS_OP_COUNT;
+        const psabpf_stats_entry_t *entry = is_map_op ? &stats->map_ops[i - PSABPF_STATS_OP_COUNT] : &stats->ops[i];
+        const char *name = is_map_op ? psabpf_stats_map_op_name(i - PSABPF_STATS_OP_COUNT) : psabpf_stats_op_name(i);
+        if (entry->calls == 0)
+            continue;
+
+        json_t *item = json_object();
+        if (item == NULL) {
+            json_decref(items);
+            return NULL;
+        }
+        json_object_set_new(item, "operation", json_string(name));
+        json_object_set_new(item, "map_operation", json_boolean(is_map_op));
+        json_object_set_new(item, "calls", json_integer((json_int_t) entry->calls));
+        json_object_set_new(item, "total_ns", json_integer((json_int_t) entry->total_ns));
+        json_object_set_new(item, "max_ns", json_integer((json_int_t) entry->max_ns));
+        json_object_set_new(item, "map_ops", json_integer((json_int_t) entry->map_ops));
+        json_object_set_new(item, "bytes", json_integer((json_int_t) entry->bytes));
+        json_array_append_new(items, item);
+    }
+
+    return items;
+}
+
+static int print_results_json(FILE *out, const psabpf_stats_t *stats)
+{
+    int ret = ENOMEM;
+    json_t *root = json_object();
+    json_t *items = json_array();
+    if (root == NULL || items == NULL)
+        goto clean_up;
+
+    json_object_set_new(root, "format_version", json_integer(1));
+    json_object_set_new(root, "map_backend", json_string("emulation"));
+    json_object_set_new(root, "timestamp", json_integer(time(NULL)));
+    json_object_set_new(root, "cpus", json_integer(sysconf(_SC_NPROCESSORS_ONLN)));
+
+    for (size_t i = 0; i < n_results; i++) {
+        const bench_result_t *result = &results[i];
+        json_t *item = json_object();
+        json_t *latency = json_object();
+        if (item == NULL || latency == NULL) {
+            json_decref(item);
+            json_decref(latency);
+            goto clean_up;
+        }
+
+        json_object_set_new(item, "scenario", json_string(result->scenario));
+        json_object_set_new(item, "phase", json_string(result->phase));
+        json_object_set_new(item, "size", json_integer((json_int_t) result->size));
+        json_object_set_new(item, "ops", json_integer((json_int_t) result->items));
+        json_object_set_new(item, "calls", json_integer((json_int_t) result->calls));
+        json_object_set_new(item, "errors", json_integer((json_int_t) result->errors));
+        json_object_set_new(item, "elapsed_ns", json_integer((json_int_t) result->elapsed_ns));
+        json_object_set_new(item, "ops_per_sec", json_real(result_ops_per_sec(result)));
+        json_object_set_new(latency, "p50", json_integer((json_int_t) result->p50_ns));
+        json_object_set_new(latency, "p99", json_integer((json_int_t) result->p99_ns));
+        json_object_set_new(latency, "max", json_integer((json_int_t) result->max_ns));
+        json_object_set_new(item, "call_latency_ns", latency);
+        json_object_set_new(item, "syscalls_per_op", json_real(result_syscalls_per_op(result)));
+
+        json_array_append_new(items, item);
+    }
+
+    json_object_set(root, "results", items);
+    if (stats != NULL)
+        json_object_set_new(root, "library_stats", create_json_library_stats(stats));
+    ret = json_dumpf(root, out, JSON_INDENT(4) | JSON_ENSURE_ASCII) == 0 ? 0 : EIO;
+    fputc('\n', out);
+
+clean_up:
+    json_decref(items);
+    json_decref(root);
+    return ret;
+}
+
+/******************************************************************************
+ * Command line
+ ******************************************************************************/
+
+static int print_help(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [OPTIONS] [SCENARIO...]\n"
+            "\n"
+            "Runs scenarios (all when none is given, prefix of a name is enough) against maps emulated\n"
+            "in memory of the process, so results show cost of the library alone.\n"
+            "\n"
+            "       --sizes N[,N...]  entries of tables, counters, registers and digest queue\n"
+            "                         (default: 1000,100000,1000000)\n"
+            "       --scale N         size of the other scenarios, overrides their defaults\n"
+            "       --json            print results as JSON instead of a table\n"
+            "       --output FILE     write results to FILE\n"
+            "       --verbose         do not hide messages of the library\n"
+            "       --stats           enable statistics of the library and print them after results,\n"
+            "                         they add cost to every measured call\n"
+            "       --list            print available scenarios\n"
+            "\n"
+            "Latency is measured per API call, ops/s and syscalls/op are counted per processed item.\n"
+            "Syscalls are map operations which take a single bpf() syscall with the kernel backend.\n"
+            "Phases of multi-threaded scenarios count ops/s of all threads from the wall clock time.\n",
+            name);
+    return 0;
+}
+
+static int parse_sizes(const char *str, size_t **sizes, size_t *n_sizes)
+{
+    size_t n = 1;
+    for (const char *c = str; *c != '\0'; c++) {
+        if (*c == ',')
+            n++;
+    }
+
+    size_t *tmp = calloc(n, sizeof(size_t));
+    if (tmp == NULL)
+        return ENOMEM;
+
+    const char *c = str;
+    for (size_t i = 0; i < n; i++) {
+        char *end;
+        errno = 0;
+        unsigned long long value = strtoull(c, &end, 0);
+        if (errno != 0 || end == c || (*end != ',' && *end != '\0') || value == 0 || value > UINT32_MAX) {
+            fprintf(stderr, "%s: invalid size\n", str);
+            free(tmp);
+            return EINVAL;
+        }
+        tmp[i] = value;
+        c = end + 1;
+    }
+
+    *sizes = tmp;
+    *n_sizes = n;
+    return 0;
+}
+
+static bool scenario_selected(const bench_scenario_t *scenario, int argc, char **argv)
+{
+    if (argc == 0)
+        return true;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(scenario->name, argv[i], strlen(argv[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* Library reports errors and warnings on stderr, also in paths which are measured */
+static int silence_stderr(void)
+{
+    int saved = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (saved < 0 || null_fd < 0) {
+        if (saved >= 0)
+            close(saved);
+        if (null_fd >= 0)
+            close(null_fd);
+        return -1;
+    }
+    fflush(stderr);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+    return saved;
+}
+
+static void restore_stderr(int saved)
+{
+    if (saved < 0)
+        return;
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+}
+
+static int run_scenario(psabpf_context_t *ctx, const bench_scenario_t *scenario, size_t size, bool verbose)
+{
+    int saved_stderr = verbose ? -1 : silence_stderr();
+    size_t first_result = n_results;
+
+    int ret = scenario->run(ctx, scenario->name, size);
+    bench_pipeline_destroy(ctx);
+
+    restore_stderr(saved_stderr);
+    if (ret != 0)
+        fprintf(stderr, "%s (size %zu) failed: %s\n", scenario->name, size, strerror(ret));
+    for (size_t i = first_result; i < n_results; i++) {
+        if (results[i].errors > 0)
+            fprintf(stderr, "%s/%s (size %zu): %zu failed calls\n",
+                    results[i].scenario, results[i].phase, results[i].size, results[i].errors);
+    }
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+            { "sizes", required_argument, NULL, 's' },
+            { "scale", required_argument, NULL, 'S' },
+            { "json", no_argument, NULL, 'j' },
+            { "output", required_argument, NULL, 'o' },
+            { "verbose", no_argument, NULL, 'v' },
+            { "stats", no_argument, NULL, 't' },
+            { "list", no_argument, NULL, 'l' },
+            { "help", no_argument, NULL, 'h' },
+            { 0 }
+    };
+    size_t *sizes = NULL;
+    size_t n_sizes = 0;
+    size_t scale = 0;
+    bool json = false, verbose = false, library_stats = false;
+    psabpf_stats_t *stats = NULL;
+    const char *output_file = NULL;
+    FILE *out = stdout;
+    int opt, ret = 0;
+
+    program_name = argv[0];
+
+    while ((opt = getopt_long(argc, argv, "s:S:jo:vtlh", options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                free(sizes);
+                if (parse_sizes(optarg, &sizes, &n_sizes) != 0)
+                    return 1;
+                break;
+            case 'S': {
+                char *end;
+                errno = 0;
+                unsigned long long value = strtoull(optarg, &end, 0);
+                if (errno != 0 || end == optarg || *end != '\0' || value == 0 || value > UINT32_MAX) {
+                    fprintf(stderr, "%s: invalid scale\n", optarg);
+                    return 1;
+                }
+                scale = value;
+                break;
+            }
+            case 'j':
+                json = true;
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 't':
+                library_stats = true;
+                break;
+            case 'l':
+                for (const bench_scenario_t *s = scenarios; s->name != NULL; s++)
+                    printf("%-22s %s\n", s->name, s->description);
+                return 0;
+            case 'h':
+                return print_help(argv[0]);
+            default:
+                print_help(argv[0]);
+                return 1;
+        }
+    }
+    if (output_file != NULL) {
+        out = fopen(output_file, "w");
+        if (out == NULL) {
+            fprintf(stderr, "%s: %s\n", output_file, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (psabpf_set_map_backend(PSABPF_MAP_BACKEND_EMULATION) != 0) {
+        fprintf(stderr, "failed to select emulated maps\n");
+        return 1;
+    }
+    backend_ops = map_ops;
+    map_ops = &counting_map_ops;
+    /* Wraps counting of map operations, so they are still counted */
+    if (library_stats)
+        psabpf_stats_enable(true);
+
+    psabpf_context_t ctx;
+    psabpf_context_init(&ctx);
+    psabpf_context_set_pipeline(&ctx, BENCH_PIPELINE_ID);
+
+    if (!json)
+        print_header_text(out);
+
+    argc -= optind;
+    argv += optind;
+    for (const bench_scenario_t *s = scenarios; s->name != NULL; s++) {
+        if (!scenario_selected(s, argc, argv))
+            continue;
+
+        if (!s->sized) {
+            size_t first_result = n_results;
+            if (run_scenario(&ctx, s, scale ? scale : s->default_size, verbose) != 0)
+                ret = 1;
+            for (size_t i = first_result; !json && i < n_results; i++)
+                print_result_text(out, &results[i]);
+            continue;
+        }
+
+        for (size_t i = 0; i < (sizes != NULL ? n_sizes : sizeof(default_sizes) / sizeof(default_sizes[0])); i++) {
+            size_t first_result = n_results;
+            if (run_scenario(&ctx, s, sizes != NULL ? sizes[i] : default_sizes[i], verbose) != 0)
+                ret = 1;
+            for (size_t r = first_result; !json && r < n_results; r++)
+                print_result_text(out, &results[r]);
+        }
+    }
+
+    if (library_stats) {
+        stats = malloc(sizeof(psabpf_stats_t));
+        if (stats == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            ret = 1;
+        } else {
+            psabpf_stats_get(stats);
+        }
+    }
+    if (json && print_results_json(out, stats) != 0) {
+        fprintf(stderr, "failed to write results\n");
+        ret = 1;
+    }
+    if (!json && stats != NULL)
+        print_library_stats_text(out, stats);
+
+    psabpf_context_free(&ctx);
+    if (out != stdout)
+        fclose(out);
+    free(sizes);
+    free(results);
+    free(stats);
+
+    return ret;
+}
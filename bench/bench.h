@@ -0,0 +1,142 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PSABPF_BENCH_H
+#define __PSABPF_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <bpf/bpf.h>
+
+#include <psabpf.h>
+
+/* Pipeline used by every scenario, its maps are emulated */
+#define BENCH_PIPELINE_ID 1
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * Measurement
+ */
+
+/* One measured phase of a scenario, e.g. inserts into a table of given size. Every API call is measured
+ * separately and may process more than one item (e.g. batch); ops/s and syscalls/op are counted per item
+ * from time and map operations spent inside measured calls only. Phase is measured by a single thread,
+ * phases of threads running in parallel are merged into one with bench_phase_merge(). */
+typedef struct bench_phase {
+    const char *scenario;
+    const char *name;
+    size_t size;
+
+    size_t items;
+    size_t calls;
+    size_t errors;
+    uint64_t busy_ns;
+    uint64_t map_ops;
+    uint64_t *latencies;
+    size_t latencies_capacity;
+
+    uint64_t call_start_ns;
+    uint64_t call_map_ops;
+
+    /* When not 0, ops/s is counted from this wall clock time instead of time spent in calls */
+    uint64_t wall_ns;
+} bench_phase_t;
+
+void bench_phase_begin(bench_phase_t *phase, const char *scenario, const char *name, size_t size);
+/* Stores result of the phase */
+void bench_phase_end(bench_phase_t *phase);
+
+void bench_call_begin(bench_phase_t *phase);
+/* Call processed given number of items and returned ret (non-zero is counted as error) */
+void bench_call_end(bench_phase_t *phase, size_t items, int ret);
+/* Adds calls of src to dst, src is freed */
+void bench_phase_merge(bench_phase_t *dst, bench_phase_t *src);
+
+/*
+ * Synthetic pipeline
+ */
+
+/* Member of a BTF struct, size in bytes; array of bytes is used for sizes other than 1, 2, 4 and 8 */
+typedef struct bench_btf_field {
+    const char *name;
+    uint32_t size;
+} bench_btf_field_t;
+
+/* BTF type of a value of a table which has a single action with parameters, NULL terminated */
+typedef struct bench_btf_table_value {
+    bool has_priority;
+    const bench_btf_field_t *action_params;
+} bench_btf_table_value_t;
+
+typedef struct bench_map_def {
+    const char *name;
+    enum bpf_map_type type;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t max_entries;
+    uint32_t map_flags;
+    /* Name of a map created before, used as an inner map of map of maps */
+    const char *inner_map;
+
+    /* Map is described in BTF when any of them is given (NULL terminated arrays of fields), value
+     * of table is described by table_value; key or value not described is an integer of its size */
+    const bench_btf_field_t *key;
+    const bench_btf_field_t *value;
+    const bench_btf_table_value_t *table_value;
+} bench_map_def_t;
+
+/* Creates maps of the pipeline BENCH_PIPELINE_ID (previous content of the pipeline is removed) and sets
+ * its BTF. Maps are pinned like they would be by psabpf_pipeline_load(). */
+int bench_pipeline_create(psabpf_context_t *ctx, const bench_map_def_t *maps, size_t n_maps);
+void bench_pipeline_destroy(psabpf_context_t *ctx);
+
+/*
+ * Scenarios
+ */
+
+typedef struct bench_scenario {
+    const char *name;
+    const char *description;
+    /* When true, scenario is run once for every size given on command line, otherwise with default size */
+    bool sized;
+    size_t default_size;
+    int (*run)(psabpf_context_t *ctx, const char *name, size_t size);
+} bench_scenario_t;
+
+int bench_table_exact(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_table_array(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_table_lpm(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_table_ternary(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_table_exact_threads(psabpf_context_t *ctx, const char *name, size_t size);
+
+int bench_counter_scan(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_register_scan(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_digest_drain(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_action_selector_churn(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_pre_churn(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_ctx_open_close(psabpf_context_t *ctx, const char *name, size_t size);
+int bench_parse(psabpf_context_t *ctx, const char *name, size_t size);
+
+#endif  /* __PSABPF_BENCH_H */
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <bpf/btf.h>
+
+#include "bench.h"
+#include "../lib/common.h"
+#include "../lib/psabpf_map_ops.h"
+
+/*
+ * BTF is generated like clang does it for BTF-defined maps of the data plane:
+ *     struct { int (*type)[TYPE]; int (*max_entries)[N]; struct key *key; struct value *value; } name SEC(".maps");
+ */
+
+typedef struct btf_builder {
+    struct btf *btf;
+    int int_type;
+    int *vars;
+    size_t n_vars;
+} btf_builder_t;
+
+static int add_number_type(btf_builder_t *b, uint32_t size)
+{
+    switch (size) {
+        case 1:
+            return btf__add_int(b->btf, "u8", 1, 0);
+        case 2:
+            return btf__add_int(b->btf, "u16", 2, 0);
+        case 4:
+            return btf__add_int(b->btf, "u32", 4, 0);
+        case 8:
+            return btf__add_int(b->btf, "u64", 8, 0);
+        default: {
+            int byte = btf__add_int(b->btf, "u8", 1, 0);
+            if (byte < 0)
+                return byte;
+            return btf__add_array(b->btf, b->int_type, byte, size);
+        }
+    }
+}
+
+/* Fields are placed one after another, every field is aligned to its size (up to 8 bytes) */
+static int add_struct_type(btf_builder_t *b, const char *name, const bench_btf_field_t *fields, uint32_t size)
+{
+    size_t n_fields = 0;
+    while (fields[n_fields].name != NULL)
+        n_fields++;
+
+    int *types = calloc(n_fields + 1, sizeof(int));
+    if (types == NULL)
+        return -ENOMEM;
+    for (size_t i = 0; i < n_fields; i++) {
+        types[i] = add_number_type(b, fields[i].size);
+        if (types[i] < 0) {
+            int ret = types[i];
+            free(types);
+            return ret;
+        }
+    }
+
+    int id = btf__add_struct(b->btf, name, size);
+    uint32_t offset = 0;
+    for (size_t i = 0; i < n_fields && id >= 0; i++) {
+        uint32_t align = fields[i].size >= 8 ? 8 : (fields[i].size >= 4 ? 4 : (fields[i].size >= 2 ? 2 : 1));
+        offset = (offset + align - 1) / align * align;
+        int ret = btf__add_field(b->btf, fields[i].name, types[i], offset * 8, 0);
+        if (ret < 0)
+            id = ret;
+        offset += fields[i].size;
+    }
+
+    free(types);
+    return id;
+}
+
+static uint32_t struct_size(const bench_btf_field_t *fields)
+{
+    uint32_t offset = 0, max_align = 1;
+    for (size_t i = 0; fields[i].name != NULL; i++) {
+        uint32_t align = fields[i].size >= 8 ? 8 : (fields[i].size >= 4 ? 4 : (fields[i].size >= 2 ? 2 : 1));
+        offset = (offset + align - 1) / align * align + fields[i].size;
+        if (align > max_align)
+            max_align = align;
+    }
+    return (offset + max_align - 1) / max_align * max_align;
+}
+
+/* struct { u32 action; [u32 priority;] union { struct {} _NoAction; struct { params } action; } u; } */
+static int add_table_value_type(btf_builder_t *b, const bench_btf_table_value_t *value, uint32_t size)
+{
+    static const bench_btf_field_t no_params[] = { { 0 } };
+    uint32_t params_size = struct_size(value->action_params);
+
+    int no_action = add_struct_type(b, "_NoAction", no_params, 0);
+    int action = add_struct_type(b, "action", value->action_params, params_size);
+    if (no_action < 0 || action < 0)
+        return no_action < 0 ? no_action : action;
+
+    int actions = btf__add_union(b->btf, NULL, params_size);
+    if (actions < 0)
+        return actions;
+    if (btf__add_field(b->btf, "_NoAction", no_action, 0, 0) < 0 || btf__add_field(b->btf, "action", action, 0, 0) < 0)
+        return -EINVAL;
+
+    int id = btf__add_struct(b->btf, NULL, size);
+    if (id < 0)
+        return id;
+    uint32_t offset = 0;
+    if (btf__add_field(b->btf, "action", b->int_type, offset, 0) < 0)
+        return -EINVAL;
+    offset += 32;
+    if (value->has_priority) {
+        if (btf__add_field(b->btf, "priority", b->int_type, offset, 0) < 0)
+            return -EINVAL;
+        offset += 32;
+    }
+    if (btf__add_field(b->btf, "u", actions, offset, 0) < 0)
+        return -EINVAL;
+
+    return id;
+}
+
+/* int (*name)[value] */
+static int add_map_attribute(btf_builder_t *b, uint32_t value)
+{
+    int array = btf__add_array(b->btf, b->int_type, b->int_type, value);
+    if (array < 0)
+        return array;
+    return btf__add_ptr(b->btf, array);
+}
+
+static int add_map_var(btf_builder_t *b, const bench_map_def_t *def)
+{
+    int key, value;
+    if (def->key != NULL)
+        key = add_struct_type(b, NULL, def->key, def->key_size);
+    else
+        key = add_number_type(b, def->key_size);
+    if (def->table_value != NULL)
+        value = add_table_value_type(b, def->table_value, def->value_size);
+    else if (def->value != NULL)
+        value = add_struct_type(b, NULL, def->value, def->value_size);
+    else
+        value = add_number_type(b, def->value_size);
+    if (key < 0 || value < 0)
+        return key < 0 ? key : value;
+
+    int type_attr = add_map_attribute(b, def->type);
+    int max_entries_attr = add_map_attribute(b, def->max_entries);
+    int key_ptr = btf__add_ptr(b->btf, key);
+    int value_ptr = btf__add_ptr(b->btf, value);
+    if (type_attr < 0 || max_entries_attr < 0 || key_ptr < 0 || value_ptr < 0)
+        return -EINVAL;
+
+    int map_struct = btf__add_struct(b->btf, NULL, 4 * 8);
+    if (map_struct < 0)
+        return map_struct;
+    if (btf__add_field(b->btf, "type", type_attr, 0, 0) < 0 ||
+        btf__add_field(b->btf, "max_entries", max_entries_attr, 64, 0) < 0 ||
+        btf__add_field(b->btf, "key", key_ptr, 128, 0) < 0 ||
+        btf__add_field(b->btf, "value", value_ptr, 192, 0) < 0)
+        return -EINVAL;
+
+    int var = btf__add_var(b->btf, def->name, BTF_VAR_GLOBAL_ALLOCATED, map_struct);
+    if (var < 0)
+        return var;
+
+    int *tmp = realloc(b->vars, (b->n_vars + 1) * sizeof(int));
+    if (tmp == NULL)
+        return -ENOMEM;
+    b->vars = tmp;
+    b->vars[b->n_vars++] = var;
+
+    return NO_ERROR;
+}
+
+static int build_btf(const bench_map_def_t *maps, size_t n_maps, btf_builder_t *b)
+{
+    b->btf = btf__new_empty();
+    if (b->btf == NULL)
+        return ENOMEM;
+    b->int_type = btf__add_int(b->btf, "int", 4, BTF_INT_SIGNED);
+    if (b->int_type < 0)
+        return -b->int_type;
+
+    for (size_t i = 0; i < n_maps; i++) {
+        if (maps[i].key == NULL && maps[i].value == NULL && maps[i].table_value == NULL)
+            continue;
+        int ret = add_map_var(b, &maps[i]);
+        if (ret < 0)
+            return -ret;
+    }
+
+    int sec = btf__add_datasec(b->btf, ".maps", b->n_vars * 4 * 8);
+    if (sec < 0)
+        return -sec;
+    for (size_t i = 0; i < b->n_vars; i++) {
+        int ret = btf__add_datasec_var_info(b->btf, b->vars[i], i * 4 * 8, 4 * 8);
+        if (ret < 0)
+            return -ret;
+    }
+
+    return NO_ERROR;
+}
+
+static int create_map(psabpf_context_t *ctx, const bench_map_def_t *def, const bench_map_def_t *maps)
+{
+    char path[256];
+    int inner_fd = -1, ret = NO_ERROR;
+
+    if (def->inner_map != NULL) {
+        for (const bench_map_def_t *m = maps; m != def; m++) {
+            if (strcmp(m->name, def->inner_map) == 0) {
+                build_ebpf_map_filename(path, sizeof(path), ctx, m->name);
+                inner_fd = map_ops->obj_get(path);
+                break;
+            }
+        }
+        if (inner_fd < 0) {
+            fprintf(stderr, "%s: inner map %s not found\n", def->name, def->inner_map);
+            return ENOENT;
+        }
+    }
+
+    struct bpf_create_map_attr attr = {
+            .name = def->name,
+            .map_type = def->type,
+            .map_flags = def->map_flags,
+            .key_size = def->key_size,
+            .value_size = def->value_size,
+            .max_entries = def->max_entries,
+            .inner_map_fd = inner_fd >= 0 ? inner_fd : 0,
+    };
+    int fd = map_ops->create_map(&attr);
+    if (fd < 0) {
+        ret = errno;
+        fprintf(stderr, "failed to create map %s: %s\n", def->name, strerror(ret));
+        goto clean_up;
+    }
+
+    build_ebpf_map_filename(path, sizeof(path), ctx, def->name);
+    if (map_ops->obj_pin(fd, path) != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to pin map %s: %s\n", def->name, strerror(ret));
+    }
+
+clean_up:
+    close_object_fd(&fd);
+    close_object_fd(&inner_fd);
+    return ret;
+}
+
+int bench_pipeline_create(psabpf_context_t *ctx, const bench_map_def_t *maps, size_t n_maps)
+{
+    btf_builder_t builder = {0};
+    char pipeline_path[256];
+
+    bench_pipeline_destroy(ctx);
+
+    int ret = build_btf(maps, n_maps, &builder);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to generate BTF: %s\n", strerror(ret));
+        goto clean_up;
+    }
+
+    uint32_t btf_size = 0;
+    const void *btf_data = btf__get_raw_data(builder.btf, &btf_size);
+    if (btf_data == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+    build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
+    ret = emulation_set_pipeline_btf(pipeline_path, btf_data, btf_size);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    for (size_t i = 0; i < n_maps && ret == NO_ERROR; i++)
+        ret = create_map(ctx, &maps[i], maps);
+
+    psabpf_context_invalidate_cache(ctx);
+
+clean_up:
+    btf__free(builder.btf);
+    free(builder.vars);
+    return ret;
+}
+
+void bench_pipeline_destroy(psabpf_context_t *ctx)
+{
+    char pipeline_path[256];
+
+    build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
+    emulation_remove_pipeline(pipeline_path);
+    psabpf_context_invalidate_cache(ctx);
+}
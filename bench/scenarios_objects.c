@@ -0,0 +1,660 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <psabpf_digest.h>
+#include <psabpf_pre.h>
+
+#include "bench.h"
+#include "../lib/common.h"
+#include "../lib/psabpf_map_ops.h"
+
+#define COUNTER_NAME "ingress_counter"
+#define REGISTER_NAME "ingress_reg"
+#define DIGEST_NAME "mac_learn_digest_0"
+#define SELECTOR_NAME "as"
+#define SELECTOR_GROUP_SIZE 8
+#define PRE_GROUPS 64
+
+static const bench_btf_field_t index_key[] = { { "index", 4 }, { 0 } };
+static const bench_btf_field_t counter_value[] = { { "bytes", 8 }, { "packets", 8 }, { 0 } };
+static const bench_btf_field_t register_value[] = { { "value", 8 }, { 0 } };
+static const bench_btf_field_t digest_value[] = { { "mac", 6 }, { "port", 4 }, { 0 } };
+
+/******************************************************************************
+ * Counter and register
+ ******************************************************************************/
+
+static void measure_counter_access(psabpf_counter_context_t *cc, const char *scenario, const char *phase_name,
+                                   size_t size, bool write)
+{
+    bench_phase_t phase;
+
+    bench_phase_begin(&phase, scenario, phase_name, size);
+    for (uint32_t i = 0; i < size; i++) {
+        psabpf_counter_entry_t entry;
+
+        bench_call_begin(&phase);
+        psabpf_counter_entry_init(&entry);
+        int ret = psabpf_counter_entry_set_key(&entry, &i, sizeof(i));
+        if (ret == NO_ERROR && write) {
+            psabpf_counter_entry_set_bytes(&entry, 64 * (uint64_t) i);
+            psabpf_counter_entry_set_packets(&entry, i);
+            ret = psabpf_counter_set(cc, &entry);
+        } else if (ret == NO_ERROR) {
+            ret = psabpf_counter_get(cc, &entry);
+        }
+        psabpf_counter_entry_free(&entry);
+        bench_call_end(&phase, 1, ret);
+    }
+    bench_phase_end(&phase);
+}
+
+int bench_counter_scan(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = COUNTER_NAME, .type = BPF_MAP_TYPE_ARRAY, .key_size = 4, .value_size = 16,
+                    .max_entries = size, .key = index_key, .value = counter_value,
+            },
+    };
+    psabpf_counter_context_t cc;
+    bench_phase_t phase;
+
+    int ret = bench_pipeline_create(ctx, maps, sizeof(maps) / sizeof(maps[0]));
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_counter_ctx_init(&cc);
+    ret = psabpf_counter_ctx_name(ctx, &cc, COUNTER_NAME);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    measure_counter_access(&cc, name, "set", size, true);
+    measure_counter_access(&cc, name, "get", size, false);
+
+    bench_phase_begin(&phase, name, "scan", size);
+    while (true) {
+        bench_call_begin(&phase);
+        psabpf_counter_entry_t *entry = psabpf_counter_get_next(&cc);
+        bench_call_end(&phase, entry != NULL ? 1 : 0, 0);
+        if (entry == NULL)
+            break;
+    }
+    if (phase.items != size)
+        phase.errors += 1;
+    bench_phase_end(&phase);
+
+clean_up:
+    psabpf_counter_ctx_free(&cc);
+    return ret;
+}
+
+static void measure_register_access(psabpf_register_context_t *rc, const char *scenario, const char *phase_name,
+                                    size_t size, bool write)
+{
+    bench_phase_t phase;
+
+    bench_phase_begin(&phase, scenario, phase_name, size);
+    for (uint32_t i = 0; i < size; i++) {
+        psabpf_register_entry_t entry;
+        uint64_t value = i;
+
+        bench_call_begin(&phase);
+        psabpf_register_entry_init(&entry);
+        int ret = psabpf_register_entry_set_key(&entry, &i, sizeof(i));
+        if (ret == NO_ERROR && write) {
+            ret = psabpf_register_entry_set_value(&entry, &value, sizeof(value));
+            if (ret == NO_ERROR)
+                ret = psabpf_register_set(rc, &entry);
+        } else if (ret == NO_ERROR) {
+            ret = psabpf_register_get(rc, &entry);
+        }
+        psabpf_register_entry_free(&entry);
+        bench_call_end(&phase, 1, ret);
+    }
+    bench_phase_end(&phase);
+}
+
+int bench_register_scan(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = REGISTER_NAME, .type = BPF_MAP_TYPE_ARRAY, .key_size = 4, .value_size = 8,
+                    .max_entries = size, .key = index_key, .value = register_value,
+            },
+    };
+    psabpf_register_context_t rc;
+    bench_phase_t phase;
+
+    int ret = bench_pipeline_create(ctx, maps, sizeof(maps) / sizeof(maps[0]));
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_register_ctx_init(&rc);
+    ret = psabpf_register_ctx_name(ctx, &rc, REGISTER_NAME);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    measure_register_access(&rc, name, "set", size, true);
+    measure_register_access(&rc, name, "get", size, false);
+
+    bench_phase_begin(&phase, name, "scan", size);
+    while (true) {
+        bench_call_begin(&phase);
+        psabpf_register_entry_t *entry = psabpf_register_get_next(&rc);
+        bench_call_end(&phase, entry != NULL ? 1 : 0, 0);
+        if (entry == NULL)
+            break;
+    }
+    if (phase.items != size)
+        phase.errors += 1;
+    bench_phase_end(&phase);
+
+clean_up:
+    psabpf_register_ctx_free(&rc);
+    return ret;
+}
+
+/******************************************************************************
+ * Digest
+ ******************************************************************************/
+
+/* Queue is filled directly, like the data plane does it */
+static int fill_digest_queue(psabpf_context_t *ctx, size_t size)
+{
+    char path[256];
+    char value[12] = {0};
+
+    build_ebpf_map_filename(path, sizeof(path), ctx, DIGEST_NAME);
+    int fd = map_ops->obj_get(path);
+    if (fd < 0)
+        return errno;
+
+    int ret = NO_ERROR;
+    for (uint32_t i = 0; i < size; i++) {
+        memcpy(value, &i, sizeof(i));
+        memcpy(value + 8, &i, sizeof(i));
+        if (map_ops->update_elem(fd, NULL, value, BPF_ANY) != 0) {
+            ret = errno;
+            break;
+        }
+    }
+
+    close_object_fd(&fd);
+    return ret;
+}
+
+int bench_digest_drain(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = DIGEST_NAME, .type = BPF_MAP_TYPE_QUEUE, .key_size = 0, .value_size = 12,
+                    .max_entries = size, .value = digest_value,
+            },
+    };
+    psabpf_digest_context_t dc;
+    bench_phase_t phase;
+
+    int ret = bench_pipeline_create(ctx, maps, sizeof(maps) / sizeof(maps[0]));
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_digest_ctx_init(&dc);
+    ret = psabpf_digest_ctx_name(ctx, &dc, DIGEST_NAME);
+    if (ret != NO_ERROR)
+        goto clean_up;
+    ret = fill_digest_queue(ctx, size);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    /* Read every field of digest, like psabpf-ctl digest get does */
+    bench_phase_begin(&phase, name, "drain", size);
+    while (true) {
+        psabpf_digest_t digest;
+
+        bench_call_begin(&phase);
+        int err = psabpf_digest_get_next(&dc, &digest);
+        if (err == NO_ERROR) {
+            while (psabpf_digest_get_next_field(&dc, &digest) != NULL);
+            psabpf_digest_free(&digest);
+        }
+        bench_call_end(&phase, err == NO_ERROR ? 1 : 0, err == ENOENT ? NO_ERROR : err);
+        if (err != NO_ERROR)
+            break;
+    }
+    if (phase.items != size)
+        phase.errors += 1;
+    bench_phase_end(&phase);
+
+clean_up:
+    psabpf_digest_ctx_free(&dc);
+    return ret;
+}
+
+/******************************************************************************
+ * Action selector
+ ******************************************************************************/
+
+static int set_member_action(psabpf_action_selector_member_context_t *member, uint32_t port)
+{
+    psabpf_action_t action;
+    psabpf_action_param_t param;
+    uint32_t vlan = 1;
+
+    psabpf_action_init(&action);
+    psabpf_action_set_id(&action, 1);
+    int ret = psabpf_action_param_create(&param, (const char *) &port, sizeof(port));
+    if (ret == NO_ERROR)
+        ret = psabpf_action_param(&action, &param);
+    if (ret == NO_ERROR)
+        ret = psabpf_action_param_create(&param, (const char *) &vlan, sizeof(vlan));
+    if (ret == NO_ERROR)
+        ret = psabpf_action_param(&action, &param);
+    if (ret == NO_ERROR)
+        ret = psabpf_action_selector_member_action(member, &action);
+    psabpf_action_free(&action);
+
+    return ret;
+}
+
+/* Maps of action selector with its name and a table which uses it, see do_open_action_selector() */
+static void action_selector_maps(bench_map_def_t *maps, size_t n_members)
+{
+    size_t n_groups = (n_members + SELECTOR_GROUP_SIZE - 1) / SELECTOR_GROUP_SIZE;
+
+    /* members: action ID and two params */
+    maps[0] = (bench_map_def_t) {
+            .name = SELECTOR_NAME "_actions", .type = BPF_MAP_TYPE_HASH, .key_size = 4, .value_size = 12,
+            .max_entries = n_members,
+    };
+    /* group: number of members at index 0, then members */
+    maps[1] = (bench_map_def_t) {
+            .name = SELECTOR_NAME "_groups_inner", .type = BPF_MAP_TYPE_ARRAY, .key_size = 4, .value_size = 4,
+            .max_entries = SELECTOR_GROUP_SIZE + 1,
+    };
+    maps[2] = (bench_map_def_t) {
+            .name = SELECTOR_NAME "_groups", .type = BPF_MAP_TYPE_HASH_OF_MAPS, .key_size = 4, .value_size = 4,
+            .max_entries = n_groups, .inner_map = SELECTOR_NAME "_groups_inner",
+    };
+    maps[3] = (bench_map_def_t) {
+            .name = SELECTOR_NAME "_defaultActionGroup", .type = BPF_MAP_TYPE_ARRAY, .key_size = 4,
+            .value_size = 12, .max_entries = 1,
+    };
+}
+
+#define ACTION_SELECTOR_MAPS 4
+
+int bench_action_selector_churn(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    bench_map_def_t maps[ACTION_SELECTOR_MAPS];
+    size_t n_groups = (size + SELECTOR_GROUP_SIZE - 1) / SELECTOR_GROUP_SIZE;
+    psabpf_action_selector_context_t asc;
+    psabpf_action_selector_member_context_t *members = NULL;
+    psabpf_action_selector_group_context_t *groups = NULL;
+    bench_phase_t phase;
+
+    action_selector_maps(maps, size);
+    int ret = bench_pipeline_create(ctx, maps, ACTION_SELECTOR_MAPS);
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_action_selector_ctx_init(&asc);
+    members = calloc(size, sizeof(psabpf_action_selector_member_context_t));
+    groups = calloc(n_groups, sizeof(psabpf_action_selector_group_context_t));
+    if (members == NULL || groups == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+    ret = psabpf_action_selector_ctx_name(ctx, &asc, SELECTOR_NAME);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    bench_phase_begin(&phase, name, "add-member", size);
+    for (size_t i = 0; i < size; i++) {
+        bench_call_begin(&phase);
+        psabpf_action_selector_member_init(&members[i]);
+        int err = set_member_action(&members[i], i);
+        if (err == NO_ERROR)
+            err = psabpf_action_selector_add_member(&asc, &members[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, name, "add-group", n_groups);
+    for (size_t i = 0; i < n_groups; i++) {
+        bench_call_begin(&phase);
+        psabpf_action_selector_group_init(&groups[i]);
+        int err = psabpf_action_selector_add_group(&asc, &groups[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, name, "add-member-to-group", size);
+    for (size_t i = 0; i < size; i++) {
+        bench_call_begin(&phase);
+        int err = psabpf_action_selector_add_member_to_group(&asc, &groups[i / SELECTOR_GROUP_SIZE], &members[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, name, "del-member-from-group", size);
+    for (size_t i = 0; i < size; i++) {
+        bench_call_begin(&phase);
+        int err = psabpf_action_selector_del_member_from_group(&asc, &groups[i / SELECTOR_GROUP_SIZE], &members[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    /* Groups still exist, so every member is looked up in them */
+    bench_phase_begin(&phase, name, "del-member", size);
+    for (size_t i = 0; i < size; i++) {
+        bench_call_begin(&phase);
+        int err = psabpf_action_selector_del_member(&asc, &members[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, name, "del-group", n_groups);
+    for (size_t i = 0; i < n_groups; i++) {
+        bench_call_begin(&phase);
+        int err = psabpf_action_selector_del_group(&asc, &groups[i]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+clean_up:
+    if (members != NULL) {
+        for (size_t i = 0; i < size; i++)
+            psabpf_action_selector_member_free(&members[i]);
+        free(members);
+    }
+    free(groups);
+    psabpf_action_selector_ctx_free(&asc);
+    return ret;
+}
+
+/******************************************************************************
+ * Packet replication engine
+ ******************************************************************************/
+
+/* Inner maps are lists of members with the head at key 0, see struct element in psabpf_pre.c */
+#define PRE_LIST_KEY_SIZE 8
+#define PRE_LIST_VALUE_SIZE (sizeof(psabpf_clone_session_entry_t) + PRE_LIST_KEY_SIZE)
+
+static void measure_mcast_churn(psabpf_context_t *ctx, const char *scenario, size_t members_per_group)
+{
+    psabpf_mcast_grp_ctx_t groups[PRE_GROUPS];
+    bench_phase_t phase;
+    size_t size = PRE_GROUPS * members_per_group;
+
+    bench_phase_begin(&phase, scenario, "mcast-group-create", PRE_GROUPS);
+    for (uint32_t g = 0; g < PRE_GROUPS; g++) {
+        bench_call_begin(&phase);
+        psabpf_mcast_grp_context_init(&groups[g]);
+        psabpf_mcast_grp_id(&groups[g], g + 1);
+        int err = psabpf_mcast_grp_create(ctx, &groups[g]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "mcast-member-add", size);
+    for (uint32_t g = 0; g < PRE_GROUPS; g++) {
+        for (uint32_t m = 0; m < members_per_group; m++) {
+            psabpf_mcast_grp_member_t member;
+
+            bench_call_begin(&phase);
+            psabpf_mcast_grp_member_init(&member);
+            psabpf_mcast_grp_member_port(&member, m + 1);
+            psabpf_mcast_grp_member_instance(&member, g + 1);
+            int err = psabpf_mcast_grp_member_update(ctx, &groups[g], &member);
+            psabpf_mcast_grp_member_free(&member);
+            bench_call_end(&phase, 1, err);
+        }
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "mcast-member-delete", size);
+    for (uint32_t g = 0; g < PRE_GROUPS; g++) {
+        for (uint32_t m = 0; m < members_per_group; m++) {
+            psabpf_mcast_grp_member_t member;
+
+            bench_call_begin(&phase);
+            psabpf_mcast_grp_member_init(&member);
+            psabpf_mcast_grp_member_port(&member, m + 1);
+            psabpf_mcast_grp_member_instance(&member, g + 1);
+            int err = psabpf_mcast_grp_member_delete(ctx, &groups[g], &member);
+            psabpf_mcast_grp_member_free(&member);
+            bench_call_end(&phase, 1, err);
+        }
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "mcast-group-delete", PRE_GROUPS);
+    for (uint32_t g = 0; g < PRE_GROUPS; g++) {
+        bench_call_begin(&phase);
+        int err = psabpf_mcast_grp_delete(ctx, &groups[g]);
+        bench_call_end(&phase, 1, err);
+        psabpf_mcast_grp_context_free(&groups[g]);
+    }
+    bench_phase_end(&phase);
+}
+
+static void measure_clone_session_churn(psabpf_context_t *ctx, const char *scenario, size_t members_per_group)
+{
+    psabpf_clone_session_ctx_t sessions[PRE_GROUPS];
+    bench_phase_t phase;
+    size_t size = PRE_GROUPS * members_per_group;
+
+    bench_phase_begin(&phase, scenario, "clone-session-create", PRE_GROUPS);
+    for (uint32_t s = 0; s < PRE_GROUPS; s++) {
+        bench_call_begin(&phase);
+        psabpf_clone_session_context_init(&sessions[s]);
+        psabpf_clone_session_id(&sessions[s], s + 1);
+        int err = psabpf_clone_session_create(ctx, &sessions[s]);
+        bench_call_end(&phase, 1, err);
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "clone-entry-add", size);
+    for (uint32_t s = 0; s < PRE_GROUPS; s++) {
+        for (uint32_t m = 0; m < members_per_group; m++) {
+            psabpf_clone_session_entry_t entry;
+
+            bench_call_begin(&phase);
+            psabpf_clone_session_entry_init(&entry);
+            psabpf_clone_session_entry_port(&entry, m + 1);
+            psabpf_clone_session_entry_instance(&entry, s + 1);
+            psabpf_clone_session_entry_cos(&entry, 1);
+            int err = psabpf_clone_session_entry_update(ctx, &sessions[s], &entry);
+            psabpf_clone_session_entry_free(&entry);
+            bench_call_end(&phase, 1, err);
+        }
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "clone-entry-delete", size);
+    for (uint32_t s = 0; s < PRE_GROUPS; s++) {
+        for (uint32_t m = 0; m < members_per_group; m++) {
+            psabpf_clone_session_entry_t entry;
+
+            bench_call_begin(&phase);
+            psabpf_clone_session_entry_init(&entry);
+            psabpf_clone_session_entry_port(&entry, m + 1);
+            psabpf_clone_session_entry_instance(&entry, s + 1);
+            int err = psabpf_clone_session_entry_delete(ctx, &sessions[s], &entry);
+            psabpf_clone_session_entry_free(&entry);
+            bench_call_end(&phase, 1, err);
+        }
+    }
+    bench_phase_end(&phase);
+
+    bench_phase_begin(&phase, scenario, "clone-session-delete", PRE_GROUPS);
+    for (uint32_t s = 0; s < PRE_GROUPS; s++) {
+        bench_call_begin(&phase);
+        int err = psabpf_clone_session_delete(ctx, &sessions[s]);
+        bench_call_end(&phase, 1, err);
+        psabpf_clone_session_context_free(&sessions[s]);
+    }
+    bench_phase_end(&phase);
+}
+
+/* Size is the total number of members in PRE_GROUPS multicast groups (and clone sessions) */
+int bench_pre_churn(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    size_t members_per_group = (size + PRE_GROUPS - 1) / PRE_GROUPS;
+    const bench_map_def_t maps[] = {
+            {
+                    .name = "multicast_grp_tbl_inner", .type = BPF_MAP_TYPE_HASH, .key_size = PRE_LIST_KEY_SIZE,
+                    .value_size = PRE_LIST_VALUE_SIZE, .max_entries = members_per_group + 1,
+            },
+            {
+                    .name = "multicast_grp_tbl", .type = BPF_MAP_TYPE_HASH_OF_MAPS, .key_size = 4,
+                    .value_size = 4, .max_entries = PRE_GROUPS, .inner_map = "multicast_grp_tbl_inner",
+            },
+            {
+                    .name = "clone_session_tbl_inner", .type = BPF_MAP_TYPE_HASH, .key_size = PRE_LIST_KEY_SIZE,
+                    .value_size = PRE_LIST_VALUE_SIZE, .max_entries = members_per_group + 1,
+            },
+            {
+                    .name = "clone_session_tbl", .type = BPF_MAP_TYPE_HASH_OF_MAPS, .key_size = 4,
+                    .value_size = 4, .max_entries = PRE_GROUPS, .inner_map = "clone_session_tbl_inner",
+            },
+    };
+
+    int ret = bench_pipeline_create(ctx, maps, sizeof(maps) / sizeof(maps[0]));
+    if (ret != NO_ERROR)
+        return ret;
+
+    measure_mcast_churn(ctx, name, members_per_group);
+    measure_clone_session_churn(ctx, name, members_per_group);
+
+    return NO_ERROR;
+}
+
+/******************************************************************************
+ * Opening and closing of objects
+ ******************************************************************************/
+
+/* Cold open loads BTF and maps of the pipeline again, like the first command after start of psabpf-ctl;
+ * warm open reuses them from the context, like commands in daemon or batch mode */
+static void measure_table_open_close(psabpf_context_t *ctx, const char *scenario, size_t size, bool cold)
+{
+    bench_phase_t open_phase, close_phase;
+
+    bench_phase_begin(&open_phase, scenario, cold ? "table-open-cold" : "table-open", size);
+    bench_phase_begin(&close_phase, scenario, cold ? "table-close-cold" : "table-close", size);
+    for (size_t i = 0; i < size; i++) {
+        psabpf_table_entry_ctx_t tec;
+
+        if (cold)
+            psabpf_context_invalidate_cache(ctx);
+
+        bench_call_begin(&open_phase);
+        psabpf_table_entry_ctx_init(&tec);
+        int ret = psabpf_table_entry_ctx_tblname(ctx, &tec, "ingress_tbl_fwd");
+        bench_call_end(&open_phase, 1, ret);
+
+        bench_call_begin(&close_phase);
+        psabpf_table_entry_ctx_free(&tec);
+        bench_call_end(&close_phase, 1, 0);
+    }
+    bench_phase_end(&open_phase);
+    bench_phase_end(&close_phase);
+}
+
+static void measure_counter_open_close(psabpf_context_t *ctx, const char *scenario, size_t size)
+{
+    bench_phase_t open_phase, close_phase;
+
+    bench_phase_begin(&open_phase, scenario, "counter-open", size);
+    bench_phase_begin(&close_phase, scenario, "counter-close", size);
+    for (size_t i = 0; i < size; i++) {
+        psabpf_counter_context_t cc;
+
+        bench_call_begin(&open_phase);
+        psabpf_counter_ctx_init(&cc);
+        int ret = psabpf_counter_ctx_name(ctx, &cc, COUNTER_NAME);
+        bench_call_end(&open_phase, 1, ret);
+
+        bench_call_begin(&close_phase);
+        psabpf_counter_ctx_free(&cc);
+        bench_call_end(&close_phase, 1, 0);
+    }
+    bench_phase_end(&open_phase);
+    bench_phase_end(&close_phase);
+}
+
+static void measure_action_selector_open_close(psabpf_context_t *ctx, const char *scenario, size_t size)
+{
+    bench_phase_t open_phase, close_phase;
+
+    bench_phase_begin(&open_phase, scenario, "action-selector-open", size);
+    bench_phase_begin(&close_phase, scenario, "action-selector-close", size);
+    for (size_t i = 0; i < size; i++) {
+        psabpf_action_selector_context_t asc;
+
+        bench_call_begin(&open_phase);
+        psabpf_action_selector_ctx_init(&asc);
+        int ret = psabpf_action_selector_ctx_name(ctx, &asc, SELECTOR_NAME);
+        bench_call_end(&open_phase, 1, ret);
+
+        bench_call_begin(&close_phase);
+        psabpf_action_selector_ctx_free(&asc);
+        bench_call_end(&close_phase, 1, 0);
+    }
+    bench_phase_end(&open_phase);
+    bench_phase_end(&close_phase);
+}
+
+/* Size is the number of open and close cycles */
+int bench_ctx_open_close(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    static const bench_btf_field_t key[] = { { "ip", 4 }, { "port", 4 }, { 0 } };
+    static const bench_btf_field_t params[] = { { "port", 4 }, { "vlan", 4 }, { 0 } };
+    static const bench_btf_table_value_t value = { .has_priority = false, .action_params = params };
+    bench_map_def_t maps[ACTION_SELECTOR_MAPS + 3] = {
+            {
+                    .name = "ingress_tbl_fwd", .type = BPF_MAP_TYPE_HASH, .key_size = 8, .value_size = 12,
+                    .max_entries = 1024, .key = key, .table_value = &value,
+            },
+            {
+                    .name = "ingress_tbl_fwd_defaultAction", .type = BPF_MAP_TYPE_ARRAY, .key_size = 4,
+                    .value_size = 12, .max_entries = 1, .table_value = &value,
+            },
+            {
+                    .name = COUNTER_NAME, .type = BPF_MAP_TYPE_ARRAY, .key_size = 4, .value_size = 16,
+                    .max_entries = 1024, .key = index_key, .value = counter_value,
+            },
+    };
+
+    action_selector_maps(&maps[3], 1024);
+    int ret = bench_pipeline_create(ctx, maps, sizeof(maps) / sizeof(maps[0]));
+    if (ret != NO_ERROR)
+        return ret;
+
+    measure_table_open_close(ctx, name, size, false);
+    measure_table_open_close(ctx, name, size, true);
+    measure_counter_open_close(ctx, name, size);
+    measure_action_selector_open_close(ctx, name, size);
+
+    return NO_ERROR;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "../CLI/common.h"
+
+/* Values as they are given on the command line of psabpf-ctl */
+static const struct {
+    const char *phase;
+    const char *value;
+} parse_inputs[] = {
+        { "decimal", "4294967295" },
+        { "hex", "0x1a2b3c4d" },
+        { "ipv4", "192.168.100.254" },
+        { "mac", "00:11:22:aa:bb:cc" },
+        { "ipv6", "2001:db8:85a3::8a2e:370:7334" },
+        { "wide-number", "0x0102030405060708090a0b0c0d0e0f10" },
+};
+
+/* Size is the number of values parsed by every phase */
+int bench_parse(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    psabpf_arena_t arena;
+
+    (void) ctx;
+    psabpf_arena_init(&arena, 4096);
+
+    for (size_t p = 0; p < sizeof(parse_inputs) / sizeof(parse_inputs[0]); p++) {
+        bench_phase_t phase;
+
+        bench_phase_begin(&phase, name, parse_inputs[p].phase, size);
+        for (size_t i = 0; i < size; i++) {
+            psabpf_match_key_t mk;
+
+            psabpf_matchkey_init_arena(&mk, &arena);
+            bench_call_begin(&phase);
+            int ret = translate_data_to_bytes(parse_inputs[p].value, &mk, CTX_MATCH_KEY);
+            bench_call_end(&phase, 1, ret);
+            psabpf_arena_reset(&arena);
+        }
+        bench_phase_end(&phase);
+    }
+
+    psabpf_arena_free(&arena);
+    return NO_ERROR;
+}
@@ -0,0 +1,485 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define TABLE_NAME "ingress_tbl_fwd"
+#define TERNARY_MASKS 4
+#define BATCH_SIZE 256
+#define ACTION_FORWARD 1
+
+/* Key: ip and port (prefix and ip for LPM, index for array), value: action forward(port, vlan) */
+static const bench_btf_field_t exact_key[] = { { "ip", 4 }, { "port", 4 }, { 0 } };
+static const bench_btf_field_t array_key[] = { { "index", 4 }, { 0 } };
+static const bench_btf_field_t lpm_key[] = { { "prefixlen", 4 }, { "ip", 4 }, { 0 } };
+static const bench_btf_field_t forward_params[] = { { "port", 4 }, { "vlan", 4 }, { 0 } };
+static const bench_btf_table_value_t table_value = { .has_priority = false, .action_params = forward_params };
+static const bench_btf_table_value_t ternary_value = { .has_priority = true, .action_params = forward_params };
+
+/* Ternary entries differ by ip, so they are unique under every mask */
+static const uint32_t ternary_port_masks[TERNARY_MASKS] = { 0xFFFFFFFF, 0xFFFFFF00, 0xFFFF0000, 0 };
+
+typedef struct table_bench {
+    const char *scenario;
+    enum psabpf_matchkind_t kind;
+    size_t size;
+    size_t first;  /* index of the first entry, threads use disjoint ranges */
+    bool array;  /* exact key is only the index */
+    psabpf_table_entry_ctx_t tec;
+    psabpf_arena_t arena;
+} table_bench_t;
+
+static int add_key(table_bench_t *tb, psabpf_table_entry_t *entry, uint32_t data,
+                   enum psabpf_matchkind_t kind, uint32_t prefix_or_mask)
+{
+    psabpf_match_key_t mk;
+    psabpf_matchkey_init_arena(&mk, &tb->arena);
+    psabpf_matchkey_type(&mk, kind);
+
+    int ret = psabpf_matchkey_data(&mk, (const char *) &data, sizeof(data));
+    if (ret == NO_ERROR && kind == PSABPF_LPM)
+        ret = psabpf_matchkey_prefix_len(&mk, prefix_or_mask);
+    else if (ret == NO_ERROR && kind == PSABPF_TERNARY)
+        ret = psabpf_matchkey_mask(&mk, (const char *) &prefix_or_mask, sizeof(prefix_or_mask));
+    if (ret == NO_ERROR)
+        ret = psabpf_table_entry_matchkey(entry, &mk);
+
+    return ret;
+}
+
+static int add_param(table_bench_t *tb, psabpf_action_t *action, uint32_t data)
+{
+    psabpf_action_param_t param;
+    int ret = psabpf_action_param_create_arena(&param, &tb->arena, (const char *) &data, sizeof(data));
+    if (ret == NO_ERROR)
+        ret = psabpf_action_param(action, &param);
+    return ret;
+}
+
+/* Entry is built like a controller does it: from fields, using the library API */
+static int build_entry(table_bench_t *tb, psabpf_table_entry_t *entry, uint32_t index, bool with_action,
+                       uint32_t out_port)
+{
+    int ret;
+
+    psabpf_table_entry_init_arena(entry, &tb->arena);
+
+    switch (tb->kind) {
+        case PSABPF_EXACT:
+            ret = add_key(tb, entry, index, PSABPF_EXACT, 0);
+            if (ret == NO_ERROR && !tb->array)
+                ret = add_key(tb, entry, index ^ 0x5A5A, PSABPF_EXACT, 0);
+            break;
+        case PSABPF_LPM:
+            /* unique /24 prefixes */
+            ret = add_key(tb, entry, index << 8, PSABPF_LPM, 24);
+            break;
+        case PSABPF_TERNARY:
+            ret = add_key(tb, entry, index, PSABPF_TERNARY, 0xFFFFFFFF);
+            if (ret == NO_ERROR)
+                ret = add_key(tb, entry, index ^ 0x5A5A, PSABPF_TERNARY,
+                              ternary_port_masks[index % TERNARY_MASKS]);
+            psabpf_table_entry_priority(entry, index + 1);
+            break;
+        default:
+            return EINVAL;
+    }
+    if (ret != NO_ERROR || !with_action)
+        return ret;
+
+    psabpf_action_t action;
+    psabpf_action_init_arena(&action, &tb->arena);
+    psabpf_action_set_id(&action, ACTION_FORWARD);
+    ret = add_param(tb, &action, out_port);
+    if (ret == NO_ERROR)
+        ret = add_param(tb, &action, index & 0xFFF);
+    if (ret == NO_ERROR)
+        psabpf_table_entry_action(entry, &action);
+
+    return ret;
+}
+
+typedef int (*table_write_func_t)(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
+
+static void write_entries(table_bench_t *tb, bench_phase_t *phase, table_write_func_t write,
+                          bool with_action, uint32_t out_port)
+{
+    psabpf_table_entry_t entry;
+
+    for (size_t i = 0; i < tb->size; i++) {
+        bench_call_begin(phase);
+        int ret = build_entry(tb, &entry, tb->first + i, with_action, out_port);
+        if (ret == NO_ERROR)
+            ret = write(&tb->tec, &entry);
+        bench_call_end(phase, 1, ret);
+        psabpf_arena_reset(&tb->arena);
+    }
+}
+
+static void measure_writes(table_bench_t *tb, const char *phase_name, table_write_func_t write,
+                           bool with_action, uint32_t out_port)
+{
+    bench_phase_t phase;
+
+    bench_phase_begin(&phase, tb->scenario, phase_name, tb->size);
+    write_entries(tb, &phase, write, with_action, out_port);
+    bench_phase_end(&phase);
+}
+
+static void measure_dump(table_bench_t *tb)
+{
+    bench_phase_t phase;
+    size_t n_entries = 0;
+
+    bench_phase_begin(&phase, tb->scenario, "dump", tb->size);
+    while (true) {
+        bench_call_begin(&phase);
+        psabpf_table_entry_t *entry = psabpf_table_entry_get_next(&tb->tec);
+        bench_call_end(&phase, entry != NULL ? 1 : 0, 0);
+        if (entry == NULL)
+            break;
+        n_entries++;
+    }
+    /* Missing or excess entries are reported as errors */
+    if (n_entries != tb->size)
+        phase.errors += 1;
+    bench_phase_end(&phase);
+}
+
+static void measure_batch_insert(table_bench_t *tb)
+{
+    bench_phase_t phase;
+    psabpf_table_entry_t entries[BATCH_SIZE];
+    psabpf_table_entry_t *entries_ptr[BATCH_SIZE];
+
+    for (size_t i = 0; i < BATCH_SIZE; i++)
+        entries_ptr[i] = &entries[i];
+
+    bench_phase_begin(&phase, tb->scenario, "insert-batch", tb->size);
+    for (size_t first = 0; first < tb->size; first += BATCH_SIZE) {
+        size_t n = tb->size - first < BATCH_SIZE ? tb->size - first : BATCH_SIZE;
+
+        bench_call_begin(&phase);
+        int ret = NO_ERROR;
+        for (size_t i = 0; i < n && ret == NO_ERROR; i++)
+            ret = build_entry(tb, &entries[i], first + i, true, 1);
+        if (ret == NO_ERROR)
+            ret = psabpf_table_entry_add_batch(&tb->tec, entries_ptr, n, NULL);
+        bench_call_end(&phase, n, ret);
+
+        psabpf_arena_reset(&tb->arena);
+    }
+    bench_phase_end(&phase);
+}
+
+/* Entry without keys removes every entry of the table */
+static void measure_clear(table_bench_t *tb)
+{
+    bench_phase_t phase;
+    psabpf_table_entry_t entry;
+
+    bench_phase_begin(&phase, tb->scenario, "clear", tb->size);
+    psabpf_table_entry_init_arena(&entry, &tb->arena);
+    bench_call_begin(&phase);
+    int ret = psabpf_table_entry_del(&tb->tec, &entry);
+    bench_call_end(&phase, tb->size, ret);
+    bench_phase_end(&phase);
+
+    psabpf_arena_reset(&tb->arena);
+}
+
+static int run_table_bench(psabpf_context_t *ctx, const char *scenario, size_t size,
+                           enum psabpf_matchkind_t kind, const bench_map_def_t *maps, size_t n_maps)
+{
+    table_bench_t tb = {
+            .scenario = scenario,
+            .kind = kind,
+            .size = size,
+            .array = maps[0].type == BPF_MAP_TYPE_ARRAY,
+    };
+
+    int ret = bench_pipeline_create(ctx, maps, n_maps);
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_arena_init(&tb.arena, 64 * 1024);
+    psabpf_table_entry_ctx_init(&tb.tec);
+    ret = psabpf_table_entry_ctx_tblname(ctx, &tb.tec, TABLE_NAME);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    measure_writes(&tb, "insert", psabpf_table_entry_add, true, 1);
+    measure_writes(&tb, "update", psabpf_table_entry_update, true, 2);
+    measure_dump(&tb);
+    /* Single entry of array can't be deleted, only the whole array is cleared */
+    if (!tb.array)
+        measure_writes(&tb, "delete", psabpf_table_entry_del, false, 0);
+    measure_batch_insert(&tb);
+    measure_clear(&tb);
+
+clean_up:
+    psabpf_table_entry_ctx_free(&tb.tec);
+    psabpf_arena_free(&tb.arena);
+    return ret;
+}
+
+int bench_table_exact(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = TABLE_NAME, .type = BPF_MAP_TYPE_HASH, .key_size = 8, .value_size = 12,
+                    .max_entries = size, .key = exact_key, .table_value = &table_value,
+            },
+    };
+
+    return run_table_bench(ctx, name, size, PSABPF_EXACT, maps, sizeof(maps) / sizeof(maps[0]));
+}
+
+/* Entries of array always exist, so only clear is measured; it zeroes them */
+int bench_table_array(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = TABLE_NAME, .type = BPF_MAP_TYPE_ARRAY, .key_size = 4, .value_size = 12,
+                    .max_entries = size, .key = array_key, .table_value = &table_value,
+            },
+    };
+
+    return run_table_bench(ctx, name, size, PSABPF_EXACT, maps, sizeof(maps) / sizeof(maps[0]));
+}
+
+int bench_table_lpm(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = TABLE_NAME, .type = BPF_MAP_TYPE_LPM_TRIE, .key_size = 8, .value_size = 12,
+                    .max_entries = size, .map_flags = BPF_F_NO_PREALLOC,
+                    .key = lpm_key, .table_value = &table_value,
+            },
+    };
+
+    return run_table_bench(ctx, name, size, PSABPF_LPM, maps, sizeof(maps) / sizeof(maps[0]));
+}
+
+/* Layout of maps used by ternary tables, see open_ternary_table() */
+int bench_table_ternary(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    const bench_map_def_t maps[] = {
+            {
+                    .name = TABLE_NAME "_tuple", .type = BPF_MAP_TYPE_HASH, .key_size = 8, .value_size = 16,
+                    .max_entries = size, .key = exact_key, .table_value = &ternary_value,
+            },
+            {
+                    .name = TABLE_NAME "_tuples_map", .type = BPF_MAP_TYPE_ARRAY_OF_MAPS, .key_size = 4,
+                    .value_size = 4, .max_entries = 128, .inner_map = TABLE_NAME "_tuple",
+            },
+            {
+                    /* value: tuple_id, next_tuple_mask, has_next */
+                    .name = TABLE_NAME "_prefixes", .type = BPF_MAP_TYPE_HASH, .key_size = 8, .value_size = 24,
+                    .max_entries = 128,
+            },
+    };
+
+    return run_table_bench(ctx, name, size, PSABPF_TERNARY, maps, sizeof(maps) / sizeof(maps[0]));
+}
+
+/*
+ * Threads
+ */
+
+#define THREADS_MAX 8
+
+/* Entry read back is released like a controller does it, its buffers come from the arena */
+static int get_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
+{
+    int ret = psabpf_table_entry_get(ctx, entry);
+    psabpf_table_entry_free(entry);
+    return ret;
+}
+
+static const char *const thread_tables[THREADS_MAX] = {
+        TABLE_NAME "_0", TABLE_NAME "_1", TABLE_NAME "_2", TABLE_NAME "_3",
+        TABLE_NAME "_4", TABLE_NAME "_5", TABLE_NAME "_6", TABLE_NAME "_7",
+};
+
+typedef struct threads_run {
+    unsigned n_threads;
+    bool shared_table;
+    const char *insert_phase;
+    const char *get_phase;
+} threads_run_t;
+
+/* Every thread writes its own table (opened by the main thread), or all threads write disjoint entries of
+ * one table, each through its own clone of the table context */
+static const threads_run_t threads_runs[] = {
+        { 1, false, "own-insert/1", "own-get/1" },
+        { 2, false, "own-insert/2", "own-get/2" },
+        { 4, false, "own-insert/4", "own-get/4" },
+        { 8, false, "own-insert/8", "own-get/8" },
+        { 1, true, "shared-insert/1", "shared-get/1" },
+        { 2, true, "shared-insert/2", "shared-get/2" },
+        { 4, true, "shared-insert/4", "shared-get/4" },
+        { 8, true, "shared-insert/8", "shared-get/8" },
+};
+
+typedef struct table_worker {
+    table_bench_t tb;
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    bench_phase_t insert;
+    bench_phase_t get;
+} table_worker_t;
+
+/* Main thread waits on the barrier too, so it can take time between phases */
+static void *table_worker_run(void *arg)
+{
+    table_worker_t *worker = arg;
+
+    pthread_barrier_wait(worker->barrier);
+    write_entries(&worker->tb, &worker->insert, psabpf_table_entry_add, true, 1);
+    pthread_barrier_wait(worker->barrier);
+    write_entries(&worker->tb, &worker->get, get_entry, false, 0);
+
+    return NULL;
+}
+
+static int open_worker_table(psabpf_context_t *ctx, table_worker_t *worker, psabpf_table_entry_ctx_t *shared,
+                             unsigned idx)
+{
+    if (shared != NULL)
+        return psabpf_table_entry_ctx_clone(&worker->tb.tec, shared);
+    return psabpf_table_entry_ctx_tblname(ctx, &worker->tb.tec, thread_tables[idx]);
+}
+
+static void clear_worker_table(table_worker_t *worker)
+{
+    psabpf_table_entry_t entry;
+
+    psabpf_table_entry_init_arena(&entry, &worker->tb.arena);
+    psabpf_table_entry_del(&worker->tb.tec, &entry);
+    psabpf_arena_reset(&worker->tb.arena);
+}
+
+static int run_threads(psabpf_context_t *ctx, const char *scenario, size_t size, const threads_run_t *run,
+                       psabpf_table_entry_ctx_t *shared)
+{
+    table_worker_t workers[THREADS_MAX];
+    pthread_barrier_t barrier;
+    unsigned n_started = 0;
+    int ret = NO_ERROR;
+
+    memset(workers, 0, sizeof(workers));
+    for (unsigned i = 0; i < run->n_threads; i++) {
+        table_worker_t *worker = &workers[i];
+        size_t per_thread = size / run->n_threads;
+
+        worker->tb.scenario = scenario;
+        worker->tb.kind = PSABPF_EXACT;
+        worker->tb.first = i * per_thread;
+        worker->tb.size = i + 1 < run->n_threads ? per_thread : size - worker->tb.first;
+        worker->barrier = &barrier;
+        psabpf_arena_init(&worker->tb.arena, 64 * 1024);
+        psabpf_table_entry_ctx_init(&worker->tb.tec);
+        bench_phase_begin(&worker->insert, scenario, run->insert_phase, size);
+        bench_phase_begin(&worker->get, scenario, run->get_phase, size);
+        if (ret == NO_ERROR)
+            ret = open_worker_table(ctx, worker, shared, i);
+    }
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    pthread_barrier_init(&barrier, NULL, run->n_threads + 1);
+    for (; n_started < run->n_threads; n_started++) {
+        ret = pthread_create(&workers[n_started].thread, NULL, table_worker_run, &workers[n_started]);
+        if (ret != 0)
+            break;
+    }
+    if (ret != 0) {
+        /* Barrier can't be passed, workers already started never leave it */
+        fprintf(stderr, "failed to start thread: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_barrier_wait(&barrier);
+    uint64_t start_ns = bench_now_ns();
+    pthread_barrier_wait(&barrier);
+    uint64_t inserted_ns = bench_now_ns();
+    for (unsigned i = 0; i < n_started; i++)
+        pthread_join(workers[i].thread, NULL);
+    uint64_t end_ns = bench_now_ns();
+    pthread_barrier_destroy(&barrier);
+
+    bench_phase_t insert, get;
+    bench_phase_begin(&insert, scenario, run->insert_phase, size);
+    bench_phase_begin(&get, scenario, run->get_phase, size);
+    for (unsigned i = 0; i < run->n_threads; i++) {
+        bench_phase_merge(&insert, &workers[i].insert);
+        bench_phase_merge(&get, &workers[i].get);
+    }
+    insert.wall_ns = inserted_ns - start_ns;
+    get.wall_ns = end_ns - inserted_ns;
+    bench_phase_end(&insert);
+    bench_phase_end(&get);
+
+    /* Next run starts with empty tables */
+    for (unsigned i = 0; i < (run->shared_table ? 1 : run->n_threads); i++)
+        clear_worker_table(&workers[i]);
+
+clean_up:
+    for (unsigned i = 0; i < run->n_threads; i++) {
+        free(workers[i].insert.latencies);
+        free(workers[i].get.latencies);
+        psabpf_table_entry_ctx_free(&workers[i].tb.tec);
+        psabpf_arena_free(&workers[i].tb.arena);
+    }
+    return ret;
+}
+
+/* Throughput of phases is counted from wall clock time, so it shows scaling with the number of threads */
+int bench_table_exact_threads(psabpf_context_t *ctx, const char *name, size_t size)
+{
+    bench_map_def_t maps[THREADS_MAX + 1];
+    psabpf_table_entry_ctx_t shared;
+
+    for (unsigned i = 0; i < THREADS_MAX + 1; i++) {
+        maps[i] = (bench_map_def_t) {
+                .name = i < THREADS_MAX ? thread_tables[i] : TABLE_NAME,
+                .type = BPF_MAP_TYPE_HASH, .key_size = 8, .value_size = 12,
+                .max_entries = size, .key = exact_key, .table_value = &table_value,
+        };
+    }
+    int ret = bench_pipeline_create(ctx, maps, THREADS_MAX + 1);
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_table_entry_ctx_init(&shared);
+    ret = psabpf_table_entry_ctx_tblname(ctx, &shared, TABLE_NAME);
+
+    for (size_t i = 0; i < sizeof(threads_runs) / sizeof(threads_runs[0]) && ret == NO_ERROR; i++) {
+        const threads_run_t *run = &threads_runs[i];
+        ret = run_threads(ctx, name, size, run, run->shared_table ? &shared : NULL);
+    }
+
+    psabpf_table_entry_ctx_free(&shared);
+    return ret;
+}
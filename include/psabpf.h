@@ -34,6 +34,10 @@ typedef struct psabpf_btf {
     void * btf;
     /* To create bpf maps with BTF info */
     int btf_fd;
+    /* Name lookup index, built on demand */
+    void * index;
+    /* Not NULL when BTF is borrowed from the PSABPF context */
+    void * shared;
 } psabpf_btf_t;
 
 typedef struct psabpf_bpf_map_descriptor {
@@ -58,6 +62,10 @@ typedef uint32_t psabpf_pipeline_id_t;
  */
 typedef struct psabpf_context {
     psabpf_pipeline_id_t pipeline_id;
+
+    /* BTF and opened maps shared by all objects of the pipeline, for internal use */
+    void *btf_cache;
+    void *map_cache;
 } psabpf_context_t;
 
 /**
@@ -81,6 +89,129 @@ void psabpf_context_free(psabpf_context_t *ctx);
 void psabpf_context_set_pipeline(psabpf_context_t *ctx, psabpf_pipeline_id_t pipeline_id);
 psabpf_pipeline_id_t psabpf_context_get_pipeline(psabpf_context_t *ctx);
 
+/**
+ * BTF and map descriptors are loaded once and reused by every object opened with
+ * the context. Call this after the pipeline has been reloaded by someone else,
+ * so stale maps and BTF are not used. Already opened objects are not affected.
+ *
+ * @param ctx
+ */
+void psabpf_context_invalidate_cache(psabpf_context_t *ctx);
+
+/**
+ * Same as psabpf_context_invalidate_cache(), but only when the pipeline has been
+ * unloaded or reloaded since the cache was filled. Costs a single stat(), so long
+ * running processes can call it before every operation.
+ *
+ * @param ctx
+ */
+void psabpf_context_revalidate_cache(psabpf_context_t *ctx);
+
+/**
+ * \brief          Threads. Object contexts (table, action selector, counter, register, meter) keep iteration state
+ *                 and scratch buffers, so each of them may be used by one thread at a time. To work from several
+ *                 threads open an object once and give every thread its own clone (psabpf_*_ctx_clone()).
+ *                 Clones share BTF and the compiled table layout and own duplicates of map descriptors,
+ *                 so cloning issues no map operations. Contexts and their clones may be freed in any order.
+ *
+ *                 Safe in parallel, each thread using its own context:
+ *                 - every read: get, get_next, dump of any object, also of the same object,
+ *                 - writes of exact and LPM table entries, counters, registers and meters, also to the same
+ *                   object; like in kernel, a single entry is updated atomically, the last write wins,
+ *                 - adding and removing action selector members and groups; references are reserved atomically,
+ *                 - transactions, every thread records only its own operations.
+ *
+ *                 Must be serialized by the caller:
+ *                 - opening objects (not cloning) with one PSABPF context and psabpf_context_invalidate_cache(),
+ *                   the context caches BTF and maps while objects are opened,
+ *                 - writes to one ternary table: the list of masks is mirrored by each context and loaded once,
+ *                   clone or open the table again to see masks added through another context,
+ *                 - adding and removing members of one action selector group, and removing a member which
+ *                   is being added to a group,
+ *                 - psabpf_table_shadow_begin() ... psabpf_table_shadow_commit() of one table,
+ *                 - pipeline load and unload, psabpf_set_map_backend(), psabpf_set_log_handler(),
+ *                   psabpf_set_log_level() and psabpf_stats_enable(), which change state of the whole process.
+ */
+
+/**
+ * \brief          Backend used by the whole process to access BPF maps. With emulation maps are kept
+ *                 in memory of the process, so the library works without privileges and kernel BPF:
+ *                 psabpf_pipeline_load() creates maps described in the ELF file and reads BTF from it,
+ *                 but programs are not loaded, so map initializer does not run and ports can't be added.
+ *                 Select backend before any context is used. Emulated maps can be used from many threads,
+ *                 operations on one map are serialized.
+ */
+typedef enum psabpf_map_backend {
+    PSABPF_MAP_BACKEND_KERNEL = 0,
+    PSABPF_MAP_BACKEND_EMULATION,
+} psabpf_map_backend_t;
+
+int psabpf_set_map_backend(psabpf_map_backend_t backend);
+psabpf_map_backend_t psabpf_get_map_backend(void);
+
+/**
+ * \brief          Messages of the library. A message is formatted and passed to the handler only when its level
+ *                 is enabled by psabpf_set_log_level() (up to PSABPF_LOG_INFO by default), so disabled ones,
+ *                 e.g. debug messages printed for every entry, cost a single comparison. The default handler
+ *                 writes to stderr at most PSABPF_LOG_RATE_LIMIT messages per second, number of dropped
+ *                 messages is reported with the next one written.
+ */
+typedef enum psabpf_log_level {
+    PSABPF_LOG_ERROR = 0,
+    PSABPF_LOG_WARNING,
+    PSABPF_LOG_INFO,
+    PSABPF_LOG_DEBUG,
+} psabpf_log_level_t;
+
+#define PSABPF_LOG_RATE_LIMIT 100
+
+/* Message has no trailing new line */
+typedef void (*psabpf_log_handler_t)(psabpf_log_level_t level, const char *message, void *user_data);
+
+/* NULL restores the default handler */
+void psabpf_set_log_handler(psabpf_log_handler_t handler, void *user_data);
+void psabpf_set_log_level(psabpf_log_level_t level);
+psabpf_log_level_t psabpf_get_log_level(void);
+
+/**
+ * \brief          Bump pointer allocator. Objects initialized with an arena (e.g. table entries,
+ *                 match keys, action params) take their memory from it, so no heap call is made per object.
+ *                 Memory is returned to the arena at once by psabpf_arena_reset(), which invalidates
+ *                 every object built on it. When blocks have been added, reset merges them into a single one,
+ *                 so after a warm up series of same-sized batches does not touch the heap.
+ */
+typedef struct psabpf_arena {
+    void *blocks;  /* current block first, for internal use */
+    size_t used;
+    size_t block_size;
+} psabpf_arena_t;
+
+void psabpf_arena_init(psabpf_arena_t *arena, size_t block_size);
+void psabpf_arena_free(psabpf_arena_t *arena);
+void psabpf_arena_reset(psabpf_arena_t *arena);
+/* Returned memory is aligned to max_align_t and not zeroed */
+void *psabpf_arena_alloc(psabpf_arena_t *arena, size_t size);
+
+/**
+ * \brief          Transaction over changes made by the calling thread to tables, counters, meters, registers,
+ *                 action selectors, value sets and PRE. Every change is applied immediately, but previous
+ *                 content of each modified map element is recorded, so psabpf_txn_rollback() restores state
+ *                 from before psabpf_txn_begin(), including partial changes left by a failed call.
+ *                 Table caches are cleared once, when the transaction is finished. Objects used in
+ *                 a transaction must not be modified by anyone else until it is finished.
+ */
+typedef struct psabpf_txn {
+    void *journal;  /* for internal use */
+} psabpf_txn_t;
+
+void psabpf_txn_init(psabpf_txn_t *txn);
+/* Transaction which is still in progress is rolled back */
+void psabpf_txn_free(psabpf_txn_t *txn);
+/* Only one transaction can be in progress in a thread */
+int psabpf_txn_begin(psabpf_txn_t *txn);
+int psabpf_txn_commit(psabpf_txn_t *txn);
+int psabpf_txn_rollback(psabpf_txn_t *txn);
+
 typedef enum psabpf_struct_field_type {
     PSABPF_STRUCT_FIELD_TYPE_UNKNOWN = 0,
     PSABPF_STRUCT_FIELD_TYPE_DATA,
@@ -157,6 +288,8 @@ typedef struct psabpf_counter_context {
 void psabpf_counter_ctx_init(psabpf_counter_context_t *ctx);
 void psabpf_counter_ctx_free(psabpf_counter_context_t *ctx);
 int psabpf_counter_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_counter_context_t *ctx, const char *name);
+/* For use in another thread, dst must be initialized, see "Threads" */
+int psabpf_counter_ctx_clone(psabpf_counter_context_t *dst, psabpf_counter_context_t *src);
 
 void psabpf_counter_entry_init(psabpf_counter_entry_t *entry);
 void psabpf_counter_entry_free(psabpf_counter_entry_t *entry);
@@ -202,6 +335,8 @@ typedef struct psabpf_register_context {
 void psabpf_register_ctx_init(psabpf_register_context_t *ctx);
 void psabpf_register_ctx_free(psabpf_register_context_t *ctx);
 int psabpf_register_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_register_context_t *ctx, const char *name);
+/* For use in another thread, dst must be initialized, see "Threads" */
+int psabpf_register_ctx_clone(psabpf_register_context_t *dst, psabpf_register_context_t *src);
 
 void psabpf_register_entry_init(psabpf_register_entry_t *entry);
 void psabpf_register_entry_free(psabpf_register_entry_t *entry);
@@ -261,6 +396,8 @@ psabpf_struct_field_t * psabpf_meter_entry_get_next_index_field(psabpf_meter_ctx
 void psabpf_meter_ctx_init(psabpf_meter_ctx_t *ctx);
 void psabpf_meter_ctx_free(psabpf_meter_ctx_t *ctx);
 int psabpf_meter_ctx_name(psabpf_meter_ctx_t *ctx, psabpf_context_t *psabpf_ctx, const char *name);
+/* For use in another thread, dst must be initialized, see "Threads" */
+int psabpf_meter_ctx_clone(psabpf_meter_ctx_t *dst, psabpf_meter_ctx_t *src);
 int psabpf_meter_entry_get(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry);
 psabpf_meter_entry_t *psabpf_meter_get_next(psabpf_meter_ctx_t *ctx);
 int psabpf_meter_entry_update(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry);
@@ -301,6 +438,9 @@ typedef struct psabpf_match_key {
         } range;
     } u;
 
+    /* when not NULL data and mask are allocated from arena */
+    psabpf_arena_t *arena;
+
     /* Used to tell whether allocated memory for this psabpf_match_key_t instance
      * can be freed or not. If true then this allocated memory can be freed. Otherwise, not.
      * In some cases weak copy of instance is returned to client of this API.
@@ -331,6 +471,9 @@ typedef struct psabpf_action {
 
     size_t n_params;
     psabpf_action_param_t *params;
+
+    /* when not NULL params array is allocated from arena */
+    psabpf_arena_t *arena;
 } psabpf_action_t;
 
 typedef struct psabpf_direct_counter_entry {
@@ -397,8 +540,26 @@ typedef struct psabpf_table_entry {
     psabpf_direct_counter_context_t current_direct_counter_ctx;
     size_t current_direct_meter_ctx_id;
     psabpf_direct_meter_context_t current_direct_meter_ctx;
+
+    /* when not NULL entry data and buffers used to write it are allocated from arena */
+    psabpf_arena_t *arena;
 } psabpf_table_entry_t;
 
+/* State of the batched iteration over table, see psabpf_table_entry_ctx_set_batch_size() */
+typedef struct psabpf_table_batch_iterator {
+    uint32_t batch_size;  /* requested entries per syscall, 0 disables batched iteration */
+    uint32_t capacity;    /* number of entries which fit into buffers */
+    uint32_t count;
+    uint32_t position;
+    void *keys;
+    void *values;
+    void *in_token;
+    void *out_token;
+    bool started;
+    bool finished;
+    bool not_supported;
+} psabpf_table_batch_iterator_t;
+
 /*
  * TODO: specific fields of table entry context are still to be added.
  * The table entry context may store information about a table itself (e.g. key size, num of entries, etc.).
@@ -413,9 +574,12 @@ typedef struct psabpf_table_entry_context {
     /* for ternary tables */
     psabpf_bpf_map_descriptor_t prefixes;
     psabpf_bpf_map_descriptor_t tuple_map;
+    struct psabpf_ternary_prefixes *prefixes_mirror;  /* NULL until first use */
 
     /* for cache maintenance */
     psabpf_bpf_map_descriptor_t cache;
+    bool defer_cache_invalidation;
+    bool cache_invalidation_pending;
 
     psabpf_btf_t btf_metadata;
 
@@ -436,17 +600,77 @@ typedef struct psabpf_table_entry_context {
     void *current_raw_key;
     void *current_raw_key_mask;
     psabpf_table_entry_t current_entry;
+    psabpf_table_batch_iterator_t batch_iter;
+
+    /* Precompiled key/value layout, NULL when not available */
+    struct psabpf_table_layout *layout;
+
+    /* for tables which can be swapped at once, NULL otherwise */
+    struct psabpf_table_shadow *shadow;
 } psabpf_table_entry_ctx_t;
 
 void psabpf_table_entry_ctx_init(psabpf_table_entry_ctx_t *ctx);
 void psabpf_table_entry_ctx_free(psabpf_table_entry_ctx_t *ctx);
 int psabpf_table_entry_ctx_tblname(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *ctx, const char *name);
+/* Opens the same table for use in another thread, dst must be initialized. BTF and the compiled layout are
+ * shared, map descriptors are duplicated, iteration state and cache of ternary masks start empty. Context
+ * can't be cloned while its shadow table is being built (EBUSY). See "Threads" above. */
+int psabpf_table_entry_ctx_clone(psabpf_table_entry_ctx_t *dst, psabpf_table_entry_ctx_t *src);
 void psabpf_table_entry_ctx_mark_indirect(psabpf_table_entry_ctx_t *ctx);
 bool psabpf_table_entry_ctx_is_indirect(psabpf_table_entry_ctx_t *ctx);
 bool psabpf_table_entry_ctx_has_priority(psabpf_table_entry_ctx_t *ctx);
+/* Number of entries read from kernel at once by psabpf_table_entry_get_next(), 0 disables batching.
+ * Batched iteration is not used for ternary tables and falls back to per-entry mode on older kernels. */
+#define PSABPF_TABLE_DEFAULT_BATCH_SIZE 256
+void psabpf_table_entry_ctx_set_batch_size(psabpf_table_entry_ctx_t *ctx, uint32_t batch_size);
+/* After single entry change only affected flows are removed from the table cache. When invalidation
+ * is deferred, cache is cleared once in psabpf_table_entry_ctx_flush_cache() (or when context is freed),
+ * use it for a series of changes, e.g. batch or transaction. */
+void psabpf_table_entry_ctx_defer_cache_invalidation(psabpf_table_entry_ctx_t *ctx, bool defer);
+int psabpf_table_entry_ctx_flush_cache(psabpf_table_entry_ctx_t *ctx);
+
+/* Hitless replacement of the whole table. It requires the table to be accessed by the data plane through
+ * slot 0 of "<name>_outer" map (array or hash of maps, inner map template pinned as "<name>"), see
+ * psabpf_table_entry_ctx_has_shadow(). Between begin and commit every operation on the context goes to
+ * a new, empty table (use batch API to fill it), invisible to the data plane. Commit publishes it with
+ * a single update of the outer map and releases the previous instance, abort drops the shadow table.
+ * Default entry is not a part of the swapped table. */
+bool psabpf_table_entry_ctx_has_shadow(psabpf_table_entry_ctx_t *ctx);
+int psabpf_table_shadow_begin(psabpf_table_entry_ctx_t *ctx);
+int psabpf_table_shadow_commit(psabpf_table_entry_ctx_t *ctx);
+void psabpf_table_shadow_abort(psabpf_table_entry_ctx_t *ctx);
+
+/* Ternary tables: data plane searches masks (tuples) in the list order, so the library keeps masks
+ * sorted by the highest priority of entries in each tuple when a new mask is added. Priorities of tuples
+ * are known to a context which created the first mask or called psabpf_table_ternary_reorder() or
+ * psabpf_table_ternary_get_stats() (these read the whole table), otherwise a new mask is added at the end.
+ * Changes of priority in existing tuples are also applied by psabpf_table_ternary_reorder(). */
+typedef struct psabpf_table_tuple_stats {
+    uint32_t tuple_id;
+    uint32_t n_entries;
+    uint32_t max_priority;
+} psabpf_table_tuple_stats_t;
+
+typedef struct psabpf_table_ternary_stats {
+    size_t chain_length;  /* number of masks walked by the data plane */
+    psabpf_table_tuple_stats_t *tuples;  /* in the data plane order */
+} psabpf_table_ternary_stats_t;
+
+int psabpf_table_ternary_get_stats(psabpf_table_entry_ctx_t *ctx, psabpf_table_ternary_stats_t *stats);
+void psabpf_table_ternary_stats_free(psabpf_table_ternary_stats_t *stats);
+/* Masks are moved one by one, every move takes up to five map updates. During a move the list of masks
+ * ends in a cycle through all of them, so the data plane never misses a mask, but it may visit masks
+ * twice, up to its limit of tuples per lookup (the limit must not be lower than the number of masks). */
+int psabpf_table_ternary_reorder(psabpf_table_entry_ctx_t *ctx);
 
 void psabpf_table_entry_init(psabpf_table_entry_t *entry);
 void psabpf_table_entry_free(psabpf_table_entry_t *entry);
+/* Entry, its arrays of keys, direct counters and meters and its write buffers are allocated from arena.
+ * Use together with psabpf_matchkey_init_arena(), psabpf_action_init_arena() and
+ * psabpf_action_param_create_arena() to build entries without heap calls. */
+void psabpf_table_entry_init_arena(psabpf_table_entry_t *entry, psabpf_arena_t *arena);
+/* Clears entry for reuse, entry stays bound to its arena */
+void psabpf_table_entry_reset(psabpf_table_entry_t *entry);
 
 /* can be invoked multiple times */
 int psabpf_table_entry_matchkey(psabpf_table_entry_t *entry, psabpf_match_key_t *mk);
@@ -458,6 +682,7 @@ void psabpf_table_entry_priority(psabpf_table_entry_t *entry, uint32_t priority)
 uint32_t psabpf_table_entry_get_priority(psabpf_table_entry_t *entry);
 
 void psabpf_matchkey_init(psabpf_match_key_t *mk);
+void psabpf_matchkey_init_arena(psabpf_match_key_t *mk, psabpf_arena_t *arena);
 void psabpf_matchkey_free(psabpf_match_key_t *mk);
 void psabpf_matchkey_type(psabpf_match_key_t *mk, enum psabpf_matchkind_t type);
 int psabpf_matchkey_data(psabpf_match_key_t *mk, const char *data, size_t size);
@@ -479,6 +704,8 @@ int psabpf_matchkey_start(psabpf_match_key_t *mk, uint64_t start);
 int psabpf_matchkey_end(psabpf_match_key_t *mk, uint64_t end);
 
 int psabpf_action_param_create(psabpf_action_param_t *param, const char *data, size_t size);
+int psabpf_action_param_create_arena(psabpf_action_param_t *param, psabpf_arena_t *arena,
+                                     const char *data, size_t size);
 /* should be called when psabpf_action_param() is not called after psabpf_action_param_create() */
 void psabpf_action_param_free(psabpf_action_param_t *param);
 
@@ -491,6 +718,7 @@ size_t psabpf_action_param_get_data_len(psabpf_action_param_t *param);
 const char *psabpf_action_param_get_name(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, psabpf_action_param_t *param);
 
 void psabpf_action_init(psabpf_action_t *action);
+void psabpf_action_init_arena(psabpf_action_t *action, psabpf_arena_t *arena);
 void psabpf_action_free(psabpf_action_t *action);
 void psabpf_action_set_id(psabpf_action_t *action, uint32_t action_id);
 #define PSABPF_INVALID_ACTION_ID 0xFFFFFFFF
@@ -502,10 +730,58 @@ const char *psabpf_action_get_name(psabpf_table_entry_ctx_t *ctx, uint32_t actio
 
 int psabpf_table_entry_add(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
 int psabpf_table_entry_update(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
+/* Write many entries at once. Status of every entry is stored in the status array (if not NULL),
+ * returns the first error encountered. Cache of the table is cleared only once per call. */
+int psabpf_table_entry_add_batch(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries,
+                                 size_t n_entries, int *status);
+int psabpf_table_entry_update_batch(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries,
+                                    size_t n_entries, int *status);
 int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
 int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
 psabpf_table_entry_t *psabpf_table_entry_get_next(psabpf_table_entry_ctx_t *ctx);
 
+/* Makes content of the table equal to the given entries with the minimal set of batched writes: entries
+ * missing in the table are added, different ones updated and the others deleted (elements of array are
+ * cleared). Raw keys and values are compared; direct counters and meters not provided in an entry are
+ * preserved. An entry which repeats the key of a previous one fails with EINVAL. Ternary tables are not
+ * supported. Returns the first error, stats may be NULL. */
+typedef struct psabpf_table_reconcile_stats {
+    size_t n_added;
+    size_t n_updated;
+    size_t n_deleted;
+    size_t n_unchanged;
+    size_t n_failed;
+    uint64_t elapsed_ns;
+} psabpf_table_reconcile_stats_t;
+
+int psabpf_table_reconcile(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries, size_t n_entries,
+                           psabpf_table_reconcile_stats_t *stats);
+
+/* Raw view of a table entry, without decoding. Pointers refer to buffers of the table context and are valid
+ * until the next call to psabpf_table_entry_view_next() or psabpf_table_entry_get_next(); both share the
+ * iteration state, so do not mix them. Key and mask are stored like in the map (masked for ternary tables),
+ * mask is NULL for non-ternary tables. */
+typedef struct psabpf_table_entry_view {
+    const void *key;
+    const void *mask;
+    const void *value;
+    size_t key_size;
+    size_t value_size;
+} psabpf_table_entry_view_t;
+
+/* Returns ENODATA after the last entry, next call starts from the beginning */
+int psabpf_table_entry_view_next(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view);
+/* Accessors decode only the requested field, key fields and action params require BTF */
+uint32_t psabpf_table_entry_view_get_action_id(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view);
+uint32_t psabpf_table_entry_view_get_priority(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view);
+int psabpf_table_entry_view_get_key_field(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                          size_t index, const void **data, size_t *size);
+int psabpf_table_entry_view_get_action_param(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                             size_t index, const void **data, size_t *size);
+/* Full decode, e.g. into an entry bound to arena */
+int psabpf_table_entry_view_decode(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                   psabpf_table_entry_t *entry);
+
 int psabpf_table_entry_set_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
 int psabpf_table_entry_get_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry);
 
@@ -568,6 +844,8 @@ typedef struct psabpf_action_selector_context {
 void psabpf_action_selector_ctx_init(psabpf_action_selector_context_t *ctx);
 void psabpf_action_selector_ctx_free(psabpf_action_selector_context_t *ctx);
 int psabpf_action_selector_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_action_selector_context_t *ctx, const char *name);
+/* For use in another thread, dst must be initialized, see "Threads" */
+int psabpf_action_selector_ctx_clone(psabpf_action_selector_context_t *dst, psabpf_action_selector_context_t *src);
 
 void psabpf_action_selector_member_init(psabpf_action_selector_member_context_t *member);
 void psabpf_action_selector_member_free(psabpf_action_selector_member_context_t *member);
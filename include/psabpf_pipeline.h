@@ -24,6 +24,11 @@ int psabpf_pipeline_unload(psabpf_context_t *ctx);
 int psabpf_pipeline_add_port(psabpf_context_t *ctx, const char *interface, int *port_id);
 int psabpf_pipeline_del_port(psabpf_context_t *ctx, const char *interface);
 
+/* Saves content of all pipeline maps into a binary file. Restore replaces content of maps
+ * with the one from file; maps which no longer exist or changed their layout are skipped. */
+int psabpf_pipeline_snapshot_save(psabpf_context_t *ctx, const char *file);
+int psabpf_pipeline_snapshot_restore(psabpf_context_t *ctx, const char *file);
+
 typedef struct psabpf_port_spec {
     const char *name;
     unsigned id;
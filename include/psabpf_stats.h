@@ -0,0 +1,142 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PSABPF_STATS_H
+#define __PSABPF_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \brief          Instrumentation of the library, counted for the whole process. Disabled by default,
+ *                 then the only cost is a single branch per operation. When enabled, every map operation
+ *                 (with kernel backend each one is a single bpf() syscall, except path_exists which is stat())
+ *                 is timed and counted, so is every high-level operation listed below. High-level operations
+ *                 include time and map operations of the nested ones, e.g. table_buffer_build is also part
+ *                 of table_entry_add.
+ */
+
+/* Map operations, see psabpf_map_ops_t */
+typedef enum psabpf_stats_map_op {
+    PSABPF_STATS_MAP_OBJ_GET = 0,
+    PSABPF_STATS_MAP_OBJ_PIN,
+    PSABPF_STATS_MAP_PATH_EXISTS,
+    PSABPF_STATS_MAP_OBJ_GET_INFO_BY_FD,
+    PSABPF_STATS_MAP_GET_FD_BY_ID,
+    PSABPF_STATS_MAP_CREATE_MAP,
+    PSABPF_STATS_MAP_LOOKUP_ELEM,
+    PSABPF_STATS_MAP_LOOKUP_ELEM_FLAGS,
+    PSABPF_STATS_MAP_LOOKUP_AND_DELETE_ELEM,
+    PSABPF_STATS_MAP_UPDATE_ELEM,
+    PSABPF_STATS_MAP_DELETE_ELEM,
+    PSABPF_STATS_MAP_GET_NEXT_KEY,
+    PSABPF_STATS_MAP_LOOKUP_BATCH,
+    PSABPF_STATS_MAP_LOOKUP_AND_DELETE_BATCH,
+    PSABPF_STATS_MAP_UPDATE_BATCH,
+    PSABPF_STATS_MAP_DELETE_BATCH,
+    PSABPF_STATS_MAP_OP_COUNT,
+} psabpf_stats_map_op_t;
+
+/* High-level operations, named after the API functions; the last ones are internal steps of them */
+typedef enum psabpf_stats_op {
+    PSABPF_STATS_TABLE_CTX_OPEN = 0,
+    PSABPF_STATS_TABLE_ENTRY_ADD,
+    PSABPF_STATS_TABLE_ENTRY_UPDATE,
+    PSABPF_STATS_TABLE_ENTRY_DEL,
+    PSABPF_STATS_TABLE_ENTRY_GET,
+    PSABPF_STATS_TABLE_ENTRY_GET_NEXT,
+    PSABPF_STATS_TABLE_ENTRY_VIEW_NEXT,
+    PSABPF_STATS_TABLE_ENTRY_ADD_BATCH,
+    PSABPF_STATS_TABLE_ENTRY_UPDATE_BATCH,
+    PSABPF_STATS_TABLE_SET_DEFAULT_ENTRY,
+    PSABPF_STATS_TABLE_GET_DEFAULT_ENTRY,
+    PSABPF_STATS_COUNTER_CTX_OPEN,
+    PSABPF_STATS_COUNTER_GET,
+    PSABPF_STATS_COUNTER_GET_NEXT,
+    PSABPF_STATS_COUNTER_SET,
+    PSABPF_STATS_COUNTER_RESET,
+    PSABPF_STATS_REGISTER_CTX_OPEN,
+    PSABPF_STATS_REGISTER_GET,
+    PSABPF_STATS_REGISTER_SET,
+    PSABPF_STATS_METER_CTX_OPEN,
+    PSABPF_STATS_METER_GET,
+    PSABPF_STATS_METER_GET_NEXT,
+    PSABPF_STATS_METER_UPDATE,
+    PSABPF_STATS_METER_RESET,
+    PSABPF_STATS_DIGEST_CTX_OPEN,
+    PSABPF_STATS_DIGEST_GET_NEXT,
+    PSABPF_STATS_ACTION_SELECTOR_CTX_OPEN,
+    PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER,
+    PSABPF_STATS_ACTION_SELECTOR_UPDATE_MEMBER,
+    PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER,
+    PSABPF_STATS_ACTION_SELECTOR_ADD_GROUP,
+    PSABPF_STATS_ACTION_SELECTOR_DEL_GROUP,
+    PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER_TO_GROUP,
+    PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER_FROM_GROUP,
+    PSABPF_STATS_CLONE_SESSION_CREATE,
+    PSABPF_STATS_CLONE_SESSION_DELETE,
+    PSABPF_STATS_CLONE_SESSION_ENTRY_UPDATE,
+    PSABPF_STATS_CLONE_SESSION_ENTRY_DELETE,
+    PSABPF_STATS_MCAST_GRP_CREATE,
+    PSABPF_STATS_MCAST_GRP_DELETE,
+    PSABPF_STATS_MCAST_GRP_MEMBER_UPDATE,
+    PSABPF_STATS_MCAST_GRP_MEMBER_DELETE,
+    PSABPF_STATS_PIPELINE_LOAD,
+    PSABPF_STATS_PIPELINE_UNLOAD,
+    /* Internal steps */
+    PSABPF_STATS_BTF_LOAD,
+    PSABPF_STATS_TABLE_BUFFER_BUILD,
+    PSABPF_STATS_TABLE_CACHE_CLEAR,
+    PSABPF_STATS_OP_COUNT,
+} psabpf_stats_op_t;
+
+/* Bucket 0 counts calls shorter than 1 ns, bucket i calls which took from 2^(i-1) to 2^i - 1 ns,
+ * the last bucket counts also every longer call (above ~1 s). */
+#define PSABPF_STATS_HISTOGRAM_BUCKETS 32
+
+typedef struct psabpf_stats_entry {
+    uint64_t calls;
+    /* Failed map operations, including expected ones like ENOENT at the end of iteration.
+     * Not counted for high-level operations. */
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    /* Map operations issued, for a map operation equal to calls */
+    uint64_t map_ops;
+    /* Keys and values copied to or from maps, counted for maps whose sizes were read by the library */
+    uint64_t bytes;
+    uint64_t histogram[PSABPF_STATS_HISTOGRAM_BUCKETS];
+} psabpf_stats_entry_t;
+
+typedef struct psabpf_stats {
+    bool enabled;
+    psabpf_stats_entry_t map_ops[PSABPF_STATS_MAP_OP_COUNT];
+    psabpf_stats_entry_t ops[PSABPF_STATS_OP_COUNT];
+} psabpf_stats_t;
+
+/* Collected values are kept when disabled. Sizes of maps are learned when they are opened,
+ * so bytes are not counted for objects opened before stats were enabled. */
+void psabpf_stats_enable(bool enable);
+bool psabpf_stats_is_enabled(void);
+/* Not atomic with regard to operations running concurrently in other threads */
+void psabpf_stats_reset(void);
+void psabpf_stats_get(psabpf_stats_t *stats);
+
+const char *psabpf_stats_map_op_name(psabpf_stats_map_op_t op);
+const char *psabpf_stats_op_name(psabpf_stats_op_t op);
+
+#endif  /* __PSABPF_STATS_H */
@@ -17,7 +17,10 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <bpf/bpf.h>
 #include <bpf/btf.h>
 #include <linux/bpf.h>
@@ -27,6 +30,8 @@
 #include "btf.h"
 #include "common.h"
 #include "bpf_defs.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 static uint32_t follow_types(struct btf *btf, uint32_t type_id)
 {
@@ -45,68 +50,205 @@ static uint32_t follow_types(struct btf *btf, uint32_t type_id)
     return type_id;
 }
 
-static uint32_t find_data_section_type_id(struct btf *btf, uint32_t sec_type_id, const char *name)
+const struct btf_type *psabtf_get_type_by_id(struct btf *btf, uint32_t type_id)
 {
-    const struct btf_type *type = btf__type_by_id(btf, sec_type_id);
-    if (type == NULL)
-        return 0;
+    type_id = follow_types(btf, type_id);
+    if (type_id == 0)
+        return NULL;
+    return btf__type_by_id(btf, type_id);
+}
 
-    if (!btf_is_datasec(type))
-        return 0;
+/* Open addressing hash table, names point to the string section of BTF */
+typedef struct psabtf_name_index {
+    size_t mask;
+    const char **names;
+    uint32_t *type_ids;
+} psabtf_name_index_t;
+
+typedef struct psabtf_index {
+    psabtf_name_index_t types;
+    psabtf_name_index_t maps;
+} psabtf_index_t;
 
-    unsigned entries = btf_vlen(type);
-    const struct btf_var_secinfo *info = btf_var_secinfos(type);
+static uint64_t hash_name(const char *name)
+{
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *name != '\0'; name++) {
+        hash ^= (uint8_t) *name;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-    for (unsigned i = 0; i < entries; i++, info++) {
-        const struct btf_type *entry_type = btf__type_by_id(btf, info->type);
+static int name_index_init(psabtf_name_index_t *index, size_t expected_entries)
+{
+    size_t buckets = 16;
+    while (buckets < 2 * expected_entries)
+        buckets *= 2;
 
-        const char *entry_name = btf__name_by_offset(btf, entry_type->name_off);
-        if (entry_name != NULL && name != NULL) {
-            if (strcmp(entry_name, name) == 0) {
-                return entry_type->type;
-            }
-        }
+    index->names = calloc(buckets, sizeof(const char *));
+    index->type_ids = calloc(buckets, sizeof(uint32_t));
+    if (index->names == NULL || index->type_ids == NULL)
+        return ENOMEM;
+    index->mask = buckets - 1;
+
+    return NO_ERROR;
+}
+
+static void name_index_free(psabtf_name_index_t *index)
+{
+    if (index->names != NULL)
+        free(index->names);
+    if (index->type_ids != NULL)
+        free(index->type_ids);
+    index->names = NULL;
+    index->type_ids = NULL;
+}
+
+/* Keeps the first inserted type, this is how linear scan used to work */
+static void name_index_insert(psabtf_name_index_t *index, const char *name, uint32_t type_id)
+{
+    size_t bucket = hash_name(name) & index->mask;
+    while (index->names[bucket] != NULL) {
+        if (strcmp(index->names[bucket], name) == 0)
+            return;
+        bucket = (bucket + 1) & index->mask;
+    }
+    index->names[bucket] = name;
+    index->type_ids[bucket] = type_id;
+}
+
+static uint32_t name_index_find(psabtf_name_index_t *index, const char *name)
+{
+    if (index->names == NULL || name == NULL)
+        return 0;
+
+    size_t bucket = hash_name(name) & index->mask;
+    while (index->names[bucket] != NULL) {
+        if (strcmp(index->names[bucket], name) == 0)
+            return index->type_ids[bucket];
+        bucket = (bucket + 1) & index->mask;
     }
 
     return 0;
 }
 
-const struct btf_type *psabtf_get_type_by_id(struct btf *btf, uint32_t type_id)
+static void free_btf_index(psabpf_btf_t *btf)
 {
-    type_id = follow_types(btf, type_id);
-    if (type_id == 0)
-        return NULL;
-    return btf__type_by_id(btf, type_id);
+    psabtf_index_t *index = btf->index;
+    if (index == NULL)
+        return;
+
+    name_index_free(&index->types);
+    name_index_free(&index->maps);
+    free(index);
+    btf->index = NULL;
+}
+
+/* BTF owned by psabpf context and borrowed by object contexts. It is not modified after it is loaded,
+ * so contexts cloned into other threads use it concurrently, only the reference counter is atomic. */
+typedef struct psabtf_shared {
+    unsigned refcount;
+    psabpf_btf_t btf;
+    ino_t pipeline_dir;
+} psabtf_shared_t;
+
+/* Directory with pinned objects is created again when pipeline is reloaded, so it identifies pipeline instance */
+static ino_t get_pipeline_dir_inode(psabpf_context_t *psabpf_ctx)
+{
+    char path[256];
+    struct stat dir_stat;
+
+    build_ebpf_pipeline_path(path, sizeof(path), psabpf_ctx);
+    if (stat(path, &dir_stat) != 0)
+        return 0;
+
+    return dir_stat.st_ino;
 }
 
-static uint32_t psabtf_get_map_type_id_by_name(struct btf *btf, const char *name)
+static int build_btf_index(psabpf_btf_t *btf)
 {
-    uint32_t type_id = 0;
-    unsigned nodes = btf__get_nr_types(btf);
+    if (btf->index != NULL)
+        return NO_ERROR;
+    if (btf->btf == NULL)
+        return ENOENT;
+
+    /* Borrowed BTF shares also the index, which is built when BTF is loaded. It is never built later,
+     * because borrowers may run in different threads. */
+    if (btf->shared != NULL) {
+        btf->index = ((psabtf_shared_t *) btf->shared)->btf.index;
+        return btf->index != NULL ? NO_ERROR : ENOENT;
+    }
+
+    psabtf_index_t *index = calloc(1, sizeof(psabtf_index_t));
+    if (index == NULL)
+        return ENOMEM;
+    btf->index = index;
+
+    unsigned nodes = btf__get_nr_types(btf->btf);
+    uint32_t maps_sec_id = 0;
+    if (name_index_init(&index->types, nodes) != NO_ERROR)
+        goto no_memory;
 
-    /* First find ".maps" section to avoid false positive match to name */
     for (unsigned i = 1; i <= nodes; i++) {
-        const struct btf_type *type = btf__type_by_id(btf, i);
-        if (!type->name_off)
+        const struct btf_type *type = btf__type_by_id(btf->btf, i);
+        if (type == NULL || !type->name_off)
             continue;
-        const char *type_name = btf__name_by_offset(btf, type->name_off);
-        if (type_name == NULL)
+        const char *type_name = btf__name_by_offset(btf->btf, type->name_off);
+        if (type_name == NULL || type_name[0] == '\0')
             continue;
-        if (strcmp(type_name, ".maps") == 0) {
-            type_id = i;
-            break;
-        }
+        name_index_insert(&index->types, type_name, i);
+        if (maps_sec_id == 0 && btf_is_datasec(type) && strcmp(type_name, ".maps") == 0)
+            maps_sec_id = i;
+    }
+
+    /* Section with maps is optional here, error is reported when map is looked up */
+    const struct btf_type *maps_sec = maps_sec_id != 0 ? btf__type_by_id(btf->btf, maps_sec_id) : NULL;
+    unsigned n_maps = maps_sec != NULL ? btf_vlen(maps_sec) : 0;
+    if (name_index_init(&index->maps, n_maps) != NO_ERROR)
+        goto no_memory;
+
+    const struct btf_var_secinfo *info = maps_sec != NULL ? btf_var_secinfos(maps_sec) : NULL;
+    for (unsigned i = 0; i < n_maps; i++, info++) {
+        const struct btf_type *var_type = btf__type_by_id(btf->btf, info->type);
+        if (var_type == NULL)
+            continue;
+        const char *map_name = btf__name_by_offset(btf->btf, var_type->name_off);
+        if (map_name == NULL || map_name[0] == '\0')
+            continue;
+        name_index_insert(&index->maps, map_name, follow_types(btf->btf, var_type->type));
     }
 
-    if (type_id == 0) {
-        fprintf(stderr, "section with maps definitions was not found, BTF is invalid or bug?");
+    return NO_ERROR;
+
+no_memory:
+    pr_err("not enough memory\n");
+    free_btf_index(btf);
+    return ENOMEM;
+}
+
+uint32_t psabtf_get_type_id_by_name(psabpf_btf_t *btf, const char *name)
+{
+    if (btf == NULL || build_btf_index(btf) != NO_ERROR)
+        return 0;
+
+    return name_index_find(&((psabtf_index_t *) btf->index)->types, name);
+}
+
+static uint32_t psabtf_get_map_type_id_by_name(psabpf_btf_t *btf, const char *name)
+{
+    if (build_btf_index(btf) != NO_ERROR)
+        return 0;
+
+    psabtf_index_t *index = btf->index;
+    if (psabtf_get_type_id_by_name(btf, ".maps") == 0) {
+        pr_err("section with maps definitions was not found, BTF is invalid or bug?");
         return 0;
     }
 
     /* find our map in maps section */
-    type_id = find_data_section_type_id(btf, type_id, name);
-
-    return follow_types(btf, type_id);
+    return name_index_find(&index->maps, name);
 }
 
 int psabtf_get_member_md_by_name(struct btf *btf, uint32_t type_id,
@@ -201,7 +343,7 @@ size_t psabtf_get_type_size_by_id(struct btf *btf, uint32_t type_id)
         }
 
         default:
-            fprintf(stderr, "unable to obtain type size\n");
+            pr_err("unable to obtain type size\n");
     }
 
     return 0;
@@ -212,6 +354,8 @@ void init_btf(psabpf_btf_t *btf)
     btf->btf = NULL;
     btf->associated_prog = -1;
     btf->btf_fd = -1;
+    btf->index = NULL;
+    btf->shared = NULL;
 }
 
 static int try_load_btf(psabpf_btf_t *btf, const char *program_name)
@@ -245,15 +389,21 @@ free_program:
     return ENOENT;
 }
 
-int load_btf(psabpf_context_t *psabpf_ctx, psabpf_btf_t *btf)
+static int load_btf_from_pipeline(psabpf_context_t *psabpf_ctx, psabpf_btf_t *btf)
 {
-    if (btf->btf != NULL)
-        return NO_ERROR;
+    STATS_SCOPE(PSABPF_STATS_BTF_LOAD);
 
     char program_file_name[256];
     const char *programs_to_search[] = { TC_INGRESS_PROG, XDP_INGRESS_PROG, TC_EGRESS_PROG };
     int number_of_programs = sizeof(programs_to_search) / sizeof(programs_to_search[0]);
 
+    /* Emulated pipeline has no programs */
+    if (map_ops_emulated()) {
+        build_ebpf_pipeline_path(program_file_name, sizeof(program_file_name), psabpf_ctx);
+        btf->btf = emulation_load_pipeline_btf(program_file_name);
+        return btf->btf != NULL ? NO_ERROR : ENOENT;
+    }
+
     for (int i = 0; i < number_of_programs; i++) {
         snprintf(program_file_name, sizeof(program_file_name), "%s/%s%u/%s",
                  BPF_FS, PIPELINE_PREFIX, psabpf_context_get_pipeline(psabpf_ctx), programs_to_search[i]);
@@ -266,11 +416,72 @@ int load_btf(psabpf_context_t *psabpf_ctx, psabpf_btf_t *btf)
     return NO_ERROR;
 }
 
+static void release_shared_btf(psabtf_shared_t *shared)
+{
+    if (shared == NULL || __atomic_sub_fetch(&shared->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    free_btf(&shared->btf);
+    free(shared);
+}
+
+int load_btf(psabpf_context_t *psabpf_ctx, psabpf_btf_t *btf)
+{
+    if (btf->btf != NULL)
+        return NO_ERROR;
+
+    /* BTF is loaded only once per psabpf context, object contexts borrow it */
+    psabtf_shared_t *shared = psabpf_ctx->btf_cache;
+    if (shared == NULL) {
+        shared = malloc(sizeof(psabtf_shared_t));
+        if (shared == NULL)
+            return ENOMEM;
+        init_btf(&shared->btf);
+        if (load_btf_from_pipeline(psabpf_ctx, &shared->btf) != NO_ERROR) {
+            free(shared);
+            return ENOENT;
+        }
+        /* Every borrower will use it, so build it now. Index is optional. */
+        build_btf_index(&shared->btf);
+        shared->refcount = 1;
+        shared->pipeline_dir = get_pipeline_dir_inode(psabpf_ctx);
+        psabpf_ctx->btf_cache = shared;
+    }
+
+    __atomic_fetch_add(&shared->refcount, 1, __ATOMIC_RELAXED);
+    *btf = shared->btf;
+    btf->shared = shared;
+
+    return NO_ERROR;
+}
+
+int borrow_btf(psabpf_btf_t *dst, const psabpf_btf_t *src)
+{
+    init_btf(dst);
+    if (src->btf == NULL)
+        return NO_ERROR;
+    /* BTF owned by a single object context can't be shared */
+    if (src->shared == NULL)
+        return ENOTSUP;
+
+    __atomic_fetch_add(&((psabtf_shared_t *) src->shared)->refcount, 1, __ATOMIC_RELAXED);
+    *dst = *src;
+
+    return NO_ERROR;
+}
+
 void free_btf(psabpf_btf_t *btf)
 {
     if (btf == NULL)
         return;
 
+    if (btf->shared != NULL) {
+        release_shared_btf(btf->shared);
+        init_btf(btf);
+        return;
+    }
+
+    free_btf_index(btf);
     if (btf->btf)
         btf__free(btf->btf);
     btf->btf = NULL;
@@ -278,6 +489,127 @@ void free_btf(psabpf_btf_t *btf)
     close_object_fd(&btf->btf_fd);
 }
 
+/* Opened maps, every entry owns its file descriptor */
+typedef struct psabpf_map_cache_entry {
+    char *name;
+    psabpf_bpf_map_descriptor_t md;
+} psabpf_map_cache_entry_t;
+
+typedef struct psabpf_map_cache {
+    size_t n_entries;
+    size_t capacity;
+    psabpf_map_cache_entry_t *entries;
+    psabtf_name_index_t index;  /* name -> entry index + 1 */
+    ino_t pipeline_dir;
+} psabpf_map_cache_t;
+
+static psabpf_map_cache_entry_t *map_cache_find(psabpf_context_t *psabpf_ctx, const char *name)
+{
+    psabpf_map_cache_t *cache = psabpf_ctx->map_cache;
+    if (cache == NULL)
+        return NULL;
+
+    uint32_t idx = name_index_find(&cache->index, name);
+    if (idx == 0)
+        return NULL;
+
+    return &cache->entries[idx - 1];
+}
+
+static int map_cache_rebuild_index(psabpf_map_cache_t *cache, size_t expected_entries)
+{
+    psabtf_name_index_t new_index = {};
+    if (name_index_init(&new_index, expected_entries) != NO_ERROR) {
+        name_index_free(&new_index);
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < cache->n_entries; i++)
+        name_index_insert(&new_index, cache->entries[i].name, i + 1);
+
+    name_index_free(&cache->index);
+    cache->index = new_index;
+
+    return NO_ERROR;
+}
+
+static void map_cache_insert(psabpf_context_t *psabpf_ctx, const char *name, psabpf_bpf_map_descriptor_t *md)
+{
+    psabpf_map_cache_t *cache = psabpf_ctx->map_cache;
+    if (cache == NULL) {
+        cache = calloc(1, sizeof(psabpf_map_cache_t));
+        if (cache == NULL)
+            return;
+        cache->pipeline_dir = get_pipeline_dir_inode(psabpf_ctx);
+        psabpf_ctx->map_cache = cache;
+    }
+
+    if (cache->n_entries == cache->capacity) {
+        size_t new_capacity = cache->capacity == 0 ? 16 : 2 * cache->capacity;
+        psabpf_map_cache_entry_t *entries = realloc(cache->entries, new_capacity * sizeof(psabpf_map_cache_entry_t));
+        if (entries == NULL)
+            return;
+        cache->entries = entries;
+        cache->capacity = new_capacity;
+        if (map_cache_rebuild_index(cache, new_capacity) != NO_ERROR)
+            return;
+    }
+
+    psabpf_map_cache_entry_t *entry = &cache->entries[cache->n_entries];
+    entry->name = strdup(name);
+    entry->md = *md;
+    entry->md.fd = dup(md->fd);
+    if (entry->name == NULL || entry->md.fd < 0) {
+        if (entry->name != NULL)
+            free(entry->name);
+        close_object_fd(&entry->md.fd);
+        return;
+    }
+
+    cache->n_entries++;
+    name_index_insert(&cache->index, entry->name, cache->n_entries);
+}
+
+static void free_map_cache(psabpf_context_t *psabpf_ctx)
+{
+    psabpf_map_cache_t *cache = psabpf_ctx->map_cache;
+    if (cache == NULL)
+        return;
+
+    for (size_t i = 0; i < cache->n_entries; i++) {
+        free(cache->entries[i].name);
+        close_object_fd(&cache->entries[i].md.fd);
+    }
+    if (cache->entries != NULL)
+        free(cache->entries);
+    name_index_free(&cache->index);
+    free(cache);
+    psabpf_ctx->map_cache = NULL;
+}
+
+void invalidate_context_cache(psabpf_context_t *psabpf_ctx)
+{
+    if (psabpf_ctx == NULL)
+        return;
+
+    free_map_cache(psabpf_ctx);
+    release_shared_btf(psabpf_ctx->btf_cache);
+    psabpf_ctx->btf_cache = NULL;
+}
+
+void revalidate_context_cache(psabpf_context_t *psabpf_ctx)
+{
+    psabtf_shared_t *shared = psabpf_ctx->btf_cache;
+    psabpf_map_cache_t *maps = psabpf_ctx->map_cache;
+    if (shared == NULL && maps == NULL)
+        return;
+
+    ino_t current = get_pipeline_dir_inode(psabpf_ctx);
+    if (current == 0 || (shared != NULL && shared->pipeline_dir != current) ||
+        (maps != NULL && maps->pipeline_dir != current))
+        invalidate_context_cache(psabpf_ctx);
+}
+
 int open_bpf_map(psabpf_context_t *psabpf_ctx, const char *name, psabpf_btf_t *btf, psabpf_bpf_map_descriptor_t *md)
 {
     char buffer[256];
@@ -286,26 +618,54 @@ int open_bpf_map(psabpf_context_t *psabpf_ctx, const char *name, psabpf_btf_t *b
     if (md == NULL)
         return EPERM;
 
-    build_ebpf_map_filename(buffer, sizeof(buffer), psabpf_ctx, name);
-    md->fd = bpf_obj_get(buffer);
-    if (md->fd < 0)
-        return errno;
-
-    /* get key/value size */
-    errno_val = update_map_info(md);
-    if (errno_val != NO_ERROR)
-        return errno_val;
+    psabpf_map_cache_entry_t *cached = map_cache_find(psabpf_ctx, name);
+    if (cached != NULL) {
+        /* Caller owns returned file descriptor */
+        *md = cached->md;
+        md->fd = dup(cached->md.fd);
+        if (md->fd < 0)
+            return errno;
+    } else {
+        build_ebpf_map_filename(buffer, sizeof(buffer), psabpf_ctx, name);
+        md->fd = map_ops->obj_get(buffer);
+        if (md->fd < 0)
+            return errno;
+
+        /* get key/value size */
+        errno_val = update_map_info(md);
+        if (errno_val != NO_ERROR)
+            return errno_val;
+
+        md->btf_type_id = 0;
+        map_cache_insert(psabpf_ctx, name, md);
+        cached = map_cache_find(psabpf_ctx, name);
+    }
 
     /* Find entry in BTF for our map */
-    if (btf != NULL && btf->btf != NULL) {
-        md->btf_type_id = psabtf_get_map_type_id_by_name(btf->btf, name);
+    if (btf != NULL && btf->btf != NULL && md->btf_type_id == 0) {
+        md->btf_type_id = psabtf_get_map_type_id_by_name(btf, name);
         if (md->btf_type_id == 0)
-            fprintf(stderr, "can't get BTF info for %s\n", name);
+            pr_err("can't get BTF info for %s\n", name);
+        else if (cached != NULL)
+            cached->md.btf_type_id = md->btf_type_id;
     }
 
     return NO_ERROR;
 }
 
+int clone_map_descriptor(psabpf_bpf_map_descriptor_t *dst, const psabpf_bpf_map_descriptor_t *src)
+{
+    *dst = *src;
+    if (src->fd < 0)
+        return NO_ERROR;
+
+    dst->fd = dup(src->fd);
+    if (dst->fd < 0)
+        return errno;
+
+    return NO_ERROR;
+}
+
 int update_map_info(psabpf_bpf_map_descriptor_t *md)
 {
     if (md == NULL)
@@ -315,10 +675,10 @@ int update_map_info(psabpf_bpf_map_descriptor_t *md)
 
     struct bpf_map_info info = {};
     uint32_t len = sizeof(info);
-    int errno_val = bpf_obj_get_info_by_fd(md->fd, &info, &len);
+    int errno_val = map_ops->obj_get_info_by_fd(md->fd, &info, &len);
     if (errno_val) {
         errno_val = errno;
-        fprintf(stderr, "can't get info for table: %s\n", strerror(errno_val));
+        pr_err("can't get info for table: %s\n", strerror(errno_val));
         return errno_val;
     }
 
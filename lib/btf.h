@@ -41,11 +41,21 @@ uint32_t psabtf_get_member_type_id_by_name(struct btf *btf, uint32_t type_id,
 
 size_t psabtf_get_type_size_by_id(struct btf *btf, uint32_t type_id);
 
+/* Uses name index built once per loaded BTF, returns 0 if not found */
+uint32_t psabtf_get_type_id_by_name(psabpf_btf_t *btf, const char *name);
+
 void init_btf(psabpf_btf_t *btf);
 int load_btf(psabpf_context_t *psabpf_ctx, psabpf_btf_t *btf);
+/* BTF of a cloned object context, shared with the source context */
+int borrow_btf(psabpf_btf_t *dst, const psabpf_btf_t *src);
 void free_btf(psabpf_btf_t *btf);
 
 int open_bpf_map(psabpf_context_t *psabpf_ctx, const char *name, psabpf_btf_t *btf, psabpf_bpf_map_descriptor_t *md);
+void invalidate_context_cache(psabpf_context_t *psabpf_ctx);
+/* Invalidates cache only when pipeline has been reloaded since it was filled */
+void revalidate_context_cache(psabpf_context_t *psabpf_ctx);
 int update_map_info(psabpf_bpf_map_descriptor_t *md);
+/* Copy of descriptor which owns a duplicate of the file descriptor, if it is opened */
+int clone_map_descriptor(psabpf_bpf_map_descriptor_t *dst, const psabpf_bpf_map_descriptor_t *src);
 
 #endif  // __PSABPF_BTF_H
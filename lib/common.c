@@ -20,10 +20,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <bpf/libbpf.h>
+#include <linux/bpf.h>
 
 #include "common.h"
 #include "bpf_defs.h"
 #include "btf.h"
+#include "psabpf_map_ops.h"
 
 int str_ends_with(const char *str, const char *suffix)
 {
@@ -72,6 +75,114 @@ void close_object_fd(int *fd)
     *fd = -1;
 }
 
+void *arena_or_heap_alloc(psabpf_arena_t *arena, size_t size)
+{
+    if (arena != NULL)
+        return psabpf_arena_alloc(arena, size);
+    return malloc(size);
+}
+
+void arena_or_heap_free(psabpf_arena_t *arena, void *ptr)
+{
+    if (arena == NULL && ptr != NULL)
+        free(ptr);
+}
+
+void *arena_or_heap_grow_array(psabpf_arena_t *arena, void *array, size_t n, size_t elem_size)
+{
+    if (arena == NULL)
+        return realloc(array, (n + 1) * elem_size);
+
+    /* Capacity is not stored: it is 0 for empty array, otherwise the lowest power of 2 not less than n and 4 */
+    size_t capacity = 0;
+    if (n > 0) {
+        capacity = 4;
+        while (capacity < n)
+            capacity *= 2;
+    }
+    if (n < capacity)
+        return array;
+
+    void *new_array = psabpf_arena_alloc(arena, (capacity > 0 ? capacity * 2 : 4) * elem_size);
+    if (new_array != NULL && n > 0)
+        memcpy(new_array, array, n * elem_size);
+
+    return new_array;
+}
+
+bool batch_ops_not_supported(int err)
+{
+    /* Kernels older than 5.6 do not know batch commands at all (EINVAL), while
+     * some map types do not implement them (ENOTSUPP - 524, not exported to userspace). */
+    return err == EINVAL || err == EOPNOTSUPP || err == 524;
+}
+
+/* For existing key the next key is its successor, for the missing one it is the first key of the trie */
+int lpm_trie_key_exists(int fd, const void *key, size_t key_size, bool *exists)
+{
+    int ret = NO_ERROR;
+    char *first_key = malloc(key_size);
+    char *next_key = malloc(key_size);
+    if (first_key == NULL || next_key == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    if (map_ops->get_next_key(fd, NULL, first_key) != 0) {
+        /* empty trie */
+        *exists = false;
+        goto clean_up;
+    }
+    if (map_ops->get_next_key(fd, key, next_key) != 0) {
+        if (errno != ENOENT) {
+            ret = errno;
+            goto clean_up;
+        }
+        /* key is the last one */
+        *exists = true;
+        goto clean_up;
+    }
+    *exists = memcmp(first_key, next_key, key_size) != 0;
+
+clean_up:
+    if (first_key != NULL)
+        free(first_key);
+    if (next_key != NULL)
+        free(next_key);
+
+    return ret;
+}
+
+int get_map_lookup_value_size(const struct bpf_map_info *info, uint32_t *value_size)
+{
+    switch (info->type) {
+        case BPF_MAP_TYPE_HASH:
+        case BPF_MAP_TYPE_LRU_HASH:
+        case BPF_MAP_TYPE_ARRAY:
+        case BPF_MAP_TYPE_LPM_TRIE:
+            *value_size = info->value_size;
+            return NO_ERROR;
+
+        case BPF_MAP_TYPE_PERCPU_HASH:
+        case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+        case BPF_MAP_TYPE_PERCPU_ARRAY: {
+            int n_cpus = libbpf_num_possible_cpus();
+            if (n_cpus <= 0)
+                return EINVAL;
+            *value_size = ((info->value_size + 7) & ~7U) * (uint32_t) n_cpus;
+            return NO_ERROR;
+        }
+
+        case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+        case BPF_MAP_TYPE_HASH_OF_MAPS:
+            *value_size = sizeof(uint32_t);
+            return NO_ERROR;
+
+        default:
+            return EOPNOTSUPP;
+    }
+}
+
 int build_ebpf_map_filename(char *buffer, size_t maxlen, psabpf_context_t *ctx, const char *name)
 {
     return snprintf(buffer, maxlen, "%s/%s%u/maps/%s",
@@ -107,18 +218,45 @@ void free_struct_field_descriptor_set(psabpf_struct_field_descriptor_set_t *fds)
     fds->n_fields = 0;
 }
 
+int copy_struct_field_descriptor_set(psabpf_struct_field_descriptor_set_t *dst,
+                                     const psabpf_struct_field_descriptor_set_t *src)
+{
+    dst->n_fields = 0;
+    dst->fields = NULL;
+    if (src->fields == NULL || src->n_fields == 0)
+        return NO_ERROR;
+
+    dst->fields = calloc(src->n_fields, sizeof(psabpf_struct_field_descriptor_t));
+    if (dst->fields == NULL)
+        return ENOMEM;
+    dst->n_fields = src->n_fields;
+
+    for (size_t i = 0; i < src->n_fields; i++) {
+        dst->fields[i] = src->fields[i];
+        if (src->fields[i].name == NULL)
+            continue;
+        dst->fields[i].name = strdup(src->fields[i].name);
+        if (dst->fields[i].name == NULL) {
+            free_struct_field_descriptor_set(dst);
+            return ENOMEM;
+        }
+    }
+
+    return NO_ERROR;
+}
+
 static int setup_struct_field_descriptor_set_no_btf(psabpf_struct_field_descriptor_set_t *fds, size_t data_size)
 {
     fds->fields = calloc(1, sizeof(psabpf_struct_field_descriptor_t));
     if (fds->fields == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
     /* must be malloc'ed because later we assume all fields are dynamically allocated */
     fds->fields[0].name = strdup("data");
     if (fds->fields[0].name == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
@@ -147,7 +285,7 @@ static size_t count_total_fields(psabpf_btf_t *btf_md, uint32_t type_id)
     for (unsigned i = 0; i < struct_entries; i++) {
         psabtf_struct_member_md_t md;
         if (psabtf_get_member_md_by_index(btf_md->btf, type_id, i, &md) != NO_ERROR) {
-            fprintf(stderr, "invalid field or type\n");
+            pr_err("invalid field or type\n");
             return 0;
         }
 
@@ -155,12 +293,12 @@ static size_t count_total_fields(psabpf_btf_t *btf_md, uint32_t type_id)
          * This is an internal field not relevant to a user. */
         const struct btf_type *member_type = psabtf_get_type_by_id(btf_md->btf, md.effective_type_id);
         if (member_type == NULL) {
-            fprintf(stderr, "invalid type\n");
+            pr_err("invalid type\n");
             return false;
         }
         const char *type_name = btf__name_by_offset(btf_md->btf, member_type->name_off);
         if (type_name == NULL) {
-            fprintf(stderr, "invalid type\n");
+            pr_err("invalid type\n");
             return false;
         }
         if (strcmp(type_name, "bpf_spin_lock") == 0) {
@@ -184,7 +322,7 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
 {
     const struct btf_type *type = psabtf_get_type_by_id(btf_md->btf, type_id);
     if (type == NULL) {
-        fprintf(stderr, "invalid type id: %u\n", type_id);
+        pr_err("invalid type id: %u\n", type_id);
         return EINVAL;
     }
 
@@ -201,7 +339,7 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
         snprintf(&name_tmp[0], sizeof(name_tmp), "field%u", *field_idx);
         fds->fields[*field_idx].name = strdup(name_tmp);
         if (fds->fields[*field_idx].name == NULL) {
-            fprintf(stderr, "not enough memory\n");
+            pr_err("not enough memory\n");
             return ENOMEM;
         }
 
@@ -210,7 +348,7 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
     }
 
     if (!btf_is_struct(type)) {
-        fprintf(stderr, "invalid type: expected struct\n");
+        pr_err("invalid type: expected struct\n");
         return EINVAL;
     }
 
@@ -218,7 +356,7 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
     for (unsigned i = 0; i < entries; i++) {
         psabtf_struct_member_md_t md;
         if (psabtf_get_member_md_by_index(btf_md->btf, type_id, i, &md) != NO_ERROR) {
-            fprintf(stderr, "invalid field or type\n");
+            pr_err("invalid field or type\n");
             return 0;
         }
 
@@ -226,12 +364,12 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
          * This is an internal field not relevant to a user. */
         const struct btf_type *member_type = psabtf_get_type_by_id(btf_md->btf, md.effective_type_id);
         if (member_type == NULL) {
-            fprintf(stderr, "invalid type\n");
+            pr_err("invalid type\n");
             return EINVAL;
         }
         const char *type_name = btf__name_by_offset(btf_md->btf, member_type->name_off);
         if (type_name == NULL) {
-            fprintf(stderr, "invalid type\n");
+            pr_err("invalid type\n");
             return EINVAL;
         }
         if (strcmp(type_name, "bpf_spin_lock") == 0)
@@ -247,7 +385,7 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
         if (field_name != NULL) {
             fds->fields[*field_idx].name = strdup(field_name);
             if (fds->fields[*field_idx].name == NULL) {
-                fprintf(stderr, "not enough memory\n");
+                pr_err("not enough memory\n");
                 return ENOMEM;
             }
         }
@@ -274,21 +412,21 @@ static int setup_struct_field_descriptor_set_btf(psabpf_btf_t *btf_md, psabpf_st
     return NO_ERROR;
 
 too_many_fields:
-    fprintf(stderr, "to many fields\n");
+    pr_err("to many fields\n");
     return EFBIG;
 }
 
 int parse_struct_type(psabpf_btf_t *btf_md, uint32_t type_id, size_t data_size, psabpf_struct_field_descriptor_set_t *fds)
 {
     if (type_id == 0) {
-        fprintf(stderr, "warning: BTF type not found, placing all the data in a single field\n");
+        pr_warn("warning: BTF type not found, placing all the data in a single field\n");
         return setup_struct_field_descriptor_set_no_btf(fds, data_size);
     }
 
     fds->n_fields = count_total_fields(btf_md, type_id);
     fds->fields = calloc(fds->n_fields, sizeof(psabpf_struct_field_descriptor_t));
     if (fds->n_fields == 0 || fds->fields == NULL) {
-        fprintf(stderr, "failed to count fields\n");
+        pr_err("failed to count fields\n");
         return EINVAL;
     }
 
@@ -395,7 +533,7 @@ int construct_struct_from_fields(psabpf_struct_field_set_t *data, psabpf_struct_
             return NO_ERROR;
     }
 
-    fprintf(stderr, "failed to construct data type based on fields, trying byte by byte...\n");
+    pr_debug("failed to construct data type based on fields, trying byte by byte...\n");
 
     /* We can build structure if total length of data is equal to length of struct type */
     size_t total_size = 0;
@@ -411,6 +549,6 @@ int construct_struct_from_fields(psabpf_struct_field_set_t *data, psabpf_struct_
         return NO_ERROR;
     }
 
-    fprintf(stderr, "failed to construct data type\n");
+    pr_err("failed to construct data type\n");
     return EINVAL;
 }
@@ -30,11 +30,32 @@ void swap_byte_order(char *data, size_t len);
 
 void close_object_fd(int *fd);
 
+/* Memory from arena when it is not NULL, otherwise from heap; only heap memory is released by free */
+void *arena_or_heap_alloc(psabpf_arena_t *arena, size_t size);
+void arena_or_heap_free(psabpf_arena_t *arena, void *ptr);
+/* Makes room for one more element in an array of n elements, for arena capacity grows twice */
+void *arena_or_heap_grow_array(psabpf_arena_t *arena, void *array, size_t n, size_t elem_size);
+
+/* True when error returned by a batch map operation means that the batch
+ * API is not available and caller should fall back to per-element calls. */
+bool batch_ops_not_supported(int err);
+
+/* Lookup in LPM trie returns the longest matching prefix, this checks whether the key itself is in the trie */
+int lpm_trie_key_exists(int fd, const void *key, size_t key_size, bool *exists);
+
+/* Size of value buffer for lookup, for per-CPU maps it holds values of all CPUs and for maps of maps
+ * it is the ID of inner map. EOPNOTSUPP for maps which content can't be saved, e.g. queue or program array. */
+struct bpf_map_info;
+int get_map_lookup_value_size(const struct bpf_map_info *info, uint32_t *value_size);
+
 int build_ebpf_map_filename(char *buffer, size_t maxlen, psabpf_context_t *ctx, const char *name);
 int build_ebpf_prog_filename(char *buffer, size_t maxlen, psabpf_context_t *ctx, const char *name);
 int build_ebpf_pipeline_path(char *buffer, size_t maxlen, psabpf_context_t *ctx);
 
 void free_struct_field_descriptor_set(psabpf_struct_field_descriptor_set_t *fds);
+/* Deep copy, names are duplicated */
+int copy_struct_field_descriptor_set(psabpf_struct_field_descriptor_set_t *dst,
+                                     const psabpf_struct_field_descriptor_set_t *src);
 int parse_struct_type(psabpf_btf_t *btf_md, uint32_t type_id, size_t data_size, psabpf_struct_field_descriptor_set_t *fds);
 psabpf_struct_field_descriptor_t *get_struct_field_descriptor(psabpf_struct_field_descriptor_set_t *fds, size_t index);
 
@@ -43,4 +64,16 @@ int struct_field_set_append(psabpf_struct_field_set_t *sfs, const void *data, si
 int construct_struct_from_fields(psabpf_struct_field_set_t *data, psabpf_struct_field_descriptor_set_t *fds,
                                  void *buffer, size_t buffer_len);
 
+/* Messages are formatted only when their level is enabled, see psabpf_set_log_level() */
+extern psabpf_log_level_t log_level;
+void log_message(psabpf_log_level_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_at_level(level, ...) \
+    do { if ((level) <= log_level) log_message((level), __VA_ARGS__); } while (0)
+
+#define pr_err(...)   log_at_level(PSABPF_LOG_ERROR, __VA_ARGS__)
+#define pr_warn(...)  log_at_level(PSABPF_LOG_WARNING, __VA_ARGS__)
+#define pr_info(...)  log_at_level(PSABPF_LOG_INFO, __VA_ARGS__)
+#define pr_debug(...) log_at_level(PSABPF_LOG_DEBUG, __VA_ARGS__)
+
 #endif  /* P4C_PSABPF_COMMON_H */
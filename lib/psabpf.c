@@ -15,9 +15,12 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../include/psabpf.h"
+#include "btf.h"
 
 void psabpf_context_init(psabpf_context_t *ctx)
 {
@@ -29,11 +32,14 @@ void psabpf_context_free(psabpf_context_t *ctx)
     if (ctx == NULL)
         return;
 
+    invalidate_context_cache(ctx);
     memset( ctx, 0, sizeof(psabpf_context_t));
 }
 
 void psabpf_context_set_pipeline(psabpf_context_t *ctx, psabpf_pipeline_id_t pipeline_id)
 {
+    if (ctx->pipeline_id != pipeline_id)
+        invalidate_context_cache(ctx);
     ctx->pipeline_id = pipeline_id;
 }
 
@@ -42,6 +48,103 @@ psabpf_pipeline_id_t psabpf_context_get_pipeline(psabpf_context_t *ctx)
     return ctx->pipeline_id;
 }
 
+void psabpf_context_invalidate_cache(psabpf_context_t *ctx)
+{
+    invalidate_context_cache(ctx);
+}
+
+void psabpf_context_revalidate_cache(psabpf_context_t *ctx)
+{
+    revalidate_context_cache(ctx);
+}
+
+typedef struct psabpf_arena_block {
+    struct psabpf_arena_block *next;
+    size_t size;
+    max_align_t data[];
+} psabpf_arena_block_t;
+
+#define PSABPF_ARENA_DEFAULT_BLOCK_SIZE 4096
+
+void psabpf_arena_init(psabpf_arena_t *arena, size_t block_size)
+{
+    if (arena == NULL)
+        return;
+    memset(arena, 0, sizeof(psabpf_arena_t));
+    arena->block_size = block_size > 0 ? block_size : PSABPF_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void psabpf_arena_free(psabpf_arena_t *arena)
+{
+    if (arena == NULL)
+        return;
+
+    psabpf_arena_block_t *block = arena->blocks;
+    while (block != NULL) {
+        psabpf_arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena->used = 0;
+}
+
+void psabpf_arena_reset(psabpf_arena_t *arena)
+{
+    if (arena == NULL)
+        return;
+
+    psabpf_arena_block_t *block = arena->blocks;
+    arena->used = 0;
+    if (block == NULL || block->next == NULL)
+        return;
+
+    /* Merge blocks, so the next use of the same amount of memory fits into a single block */
+    size_t total_size = 0;
+    for (psabpf_arena_block_t *b = block; b != NULL; b = b->next)
+        total_size += b->size;
+    psabpf_arena_free(arena);
+
+    block = malloc(sizeof(psabpf_arena_block_t) + total_size);
+    if (block == NULL)
+        return;  /* will be allocated on demand */
+    block->next = NULL;
+    block->size = total_size;
+    arena->blocks = block;
+}
+
+void *psabpf_arena_alloc(psabpf_arena_t *arena, size_t size)
+{
+    if (arena == NULL)
+        return NULL;
+
+    const size_t align = sizeof(max_align_t);
+    size = size > 0 ? (size + align - 1) & ~(align - 1) : align;
+
+    psabpf_arena_block_t *block = arena->blocks;
+    if (block == NULL || arena->used + size > block->size) {
+        size_t block_size = arena->block_size > 0 ? arena->block_size : PSABPF_ARENA_DEFAULT_BLOCK_SIZE;
+        if (block != NULL && block->size * 2 > block_size)
+            block_size = block->size * 2;
+        if (size > block_size)
+            block_size = size;
+
+        psabpf_arena_block_t *new_block = malloc(sizeof(psabpf_arena_block_t) + block_size);
+        if (new_block == NULL)
+            return NULL;
+        new_block->next = block;
+        new_block->size = block_size;
+        arena->blocks = new_block;
+        arena->used = 0;
+        block = new_block;
+    }
+
+    void *ptr = (char *) block->data + arena->used;
+    arena->used += size;
+
+    return ptr;
+}
+
 psabpf_struct_field_type_t psabpf_struct_get_field_type(psabpf_struct_field_t *field)
 {
     return field->type;
@@ -25,29 +25,32 @@
 #include <psabpf.h>
 #include "btf.h"
 #include "common.h"
+#include "psabpf_txn.h"
 #include "psabpf_table.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 static int open_group_map(psabpf_action_selector_context_t *ctx,
                           psabpf_action_selector_group_context_t *group)
 {
     if (ctx->map_of_groups.fd < 0) {
-        fprintf(stderr, "map of groups not opened\n");
+        pr_err("map of groups not opened\n");
         return EINVAL;
     }
     if (ctx->map_of_groups.key_size != 4 || ctx->map_of_groups.value_size != 4) {
-        fprintf(stderr, "invalid map of groups\n");
+        pr_err("invalid map of groups\n");
         return EINVAL;
     }
 
     uint32_t inner_map_id = 0;
-    int err = bpf_map_lookup_elem(ctx->map_of_groups.fd, &group->group_ref, &inner_map_id);
+    int err = map_ops->lookup_elem(ctx->map_of_groups.fd, &group->group_ref, &inner_map_id);
     if (err != 0) {
-        fprintf(stderr, "group %u was not found\n", group->group_ref);
+        pr_err("group %u was not found\n", group->group_ref);
         return ENOENT;
     }
-    ctx->group.fd = bpf_map_get_fd_by_id(inner_map_id);
+    ctx->group.fd = map_ops->get_fd_by_id(inner_map_id);
     if (ctx->group.fd < 0) {
-        fprintf(stderr, "group map for group %u was not found\n", group->group_ref);
+        pr_err("group map for group %u was not found\n", group->group_ref);
         return ENOENT;
     }
 
@@ -56,10 +59,10 @@ static int open_group_map(psabpf_action_selector_context_t *ctx,
 
 static int get_number_of_members_in_group(psabpf_action_selector_context_t *ctx, uint32_t *number_of_members) {
     uint32_t key = 0;
-    int return_code = bpf_map_lookup_elem(ctx->group.fd, &key, number_of_members);
+    int return_code = map_ops->lookup_elem(ctx->group.fd, &key, number_of_members);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to obtain number of members in group: %s\n", strerror(return_code));
+        pr_err("failed to obtain number of members in group: %s\n", strerror(return_code));
         return return_code;
     }
     return NO_ERROR;
@@ -67,10 +70,10 @@ static int get_number_of_members_in_group(psabpf_action_selector_context_t *ctx,
 
 static int update_number_of_members_in_group(psabpf_action_selector_context_t *ctx, uint32_t new_value) {
     uint32_t key = 0;
-    int return_code = bpf_map_update_elem(ctx->group.fd, &key, &new_value, BPF_ANY);
+    int return_code = txn_map_update_elem(ctx->group.fd, &key, &new_value, BPF_ANY);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to update member in group: %s\n", strerror(return_code));
+        pr_err("failed to update member in group: %s\n", strerror(return_code));
         return return_code;
     }
     return NO_ERROR;
@@ -82,7 +85,7 @@ static uint32_t find_member_entry_idx_in_group(psabpf_bpf_map_descriptor_t *grou
 {
     for (uint32_t index = 1; index <= number_of_members; ++index) {
         uint32_t current_member_ref;
-        int return_code = bpf_map_lookup_elem(group->fd, &index, &current_member_ref);
+        int return_code = map_ops->lookup_elem(group->fd, &index, &current_member_ref);
         if (return_code == 0 && current_member_ref == member->member_ref) {
             return index;
         }
@@ -97,7 +100,7 @@ static bool validate_member_reference(psabpf_action_selector_context_t *ctx,
     if (value == NULL)
         return false;
 
-    int ret = bpf_map_lookup_elem(ctx->map_of_members.fd, &member->member_ref, value);
+    int ret = map_ops->lookup_elem(ctx->map_of_members.fd, &member->member_ref, value);
     free(value);
 
     if (ret != 0)
@@ -151,7 +154,7 @@ static int do_open_action_selector(psabpf_context_t *psabpf_ctx, psabpf_action_s
     snprintf(derived_name, sizeof(derived_name), "%s_groups_inner", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf, &ctx->group);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
     close_object_fd(&ctx->group.fd);
@@ -159,28 +162,28 @@ static int do_open_action_selector(psabpf_context_t *psabpf_ctx, psabpf_action_s
     snprintf(derived_name, sizeof(derived_name), "%s_groups", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf, &ctx->map_of_groups);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
     snprintf(derived_name, sizeof(derived_name), "%s_actions", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf, &ctx->map_of_members);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
     snprintf(derived_name, sizeof(derived_name), "%s_defaultActionGroup", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf, &ctx->empty_group_action);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
     snprintf(derived_name, sizeof(derived_name), "%s_cache", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf, &ctx->cache);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "warning: couldn't find ActionSelector cache: %s\n", strerror(ret));
+        pr_warn("warning: couldn't find ActionSelector cache: %s\n", strerror(ret));
     }
 
     return NO_ERROR;
@@ -188,22 +191,48 @@ static int do_open_action_selector(psabpf_context_t *psabpf_ctx, psabpf_action_s
 
 int psabpf_action_selector_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_action_selector_context_t *ctx, const char *name)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_CTX_OPEN);
+
     if (ctx == NULL || psabpf_ctx == NULL || name == NULL)
         return EINVAL;
 
     /* get the BTF, it is optional so print only warning */
     if (load_btf(psabpf_ctx, &ctx->btf) != NO_ERROR)
-        fprintf(stderr, "warning: couldn't find BTF info\n");
+        pr_warn("warning: couldn't find BTF info\n");
 
     int ret = do_open_action_selector(psabpf_ctx, ctx, name);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open ActionSelector %s: %s\n", name, strerror(ret));
+        pr_err("couldn't open ActionSelector %s: %s\n", name, strerror(ret));
         return ret;
     }
 
     return NO_ERROR;
 }
 
+int psabpf_action_selector_ctx_clone(psabpf_action_selector_context_t *dst, psabpf_action_selector_context_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src)
+        return EINVAL;
+
+    int ret = borrow_btf(&dst->btf, &src->btf);
+    if (ret != NO_ERROR)
+        return ret;
+
+    /* Group map is opened by every operation on a group, the clone gets only its metadata */
+    dst->group = src->group;
+    dst->group.fd = -1;
+
+    ret = clone_map_descriptor(&dst->map_of_groups, &src->map_of_groups);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->map_of_members, &src->map_of_members);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->empty_group_action, &src->empty_group_action);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->cache, &src->cache);
+
+    return ret;
+}
+
 void psabpf_action_selector_member_init(psabpf_action_selector_member_context_t *member)
 {
     if (member == NULL)
@@ -279,17 +308,17 @@ static uint32_t find_and_reserve_reference(psabpf_bpf_map_descriptor_t *map, voi
 {
     uint32_t ref;
     if (map->key_size != 4) {
-        fprintf(stderr, "expected that map have 32 bit key\n");
+        pr_err("expected that map have 32 bit key\n");
         return PSABPF_ACTION_SELECTOR_INVALID_REFERENCE;
     }
     if (map->fd < 0) {
-        fprintf(stderr, "map not opened\n");
+        pr_err("map not opened\n");
         return PSABPF_ACTION_SELECTOR_INVALID_REFERENCE;
     }
 
     char *value = malloc(map->value_size);
     if (value == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return PSABPF_ACTION_SELECTOR_INVALID_REFERENCE;
     }
     if (data != NULL)
@@ -299,7 +328,7 @@ static uint32_t find_and_reserve_reference(psabpf_bpf_map_descriptor_t *map, voi
 
     bool found = false;
     for (ref = 1; ref <= map->max_entries; ++ref) {
-        int return_code = bpf_map_update_elem(map->fd, &ref, value, BPF_NOEXIST);
+        int return_code = txn_map_update_elem(map->fd, &ref, value, BPF_NOEXIST);
         if (return_code == 0) {
             found = true;
             break;
@@ -314,23 +343,25 @@ static uint32_t find_and_reserve_reference(psabpf_bpf_map_descriptor_t *map, voi
 
 int psabpf_action_selector_add_member(psabpf_action_selector_context_t *ctx, psabpf_action_selector_member_context_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER);
+
     if (ctx == NULL || member == NULL)
         return EINVAL;
     if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
+        pr_err("Map of members not opened\n");
         return EINVAL;
     }
 
     member->member_ref = find_and_reserve_reference(&ctx->map_of_members, NULL);
     if (member->member_ref == PSABPF_ACTION_SELECTOR_INVALID_REFERENCE) {
-        fprintf(stderr, "failed to find available reference for member");
+        pr_err("failed to find available reference for member");
         return EFBIG;  /* Probably, here we know we have access to eBPF, so most probably version is that map is full */
     }
 
     int ret = psabpf_action_selector_update_member(ctx, member);
     if (ret != NO_ERROR) {
         /* Remove reserved reference if failed to add */
-        bpf_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
+        txn_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
         return ret;
     }
 
@@ -339,10 +370,12 @@ int psabpf_action_selector_add_member(psabpf_action_selector_context_t *ctx, psa
 
 int psabpf_action_selector_update_member(psabpf_action_selector_context_t *ctx, psabpf_action_selector_member_context_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_UPDATE_MEMBER);
+
     if (ctx == NULL || member == NULL)
         return EINVAL;
     if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
+        pr_err("Map of members not opened\n");
         return EINVAL;
     }
 
@@ -376,7 +409,7 @@ static bool member_in_use(psabpf_action_selector_context_t *ctx, psabpf_action_s
     uint32_t key = 0, next_key;
 
     /* Iterate over every group and check if member reference exists */
-    if (bpf_map_get_next_key(ctx->map_of_groups.fd, NULL, &next_key) != 0)
+    if (map_ops->get_next_key(ctx->map_of_groups.fd, NULL, &next_key) != 0)
         return false;  /* no groups */
     do {
         /* Swap buffers, so next_key will become key and next_key may be reused */
@@ -394,49 +427,51 @@ static bool member_in_use(psabpf_action_selector_context_t *ctx, psabpf_action_s
         uint32_t number_of_members = 0;
         if (get_number_of_members_in_group(ctx, &number_of_members) == NO_ERROR) {
             if (find_member_entry_idx_in_group(&ctx->group, number_of_members, member) != 0) {
-                fprintf(stderr, "%u referenced in group %u\n", member->member_ref, group.group_ref);
+                pr_err("%u referenced in group %u\n", member->member_ref, group.group_ref);
                 found = true;
             }
         }
         close_object_fd(&ctx->group.fd);
-    } while (bpf_map_get_next_key(ctx->map_of_groups.fd, &key, &next_key) == 0 && !found);
+    } while (map_ops->get_next_key(ctx->map_of_groups.fd, &key, &next_key) == 0 && !found);
 
     return found;
 }
 
 int psabpf_action_selector_del_member(psabpf_action_selector_context_t *ctx, psabpf_action_selector_member_context_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER);
+
     if (ctx == NULL || member == NULL)
         return EINVAL;
     if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
+        pr_err("Map of members not opened\n");
         return EINVAL;
     }
     if (ctx->map_of_members.key_size != 4) {
-        fprintf(stderr, "expected that map have 32 bit key\n");
+        pr_err("expected that map have 32 bit key\n");
         return EINVAL;
     }
     if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
-        fprintf(stderr, "invalid group map\n");
+        pr_err("invalid group map\n");
         return EINVAL;
     }
 
     /* Validate if member is referenced in any group */
     if (member_in_use(ctx, member)) {
-        fprintf(stderr, "failed to delete member %u: already in use\n", member->member_ref);
+        pr_err("failed to delete member %u: already in use\n", member->member_ref);
         return EBUSY;
     }
 
-    int ret = bpf_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
+    int ret = txn_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to delete member %u: %s\n", member->member_ref, strerror(ret));
+        pr_err("failed to delete member %u: %s\n", member->member_ref, strerror(ret));
         return ret;
     }
 
     ret = clear_table_cache(&ctx->cache);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to clear cache: %s\n", strerror(ret));
+        pr_err("failed to clear cache: %s\n", strerror(ret));
     }
 
     return NO_ERROR;
@@ -444,18 +479,20 @@ int psabpf_action_selector_del_member(psabpf_action_selector_context_t *ctx, psa
 
 int psabpf_action_selector_add_group(psabpf_action_selector_context_t *ctx, psabpf_action_selector_group_context_t *group)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_ADD_GROUP);
+
     if (ctx == NULL || group == NULL)
         return EINVAL;
     if (ctx->map_of_groups.fd < 0) {
-        fprintf(stderr, "Map of groups not opened\n");
+        pr_err("Map of groups not opened\n");
         return EINVAL;
     }
     if (ctx->group.fd >= 0) {
-        fprintf(stderr, "Group map not closed properly before\n");
+        pr_err("Group map not closed properly before\n");
         return EINVAL;
     }
     if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
-        fprintf(stderr, "invalid group map\n");
+        pr_err("invalid group map\n");
         return EINVAL;
     }
 
@@ -468,10 +505,10 @@ int psabpf_action_selector_add_group(psabpf_action_selector_context_t *ctx, psab
             .btf_key_type_id = ctx->group.key_type_id,
             .btf_value_type_id = ctx->group.value_type_id,
     };
-    ctx->group.fd = bpf_create_map_xattr(&attr);
+    ctx->group.fd = map_ops->create_map(&attr);
     if (ctx->group.fd < 0) {
         int err = errno;
-        fprintf(stderr, "failed to create new group: %s\n", strerror(err));
+        pr_err("failed to create new group: %s\n", strerror(err));
         return err;
     }
 
@@ -480,7 +517,7 @@ int psabpf_action_selector_add_group(psabpf_action_selector_context_t *ctx, psab
     close_object_fd(&ctx->group.fd);
 
     if (group->group_ref == PSABPF_ACTION_SELECTOR_INVALID_REFERENCE) {
-        fprintf(stderr, "failed to insert new group to map of groups\n");
+        pr_err("failed to insert new group to map of groups\n");
         return EFBIG;
     }
 
@@ -489,23 +526,25 @@ int psabpf_action_selector_add_group(psabpf_action_selector_context_t *ctx, psab
 
 int psabpf_action_selector_del_group(psabpf_action_selector_context_t *ctx, psabpf_action_selector_group_context_t *group)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_DEL_GROUP);
+
     if (ctx == NULL || group == NULL)
         return EINVAL;
     if (ctx->map_of_groups.fd < 0) {
-        fprintf(stderr, "Map of groups not opened\n");
+        pr_err("Map of groups not opened\n");
         return EINVAL;
     }
 
-    int ret = bpf_map_delete_elem(ctx->map_of_groups.fd, &group->group_ref);
+    int ret = txn_map_delete_elem(ctx->map_of_groups.fd, &group->group_ref);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to delete group %u: %s\n", group->group_ref, strerror(ret));
+        pr_err("failed to delete group %u: %s\n", group->group_ref, strerror(ret));
         return ret;
     }
 
     ret = clear_table_cache(&ctx->cache);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to clear cache: %s\n", strerror(ret));
+        pr_err("failed to clear cache: %s\n", strerror(ret));
     }
 
     return NO_ERROR;
@@ -527,16 +566,16 @@ static int append_member_to_group(psabpf_action_selector_context_t *ctx,
 
     /* Verify that member reference not existed in group before */
     if (find_member_entry_idx_in_group(&ctx->group, number_of_members, member) != 0) {
-        fprintf(stderr, "%u already exists in group\n", member->member_ref);
+        pr_err("%u already exists in group\n", member->member_ref);
         return EEXIST;
     }
 
     /* Append new member if possible */
     group_key = number_of_members + 1;
-    return_code = bpf_map_update_elem(ctx->group.fd, &group_key, &member->member_ref, BPF_ANY);
+    return_code = txn_map_update_elem(ctx->group.fd, &group_key, &member->member_ref, BPF_ANY);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to add member to group: %s\n", strerror(return_code));
+        pr_err("failed to add member to group: %s\n", strerror(return_code));
         return return_code;
     }
 
@@ -552,22 +591,24 @@ int psabpf_action_selector_add_member_to_group(psabpf_action_selector_context_t
                                                psabpf_action_selector_group_context_t *group,
                                                psabpf_action_selector_member_context_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER_TO_GROUP);
+
     int return_code;
 
     if (ctx == NULL || group == NULL || member == NULL)
         return EINVAL;
     if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
-        fprintf(stderr, "invalid group map\n");
+        pr_err("invalid group map\n");
         return EINVAL;
     }
     if (ctx->group.fd >= 0) {
-        fprintf(stderr, "group map not closed properly before\n");
+        pr_err("group map not closed properly before\n");
         return EINVAL;
     }
 
     /* verify that member reference exists and is valid */
     if (!validate_member_reference(ctx, member)) {
-        fprintf(stderr, "invalid member reference: %u\n", member->member_ref);
+        pr_err("invalid member reference: %u\n", member->member_ref);
         return EINVAL;
     }
 
@@ -582,7 +623,7 @@ int psabpf_action_selector_add_member_to_group(psabpf_action_selector_context_t
 
     return_code = clear_table_cache(&ctx->cache);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        pr_err("failed to clear cache: %s\n", strerror(return_code));
     }
 
     return return_code;
@@ -608,15 +649,15 @@ static int remove_member_from_group(psabpf_action_selector_context_t *ctx,
     /* 2. Find index of our reference */
     index_to_remove = find_member_entry_idx_in_group(&ctx->group, number_of_members, member);
     if (index_to_remove == 0) {
-        fprintf(stderr, "%u not referenced in group\n", member->member_ref);
+        pr_err("%u not referenced in group\n", member->member_ref);
         return ENOENT;
     }
 
     /* 3. Find reference of last member in group (see comment below) */
-    return_code = bpf_map_lookup_elem(ctx->group.fd, &number_of_members, &last_member_ref);
+    return_code = map_ops->lookup_elem(ctx->group.fd, &number_of_members, &last_member_ref);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get last member in a group: %s\n", strerror(return_code));
+        pr_err("failed to get last member in a group: %s\n", strerror(return_code));
         return return_code;
     }
 
@@ -644,10 +685,10 @@ static int remove_member_from_group(psabpf_action_selector_context_t *ctx,
     uint32_t n_keys = 3;
     if (index_to_remove == number_of_members)
         n_keys = 2;
-    return_code = bpf_map_update_batch(ctx->group.fd, &(keys[3-n_keys]), &(values[3-n_keys]), &n_keys, &opts);
+    return_code = txn_map_update_batch(ctx->group.fd, &(keys[3-n_keys]), &(values[3-n_keys]), &n_keys, &opts);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to remove member from group: %s\n", strerror(return_code));
+        pr_err("failed to remove member from group: %s\n", strerror(return_code));
         return return_code;
     }
 
@@ -658,21 +699,23 @@ int psabpf_action_selector_del_member_from_group(psabpf_action_selector_context_
                                                  psabpf_action_selector_group_context_t *group,
                                                  psabpf_action_selector_member_context_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER_FROM_GROUP);
+
     int return_code;
 
     if (ctx == NULL || group == NULL || member == NULL)
         return EINVAL;
     if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
-        fprintf(stderr, "invalid group map\n");
+        pr_err("invalid group map\n");
         return EINVAL;
     }
     if (ctx->group.fd >= 0) {
-        fprintf(stderr, "group map not closed properly before\n");
+        pr_err("group map not closed properly before\n");
         return EINVAL;
     }
 
     if (member->member_ref == PSABPF_ACTION_SELECTOR_INVALID_REFERENCE) {
-        fprintf(stderr, "invalid member reference\n");
+        pr_err("invalid member reference\n");
         return EINVAL;
     }
 
@@ -689,7 +732,7 @@ int psabpf_action_selector_del_member_from_group(psabpf_action_selector_context_
 
     return_code = clear_table_cache(&ctx->cache);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        pr_err("failed to clear cache: %s\n", strerror(return_code));
     }
 
     return NO_ERROR;
@@ -700,11 +743,11 @@ int psabpf_action_selector_set_empty_group_action(psabpf_action_selector_context
     if (ctx == NULL || action == NULL)
         return EINVAL;
     if (ctx->empty_group_action.fd < 0) {
-        fprintf(stderr, "map with default action for empty group not opened\n");
+        pr_err("map with default action for empty group not opened\n");
         return EINVAL;
     }
     if (ctx->empty_group_action.key_size != 4) {
-        fprintf(stderr, "invalid map with default action form empty group\n");
+        pr_err("invalid map with default action form empty group\n");
         return EINVAL;
     }
     uint32_t key = 0;
@@ -739,11 +782,11 @@ int psabpf_action_selector_get_empty_group_action(psabpf_action_selector_context
     if (ctx == NULL || member == NULL)
         return EINVAL;
     if (ctx->empty_group_action.fd < 0) {
-        fprintf(stderr, "map with default action for empty group not opened\n");
+        pr_err("map with default action for empty group not opened\n");
         return EINVAL;
     }
     if (ctx->empty_group_action.key_size != 4) {
-        fprintf(stderr, "invalid map with default action form empty group\n");
+        pr_err("invalid map with default action form empty group\n");
         return EINVAL;
     }
 
@@ -790,16 +833,16 @@ int psabpf_action_selector_get_group(psabpf_action_selector_context_t *ctx, psab
     if (ctx == NULL || group == NULL)
         return EINVAL;
     if (ctx->map_of_groups.key_size != 4 || ctx->map_of_groups.value_size != 4) {
-        fprintf(stderr, "invalid map of groups\n");
+        pr_err("invalid map of groups\n");
         return EINVAL;
     }
 
     /* Just validate that group exists */
     uint32_t inner_map_id = 0;
-    int err = bpf_map_lookup_elem(ctx->map_of_groups.fd, &group->group_ref, &inner_map_id);
+    int err = map_ops->lookup_elem(ctx->map_of_groups.fd, &group->group_ref, &inner_map_id);
     if (err != 0) {
         err = errno;
-        fprintf(stderr, "failed to get group: %s\n", strerror(err));
+        pr_err("failed to get group: %s\n", strerror(err));
         return err;
     }
 
@@ -811,7 +854,7 @@ psabpf_action_selector_group_context_t *psabpf_action_selector_get_next_group(ps
     if (ctx == NULL)
         return NULL;
     if (ctx->map_of_groups.key_size != 4) {
-        fprintf(stderr, "invalid map of groups\n");
+        pr_err("invalid map of groups\n");
         return NULL;
     }
 
@@ -821,11 +864,11 @@ psabpf_action_selector_group_context_t *psabpf_action_selector_get_next_group(ps
 
     if (ctx->current_group_id == PSABPF_ACTION_SELECTOR_INVALID_REFERENCE) {
         /* group map is not open, so we start from this point */
-        if (bpf_map_get_next_key(ctx->map_of_groups.fd, NULL, &ctx->current_group.group_ref) != 0)
+        if (map_ops->get_next_key(ctx->map_of_groups.fd, NULL, &ctx->current_group.group_ref) != 0)
             goto err_or_no_more_groups;
     } else {
         /* find next group reference */
-        if (bpf_map_get_next_key(ctx->map_of_groups.fd, &ctx->current_group_id, &ctx->current_group.group_ref) != 0)
+        if (map_ops->get_next_key(ctx->map_of_groups.fd, &ctx->current_group_id, &ctx->current_group.group_ref) != 0)
             goto err_or_no_more_groups;
     }
 
@@ -874,7 +917,7 @@ psabpf_action_selector_member_context_t *psabpf_action_selector_get_next_group_m
         return NULL;
     /* key is a group reference, value contains member references, so both always are 32 bits */
     if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
-        fprintf(stderr, "invalid group map\n");
+        pr_err("invalid group map\n");
         return NULL;
     }
 
@@ -897,7 +940,7 @@ psabpf_action_selector_member_context_t *psabpf_action_selector_get_next_group_m
 
     if (ctx->current_member_id < number_of_members) {
         ctx->current_member_id += 1;
-        if (bpf_map_lookup_elem(ctx->group.fd, &ctx->current_member_id, &ctx->current_member.member_ref))
+        if (map_ops->lookup_elem(ctx->group.fd, &ctx->current_member_id, &ctx->current_member.member_ref))
             goto err_or_no_more_members;
     } else {
         goto err_or_no_more_members;
@@ -920,11 +963,11 @@ psabpf_action_selector_member_context_t *psabpf_action_selector_get_next_member(
         return NULL;
 
     if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
+        pr_err("Map of members not opened\n");
         return NULL;
     }
     if (ctx->map_of_members.key_size != 4) {
-        fprintf(stderr, "Invalid map of members\n");
+        pr_err("Invalid map of members\n");
         return NULL;
     }
 
@@ -932,10 +975,10 @@ psabpf_action_selector_member_context_t *psabpf_action_selector_get_next_member(
     psabpf_action_selector_member_init(&ctx->current_member);
 
     if (ctx->current_member_id == PSABPF_ACTION_SELECTOR_INVALID_REFERENCE) {
-        if (bpf_map_get_next_key(ctx->map_of_members.fd, NULL, &ctx->current_member.member_ref) != 0)
+        if (map_ops->get_next_key(ctx->map_of_members.fd, NULL, &ctx->current_member.member_ref) != 0)
             goto err_or_no_more_members;
     } else {
-        if (bpf_map_get_next_key(ctx->map_of_members.fd, &ctx->current_member_id, &ctx->current_member.member_ref) != 0)
+        if (map_ops->get_next_key(ctx->map_of_members.fd, &ctx->current_member_id, &ctx->current_member.member_ref) != 0)
             goto err_or_no_more_members;
     }
 
@@ -955,11 +998,11 @@ int psabpf_action_selector_get_member(psabpf_action_selector_context_t *ctx, psa
     if (ctx == NULL || member == NULL)
         return EINVAL;
     if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
+        pr_err("Map of members not opened\n");
         return EINVAL;
     }
     if (ctx->map_of_members.key_size != 4) {
-        fprintf(stderr, "Invalid map of members\n");
+        pr_err("Invalid map of members\n");
         return EINVAL;
     }
 
@@ -22,9 +22,12 @@
 
 #include <psabpf.h>
 #include "common.h"
+#include "psabpf_txn.h"
 #include "btf.h"
 #include "bpf_defs.h"
 #include "psabpf_counter.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 #define MAX_COUNTER_VALUE_SIZE 16
 
@@ -123,23 +126,25 @@ static int parse_counter_key(psabpf_counter_context_t *ctx)
 
 int psabpf_counter_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_counter_context_t *ctx, const char *name)
 {
+    STATS_SCOPE(PSABPF_STATS_COUNTER_CTX_OPEN);
+
     if (psabpf_ctx == NULL || ctx == NULL || name == NULL)
         return EINVAL;
 
     /* get the BTF, will not work without it because there is too many possible configurations */
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR) {
-        fprintf(stderr, "couldn't find BTF info\n");
+        pr_err("couldn't find BTF info\n");
         return ENOTSUP;
     }
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->counter);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open counter %s\n", name);
+        pr_err("couldn't open counter %s\n", name);
         return ret;
     }
 
     if (parse_counter_value(ctx) != NO_ERROR) {
-        fprintf(stderr, "%s: not a Counter instance\n", name);
+        pr_err("%s: not a Counter instance\n", name);
         close_object_fd(&ctx->counter.fd);
         return EOPNOTSUPP;
     }
@@ -147,6 +152,21 @@ int psabpf_counter_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_counter_context
     return parse_counter_key(ctx);
 }
 
+int psabpf_counter_ctx_clone(psabpf_counter_context_t *dst, psabpf_counter_context_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src)
+        return EINVAL;
+
+    dst->counter_type = src->counter_type;
+    int ret = borrow_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->counter, &src->counter);
+    if (ret == NO_ERROR)
+        ret = copy_struct_field_descriptor_set(&dst->key_fds, &src->key_fds);
+
+    return ret;
+}
+
 void psabpf_counter_entry_init(psabpf_counter_entry_t *entry)
 {
     if (entry == NULL)
@@ -176,7 +196,7 @@ int psabpf_counter_entry_set_key(psabpf_counter_entry_t *entry, const void *data
 
     int ret = struct_field_set_append(&entry->entry_key, data, data_len);
     if (ret != NO_ERROR)
-        fprintf(stderr, "couldn't append key to an entry: %s\n", strerror(ret));
+        pr_err("couldn't append key to an entry: %s\n", strerror(ret));
     return ret;
 }
 
@@ -248,7 +268,7 @@ static void *allocate_key_buffer(psabpf_counter_context_t *ctx, psabpf_counter_e
 
     entry->raw_key = malloc(ctx->counter.key_size);
     if (entry->raw_key == NULL)
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
 
     return entry->raw_key;
 }
@@ -275,10 +295,10 @@ int convert_counter_data_to_entry(const uint8_t *data, size_t counter_size,
 static int read_and_parse_counter_value(psabpf_counter_context_t *ctx, psabpf_counter_entry_t *entry)
 {
     uint8_t value[MAX_COUNTER_VALUE_SIZE];
-    int ret = bpf_map_lookup_elem(ctx->counter.fd, entry->raw_key, &value[0]);
+    int ret = map_ops->lookup_elem(ctx->counter.fd, entry->raw_key, &value[0]);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to read Counter entry: %s\n", strerror(ret));
+        pr_err("failed to read Counter entry: %s\n", strerror(ret));
         return ret;
     }
 
@@ -287,6 +307,8 @@ static int read_and_parse_counter_value(psabpf_counter_context_t *ctx, psabpf_co
 
 int psabpf_counter_get(psabpf_counter_context_t *ctx, psabpf_counter_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_COUNTER_GET);
+
     if (ctx == NULL || entry == NULL)
         return EINVAL;
 
@@ -302,6 +324,8 @@ int psabpf_counter_get(psabpf_counter_context_t *ctx, psabpf_counter_entry_t *en
 
 psabpf_counter_entry_t *psabpf_counter_get_next(psabpf_counter_context_t *ctx)
 {
+    STATS_SCOPE(PSABPF_STATS_COUNTER_GET_NEXT);
+
     if (ctx == NULL)
         return NULL;
 
@@ -309,7 +333,7 @@ psabpf_counter_entry_t *psabpf_counter_get_next(psabpf_counter_context_t *ctx)
         return NULL;
 
     /* on first call ctx->prev_entry_ke must be NULL */
-    if (bpf_map_get_next_key(ctx->counter.fd, ctx->prev_entry_key, ctx->current_entry.raw_key) != 0) {
+    if (map_ops->get_next_key(ctx->counter.fd, ctx->prev_entry_key, ctx->current_entry.raw_key) != 0) {
         /* no more entries, prepare for next iteration */
         if (ctx->prev_entry_key != NULL)
             free(ctx->prev_entry_key);
@@ -321,7 +345,7 @@ psabpf_counter_entry_t *psabpf_counter_get_next(psabpf_counter_context_t *ctx)
     if (ctx->prev_entry_key == NULL) {
         ctx->prev_entry_key = malloc(ctx->counter.key_size);
         if (ctx->prev_entry_key == NULL) {
-            fprintf(stderr, "not enough memory\n");
+            pr_err("not enough memory\n");
             return NULL;
         }
     }
@@ -371,12 +395,12 @@ static int set_all_counters(psabpf_counter_context_t *ctx, void *encoded_value,
         can_remove_entries = false;
 
     if (key == NULL || next_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         error_code = ENOMEM;
         goto clean_up;
     }
 
-    if (bpf_map_get_next_key(ctx->counter.fd, NULL, next_key) != 0)
+    if (map_ops->get_next_key(ctx->counter.fd, NULL, next_key) != 0)
         goto clean_up;  /* table empty */
 
     do {
@@ -386,17 +410,17 @@ static int set_all_counters(psabpf_counter_context_t *ctx, void *encoded_value,
         key = tmp_key;
 
         if (can_remove_entries)
-            ret = bpf_map_delete_elem(ctx->counter.fd, key);
+            ret = txn_map_delete_elem(ctx->counter.fd, key);
         else
-            ret = bpf_map_update_elem(ctx->counter.fd, key, encoded_value, 0);
+            ret = txn_map_update_elem(ctx->counter.fd, key, encoded_value, 0);
 
         if (ret != 0) {
             error_code = errno;
-            fprintf(stderr, "failed to set all entries: %s\n", strerror(error_code));
+            pr_err("failed to set all entries: %s\n", strerror(error_code));
             break;
         }
 
-    } while (bpf_map_get_next_key(ctx->counter.fd, key, next_key) == 0);
+    } while (map_ops->get_next_key(ctx->counter.fd, key, next_key) == 0);
 
 clean_up:
     if (key)
@@ -428,13 +452,13 @@ static int do_counter_set(psabpf_counter_context_t *ctx, psabpf_counter_entry_t
     if (remove_entry_allowed &&
         ctx->counter.type == BPF_MAP_TYPE_HASH &&
         is_zero_counter_value(&value[0], ctx->counter.value_size)) {
-        ret = bpf_map_delete_elem(ctx->counter.fd, entry->raw_key);
+        ret = txn_map_delete_elem(ctx->counter.fd, entry->raw_key);
     } else {
-        ret = bpf_map_update_elem(ctx->counter.fd, entry->raw_key, &value[0], 0);
+        ret = txn_map_update_elem(ctx->counter.fd, entry->raw_key, &value[0], 0);
     }
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to set an entry: %s\n", strerror(ret));
+        pr_err("failed to set an entry: %s\n", strerror(ret));
     }
 
     return ret;
@@ -442,11 +466,15 @@ static int do_counter_set(psabpf_counter_context_t *ctx, psabpf_counter_entry_t
 
 int psabpf_counter_set(psabpf_counter_context_t *ctx, psabpf_counter_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_COUNTER_SET);
+
     return do_counter_set(ctx, entry, false);
 }
 
 int psabpf_counter_reset(psabpf_counter_context_t *ctx, psabpf_counter_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_COUNTER_RESET);
+
     if (ctx == NULL || entry == NULL)
         return EINVAL;
 
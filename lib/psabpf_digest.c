@@ -25,6 +25,8 @@
 
 #include "btf.h"
 #include "common.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 void psabpf_digest_ctx_init(psabpf_digest_context_t *ctx)
 {
@@ -54,26 +56,28 @@ static int parse_digest_btf(psabpf_digest_context_t *ctx)
 
 int psabpf_digest_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_digest_context_t *ctx, const char *name)
 {
+    STATS_SCOPE(PSABPF_STATS_DIGEST_CTX_OPEN);
+
     if (psabpf_ctx == NULL || ctx == NULL || name == NULL)
         return EINVAL;
 
     /* get the BTF, it is optional so print only warning */
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR)
-        fprintf(stderr, "warning: couldn't find BTF info\n");
+        pr_warn("warning: couldn't find BTF info\n");
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->queue);
     if (ret != NO_ERROR)
         return ret;
 
     if (ctx->queue.type != BPF_MAP_TYPE_QUEUE) {
-        fprintf(stderr, "%s: not a Digest instance\n", name);
+        pr_err("%s: not a Digest instance\n", name);
         close_object_fd(&ctx->queue.fd);
         return EOPNOTSUPP;
     }
 
     ret = parse_digest_btf(ctx);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to obtain fields names\n");
+        pr_err("failed to obtain fields names\n");
         return ret;
     }
 
@@ -82,6 +86,8 @@ int psabpf_digest_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_digest_context_t
 
 int psabpf_digest_get_next(psabpf_digest_context_t *ctx, psabpf_digest_t *digest)
 {
+    STATS_SCOPE(PSABPF_STATS_DIGEST_GET_NEXT);
+
     if (ctx == NULL || digest == NULL)
         return EINVAL;
 
@@ -92,15 +98,15 @@ int psabpf_digest_get_next(psabpf_digest_context_t *ctx, psabpf_digest_t *digest
 
     digest->raw_data = malloc(ctx->queue.value_size);
     if (digest->raw_data == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
-    int ret = bpf_map_lookup_and_delete_elem(ctx->queue.fd, NULL, digest->raw_data);
+    int ret = map_ops->lookup_and_delete_elem(ctx->queue.fd, NULL, digest->raw_data);
     if (ret != 0) {
         ret = errno;
         if (ret != ENOENT)
-            fprintf(stderr, "failed to pop element from queue: %s\n", strerror(ret));
+            pr_err("failed to pop element from queue: %s\n", strerror(ret));
         psabpf_digest_free(digest);
         return ret;
     }
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include <psabpf.h>
+#include "common.h"
 
 void psabpf_direct_counter_ctx_init(psabpf_direct_counter_context_t *dc_ctx)
 {
@@ -60,7 +61,7 @@ int psabpf_direct_counter_ctx_name(psabpf_direct_counter_context_t *dc_ctx,
         }
     }
 
-    fprintf(stderr, "%s: DirectCounter entry not found\n", dc_name);
+    pr_err("%s: DirectCounter entry not found\n", dc_name);
     return ENOENT;
 }
 
@@ -70,13 +71,10 @@ int psabpf_table_entry_set_direct_counter(psabpf_table_entry_t *entry,
     if (entry == NULL || dc_ctx == NULL || dc == NULL)
         return EINVAL;
 
-    void *tmp_ptr = NULL;
-    if (entry->direct_counters == NULL)
-        tmp_ptr = malloc(sizeof(psabpf_direct_counter_entry_t));
-    else
-        tmp_ptr = realloc(entry->direct_counters, (entry->n_direct_counters + 1) * sizeof(psabpf_direct_counter_entry_t));
+    void *tmp_ptr = arena_or_heap_grow_array(entry->arena, entry->direct_counters, entry->n_direct_counters,
+                                             sizeof(psabpf_direct_counter_entry_t));
     if (tmp_ptr == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
     entry->direct_counters = tmp_ptr;
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include <psabpf.h>
+#include "common.h"
 
 void psabpf_direct_meter_ctx_init(psabpf_direct_meter_context_t *dm_ctx)
 {
@@ -55,7 +56,7 @@ int psabpf_direct_meter_ctx_name(psabpf_direct_meter_context_t *dm_ctx,
         }
     }
 
-    fprintf(stderr, "%s: DirectMeter entry not found\n", dm_name);
+    pr_err("%s: DirectMeter entry not found\n", dm_name);
     return ENOENT;
 }
 
@@ -65,13 +66,10 @@ int psabpf_table_entry_set_direct_meter(psabpf_table_entry_t *entry, psabpf_dire
     if (entry == NULL || dm_ctx == NULL || dm == NULL)
         return EINVAL;
 
-    void *tmp_ptr = NULL;
-    if (entry->direct_meters == NULL)
-        tmp_ptr = malloc(sizeof(psabpf_direct_meter_entry_t));
-    else
-        tmp_ptr = realloc(entry->direct_meters, (entry->n_direct_meters + 1) * sizeof(psabpf_direct_meter_entry_t));
+    void *tmp_ptr = arena_or_heap_grow_array(entry->arena, entry->direct_meters, entry->n_direct_meters,
+                                             sizeof(psabpf_direct_meter_entry_t));
     if (tmp_ptr == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
     entry->direct_meters = tmp_ptr;
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <psabpf.h>
+#include "common.h"
+
+#define LOG_MESSAGE_MAX_LEN 1024
+
+psabpf_log_level_t log_level = PSABPF_LOG_INFO;
+
+static void default_log_handler(psabpf_log_level_t level, const char *message, void *user_data);
+
+static psabpf_log_handler_t log_handler = default_log_handler;
+static void *log_handler_data = NULL;
+
+/* Messages written by the default handler in the current second, handler may be called from many threads */
+static pthread_mutex_t rate_limit_lock = PTHREAD_MUTEX_INITIALIZER;
+static time_t rate_limit_second;
+static unsigned rate_limit_written;
+static unsigned long rate_limit_dropped;
+
+static void default_log_handler(psabpf_log_level_t level, const char *message, void *user_data)
+{
+    struct timespec now;
+    (void) level; (void) user_data;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&rate_limit_lock);
+    if (now.tv_sec != rate_limit_second) {
+        rate_limit_second = now.tv_sec;
+        rate_limit_written = 0;
+    }
+    if (rate_limit_written >= PSABPF_LOG_RATE_LIMIT) {
+        rate_limit_dropped++;
+        pthread_mutex_unlock(&rate_limit_lock);
+        return;
+    }
+    rate_limit_written++;
+    unsigned long dropped = rate_limit_dropped;
+    rate_limit_dropped = 0;
+    pthread_mutex_unlock(&rate_limit_lock);
+
+    if (dropped > 0)
+        fprintf(stderr, "(%lu messages dropped)\n%s\n", dropped, message);
+    else
+        fprintf(stderr, "%s\n", message);
+}
+
+void psabpf_set_log_handler(psabpf_log_handler_t handler, void *user_data)
+{
+    if (handler == NULL) {
+        log_handler = default_log_handler;
+        log_handler_data = NULL;
+        return;
+    }
+    log_handler = handler;
+    log_handler_data = user_data;
+}
+
+void psabpf_set_log_level(psabpf_log_level_t level)
+{
+    log_level = level;
+}
+
+psabpf_log_level_t psabpf_get_log_level(void)
+{
+    return log_level;
+}
+
+void log_message(psabpf_log_level_t level, const char *format, ...)
+{
+    char message[LOG_MESSAGE_MAX_LEN];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (len < 0)
+        return;
+
+    /* Messages are written like lines of stderr, handler gets them without new line */
+    len = (int) strnlen(message, sizeof(message));
+    while (len > 0 && message[len - 1] == '\n')
+        message[--len] = '\0';
+
+    log_handler(level, message, log_handler_data);
+}
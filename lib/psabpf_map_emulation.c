@@ -0,0 +1,1173 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* for memfd_create */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+#include <bpf/libbpf.h>
+#include <linux/bpf.h>
+
+#include <psabpf.h>
+#include "psabpf_map_ops.h"
+
+#define EMU_NO_SLOT UINT32_MAX
+#define EMU_INODE_BUCKETS 1024
+/* Number of created maps after which unused ones are looked for */
+#define EMU_GC_INTERVAL 256
+
+typedef struct emu_map {
+    struct bpf_map_info info;
+    dev_t dev;
+    ino_t ino;
+    int fd;  /* held by the registry, returned descriptors are its duplicates */
+    char *pin_path;
+    unsigned outer_refs;  /* elements of maps of maps which hold this map, changed atomically */
+    bool has_fds;         /* used only while garbage is collected */
+
+    /* Elements are stored in slots, key followed by value. Array index is the slot number,
+     * hash maps and LPM tries chain used slots in buckets and free slots in free list. */
+    uint32_t value_size;  /* of stored value: for all CPUs for per-CPU maps, inner map ID for maps of maps */
+    size_t value_offset;
+    size_t slot_size;
+    char *slots;
+    bool *used;
+    uint32_t n_used;
+    uint32_t first_used;  /* no used slot before it */
+
+    uint32_t *buckets;
+    uint32_t *next;
+    uint32_t bucket_mask;
+    uint32_t free_slot;
+
+    uint32_t *prefix_count;  /* LPM: number of entries with given prefix length */
+    uint32_t max_prefix_len;
+    char *lookup_key;        /* LPM: buffer for masked key */
+
+    uint32_t queue_head;     /* queue: ring buffer of n_used elements */
+
+    /* Held by every operation on elements, also by lookups, which use lookup_key and move first_used */
+    pthread_mutex_t lock;
+
+    struct emu_map *ino_next;
+} emu_map_t;
+
+typedef struct emu_btf {
+    char *pipeline_path;
+    void *data;
+    uint32_t size;
+    struct emu_btf *next;
+} emu_btf_t;
+
+static struct {
+    emu_map_t **by_id;  /* map with ID is at index ID - 1, NULL when released */
+    uint32_t n_ids;
+    uint32_t ids_capacity;
+    emu_map_t *by_ino[EMU_INODE_BUCKETS];
+    unsigned created_since_gc;
+    emu_btf_t *btfs;
+} registry;
+
+/* Operations on elements hold it for reading, so maps are not released and pin paths do not change under them.
+ * Maps of maps touch their inner maps only through outer_refs. */
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int emu_error(int err)
+{
+    errno = err;
+    return -err;
+}
+
+static bool is_array_map(const emu_map_t *map)
+{
+    return map->info.type == BPF_MAP_TYPE_ARRAY || map->info.type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+           map->info.type == BPF_MAP_TYPE_ARRAY_OF_MAPS;
+}
+
+static bool is_map_of_maps(const emu_map_t *map)
+{
+    return map->info.type == BPF_MAP_TYPE_ARRAY_OF_MAPS || map->info.type == BPF_MAP_TYPE_HASH_OF_MAPS;
+}
+
+static bool is_lru_map(const emu_map_t *map)
+{
+    return map->info.type == BPF_MAP_TYPE_LRU_HASH || map->info.type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+static char *slot_key(const emu_map_t *map, uint32_t slot)
+{
+    return map->slots + (size_t) slot * map->slot_size;
+}
+
+static char *slot_value(const emu_map_t *map, uint32_t slot)
+{
+    return slot_key(map, slot) + map->value_offset;
+}
+
+static uint32_t hash_key(const void *key, uint32_t len)
+{
+    /* FNV-1a */
+    const unsigned char *data = key;
+    uint32_t hash = 2166136261U;
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static emu_map_t *find_map_by_inode(dev_t dev, ino_t ino)
+{
+    for (emu_map_t *map = registry.by_ino[ino % EMU_INODE_BUCKETS]; map != NULL; map = map->ino_next) {
+        if (map->ino == ino && map->dev == dev)
+            return map;
+    }
+    return NULL;
+}
+
+static emu_map_t *find_map_by_fd(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return NULL;
+
+    emu_map_t *map = find_map_by_inode(st.st_dev, st.st_ino);
+    if (map == NULL)
+        errno = EBADF;
+    return map;
+}
+
+static emu_map_t *find_map_by_id(uint32_t id)
+{
+    if (id == 0 || id > registry.n_ids)
+        return NULL;
+    return registry.by_id[id - 1];
+}
+
+static emu_map_t *find_map_by_path(const char *pathname)
+{
+    for (uint32_t i = 0; i < registry.n_ids; i++) {
+        emu_map_t *map = registry.by_id[i];
+        if (map != NULL && map->pin_path != NULL && strcmp(map->pin_path, pathname) == 0)
+            return map;
+    }
+    return NULL;
+}
+
+static bool path_is_under(const char *pathname, const char *dir)
+{
+    size_t len = strlen(dir);
+    return strncmp(pathname, dir, len) == 0 && (pathname[len] == '\0' || pathname[len] == '/');
+}
+
+static int new_map_fd(emu_map_t *map)
+{
+    int fd = fcntl(map->fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        return -errno;
+    return fd;
+}
+
+/* Slots */
+
+static uint32_t find_slot(const emu_map_t *map, const void *key)
+{
+    if (is_array_map(map)) {
+        uint32_t index = *(const uint32_t *) key;
+        return index < map->info.max_entries ? index : EMU_NO_SLOT;
+    }
+
+    uint32_t slot = map->buckets[hash_key(key, map->info.key_size) & map->bucket_mask];
+    while (slot != EMU_NO_SLOT) {
+        if (memcmp(slot_key(map, slot), key, map->info.key_size) == 0)
+            return slot;
+        slot = map->next[slot];
+    }
+    return EMU_NO_SLOT;
+}
+
+static uint32_t find_next_used_slot(emu_map_t *map, uint32_t slot)
+{
+    for (; slot < map->info.max_entries; slot++) {
+        if (map->used[slot])
+            return slot;
+    }
+    return EMU_NO_SLOT;
+}
+
+static uint32_t insert_slot(emu_map_t *map, const void *key)
+{
+    uint32_t slot = map->free_slot;
+    if (slot == EMU_NO_SLOT)
+        return EMU_NO_SLOT;
+    map->free_slot = map->next[slot];
+
+    memcpy(slot_key(map, slot), key, map->info.key_size);
+    uint32_t bucket = hash_key(key, map->info.key_size) & map->bucket_mask;
+    map->next[slot] = map->buckets[bucket];
+    map->buckets[bucket] = slot;
+
+    map->used[slot] = true;
+    map->n_used++;
+    if (slot < map->first_used)
+        map->first_used = slot;
+    if (map->prefix_count != NULL)
+        map->prefix_count[*(uint32_t *) slot_key(map, slot)]++;
+
+    return slot;
+}
+
+static void remove_slot(emu_map_t *map, uint32_t slot)
+{
+    uint32_t *link = &map->buckets[hash_key(slot_key(map, slot), map->info.key_size) & map->bucket_mask];
+    while (*link != slot)
+        link = &map->next[*link];
+    *link = map->next[slot];
+
+    map->next[slot] = map->free_slot;
+    map->free_slot = slot;
+
+    map->used[slot] = false;
+    map->n_used--;
+    if (map->prefix_count != NULL)
+        map->prefix_count[*(uint32_t *) slot_key(map, slot)]--;
+}
+
+/* Key of LPM trie with bits after prefix cleared, so it can be compared as a whole */
+static int mask_lpm_key(emu_map_t *map, const void *key, uint32_t prefix_len)
+{
+    if (prefix_len > map->max_prefix_len)
+        return EINVAL;
+
+    const unsigned char *data = (const unsigned char *) key + sizeof(uint32_t);
+    unsigned char *masked = (unsigned char *) map->lookup_key + sizeof(uint32_t);
+    uint32_t data_len = map->info.key_size - sizeof(uint32_t);
+    uint32_t full_bytes = prefix_len / 8;
+
+    memcpy(map->lookup_key, &prefix_len, sizeof(uint32_t));
+    memcpy(masked, data, full_bytes);
+    memset(masked + full_bytes, 0, data_len - full_bytes);
+    if (prefix_len % 8 != 0)
+        masked[full_bytes] = data[full_bytes] & (unsigned char) (0xFF00 >> (prefix_len % 8));
+
+    return NO_ERROR;
+}
+
+static uint32_t find_key_slot(emu_map_t *map, const void *key)
+{
+    if (map->info.type != BPF_MAP_TYPE_LPM_TRIE)
+        return find_slot(map, key);
+
+    if (mask_lpm_key(map, key, *(const uint32_t *) key) != NO_ERROR)
+        return EMU_NO_SLOT;
+    return find_slot(map, map->lookup_key);
+}
+
+/* Longest prefix match, prefix length in the key limits length of the match */
+static uint32_t find_lpm_slot(emu_map_t *map, const void *key)
+{
+    uint32_t prefix_len = *(const uint32_t *) key;
+    if (prefix_len > map->max_prefix_len)
+        prefix_len = map->max_prefix_len;
+
+    for (uint32_t len = prefix_len + 1; len-- > 0;) {
+        if (map->prefix_count[len] == 0)
+            continue;
+        mask_lpm_key(map, key, len);
+        uint32_t slot = find_slot(map, map->lookup_key);
+        if (slot != EMU_NO_SLOT)
+            return slot;
+    }
+    return EMU_NO_SLOT;
+}
+
+/* Maps of maps store ID of inner map, which is held until element is removed */
+
+static void release_inner_map(emu_map_t *map, uint32_t slot)
+{
+    if (!is_map_of_maps(map))
+        return;
+
+    emu_map_t *inner = find_map_by_id(*(uint32_t *) slot_value(map, slot));
+    if (inner == NULL)
+        return;
+    unsigned refs = __atomic_load_n(&inner->outer_refs, __ATOMIC_RELAXED);
+    while (refs > 0 && !__atomic_compare_exchange_n(&inner->outer_refs, &refs, refs - 1, true,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static int resolve_value(emu_map_t *map, const void *value, const void **stored)
+{
+    *stored = value;
+    if (!is_map_of_maps(map))
+        return NO_ERROR;
+
+    emu_map_t *inner = find_map_by_fd(*(const int *) value);
+    if (inner == NULL)
+        return EBADF;
+    if (is_map_of_maps(inner))
+        return EINVAL;
+    *stored = &inner->info.id;
+
+    return NO_ERROR;
+}
+
+static void store_value(emu_map_t *map, uint32_t slot, const void *stored)
+{
+    if (is_map_of_maps(map)) {
+        emu_map_t *inner = find_map_by_id(*(const uint32_t *) stored);
+        __atomic_fetch_add(&inner->outer_refs, 1, __ATOMIC_RELAXED);
+    }
+    memcpy(slot_value(map, slot), stored, map->value_size);
+}
+
+/* Registry */
+
+static void free_map(emu_map_t *map)
+{
+    if (map->used != NULL && is_map_of_maps(map)) {
+        for (uint32_t slot = 0; slot < map->info.max_entries; slot++) {
+            if (map->used[slot])
+                release_inner_map(map, slot);
+        }
+    }
+
+    if (map->fd >= 0) {
+        emu_map_t **link = &registry.by_ino[map->ino % EMU_INODE_BUCKETS];
+        while (*link != NULL && *link != map)
+            link = &(*link)->ino_next;
+        if (*link != NULL)
+            *link = map->ino_next;
+        close(map->fd);
+    }
+    if (map->info.id != 0)
+        registry.by_id[map->info.id - 1] = NULL;
+
+    free(map->pin_path);
+    free(map->slots);
+    free(map->used);
+    free(map->buckets);
+    free(map->next);
+    free(map->prefix_count);
+    free(map->lookup_key);
+    pthread_mutex_destroy(&map->lock);
+    free(map);
+}
+
+static void collect_garbage(void)
+{
+    bool any_candidate = false;
+    for (uint32_t i = 0; i < registry.n_ids; i++) {
+        emu_map_t *map = registry.by_id[i];
+        if (map == NULL)
+            continue;
+        map->has_fds = false;
+        if (map->pin_path == NULL && map->outer_refs == 0)
+            any_candidate = true;
+    }
+    registry.created_since_gc = 0;
+    if (!any_candidate)
+        return;
+
+    /* When descriptors can't be checked maps are kept */
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char *end;
+        long fd = strtol(entry->d_name, &end, 10);
+        if (end == entry->d_name || *end != '\0' || fd == dirfd(dir))
+            continue;
+
+        struct stat st;
+        if (fstat((int) fd, &st) != 0)
+            continue;
+        emu_map_t *map = find_map_by_inode(st.st_dev, st.st_ino);
+        if (map != NULL && map->fd != fd)
+            map->has_fds = true;
+    }
+    closedir(dir);
+
+    /* Released map of maps may leave its inner maps unused */
+    bool released;
+    do {
+        released = false;
+        for (uint32_t i = 0; i < registry.n_ids; i++) {
+            emu_map_t *map = registry.by_id[i];
+            if (map != NULL && map->pin_path == NULL && map->outer_refs == 0 && !map->has_fds) {
+                free_map(map);
+                released = true;
+            }
+        }
+    } while (released);
+}
+
+static int register_map(emu_map_t *map)
+{
+    if (registry.n_ids == registry.ids_capacity) {
+        uint32_t capacity = registry.ids_capacity > 0 ? registry.ids_capacity * 2 : 64;
+        emu_map_t **by_id = realloc(registry.by_id, capacity * sizeof(emu_map_t *));
+        if (by_id == NULL)
+            return ENOMEM;
+        registry.by_id = by_id;
+        registry.ids_capacity = capacity;
+    }
+
+    map->fd = memfd_create("psabpf-emulated-map", MFD_CLOEXEC);
+    if (map->fd < 0)
+        return errno;
+    struct stat st;
+    if (fstat(map->fd, &st) != 0)
+        return errno;
+    map->dev = st.st_dev;
+    map->ino = st.st_ino;
+    map->ino_next = registry.by_ino[map->ino % EMU_INODE_BUCKETS];
+    registry.by_ino[map->ino % EMU_INODE_BUCKETS] = map;
+
+    registry.by_id[registry.n_ids++] = map;
+    map->info.id = registry.n_ids;
+
+    return NO_ERROR;
+}
+
+static int init_map_storage(emu_map_t *map)
+{
+    uint32_t max_entries = map->info.max_entries;
+
+    map->value_offset = (map->info.key_size + 7) & ~7U;
+    map->slot_size = map->value_offset + ((map->value_size + 7) & ~7U);
+    map->slots = calloc(max_entries, map->slot_size);
+    map->used = calloc(max_entries, sizeof(bool));
+    if (map->slots == NULL || map->used == NULL)
+        return ENOMEM;
+    map->first_used = EMU_NO_SLOT;
+
+    if (map->info.type == BPF_MAP_TYPE_ARRAY || map->info.type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+        memset(map->used, true, max_entries);
+        map->n_used = max_entries;
+        map->first_used = 0;
+        return NO_ERROR;
+    }
+    if (is_array_map(map) || map->info.type == BPF_MAP_TYPE_QUEUE)
+        return NO_ERROR;
+
+    uint32_t n_buckets = 1;
+    while (n_buckets < max_entries && n_buckets < (1U << 31))
+        n_buckets <<= 1;
+    map->bucket_mask = n_buckets - 1;
+    map->buckets = malloc(n_buckets * sizeof(uint32_t));
+    map->next = malloc(max_entries * sizeof(uint32_t));
+    if (map->buckets == NULL || map->next == NULL)
+        return ENOMEM;
+    memset(map->buckets, 0xFF, n_buckets * sizeof(uint32_t));
+    /* Free slots are taken in order, so elements are iterated in order of insertion until first removal */
+    for (uint32_t slot = 0; slot < max_entries; slot++)
+        map->next[slot] = slot + 1 < max_entries ? slot + 1 : EMU_NO_SLOT;
+    map->free_slot = 0;
+
+    if (map->info.type == BPF_MAP_TYPE_LPM_TRIE) {
+        map->max_prefix_len = (map->info.key_size - sizeof(uint32_t)) * 8;
+        map->prefix_count = calloc(map->max_prefix_len + 1, sizeof(uint32_t));
+        map->lookup_key = calloc(1, map->info.key_size);
+        if (map->prefix_count == NULL || map->lookup_key == NULL)
+            return ENOMEM;
+    }
+
+    return NO_ERROR;
+}
+
+static int validate_map_attr(const struct bpf_create_map_attr *attr, uint32_t *value_size)
+{
+    if (attr->max_entries == 0)
+        return EINVAL;
+    *value_size = attr->value_size;
+
+    switch (attr->map_type) {
+        case BPF_MAP_TYPE_HASH:
+        case BPF_MAP_TYPE_LRU_HASH:
+            return attr->key_size > 0 && attr->value_size > 0 ? NO_ERROR : EINVAL;
+
+        case BPF_MAP_TYPE_ARRAY:
+            return attr->key_size == sizeof(uint32_t) && attr->value_size > 0 ? NO_ERROR : EINVAL;
+
+        case BPF_MAP_TYPE_PERCPU_HASH:
+        case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+        case BPF_MAP_TYPE_PERCPU_ARRAY: {
+            if (attr->key_size == 0 || attr->value_size == 0)
+                return EINVAL;
+            if (attr->map_type == BPF_MAP_TYPE_PERCPU_ARRAY && attr->key_size != sizeof(uint32_t))
+                return EINVAL;
+            int n_cpus = libbpf_num_possible_cpus();
+            if (n_cpus <= 0)
+                return EINVAL;
+            *value_size = ((attr->value_size + 7) & ~7U) * (uint32_t) n_cpus;
+            return NO_ERROR;
+        }
+
+        case BPF_MAP_TYPE_LPM_TRIE:
+            return attr->key_size > sizeof(uint32_t) && attr->value_size > 0 ? NO_ERROR : EINVAL;
+
+        case BPF_MAP_TYPE_QUEUE:
+            return attr->key_size == 0 && attr->value_size > 0 ? NO_ERROR : EINVAL;
+
+        case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+        case BPF_MAP_TYPE_HASH_OF_MAPS:
+            if (attr->value_size != sizeof(uint32_t) || attr->key_size == 0)
+                return EINVAL;
+            if (attr->map_type == BPF_MAP_TYPE_ARRAY_OF_MAPS && attr->key_size != sizeof(uint32_t))
+                return EINVAL;
+            return NO_ERROR;
+
+        default:
+            return EINVAL;
+    }
+}
+
+static int create_map(const struct bpf_create_map_attr *attr)
+{
+    uint32_t value_size;
+    int ret = validate_map_attr(attr, &value_size);
+    if (ret != NO_ERROR)
+        return emu_error(ret);
+
+    if (++registry.created_since_gc >= EMU_GC_INTERVAL)
+        collect_garbage();
+
+    emu_map_t *map = calloc(1, sizeof(emu_map_t));
+    if (map == NULL)
+        return emu_error(ENOMEM);
+    pthread_mutex_init(&map->lock, NULL);
+    map->fd = -1;
+    map->info.type = attr->map_type;
+    map->info.key_size = attr->key_size;
+    map->info.value_size = attr->value_size;
+    map->info.max_entries = attr->max_entries;
+    map->info.map_flags = attr->map_flags;
+    map->info.btf_key_type_id = attr->btf_key_type_id;
+    map->info.btf_value_type_id = attr->btf_value_type_id;
+    if (attr->name != NULL)
+        strncpy(map->info.name, attr->name, sizeof(map->info.name) - 1);
+    map->value_size = value_size;
+
+    ret = init_map_storage(map);
+    if (ret == NO_ERROR)
+        ret = register_map(map);
+    if (ret != NO_ERROR) {
+        free_map(map);
+        return emu_error(ret);
+    }
+
+    int fd = new_map_fd(map);
+    if (fd < 0) {
+        ret = errno;
+        free_map(map);
+        return emu_error(ret);
+    }
+    return fd;
+}
+
+static int emu_create_map(const struct bpf_create_map_attr *attr)
+{
+    pthread_rwlock_wrlock(&registry_lock);
+    int ret = create_map(attr);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+/* Objects */
+
+static int emu_obj_get(const char *pathname)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    emu_map_t *map = find_map_by_path(pathname);
+    int ret = map != NULL ? new_map_fd(map) : emu_error(ENOENT);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+static int obj_pin(int fd, const char *pathname)
+{
+    emu_map_t *map = find_map_by_fd(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+    if (map->pin_path != NULL || find_map_by_path(pathname) != NULL)
+        return emu_error(EEXIST);
+
+    map->pin_path = strdup(pathname);
+    if (map->pin_path == NULL)
+        return emu_error(ENOMEM);
+    return 0;
+}
+
+static int emu_obj_pin(int fd, const char *pathname)
+{
+    pthread_rwlock_wrlock(&registry_lock);
+    int ret = obj_pin(fd, pathname);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+static bool path_exists(const char *pathname)
+{
+    for (uint32_t i = 0; i < registry.n_ids; i++) {
+        emu_map_t *map = registry.by_id[i];
+        if (map != NULL && map->pin_path != NULL && path_is_under(map->pin_path, pathname))
+            return true;
+    }
+    for (emu_btf_t *btf = registry.btfs; btf != NULL; btf = btf->next) {
+        if (path_is_under(btf->pipeline_path, pathname))
+            return true;
+    }
+    return false;
+}
+
+static bool emu_path_exists(const char *pathname)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    bool exists = path_exists(pathname);
+    pthread_rwlock_unlock(&registry_lock);
+    return exists;
+}
+
+static int emu_obj_get_info_by_fd(int fd, void *info, uint32_t *info_len)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    emu_map_t *map = find_map_by_fd(fd);
+    if (map == NULL) {
+        pthread_rwlock_unlock(&registry_lock);
+        return emu_error(EBADF);
+    }
+
+    /* Information is not changed after map is created */
+    uint32_t len = *info_len < sizeof(struct bpf_map_info) ? *info_len : sizeof(struct bpf_map_info);
+    memcpy(info, &map->info, len);
+    *info_len = len;
+    pthread_rwlock_unlock(&registry_lock);
+    return 0;
+}
+
+static int emu_get_fd_by_id(uint32_t id)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    emu_map_t *map = find_map_by_id(id);
+    int ret = map != NULL ? new_map_fd(map) : emu_error(ENOENT);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+/* Elements */
+
+static emu_map_t *lock_map(int fd)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    emu_map_t *map = find_map_by_fd(fd);
+    if (map == NULL) {
+        pthread_rwlock_unlock(&registry_lock);
+        return NULL;
+    }
+    pthread_mutex_lock(&map->lock);
+    return map;
+}
+
+static void unlock_map(emu_map_t *map)
+{
+    pthread_mutex_unlock(&map->lock);
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+static int lookup_elem(emu_map_t *map, const void *key, void *value)
+{
+    uint32_t slot;
+    if (map->info.type == BPF_MAP_TYPE_QUEUE) {
+        if (map->n_used == 0)
+            return emu_error(ENOENT);
+        memcpy(value, slot_value(map, map->queue_head), map->value_size);
+        return 0;
+    }
+    if (map->info.type == BPF_MAP_TYPE_LPM_TRIE)
+        slot = find_lpm_slot(map, key);
+    else
+        slot = find_slot(map, key);
+    if (slot == EMU_NO_SLOT || !map->used[slot])
+        return emu_error(ENOENT);
+
+    memcpy(value, slot_value(map, slot), map->value_size);
+    return 0;
+}
+
+static int emu_lookup_elem(int fd, const void *key, void *value)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+
+    int ret = lookup_elem(map, key, value);
+    unlock_map(map);
+    return ret;
+}
+
+static int emu_lookup_elem_flags(int fd, const void *key, void *value, uint64_t flags)
+{
+    if (flags & ~((uint64_t) BPF_F_LOCK))
+        return emu_error(EINVAL);
+    return emu_lookup_elem(fd, key, value);
+}
+
+static int lookup_and_delete_elem(emu_map_t *map, const void *key, void *value)
+{
+    if (map->info.type == BPF_MAP_TYPE_QUEUE) {
+        if (map->n_used == 0)
+            return emu_error(ENOENT);
+        memcpy(value, slot_value(map, map->queue_head), map->value_size);
+        map->queue_head = (map->queue_head + 1) % map->info.max_entries;
+        map->n_used--;
+        return 0;
+    }
+    if (map->info.type != BPF_MAP_TYPE_HASH && map->info.type != BPF_MAP_TYPE_LRU_HASH)
+        return emu_error(EOPNOTSUPP);
+
+    uint32_t slot = find_slot(map, key);
+    if (slot == EMU_NO_SLOT)
+        return emu_error(ENOENT);
+    memcpy(value, slot_value(map, slot), map->value_size);
+    remove_slot(map, slot);
+    return 0;
+}
+
+static int emu_lookup_and_delete_elem(int fd, const void *key, void *value)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+
+    int ret = lookup_and_delete_elem(map, key, value);
+    unlock_map(map);
+    return ret;
+}
+
+static int update_elem(emu_map_t *map, const void *key, const void *value, uint64_t flags)
+{
+    flags &= ~((uint64_t) BPF_F_LOCK);
+    if (flags > BPF_EXIST)
+        return emu_error(EINVAL);
+
+    if (map->info.type == BPF_MAP_TYPE_QUEUE) {
+        if (map->n_used == map->info.max_entries) {
+            if (flags != BPF_EXIST)
+                return emu_error(E2BIG);
+            /* Oldest element is replaced */
+            map->queue_head = (map->queue_head + 1) % map->info.max_entries;
+            map->n_used--;
+        }
+        uint32_t slot = (map->queue_head + map->n_used) % map->info.max_entries;
+        memcpy(slot_value(map, slot), value, map->value_size);
+        map->n_used++;
+        return 0;
+    }
+
+    const void *stored;
+    int ret = resolve_value(map, value, &stored);
+    if (ret != NO_ERROR)
+        return emu_error(ret);
+
+    if (is_array_map(map)) {
+        uint32_t slot = find_slot(map, key);
+        if (slot == EMU_NO_SLOT)
+            return emu_error(E2BIG);
+        if (flags == BPF_NOEXIST && (map->used[slot] || !is_map_of_maps(map)))
+            return emu_error(EEXIST);
+        if (map->used[slot]) {
+            release_inner_map(map, slot);
+        } else {
+            map->used[slot] = true;
+            map->n_used++;
+            if (slot < map->first_used)
+                map->first_used = slot;
+        }
+        store_value(map, slot, stored);
+        return 0;
+    }
+
+    if (map->info.type == BPF_MAP_TYPE_LPM_TRIE) {
+        if (mask_lpm_key(map, key, *(const uint32_t *) key) != NO_ERROR)
+            return emu_error(EINVAL);
+        key = map->lookup_key;
+    }
+
+    uint32_t slot = find_slot(map, key);
+    if (slot != EMU_NO_SLOT) {
+        if (flags == BPF_NOEXIST)
+            return emu_error(EEXIST);
+        release_inner_map(map, slot);
+        store_value(map, slot, stored);
+        return 0;
+    }
+
+    if (flags == BPF_EXIST)
+        return emu_error(ENOENT);
+    if (map->free_slot == EMU_NO_SLOT && is_lru_map(map)) {
+        /* Not the least recently used one, but any element can be evicted */
+        remove_slot(map, find_next_used_slot(map, map->first_used));
+    }
+    slot = insert_slot(map, key);
+    if (slot == EMU_NO_SLOT)
+        return emu_error(E2BIG);
+    store_value(map, slot, stored);
+
+    return 0;
+}
+
+static int emu_update_elem(int fd, const void *key, const void *value, uint64_t flags)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+
+    int ret = update_elem(map, key, value, flags);
+    unlock_map(map);
+    return ret;
+}
+
+static int delete_elem(emu_map_t *map, const void *key)
+{
+    if (map->info.type == BPF_MAP_TYPE_QUEUE || map->info.type == BPF_MAP_TYPE_ARRAY ||
+        map->info.type == BPF_MAP_TYPE_PERCPU_ARRAY)
+        return emu_error(EINVAL);
+
+    uint32_t slot = find_key_slot(map, key);
+    if (slot == EMU_NO_SLOT || !map->used[slot])
+        return emu_error(ENOENT);
+
+    release_inner_map(map, slot);
+    if (is_array_map(map)) {
+        map->used[slot] = false;
+        map->n_used--;
+    } else {
+        remove_slot(map, slot);
+    }
+
+    return 0;
+}
+
+static int emu_delete_elem(int fd, const void *key)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+
+    int ret = delete_elem(map, key);
+    unlock_map(map);
+    return ret;
+}
+
+static int get_next_key(emu_map_t *map, const void *key, void *next_key)
+{
+    if (map->info.type == BPF_MAP_TYPE_QUEUE)
+        return emu_error(EINVAL);
+
+    if (is_array_map(map)) {
+        /* Like in kernel, all indexes are iterated, also of unused elements of array of maps */
+        uint32_t index = key != NULL ? *(const uint32_t *) key : UINT32_MAX;
+        index = index < map->info.max_entries ? index + 1 : 0;
+        if (index >= map->info.max_entries)
+            return emu_error(ENOENT);
+        memcpy(next_key, &index, sizeof(index));
+        return 0;
+    }
+
+    /* Not existing key starts iteration from the beginning */
+    uint32_t slot = key != NULL ? find_key_slot(map, key) : EMU_NO_SLOT;
+    if (slot == EMU_NO_SLOT) {
+        slot = map->first_used;
+        if (slot != EMU_NO_SLOT) {
+            slot = find_next_used_slot(map, slot);
+            map->first_used = slot;
+        }
+    } else {
+        slot = find_next_used_slot(map, slot + 1);
+    }
+    if (slot == EMU_NO_SLOT)
+        return emu_error(ENOENT);
+
+    memcpy(next_key, slot_key(map, slot), map->info.key_size);
+    return 0;
+}
+
+static int emu_get_next_key(int fd, const void *key, void *next_key)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL)
+        return emu_error(EBADF);
+
+    int ret = get_next_key(map, key, next_key);
+    unlock_map(map);
+    return ret;
+}
+
+/* Batches, position in batch is the number of slot */
+
+static int lookup_batch(emu_map_t *map, void *in_batch, void *out_batch, void *keys, void *values,
+                        uint32_t *count, bool delete)
+{
+    const uint32_t max_count = *count;
+    *count = 0;
+    if (map->info.type == BPF_MAP_TYPE_QUEUE || map->info.type == BPF_MAP_TYPE_LPM_TRIE ||
+        (delete && is_array_map(map)))
+        return emu_error(EOPNOTSUPP);
+    if (max_count == 0)
+        return emu_error(EINVAL);
+
+    uint32_t slot = in_batch != NULL ? *(uint32_t *) in_batch : 0;
+    uint32_t n = 0;
+    for (; n < max_count; slot++) {
+        slot = find_next_used_slot(map, slot);
+        if (slot == EMU_NO_SLOT)
+            break;
+
+        char *key = (char *) keys + (size_t) n * map->info.key_size;
+        if (is_array_map(map))
+            memcpy(key, &slot, sizeof(slot));
+        else
+            memcpy(key, slot_key(map, slot), map->info.key_size);
+        memcpy((char *) values + (size_t) n * map->value_size, slot_value(map, slot), map->value_size);
+        if (delete) {
+            release_inner_map(map, slot);
+            remove_slot(map, slot);
+        }
+        n++;
+    }
+
+    *count = n;
+    if (slot == EMU_NO_SLOT || slot >= map->info.max_entries)
+        return emu_error(ENOENT);
+    memcpy(out_batch, &slot, sizeof(slot));
+
+    return 0;
+}
+
+static int emu_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                            uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    (void) opts;
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL) {
+        *count = 0;
+        return emu_error(EBADF);
+    }
+
+    int ret = lookup_batch(map, in_batch, out_batch, keys, values, count, false);
+    unlock_map(map);
+    return ret;
+}
+
+static int emu_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                       uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    (void) opts;
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL) {
+        *count = 0;
+        return emu_error(EBADF);
+    }
+
+    int ret = lookup_batch(map, in_batch, out_batch, keys, values, count, true);
+    unlock_map(map);
+    return ret;
+}
+
+static int emu_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                            const struct bpf_map_batch_opts *opts)
+{
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL) {
+        *count = 0;
+        return emu_error(EBADF);
+    }
+
+    uint64_t elem_flags = opts != NULL ? opts->elem_flags : 0;
+    /* Values are given as for lookup, except maps of maps, which take descriptors */
+    size_t value_size = is_map_of_maps(map) ? sizeof(int) : map->value_size;
+    const uint32_t n = *count;
+    int ret = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        ret = update_elem(map, (char *) keys + (size_t) i * map->info.key_size,
+                          (char *) values + i * value_size, elem_flags);
+        if (ret != 0) {
+            *count = i;
+            break;
+        }
+    }
+
+    unlock_map(map);
+    return ret;
+}
+
+static int emu_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    (void) opts;
+    emu_map_t *map = lock_map(fd);
+    if (map == NULL) {
+        *count = 0;
+        return emu_error(EBADF);
+    }
+
+    const uint32_t n = *count;
+    int ret = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        ret = delete_elem(map, (char *) keys + (size_t) i * map->info.key_size);
+        if (ret != 0) {
+            *count = i;
+            break;
+        }
+    }
+
+    unlock_map(map);
+    return ret;
+}
+
+const psabpf_map_ops_t emulated_map_ops = {
+    .obj_get = emu_obj_get,
+    .obj_pin = emu_obj_pin,
+    .path_exists = emu_path_exists,
+    .obj_get_info_by_fd = emu_obj_get_info_by_fd,
+    .get_fd_by_id = emu_get_fd_by_id,
+    .create_map = emu_create_map,
+
+    .lookup_elem = emu_lookup_elem,
+    .lookup_elem_flags = emu_lookup_elem_flags,
+    .lookup_and_delete_elem = emu_lookup_and_delete_elem,
+    .update_elem = emu_update_elem,
+    .delete_elem = emu_delete_elem,
+    .get_next_key = emu_get_next_key,
+
+    .lookup_batch = emu_lookup_batch,
+    .lookup_and_delete_batch = emu_lookup_and_delete_batch,
+    .update_batch = emu_update_batch,
+    .delete_batch = emu_delete_batch,
+};
+
+/* Pipelines */
+
+static emu_btf_t **find_pipeline_btf(const char *pipeline_path)
+{
+    emu_btf_t **link = &registry.btfs;
+    while (*link != NULL && strcmp((*link)->pipeline_path, pipeline_path) != 0)
+        link = &(*link)->next;
+    return link;
+}
+
+static int set_pipeline_btf(const char *pipeline_path, const void *data, uint32_t size)
+{
+    emu_btf_t **link = find_pipeline_btf(pipeline_path);
+    emu_btf_t *btf = *link;
+    if (btf == NULL) {
+        btf = calloc(1, sizeof(emu_btf_t));
+        if (btf == NULL)
+            return ENOMEM;
+        btf->pipeline_path = strdup(pipeline_path);
+        if (btf->pipeline_path == NULL) {
+            free(btf);
+            return ENOMEM;
+        }
+        *link = btf;
+    }
+
+    void *copy = malloc(size);
+    if (copy == NULL)
+        return ENOMEM;
+    memcpy(copy, data, size);
+    free(btf->data);
+    btf->data = copy;
+    btf->size = size;
+
+    return NO_ERROR;
+}
+
+int emulation_set_pipeline_btf(const char *pipeline_path, const void *data, uint32_t size)
+{
+    pthread_rwlock_wrlock(&registry_lock);
+    int ret = set_pipeline_btf(pipeline_path, data, size);
+    pthread_rwlock_unlock(&registry_lock);
+    return ret;
+}
+
+static struct btf *load_pipeline_btf(const char *pipeline_path)
+{
+    emu_btf_t *btf = *find_pipeline_btf(pipeline_path);
+    if (btf == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    struct btf *loaded = btf__new(btf->data, btf->size);
+    long err = libbpf_get_error(loaded);
+    if (err != 0) {
+        errno = (int) -err;
+        return NULL;
+    }
+    return loaded;
+}
+
+struct btf *emulation_load_pipeline_btf(const char *pipeline_path)
+{
+    pthread_rwlock_rdlock(&registry_lock);
+    struct btf *loaded = load_pipeline_btf(pipeline_path);
+    pthread_rwlock_unlock(&registry_lock);
+    return loaded;
+}
+
+int emulation_remove_pipeline(const char *pipeline_path)
+{
+    pthread_rwlock_wrlock(&registry_lock);
+
+    for (uint32_t i = 0; i < registry.n_ids; i++) {
+        emu_map_t *map = registry.by_id[i];
+        if (map != NULL && map->pin_path != NULL && path_is_under(map->pin_path, pipeline_path)) {
+            free(map->pin_path);
+            map->pin_path = NULL;
+        }
+    }
+
+    emu_btf_t **link = find_pipeline_btf(pipeline_path);
+    emu_btf_t *btf = *link;
+    if (btf != NULL) {
+        *link = btf->next;
+        free(btf->pipeline_path);
+        free(btf->data);
+        free(btf);
+    }
+
+    collect_garbage();
+
+    pthread_rwlock_unlock(&registry_lock);
+
+    return NO_ERROR;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+
+#include <psabpf.h>
+#include "psabpf_map_ops.h"
+#include "stats.h"
+
+static bool kernel_path_exists(const char *pathname)
+{
+    return access(pathname, F_OK) == 0;
+}
+
+/* Keys and values of batch operations are const in newer libbpf, wrappers accept both */
+static int kernel_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                               const struct bpf_map_batch_opts *opts)
+{
+    return bpf_map_update_batch(fd, keys, values, count, opts);
+}
+
+static int kernel_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    return bpf_map_delete_batch(fd, keys, count, opts);
+}
+
+const psabpf_map_ops_t kernel_map_ops = {
+    .obj_get = bpf_obj_get,
+    .obj_pin = bpf_obj_pin,
+    .path_exists = kernel_path_exists,
+    .obj_get_info_by_fd = bpf_obj_get_info_by_fd,
+    .get_fd_by_id = bpf_map_get_fd_by_id,
+    .create_map = bpf_create_map_xattr,
+
+    .lookup_elem = bpf_map_lookup_elem,
+    .lookup_elem_flags = bpf_map_lookup_elem_flags,
+    .lookup_and_delete_elem = bpf_map_lookup_and_delete_elem,
+    .update_elem = bpf_map_update_elem,
+    .delete_elem = bpf_map_delete_elem,
+    .get_next_key = bpf_map_get_next_key,
+
+    .lookup_batch = bpf_map_lookup_batch,
+    .lookup_and_delete_batch = bpf_map_lookup_and_delete_batch,
+    .update_batch = kernel_update_batch,
+    .delete_batch = kernel_delete_batch,
+};
+
+const psabpf_map_ops_t *map_ops = &kernel_map_ops;
+static psabpf_map_backend_t map_backend = PSABPF_MAP_BACKEND_KERNEL;
+
+int psabpf_set_map_backend(psabpf_map_backend_t backend)
+{
+    switch (backend) {
+        case PSABPF_MAP_BACKEND_KERNEL:
+            stats_set_map_ops(&kernel_map_ops);
+            map_backend = backend;
+            return NO_ERROR;
+        case PSABPF_MAP_BACKEND_EMULATION:
+            stats_set_map_ops(&emulated_map_ops);
+            map_backend = backend;
+            return NO_ERROR;
+        default:
+            return EINVAL;
+    }
+}
+
+psabpf_map_backend_t psabpf_get_map_backend(void)
+{
+    return map_backend;
+}
+
+bool map_ops_emulated(void)
+{
+    return map_backend == PSABPF_MAP_BACKEND_EMULATION;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef P4C_PSABPF_MAP_OPS_H
+#define P4C_PSABPF_MAP_OPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+
+#include "psabpf.h"
+
+/* Every access to BPF maps and their pins made by the library goes through this table. Arguments,
+ * return value and errno follow libbpf. Programs are always handled by libbpf directly. */
+typedef struct psabpf_map_ops {
+    int (*obj_get)(const char *pathname);
+    int (*obj_pin)(int fd, const char *pathname);
+    bool (*path_exists)(const char *pathname);
+    int (*obj_get_info_by_fd)(int fd, void *info, uint32_t *info_len);
+    int (*get_fd_by_id)(uint32_t id);
+    int (*create_map)(const struct bpf_create_map_attr *attr);
+
+    int (*lookup_elem)(int fd, const void *key, void *value);
+    int (*lookup_elem_flags)(int fd, const void *key, void *value, uint64_t flags);
+    int (*lookup_and_delete_elem)(int fd, const void *key, void *value);
+    int (*update_elem)(int fd, const void *key, const void *value, uint64_t flags);
+    int (*delete_elem)(int fd, const void *key);
+    int (*get_next_key)(int fd, const void *key, void *next_key);
+
+    int (*lookup_batch)(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                        uint32_t *count, const struct bpf_map_batch_opts *opts);
+    int (*lookup_and_delete_batch)(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                   uint32_t *count, const struct bpf_map_batch_opts *opts);
+    int (*update_batch)(int fd, void *keys, void *values, uint32_t *count,
+                        const struct bpf_map_batch_opts *opts);
+    int (*delete_batch)(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts);
+} psabpf_map_ops_t;
+
+/* Selected by psabpf_set_map_backend(). Can be replaced afterwards by a table which forwards calls to the
+ * selected one, e.g. to count them (psabpf_stats_enable() does it), backend is still reported by
+ * map_ops_emulated(). */
+extern const psabpf_map_ops_t *map_ops;
+
+extern const psabpf_map_ops_t kernel_map_ops;
+extern const psabpf_map_ops_t emulated_map_ops;
+
+bool map_ops_emulated(void);
+
+/*
+ * Emulation keeps maps in memory of the process. File descriptors of emulated maps are memfds, so they can be
+ * duplicated and closed as usual. Like in kernel, map is released when it is not pinned, not used as an inner map
+ * and no descriptor refers to it, the last one is checked from time to time by scanning /proc/self/fd.
+ * Operations on elements of one map are serialized by its lock, operations on different maps run in parallel.
+ */
+
+/* Emulated pipeline has no programs, so BTF read from its ELF file is stored under pipeline path */
+int emulation_set_pipeline_btf(const char *pipeline_path, const void *data, uint32_t size);
+/* Returns new BTF object, NULL with errno set when pipeline has no BTF */
+struct btf *emulation_load_pipeline_btf(const char *pipeline_path);
+/* Unpins all maps under pipeline path and forgets its BTF */
+int emulation_remove_pipeline(const char *pipeline_path);
+
+#endif  /* P4C_PSABPF_MAP_OPS_H */
@@ -27,8 +27,11 @@
 #include <psabpf.h>
 #include "btf.h"
 #include "common.h"
+#include "psabpf_txn.h"
 #include "psabpf_meter.h"
 #include "psabpf_table.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 /**
  * This function comes from DPDK
@@ -118,7 +121,7 @@ int psabpf_meter_entry_index(psabpf_meter_entry_t *entry, const char *data, size
 
     int ret = struct_field_set_append(&entry->index_sfs, data, size);
     if (ret != NO_ERROR)
-        fprintf(stderr, "couldn't append key to an entry: %s\n", strerror(ret));
+        pr_err("couldn't append key to an entry: %s\n", strerror(ret));
 
     return ret;
 }
@@ -206,21 +209,23 @@ void psabpf_meter_ctx_free(psabpf_meter_ctx_t *ctx) {
 }
 
 int psabpf_meter_ctx_name(psabpf_meter_ctx_t *ctx, psabpf_context_t *psabpf_ctx, const char *name) {
+    STATS_SCOPE(PSABPF_STATS_METER_CTX_OPEN);
+
     if (ctx == NULL || psabpf_ctx == NULL || name == NULL)
         return EPERM;
 
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR) {
-        fprintf(stderr, "couldn't find a BTF info\n");
+        pr_err("couldn't find a BTF info\n");
     }
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->meter);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open meter %s: %s\n", name, strerror(ret));
+        pr_err("couldn't open meter %s: %s\n", name, strerror(ret));
         return ret;
     }
 
     if (sizeof(psabpf_meter_data_t) > ctx->meter.value_size) {
-        fprintf(stderr, "Meter data has bigger size "
+        pr_err("Meter data has bigger size "
                         "(%lu) than meter definition value size (%u)!\n",
                 sizeof(psabpf_meter_data_t), ctx->meter.value_size);
         return EINVAL;
@@ -230,14 +235,29 @@ int psabpf_meter_ctx_name(psabpf_meter_ctx_t *ctx, psabpf_context_t *psabpf_ctx,
     uint32_t type_id = psabtf_get_member_type_id_by_name(ctx->btf_metadata.btf, ctx->meter.btf_type_id, "key");
     ret = parse_struct_type(&ctx->btf_metadata, type_id, ctx->meter.key_size, &ctx->index_fds);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to parse meter type: %s\n", strerror(ret));
+        pr_err("failed to parse meter type: %s\n", strerror(ret));
         return ret;
     }
 
     return NO_ERROR;
 }
 
+int psabpf_meter_ctx_clone(psabpf_meter_ctx_t *dst, psabpf_meter_ctx_t *src) {
+    if (dst == NULL || src == NULL || dst == src)
+        return EINVAL;
+
+    int ret = borrow_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->meter, &src->meter);
+    if (ret == NO_ERROR)
+        ret = copy_struct_field_descriptor_set(&dst->index_fds, &src->index_fds);
+
+    return ret;
+}
+
 int psabpf_meter_entry_get(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry) {
+    STATS_SCOPE(PSABPF_STATS_METER_GET);
+
     int return_code = NO_ERROR;
     uint64_t bpf_flags = BPF_F_LOCK;
     char *value_buffer = NULL;
@@ -246,7 +266,7 @@ int psabpf_meter_entry_get(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry)
         return EINVAL;
 
     if (entry->index_sfs.n_fields == 0) {
-        fprintf(stderr, "Index not provided");
+        pr_err("Index not provided");
         return EINVAL;
     }
 
@@ -254,7 +274,7 @@ int psabpf_meter_entry_get(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry)
         entry->raw_index = malloc(ctx->meter.key_size);
     value_buffer = malloc(ctx->meter.value_size);
     if (entry->raw_index == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return_code = ENOMEM;
         goto clean_up;
     }
@@ -264,10 +284,10 @@ int psabpf_meter_entry_get(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry)
     if (return_code != NO_ERROR)
         goto clean_up;
 
-    return_code = bpf_map_lookup_elem_flags(ctx->meter.fd, entry->raw_index, value_buffer, bpf_flags);
+    return_code = map_ops->lookup_elem_flags(ctx->meter.fd, entry->raw_index, value_buffer, bpf_flags);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get meter: %s\n", strerror(errno));
+        pr_err("failed to get meter: %s\n", strerror(errno));
         goto clean_up;
     }
 
@@ -281,6 +301,8 @@ clean_up:
 }
 
 psabpf_meter_entry_t *psabpf_meter_get_next(psabpf_meter_ctx_t *ctx) {
+    STATS_SCOPE(PSABPF_STATS_METER_GET_NEXT);
+
     psabpf_meter_entry_t *ret_instance = NULL;
     void *next_key = NULL;
     void *value_buffer = NULL;
@@ -291,11 +313,11 @@ psabpf_meter_entry_t *psabpf_meter_get_next(psabpf_meter_ctx_t *ctx) {
     next_key = malloc(ctx->meter.key_size);
     value_buffer = malloc(ctx->meter.value_size);
     if (next_key == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         goto clean_up;
     }
 
-    if (bpf_map_get_next_key(ctx->meter.fd, ctx->previous_index, next_key) != 0) {
+    if (map_ops->get_next_key(ctx->meter.fd, ctx->previous_index, next_key) != 0) {
         /* restart iteration */
         if (ctx->previous_index != NULL)
             free(ctx->previous_index);
@@ -307,7 +329,7 @@ psabpf_meter_entry_t *psabpf_meter_get_next(psabpf_meter_ctx_t *ctx) {
     if (ctx->previous_index == NULL)
         ctx->previous_index = malloc(ctx->meter.key_size);
     if (ctx->previous_index == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         goto clean_up;
     }
 
@@ -317,10 +339,10 @@ psabpf_meter_entry_t *psabpf_meter_get_next(psabpf_meter_ctx_t *ctx) {
     memcpy(ctx->previous_index, next_key, ctx->meter.key_size);
     next_key = NULL;
 
-    int return_code = bpf_map_lookup_elem(ctx->meter.fd, ctx->current_entry.raw_index, value_buffer);
+    int return_code = map_ops->lookup_elem(ctx->meter.fd, ctx->current_entry.raw_index, value_buffer);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+        pr_err("failed to get entry: %s\n", strerror(return_code));
         goto clean_up;
     }
 
@@ -342,6 +364,8 @@ clean_up:
 }
 
 int psabpf_meter_entry_update(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry) {
+    STATS_SCOPE(PSABPF_STATS_METER_UPDATE);
+
     int return_code = NO_ERROR;
     uint64_t bpf_flags = BPF_F_LOCK;
     char *value_buffer = NULL;
@@ -351,7 +375,7 @@ int psabpf_meter_entry_update(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *ent
         return EINVAL;
 
     if (entry->index_sfs.n_fields == 0) {
-        fprintf(stderr, "Index not provided");
+        pr_err("Index not provided");
         return EINVAL;
     }
 
@@ -363,7 +387,7 @@ int psabpf_meter_entry_update(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *ent
         entry->raw_index = malloc(ctx->meter.key_size);
     value_buffer = malloc(ctx->meter.value_size);
     if (entry->raw_index == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return_code = ENOMEM;
         goto clean_up;
     }
@@ -374,10 +398,10 @@ int psabpf_meter_entry_update(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *ent
     if (return_code != NO_ERROR)
         goto clean_up;
 
-    return_code = bpf_map_update_elem(ctx->meter.fd, entry->raw_index, value_buffer, bpf_flags);
+    return_code = txn_map_update_elem(ctx->meter.fd, entry->raw_index, value_buffer, bpf_flags);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to set up meter: %s\n", strerror(errno));
+        pr_err("failed to set up meter: %s\n", strerror(errno));
         goto clean_up;
     }
 
@@ -387,6 +411,8 @@ clean_up:
 }
 
 int psabpf_meter_entry_reset(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entry) {
+    STATS_SCOPE(PSABPF_STATS_METER_RESET);
+
     if (ctx == NULL)
         return EINVAL;
 
@@ -403,7 +429,7 @@ int psabpf_meter_entry_reset(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entr
 
     void *key_buffer = malloc(ctx->meter.key_size);
     if (key_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
@@ -411,9 +437,9 @@ int psabpf_meter_entry_reset(psabpf_meter_ctx_t *ctx, psabpf_meter_entry_t *entr
     if (return_code != NO_ERROR)
         goto clean_up;
 
-    if (bpf_map_delete_elem(ctx->meter.fd, key_buffer) != 0) {
+    if (txn_map_delete_elem(ctx->meter.fd, key_buffer) != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to reset meter entry: %s\n", strerror(return_code));
+        pr_err("failed to reset meter entry: %s\n", strerror(return_code));
     }
 
 clean_up:
@@ -37,6 +37,8 @@
 #include "bpf_defs.h"
 #include "common.h"
 #include "btf.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 static char *program_pin_name(struct bpf_program *prog)
 {
@@ -74,7 +76,7 @@ static int tc_create_hook(int ifindex, const char *interface)
     int ret = NO_ERROR;
     if (bpf_tc_hook_create(&hook) != 0) {
         ret = errno;
-        fprintf(stderr, "failed to create TC hook for interface %s: %s\n", interface, strerror(ret));
+        pr_err("failed to create TC hook for interface %s: %s\n", interface, strerror(ret));
     }
 
     return ret;
@@ -87,11 +89,11 @@ static int tc_attach_prog(psabpf_context_t *ctx, const char *prog, int ifindex,
     if (fd < 0) {
         ret = errno;
         if (ret == ENOENT && hook_point == BPF_TC_EGRESS) {
-            fprintf(stderr, "skipping empty egress program...\n");
+            pr_info("skipping empty egress program...\n");
             return NO_ERROR;
         }
 
-        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
+        pr_err("failed to open program %s: %s\n", prog, strerror(ret));
         return ret;
     }
 
@@ -103,7 +105,7 @@ static int tc_attach_prog(psabpf_context_t *ctx, const char *prog, int ifindex,
 
     if (bpf_tc_attach(&hook, &opts) != 0) {
         ret = errno;
-        fprintf(stderr, "failed to attach bpf program to interface %s: %s\n", interface, strerror(ret));
+        pr_err("failed to attach bpf program to interface %s: %s\n", interface, strerror(ret));
         goto clean_up;
     }
 
@@ -138,7 +140,7 @@ static int xdp_attach_prog_to_port(int *fd, psabpf_context_t *ctx, int ifindex,
     *fd = open_prog_by_name(ctx, prog);
     if (*fd < 0) {
         ret = errno;  // from sys_call
-        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
+        pr_err("failed to open program %s: %s\n", prog, strerror(ret));
         return ret;
     }
 
@@ -148,18 +150,18 @@ static int xdp_attach_prog_to_port(int *fd, psabpf_context_t *ctx, int ifindex,
     ret = bpf_set_link_xdp_fd(ifindex, *fd, flags);
     if (ret != -EOPNOTSUPP) {
         if (ret < 0) {
-            fprintf(stderr, "failed to attach XDP program in driver mode: %s\n", strerror(-ret));
+            pr_err("failed to attach XDP program in driver mode: %s\n", strerror(-ret));
             close_object_fd(fd);
             return -ret;
         }
         return NO_ERROR;
     }
 
-    fprintf(stderr, "XDP native mode not supported by driver, retrying with generic SKB mode\n");
+    pr_err("XDP native mode not supported by driver, retrying with generic SKB mode\n");
     flags = XDP_FLAGS_SKB_MODE;
     ret = bpf_set_link_xdp_fd(ifindex, *fd, flags);
     if (ret < 0) {
-        fprintf(stderr, "failed to attach XDP program in SKB mode: %s\n", strerror(-ret));
+        pr_err("failed to attach XDP program in SKB mode: %s\n", strerror(-ret));
         close_object_fd(fd);
         return -ret;
     }
@@ -179,15 +181,15 @@ static int update_prog_devmap(psabpf_bpf_map_descriptor_t *devmap, int ifindex,
         devmap_val.bpf_prog.fd = egress_prog_fd;
     }
     if (ifindex > (int) devmap->max_entries) {
-        fprintf(stderr,
+        pr_warn(
                 "Warning: the index(=%d) of the interface %s is higher than the DEVMAP size (=%d)\n"
                 "Applying modulo ... \n", ifindex, intf, devmap->max_entries);
     }
     int index = ifindex % ((int) devmap->max_entries);
-    int ret = bpf_map_update_elem(devmap->fd, &index, &devmap_val, 0);
+    int ret = map_ops->update_elem(devmap->fd, &index, &devmap_val, 0);
     if (ret) {
         ret = errno;
-        fprintf(stderr, "failed to update devmap: %s\n", strerror(ret));
+        pr_err("failed to update devmap: %s\n", strerror(ret));
         return ret;
     }
 
@@ -212,7 +214,7 @@ static int xdp_port_add(psabpf_context_t *ctx, const char *intf, int ifindex)
     psabpf_bpf_map_descriptor_t devmap;
     ret = open_bpf_map(ctx, XDP_DEVMAP, NULL, &devmap);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to open DEVMAP: %s\n", strerror(ret));
+        pr_err("failed to open DEVMAP: %s\n", strerror(ret));
         close_object_fd(&eg_prog_fd);
         return ret;
     }
@@ -229,18 +231,18 @@ static int xdp_port_add(psabpf_context_t *ctx, const char *intf, int ifindex)
         psabpf_bpf_map_descriptor_t jmpmap;
         ret = open_bpf_map(ctx, XDP_JUMP_TBL, NULL, &jmpmap);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "failed to open map %s: %s\n", XDP_JUMP_TBL, strerror(errno));
+            pr_err("failed to open map %s: %s\n", XDP_JUMP_TBL, strerror(errno));
             close_object_fd(&eg_prog_fd);
             return ENOENT;
         }
 
         int index = 0;
-        ret = bpf_map_update_elem(jmpmap.fd, &index, &eg_prog_fd, 0);
+        ret = map_ops->update_elem(jmpmap.fd, &index, &eg_prog_fd, 0);
         int errno_val = errno;
         close_object_fd(&eg_prog_fd);
         close_object_fd(&jmpmap.fd);
         if (ret) {
-            fprintf(stderr, "failed to update map %s: %s\n", XDP_JUMP_TBL, strerror(errno_val));
+            pr_err("failed to update map %s: %s\n", XDP_JUMP_TBL, strerror(errno_val));
             return errno_val;
         }
     }
@@ -273,7 +275,7 @@ bool psabpf_pipeline_exists(psabpf_context_t *ctx)
     char mounted_path[256];
     build_ebpf_pipeline_path(mounted_path, sizeof(mounted_path), ctx);
 
-    return access(mounted_path, F_OK) == 0;
+    return map_ops->path_exists(mounted_path);
 }
 
 static int extract_tuple_id_from_tuple(const char *tuple_name, uint32_t *tuple_id) {
@@ -307,7 +309,7 @@ static int join_tuple_to_map_if_tuple(psabpf_context_t *ctx, const char *tuple_n
         psabpf_bpf_map_descriptor_t tuple_map;
         int ret = open_bpf_map(ctx, tuples_map_name, NULL, &tuple_map);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "couldn't open map %s: %s\n", tuples_map_name, strerror(ret));
+            pr_err("couldn't open map %s: %s\n", tuples_map_name, strerror(ret));
             return ret;
         }
 
@@ -315,20 +317,20 @@ static int join_tuple_to_map_if_tuple(psabpf_context_t *ctx, const char *tuple_n
         uint32_t tuple_id = 0;
         ret = extract_tuple_id_from_tuple(tuple_name, &tuple_id);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "cannot extract tuple_id from tuple name %s: %s", tuple_name, strerror(ret));
+            pr_err("cannot extract tuple_id from tuple name %s: %s", tuple_name, strerror(ret));
             return ENODATA;
         }
 
         psabpf_bpf_map_descriptor_t tuple;
         ret = open_bpf_map(ctx, tuple_name, NULL, &tuple);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "couldn't open map %s: %s\n", tuple_name, strerror(ret));
+            pr_err("couldn't open map %s: %s\n", tuple_name, strerror(ret));
             return ret;
         }
 
-        ret = bpf_map_update_elem(tuple_map.fd, &tuple_id, &tuple.fd, 0);
+        ret = map_ops->update_elem(tuple_map.fd, &tuple_id, &tuple.fd, 0);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(ret));
+            pr_err("failed to add tuple %u: %s\n", tuple_id, strerror(ret));
         }
 
         tuple_id++;
@@ -337,18 +339,143 @@ static int join_tuple_to_map_if_tuple(psabpf_context_t *ctx, const char *tuple_n
     return NO_ERROR;
 }
 
+static int join_table_to_outer_map_if_shadowed(psabpf_context_t *ctx, const char *map_name)
+{
+    // Table "<name>" is published to the data plane through "<name>_outer" map,
+    // maps can be pinned in any order, so check both names
+    const char *suffix = "_outer";
+    size_t name_len = strlen(map_name), suffix_len = strlen(suffix);
+    int table_name_length = (int) name_len;
+    if (name_len > suffix_len && strcmp(map_name + name_len - suffix_len, suffix) == 0)
+        table_name_length = (int) (name_len - suffix_len);
+
+    char table_name[256], outer_map_name[268];
+    snprintf(table_name, sizeof(table_name), "%.*s", table_name_length, map_name);
+    snprintf(outer_map_name, sizeof(outer_map_name), "%s%s", table_name, suffix);
+
+    psabpf_bpf_map_descriptor_t outer_map = { .fd = -1 }, table = { .fd = -1 };
+    if (open_bpf_map(ctx, outer_map_name, NULL, &outer_map) != NO_ERROR ||
+        open_bpf_map(ctx, table_name, NULL, &table) != NO_ERROR) {
+        /* Not a shadowed table or the other map is not pinned yet */
+        close_object_fd(&outer_map.fd);
+        close_object_fd(&table.fd);
+        return NO_ERROR;
+    }
+
+    int ret = NO_ERROR;
+    uint32_t slot = 0;
+    if (map_ops->update_elem(outer_map.fd, &slot, &table.fd, BPF_ANY) != 0) {
+        ret = errno;
+        pr_err("failed to publish table %s: %s\n", table_name, strerror(ret));
+    }
+
+    close_object_fd(&outer_map.fd);
+    close_object_fd(&table.fd);
+
+    return ret;
+}
+
+/* Emulated pipeline consists only of maps and BTF, programs are not loaded */
+static int load_emulated_pipeline(psabpf_context_t *ctx, const char *file)
+{
+    char pinned_file[256];
+    int ret = NO_ERROR;
+
+    struct bpf_object *obj = bpf_object__open_file(file, NULL);
+    long open_err = libbpf_get_error(obj);
+    if (open_err != 0) {
+        ret = (int) -open_err;
+        pr_err("cannot open the BPF program: %s\n", strerror(ret));
+        return ret;
+    }
+
+    /* Loading replaces previous pipeline */
+    build_ebpf_pipeline_path(pinned_file, sizeof(pinned_file), ctx);
+    emulation_remove_pipeline(pinned_file);
+
+    struct btf *btf = bpf_object__btf(obj);
+    if (btf != NULL) {
+        uint32_t btf_size = 0;
+        const void *btf_data = btf__get_raw_data(btf, &btf_size);
+        ret = btf_data != NULL ? emulation_set_pipeline_btf(pinned_file, btf_data, btf_size) : ENOMEM;
+        if (ret != NO_ERROR) {
+            pr_err("failed to store BTF of the pipeline: %s\n", strerror(ret));
+            goto clean_up;
+        }
+    }
+
+    struct bpf_map *map;
+    bpf_object__for_each_map(map, obj) {
+        const char *map_name = bpf_map__name(map);
+
+        /* Pinned file name cannot contain a dot */
+        if (strstr(map_name, ".") != NULL)
+            continue;
+
+        struct bpf_create_map_attr attr = {
+                .name = map_name,
+                .map_type = bpf_map__type(map),
+                .map_flags = bpf_map__map_flags(map),
+                .key_size = bpf_map__key_size(map),
+                .value_size = bpf_map__value_size(map),
+                .max_entries = bpf_map__max_entries(map),
+                .btf_key_type_id = bpf_map__btf_key_type_id(map),
+                .btf_value_type_id = bpf_map__btf_value_type_id(map),
+        };
+        int map_fd = map_ops->create_map(&attr);
+        if (map_fd < 0) {
+            ret = errno;
+            pr_err("failed to create map %s: %s\n", map_name, strerror(ret));
+            goto clean_up;
+        }
+
+        build_ebpf_map_filename(pinned_file, sizeof(pinned_file), ctx, map_name);
+        ret = map_ops->obj_pin(map_fd, pinned_file) != 0 ? errno : NO_ERROR;
+        close(map_fd);
+        if (ret != NO_ERROR) {
+            pr_err("failed to pin map at %s: %s\n", pinned_file, strerror(ret));
+            goto clean_up;
+        }
+
+        ret = join_tuple_to_map_if_tuple(ctx, map_name);
+        if (ret) {
+            pr_err("failed to add tuple (%s) to tuples map\n", map_name);
+            goto clean_up;
+        }
+
+        ret = join_table_to_outer_map_if_shadowed(ctx, map_name);
+        if (ret) {
+            pr_err("failed to add table (%s) to outer map\n", map_name);
+            goto clean_up;
+        }
+    }
+
+clean_up:
+    bpf_object__close(obj);
+
+    return ret;
+}
+
 int psabpf_pipeline_load(psabpf_context_t *ctx, const char *file)
 {
+    STATS_SCOPE(PSABPF_STATS_PIPELINE_LOAD);
+
     struct bpf_object *obj;
     int ret, fd;
     char pinned_file[256];
     struct bpf_program *pos;
 
+    /* Maps and BTF of the previous pipeline are no longer valid */
+    invalidate_context_cache(ctx);
+
+    if (map_ops_emulated())
+        return load_emulated_pipeline(ctx, file);
+
     ret = bpf_prog_load(file, BPF_PROG_TYPE_UNSPEC, &obj, &fd);
     /* Do not close fd obtained from above call, it is maintained by obj */
     if (ret < 0 || obj == NULL) {
         ret = errno;
-        fprintf(stderr, "cannot load the BPF program: %s\n", strerror(ret));
+        pr_err("cannot load the BPF program: %s\n", strerror(ret));
         return ret;
     }
 
@@ -360,7 +487,7 @@ int psabpf_pipeline_load(psabpf_context_t *ctx, const char *file)
 
         ret = bpf_program__pin(pos, pinned_file);
         if (ret < 0) {
-            fprintf(stderr, "failed to pin %s at %s: %s\n",
+            pr_err("failed to pin %s at %s: %s\n",
                     sec_name, pinned_file, strerror(-ret));
             goto err_close_obj;
         }
@@ -371,7 +498,7 @@ int psabpf_pipeline_load(psabpf_context_t *ctx, const char *file)
         if (bpf_map__is_pinned(map)) {
             ret = bpf_map__unpin(map, NULL);
             if (ret) {
-                fprintf(stderr, "failed to remove old map pin file: %s\n", strerror(-ret));
+                pr_err("failed to remove old map pin file: %s\n", strerror(-ret));
                 goto err_close_obj;
             }
         }
@@ -385,19 +512,25 @@ int psabpf_pipeline_load(psabpf_context_t *ctx, const char *file)
         build_ebpf_map_filename(pinned_file, sizeof(pinned_file), ctx, map_name);
         ret = bpf_map__set_pin_path(map, pinned_file);
         if (ret) {
-            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
+            pr_err("failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
             goto err_close_obj;
         }
 
         ret = bpf_map__pin(map, pinned_file);
         if (ret) {
-            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
+            pr_err("failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
             goto err_close_obj;
         }
 
         ret = join_tuple_to_map_if_tuple(ctx, map_name);
         if (ret) {
-            fprintf(stderr, "failed to add tuple (%s) to tuples map\n", map_name);
+            pr_err("failed to add tuple (%s) to tuples map\n", map_name);
+            goto err_close_obj;
+        }
+
+        ret = join_table_to_outer_map_if_shadowed(ctx, map_name);
+        if (ret) {
+            pr_err("failed to add table (%s) to outer map\n", map_name);
             goto err_close_obj;
         }
     }
@@ -409,7 +542,7 @@ int psabpf_pipeline_load(psabpf_context_t *ctx, const char *file)
             ret = do_initialize_maps(fd);
             if (ret) {
                 ret = -errno;
-                fprintf(stderr, "failed to initialize maps: %s\n", strerror(errno));
+                pr_err("failed to initialize maps: %s\n", strerror(errno));
                 goto err_close_obj;
             }
         }
@@ -444,7 +577,7 @@ static int remove_pipeline_directory(psabpf_context_t *ctx)
      * FTW_PHYS  - Do  not  follow  symbolic  links. */
     if (nftw(pipeline_path, remove_file, 16, FTW_DEPTH | FTW_MOUNT | FTW_PHYS) != 0) {
         int err = errno;
-        fprintf(stderr, "failed to remove pipeline directory: %s\n", strerror(err));
+        pr_err("failed to remove pipeline directory: %s\n", strerror(err));
         return err;
     }
 
@@ -453,8 +586,18 @@ static int remove_pipeline_directory(psabpf_context_t *ctx)
 
 int psabpf_pipeline_unload(psabpf_context_t *ctx)
 {
+    STATS_SCOPE(PSABPF_STATS_PIPELINE_UNLOAD);
+
     /* TODO: Should we scan all interfaces to detect if it uses current pipeline programs and detach it? */
 
+    invalidate_context_cache(ctx);
+
+    if (map_ops_emulated()) {
+        char pipeline_path[256];
+        build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
+        return emulation_remove_pipeline(pipeline_path);
+    }
+
     return remove_pipeline_directory(ctx);
 }
 
@@ -463,6 +606,11 @@ int psabpf_pipeline_add_port(psabpf_context_t *ctx, const char *interface, int *
     char pinned_file[256];
     bool isXDP = false;
 
+    if (map_ops_emulated()) {
+        pr_err("ports can't be added to emulated pipeline\n");
+        return EOPNOTSUPP;
+    }
+
     /* Determine firstly if we have TC-based or XDP-based pipeline.
      * We can do this by just checking if XDP helper exists under a mount path. */
     build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, XDP_HELPER_PROG);
@@ -470,7 +618,7 @@ int psabpf_pipeline_add_port(psabpf_context_t *ctx, const char *interface, int *
 
     int ifindex = (int) if_nametoindex(interface);
     if (!ifindex) {
-        fprintf(stderr, "no such interface: %s\n", interface);
+        pr_err("no such interface: %s\n", interface);
         return ENODEV;
     }
 
@@ -488,13 +636,13 @@ int psabpf_pipeline_del_port(psabpf_context_t *ctx, const char *interface)
 
     ifindex = (int) if_nametoindex(interface);
     if (!ifindex) {
-        fprintf(stderr, "no such interface: %s\n", interface);
+        pr_err("no such interface: %s\n", interface);
         return ENODEV;
     }
 
     int ret = bpf_set_link_xdp_fd(ifindex, -1, flags);
     if (ret) {
-        fprintf(stderr, "failed to detach XDP program: %s\n", strerror(-ret));
+        pr_err("failed to detach XDP program: %s\n", strerror(-ret));
         return -ret;
     }
 
@@ -505,7 +653,7 @@ int psabpf_pipeline_del_port(psabpf_context_t *ctx, const char *interface)
         ret = errno;
         /* Ignore error when qdisc does not exist, e.g. for XDP dummy program */
         if (ret != ENOENT) {
-            fprintf(stderr, "failed to detach TC program from %s: %s\n", interface, strerror(ret));
+            pr_err("failed to detach TC program from %s: %s\n", interface, strerror(ret));
             return ret;
         }
     }
@@ -533,7 +681,7 @@ int psabpf_port_list_init(psabpf_port_list_t *list, psabpf_context_t *ctx)
 
     if (fd < 0) {
         ret = errno;
-        fprintf(stderr, "failed to open pipeline program: %s\n", strerror(ret));
+        pr_err("failed to open pipeline program: %s\n", strerror(ret));
         return ret;
     }
 
@@ -541,7 +689,7 @@ int psabpf_port_list_init(psabpf_port_list_t *list, psabpf_context_t *ctx)
     unsigned len = sizeof(struct bpf_prog_info);
     if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) != 0) {
         ret = errno;
-        fprintf(stderr, "failed to get BPF program info: %s\n", strerror(ret));
+        pr_err("failed to get BPF program info: %s\n", strerror(ret));
         goto free_program;
     }
 
@@ -635,14 +783,14 @@ uint64_t psabpf_pipeline_get_load_timestamp(psabpf_context_t *ctx)
     }
 
     if (fd < 0) {
-        fprintf(stderr, "failed to open pipeline program: %s\n", strerror(errno));
+        pr_err("failed to open pipeline program: %s\n", strerror(errno));
         return 0;
     }
 
     struct bpf_prog_info prog_info = {};
     unsigned len = sizeof(struct bpf_prog_info);
     if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) != 0) {
-        fprintf(stderr, "failed to get BPF program info: %s\n", strerror(errno));
+        pr_err("failed to get BPF program info: %s\n", strerror(errno));
         goto clean_up;
     }
     double load_time = (double) prog_info.load_time / 1e9;
@@ -660,13 +808,13 @@ uint64_t psabpf_pipeline_get_load_timestamp(psabpf_context_t *ctx)
         else
             goto clean_up;
     } else {
-        fprintf(stderr, "failed to get uptime: %s\n", strerror(errno));
+        pr_err("failed to get uptime: %s\n", strerror(errno));
         goto clean_up;
     }
 
     struct timeval tv;
     if (gettimeofday(&tv, NULL) != 0) {
-        fprintf(stderr, "failed to get current time: %s\n", strerror(errno));
+        pr_err("failed to get current time: %s\n", strerror(errno));
         goto clean_up;
     }
     double now = (double) tv.tv_sec + ((double) tv.tv_usec) / 1e6;
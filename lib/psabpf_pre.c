@@ -23,7 +23,10 @@
 #include <psabpf_pre.h>
 #include "bpf_defs.h"
 #include "common.h"
+#include "psabpf_txn.h"
 #include "btf.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 struct list_key_t {
     __u32 port;
@@ -49,14 +52,14 @@ static int open_pr_maps(psabpf_context_t *ctx, const char *pr_map_outer, const c
 
     int ret = open_bpf_map(ctx, pr_map_outer, NULL, outer);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to open %s: %s\n", pr_map_outer, strerror(ret));
+        pr_err("failed to open %s: %s\n", pr_map_outer, strerror(ret));
         goto err;
     }
 
     if (pr_map_inner != NULL) {
         ret = open_bpf_map(ctx, pr_map_inner, NULL, inner);
         if (ret != NO_ERROR) {
-            fprintf(stderr, "failed to open %s: %s\n", pr_map_inner, strerror(ret));
+            pr_err("failed to open %s: %s\n", pr_map_inner, strerror(ret));
             goto err;
         }
     }
@@ -76,26 +79,26 @@ static int open_session_map(psabpf_bpf_map_descriptor_t *pr_map,
     session_map->fd = -1;
 
     if (pr_map->fd < 0) {
-        fprintf(stderr, "map not opened\n");
+        pr_err("map not opened\n");
         return EBADF;
     }
     if (pr_map->key_size != sizeof(uint32_t) || pr_map->value_size != sizeof(uint32_t)) {
-        fprintf(stderr, "invalid session/group map\n");
+        pr_err("invalid session/group map\n");
         return EINVAL;
     }
 
     uint32_t inner_map_id;
-    int ret = bpf_map_lookup_elem(pr_map->fd, &session, &inner_map_id);
+    int ret = map_ops->lookup_elem(pr_map->fd, &session, &inner_map_id);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "could not find session/group: %s\n", strerror(ret));
+        pr_err("could not find session/group: %s\n", strerror(ret));
         return ret;
     }
 
-    session_map->fd = bpf_map_get_fd_by_id(inner_map_id);
+    session_map->fd = map_ops->get_fd_by_id(inner_map_id);
     if (session_map->fd < 0) {
         ret = errno;
-        fprintf(stderr, "could not get inner map: %s\n", strerror(ret));
+        pr_err("could not get inner map: %s\n", strerror(ret));
         return ret;
     }
 
@@ -104,7 +107,7 @@ static int open_session_map(psabpf_bpf_map_descriptor_t *pr_map,
         return ret;
 
     if (session_map->key_size != sizeof(elem_t) || session_map->value_size != sizeof(struct element)) {
-        fprintf(stderr, "invalid session/group inner map\n");
+        pr_err("invalid session/group inner map\n");
         return EINVAL;
     }
 
@@ -116,15 +119,15 @@ static int do_create_pre_session(psabpf_bpf_map_descriptor_t *pr_map,
 {
     int error_code;
     if (pr_map->fd < 0 || session_template->fd < 0) {
-        fprintf(stderr, "maps not opened\n");
+        pr_err("maps not opened\n");
         return EBADF;
     }
     if (pr_map->key_size != sizeof(session)) {
-        fprintf(stderr, "key map size must be equal to %lu\n", sizeof(session));
+        pr_err("key map size must be equal to %lu\n", sizeof(session));
         return EINVAL;
     }
     if (session_template->key_size != sizeof(elem_t) || session_template->value_size != sizeof(struct element)) {
-        fprintf(stderr, "invalid session/group map template\n");
+        pr_err("invalid session/group map template\n");
         return EINVAL;
     }
 
@@ -138,20 +141,20 @@ static int do_create_pre_session(psabpf_bpf_map_descriptor_t *pr_map,
             .btf_key_type_id = session_template->key_type_id,
             .btf_value_type_id = session_template->value_type_id,
     };
-    int inner_map_fd = bpf_create_map_xattr(&attr);
+    int inner_map_fd = map_ops->create_map(&attr);
     if (inner_map_fd < 0) {
         error_code = errno;
-        fprintf(stderr, "failed to create inner session/group map: %s\n", strerror(error_code));
+        pr_err("failed to create inner session/group map: %s\n", strerror(error_code));
         return error_code;
     }
 
     /* add head in inner map */
     elem_t head_idx = { 0 };
     struct element head_elem =  { 0 };
-    error_code = bpf_map_update_elem(inner_map_fd, &head_idx, &head_elem, 0);
+    error_code = txn_map_update_elem(inner_map_fd, &head_idx, &head_elem, 0);
     if (error_code != 0) {
         error_code = errno;
-        printf("failed to add head to the list: %s\n", strerror(error_code));
+        pr_err("failed to add head to the list: %s\n", strerror(error_code));
         goto ret;
     }
 
@@ -159,10 +162,10 @@ static int do_create_pre_session(psabpf_bpf_map_descriptor_t *pr_map,
     uint64_t flags = BPF_NOEXIST;
     if (pr_map->type == BPF_MAP_TYPE_ARRAY_OF_MAPS)
         flags = BPF_ANY;
-    error_code = bpf_map_update_elem(pr_map->fd, &session, &inner_map_fd, flags);
+    error_code = txn_map_update_elem(pr_map->fd, &session, &inner_map_fd, flags);
     if (error_code != 0) {
         error_code = errno;
-        fprintf(stderr, "failed to add session/group to map: %s\n", strerror(error_code));
+        pr_err("failed to add session/group to map: %s\n", strerror(error_code));
         goto ret;
     }
 
@@ -174,7 +177,7 @@ ret:
 static int create_pre_session(psabpf_context_t *ctx, const char *pr_map, const char *pr_map_inner, uint32_t session)
 {
     if (ctx == NULL || session == 0) {
-        fprintf(stderr, "invalid session/group or context\n");
+        pr_err("invalid session/group or context\n");
         return EINVAL;
     }
 
@@ -191,7 +194,7 @@ static int create_pre_session(psabpf_context_t *ctx, const char *pr_map, const c
     free_btf(&btf);
 
     if (ret != NO_ERROR)
-        fprintf(stderr, "failed to create session/group: %s\n", strerror(ret));
+        pr_err("failed to create session/group: %s\n", strerror(ret));
 
 err:
     close_object_fd(&inner_map.fd);
@@ -204,7 +207,7 @@ static int remove_pre_session(psabpf_context_t *ctx, const char *pr_map_name, ui
     if (ctx == NULL)
         return EINVAL;
     if (session == 0) {
-        fprintf(stderr, "invalid session/group id\n");
+        pr_err("invalid session/group id\n");
         return EINVAL;
     }
 
@@ -215,15 +218,15 @@ static int remove_pre_session(psabpf_context_t *ctx, const char *pr_map_name, ui
         goto err;
 
     if (pr_map.key_size != sizeof(session)) {
-        fprintf(stderr, "key map size must be equal to %lu\n", sizeof(session));
+        pr_err("key map size must be equal to %lu\n", sizeof(session));
         ret = EINVAL;
         goto err;
     }
 
-    ret = bpf_map_delete_elem(pr_map.fd, &session);
+    ret = txn_map_delete_elem(pr_map.fd, &session);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to clear clone session with id %u: %s\n",
+        pr_err("failed to clear clone session with id %u: %s\n",
                 session, strerror(ret));
         goto err;
     }
@@ -245,13 +248,13 @@ static bool pre_session_exists(psabpf_context_t *ctx, const char *pr_map_name, u
         return false;
 
     if (pr_map.key_size != sizeof(uint32_t) || pr_map.value_size != sizeof(uint32_t)) {
-        fprintf(stderr, "invalid session/group map\n");
+        pr_err("invalid session/group map\n");
         close_object_fd(&pr_map.fd);
         return false;
     }
 
     uint32_t inner_map_id;
-    ret = bpf_map_lookup_elem(pr_map.fd, &session, &inner_map_id);
+    ret = map_ops->lookup_elem(pr_map.fd, &session, &inner_map_id);
     close_object_fd(&pr_map.fd);
 
     if (ret != 0)
@@ -267,7 +270,7 @@ static int pre_session_insert_entry(psabpf_context_t *ctx, const char *pr_map_na
         return EINVAL;
     }
     if (entry->instance == 0 && entry->egress_port == 0) {
-        fprintf(stderr, "instance and egress port not set\n");
+        pr_err("instance and egress port not set\n");
         return EINVAL;
     }
 
@@ -283,17 +286,17 @@ static int pre_session_insert_entry(psabpf_context_t *ctx, const char *pr_map_na
         goto err;
 
     if (session_map.key_size != sizeof(elem_t) || session_map.value_size != sizeof(struct element)) {
-        fprintf(stderr, "invalid session/group inner map\n");
+        pr_err("invalid session/group inner map\n");
         goto err;
     }
 
     /* 1. Gead head. */
     elem_t head_idx = { 0 };
     struct element head;
-    ret = bpf_map_lookup_elem(session_map.fd, &head_idx, &head);
+    ret = map_ops->lookup_elem(session_map.fd, &head_idx, &head);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "error getting head of list: %s\n", strerror(ret));
+        pr_err("error getting head of list: %s\n", strerror(ret));
         goto err;
     }
 
@@ -307,26 +310,26 @@ static int pre_session_insert_entry(psabpf_context_t *ctx, const char *pr_map_na
             .port = entry->egress_port,
             .instance = entry->instance,
     };
-    ret = bpf_map_update_elem(session_map.fd, &new_node_key, &new_node_value, BPF_NOEXIST);
+    ret = txn_map_update_elem(session_map.fd, &new_node_key, &new_node_value, BPF_NOEXIST);
     if (ret != 0) {
         ret = errno;
         if (ret == EEXIST) {
-            fprintf(stderr, "Clone session/multicast member [port=%d, instance=%d] already exists. "
+            pr_err("Clone session/multicast member [port=%d, instance=%d] already exists. "
                             "Increment 'instance' to clone more than one packet to the same port.\n",
                     entry->egress_port,
                     entry->instance);
-        } else if (ret < 0) {
-            printf("error creating list element: %s\n", strerror(ret));
+        } else {
+            pr_err("error creating list element: %s\n", strerror(ret));
         }
         goto err;
     }
 
     /* 4. move the head to point to the new node */
     head.next_id = new_node_key;
-    ret = bpf_map_update_elem(session_map.fd, &head_idx, &head, 0);
+    ret = txn_map_update_elem(session_map.fd, &head_idx, &head, 0);
     if (ret < 0) {
         ret = errno;
-        printf("error updating head: %s\n", strerror(ret));
+        pr_err("error updating head: %s\n", strerror(ret));
         goto err;
     }
 
@@ -344,7 +347,7 @@ static int pre_session_del_entry(psabpf_context_t *ctx, const char *pr_map_name,
         return EINVAL;
     }
     if (entry->instance == 0 && entry->egress_port == 0) {
-        fprintf(stderr, "instance and egress port not set\n");
+        pr_err("instance and egress port not set\n");
         return EINVAL;
     }
 
@@ -361,7 +364,7 @@ static int pre_session_del_entry(psabpf_context_t *ctx, const char *pr_map_name,
 
     if (session_map.key_size != sizeof(elem_t) || session_map.value_size != sizeof(struct element)) {
         ret = EINVAL;
-        fprintf(stderr, "invalid session/group inner map\n");
+        pr_err("invalid session/group inner map\n");
         goto err;
     }
 
@@ -370,7 +373,7 @@ static int pre_session_del_entry(psabpf_context_t *ctx, const char *pr_map_name,
     struct element prev_elem_value;
     bool found = false;
     do {
-        ret = bpf_map_lookup_elem(session_map.fd, &prev_elem_key, &prev_elem_value);
+        ret = map_ops->lookup_elem(session_map.fd, &prev_elem_key, &prev_elem_value);
         if (ret != 0) {
             ret = errno;
             break;
@@ -387,7 +390,7 @@ static int pre_session_del_entry(psabpf_context_t *ctx, const char *pr_map_name,
     if (ret != 0 || found == false) {
         if (ret == NO_ERROR)
             ret = ENOENT;
-        fprintf(stderr, "error getting element from list (egress_port=%d, instance=%d): %s\n",
+        pr_err("error getting element from list (egress_port=%d, instance=%d): %s\n",
                 entry->egress_port, entry->instance, strerror(ret));
         goto err;
     }
@@ -398,27 +401,27 @@ static int pre_session_del_entry(psabpf_context_t *ctx, const char *pr_map_name,
             .instance = entry->instance,
             .port = entry->egress_port,
     };
-    ret = bpf_map_lookup_elem(session_map.fd, &key_to_delete, &elem_to_delete);
+    ret = map_ops->lookup_elem(session_map.fd, &key_to_delete, &elem_to_delete);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "error getting element to delete: %s\n", strerror(ret));
+        pr_err("error getting element to delete: %s\n", strerror(ret));
         goto err;
     }
 
     /* Update previous node to point to next node */
     prev_elem_value.next_id = elem_to_delete.next_id;
-    ret = bpf_map_update_elem(session_map.fd, &prev_elem_key, &prev_elem_value, BPF_EXIST);
+    ret = txn_map_update_elem(session_map.fd, &prev_elem_key, &prev_elem_value, BPF_EXIST);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to update previous element: %s\n", strerror(ret));
+        pr_err("failed to update previous element: %s\n", strerror(ret));
         goto err;
     }
 
     /* Remove node */
-    ret = bpf_map_delete_elem(session_map.fd, &key_to_delete);
+    ret = txn_map_delete_elem(session_map.fd, &key_to_delete);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to delete element: %s\n", strerror(ret));
+        pr_err("failed to delete element: %s\n", strerror(ret));
         goto err;
     }
 
@@ -435,7 +438,7 @@ static int pre_get_next_entry(psabpf_context_t *ctx,
                               psabpf_clone_session_entry_t *current_entry)
 {
     if (ctx == NULL || session == 0) {
-        fprintf(stderr, "invalid session/group or context\n");
+        pr_err("invalid session/group or context\n");
         return EINVAL;
     }
 
@@ -461,8 +464,8 @@ static int pre_get_next_entry(psabpf_context_t *ctx,
     key.port = *current_egress_port;
     key.instance = *current_instance;
     struct element value;
-    if (bpf_map_lookup_elem(session_map->fd, &key, &value) != 0) {
-        fprintf(stderr, "failed to read next entry key: %s\n", strerror(errno));
+    if (map_ops->lookup_elem(session_map->fd, &key, &value) != 0) {
+        pr_err("failed to read next entry key: %s\n", strerror(errno));
         goto no_more_entries;
     }
     memcpy(&key, &value.next_id, sizeof(elem_t));
@@ -472,8 +475,8 @@ static int pre_get_next_entry(psabpf_context_t *ctx,
         goto no_more_entries;
 
     /* Read next entry */
-    if (bpf_map_lookup_elem(session_map->fd, &key, &value) != 0) {
-        fprintf(stderr, "failed to read next entry: %s", strerror(errno));
+    if (map_ops->lookup_elem(session_map->fd, &key, &value) != 0) {
+        pr_err("failed to read next entry: %s", strerror(errno));
         goto no_more_entries;
     }
     memcpy(current_entry, &value.entry, sizeof(psabpf_clone_session_entry_t));
@@ -494,7 +497,7 @@ static int pre_get_next_session(psabpf_bpf_map_descriptor_t *pr_map, uint32_t *c
     if (pr_map->fd < 0 ||
         pr_map->type != BPF_MAP_TYPE_ARRAY_OF_MAPS ||
         pr_map->key_size != 4 || pr_map->value_size != 4) {
-        fprintf(stderr, "invalid sessions/groups map or not opened properly\n");
+        pr_err("invalid sessions/groups map or not opened properly\n");
         return EINVAL;
     }
 
@@ -512,7 +515,7 @@ static int pre_get_next_session(psabpf_bpf_map_descriptor_t *pr_map, uint32_t *c
             return ENOENT;
         }
 
-        if (bpf_map_lookup_elem(pr_map->fd, current_session_id, &value) == 0)
+        if (map_ops->lookup_elem(pr_map->fd, current_session_id, &value) == 0)
             break;
     }
 
@@ -566,6 +569,8 @@ bool psabpf_clone_session_exists(psabpf_context_t *ctx, psabpf_clone_session_ctx
 
 int psabpf_clone_session_create(psabpf_context_t *ctx, psabpf_clone_session_ctx_t *session)
 {
+    STATS_SCOPE(PSABPF_STATS_CLONE_SESSION_CREATE);
+
     return create_pre_session(ctx, CLONE_SESSION_TABLE, CLONE_SESSION_TABLE_INNER, session->id);
 }
 
@@ -647,6 +652,8 @@ uint16_t psabpf_clone_session_entry_get_truncate_length(psabpf_clone_session_ent
 
 int psabpf_clone_session_entry_update(psabpf_context_t *ctx, psabpf_clone_session_ctx_t *session, psabpf_clone_session_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_CLONE_SESSION_ENTRY_UPDATE);
+
     if (session == NULL)
         return EINVAL;
 
@@ -655,6 +662,8 @@ int psabpf_clone_session_entry_update(psabpf_context_t *ctx, psabpf_clone_sessio
 
 int psabpf_clone_session_delete(psabpf_context_t *ctx, psabpf_clone_session_ctx_t *session)
 {
+    STATS_SCOPE(PSABPF_STATS_CLONE_SESSION_DELETE);
+
     if (session == NULL)
         return EINVAL;
 
@@ -663,6 +672,8 @@ int psabpf_clone_session_delete(psabpf_context_t *ctx, psabpf_clone_session_ctx_
 
 int psabpf_clone_session_entry_delete(psabpf_context_t *ctx, psabpf_clone_session_ctx_t *session, psabpf_clone_session_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_CLONE_SESSION_ENTRY_DELETE);
+
     if (session == NULL)
         return EINVAL;
     return pre_session_del_entry(ctx, CLONE_SESSION_TABLE, session->id, entry);
@@ -677,7 +688,7 @@ int psabpf_clone_session_entry_exists(psabpf_context_t *ctx, psabpf_clone_sessio
 psabpf_clone_session_entry_t *psabpf_clone_session_get_next_entry(psabpf_context_t *ctx, psabpf_clone_session_ctx_t *session)
 {
     if (ctx == NULL || session == NULL) {
-        fprintf(stderr, "invalid session or context\n");
+        pr_err("invalid session or context\n");
         return NULL;
     }
 
@@ -769,6 +780,8 @@ psabpf_mcast_grp_id_t psabpf_mcast_grp_get_id(psabpf_mcast_grp_ctx_t *group)
 
 int psabpf_mcast_grp_create(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *group)
 {
+    STATS_SCOPE(PSABPF_STATS_MCAST_GRP_CREATE);
+
     return create_pre_session(ctx, MULTICAST_GROUP_TABLE, MULTICAST_GROUP_TABLE_INNER, group->id);
 }
 
@@ -781,6 +794,8 @@ bool psabpf_mcast_grp_exists(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *grou
 
 int psabpf_mcast_grp_delete(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *group)
 {
+    STATS_SCOPE(PSABPF_STATS_MCAST_GRP_DELETE);
+
     if (group == NULL)
         return EINVAL;
 
@@ -829,6 +844,8 @@ uint16_t psabpf_mcast_grp_member_get_instance(psabpf_mcast_grp_member_t *member)
 
 int psabpf_mcast_grp_member_update(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *group, psabpf_mcast_grp_member_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_MCAST_GRP_MEMBER_UPDATE);
+
     if (group == NULL || member == NULL)
         return EINVAL;
 
@@ -848,6 +865,8 @@ int psabpf_mcast_grp_member_exists(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t
 
 int psabpf_mcast_grp_member_delete(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *group, psabpf_mcast_grp_member_t *member)
 {
+    STATS_SCOPE(PSABPF_STATS_MCAST_GRP_MEMBER_DELETE);
+
     if (group == NULL || member == NULL)
         return EINVAL;
 
@@ -862,7 +881,7 @@ int psabpf_mcast_grp_member_delete(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t
 psabpf_mcast_grp_member_t *psabpf_mcast_grp_get_next_member(psabpf_context_t *ctx, psabpf_mcast_grp_ctx_t *group)
 {
     if (ctx == NULL || group == NULL) {
-        fprintf(stderr, "invalid group or context\n");
+        pr_err("invalid group or context\n");
         return NULL;
     }
 
@@ -22,14 +22,18 @@
 
 #include <psabpf.h>
 #include "common.h"
+#include "psabpf_txn.h"
 #include "btf.h"
 #include "bpf_defs.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 void psabpf_register_ctx_init(psabpf_register_context_t *ctx) {
     if (ctx == NULL)
         return;
 
     memset(ctx, 0, sizeof(psabpf_register_context_t));
+    ctx->reg.fd = -1;
     init_btf(&ctx->btf_metadata);
 }
 
@@ -41,6 +45,11 @@ void psabpf_register_ctx_free(psabpf_register_context_t *ctx) {
     close_object_fd(&(ctx->reg.fd));
     free_struct_field_descriptor_set(&ctx->key_fds);
     free_struct_field_descriptor_set(&ctx->value_fds);
+    psabpf_register_entry_free(&ctx->current_entry);
+
+    if (ctx->prev_entry_key != NULL)
+        free(ctx->prev_entry_key);
+    ctx->prev_entry_key = NULL;
 }
 
 static int parse_key_type(psabpf_register_context_t *ctx)
@@ -56,32 +65,49 @@ static int parse_value_type(psabpf_register_context_t *ctx)
 }
 
 int psabpf_register_ctx_name(psabpf_context_t *psabpf_ctx, psabpf_register_context_t *ctx, const char *name) {
+    STATS_SCOPE(PSABPF_STATS_REGISTER_CTX_OPEN);
+
     if (psabpf_ctx == NULL || ctx == NULL || name == NULL)
         return EINVAL;
 
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR) {
-        fprintf(stderr, "couldn't find a BTF info\n");
+        pr_err("couldn't find a BTF info\n");
     }
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->reg);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open a register %s\n", name);
+        pr_err("couldn't open a register %s\n", name);
         return ret;
     }
 
     if (parse_key_type(ctx) != NO_ERROR) {
-        fprintf(stderr, "%s: couldn't get key BTF info of a Register instance\n", name);
+        pr_err("%s: couldn't get key BTF info of a Register instance\n", name);
         return EOPNOTSUPP;
     }
 
     if (parse_value_type(ctx) != NO_ERROR) {
-        fprintf(stderr, "%s: couldn't get value BTF info of a Register instance\n", name);
+        pr_err("%s: couldn't get value BTF info of a Register instance\n", name);
         return EOPNOTSUPP;
     }
 
     return NO_ERROR;
 }
 
+int psabpf_register_ctx_clone(psabpf_register_context_t *dst, psabpf_register_context_t *src) {
+    if (dst == NULL || src == NULL || dst == src)
+        return EINVAL;
+
+    int ret = borrow_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->reg, &src->reg);
+    if (ret == NO_ERROR)
+        ret = copy_struct_field_descriptor_set(&dst->key_fds, &src->key_fds);
+    if (ret == NO_ERROR)
+        ret = copy_struct_field_descriptor_set(&dst->value_fds, &src->value_fds);
+
+    return ret;
+}
+
 void psabpf_register_entry_init(psabpf_register_entry_t *entry) {
     if (entry == NULL)
         return;
@@ -112,7 +138,7 @@ int psabpf_register_entry_set_key(psabpf_register_entry_t *entry, const void *da
 
     int ret = struct_field_set_append(&entry->entry_key, data, data_len);
     if (ret != NO_ERROR)
-        fprintf(stderr, "couldn't append key to an entry: %s\n", strerror(ret));
+        pr_err("couldn't append key to an entry: %s\n", strerror(ret));
     return ret;
 }
 
@@ -124,7 +150,7 @@ int psabpf_register_entry_set_value(psabpf_register_entry_t *entry, const void *
 
     int ret = struct_field_set_append(&entry->entry_value, data, data_len);
     if (ret != NO_ERROR)
-        fprintf(stderr, "couldn't append value to an entry: %s\n", strerror(ret));
+        pr_err("couldn't append value to an entry: %s\n", strerror(ret));
     return ret;
 }
 
@@ -135,7 +161,7 @@ static void *allocate_key_buffer(psabpf_register_context_t *ctx, psabpf_register
 
     entry->raw_key = malloc(ctx->reg.key_size);
     if (entry->raw_key == NULL)
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
 
     return entry->raw_key;
 }
@@ -147,7 +173,7 @@ static void *allocate_value_buffer(psabpf_register_context_t *ctx, psabpf_regist
 
     entry->raw_value = malloc(ctx->reg.value_size);
     if (entry->raw_value == NULL)
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
 
     return entry->raw_value;
 }
@@ -205,7 +231,7 @@ psabpf_register_entry_t * psabpf_register_get_next(psabpf_register_context_t *ct
         return NULL;
 
     /* on first call ctx->prev_entry_ke must be NULL */
-    if (bpf_map_get_next_key(ctx->reg.fd, ctx->prev_entry_key, ctx->current_entry.raw_key) != 0) {
+    if (map_ops->get_next_key(ctx->reg.fd, ctx->prev_entry_key, ctx->current_entry.raw_key) != 0) {
         /* no more entries, prepare for next iteration */
         if (ctx->prev_entry_key != NULL)
             free(ctx->prev_entry_key);
@@ -217,7 +243,7 @@ psabpf_register_entry_t * psabpf_register_get_next(psabpf_register_context_t *ct
     if (ctx->prev_entry_key == NULL) {
         ctx->prev_entry_key = malloc(ctx->reg.key_size);
         if (ctx->prev_entry_key == NULL) {
-            fprintf(stderr, "not enough memory\n");
+            pr_err("not enough memory\n");
             return NULL;
         }
     }
@@ -227,9 +253,9 @@ psabpf_register_entry_t * psabpf_register_get_next(psabpf_register_context_t *ct
     if (allocate_value_buffer(ctx, &ctx->current_entry) == NULL)
         return NULL;
 
-    int ret = bpf_map_lookup_elem(ctx->reg.fd, ctx->current_entry.raw_key, ctx->current_entry.raw_value);
+    int ret = map_ops->lookup_elem(ctx->reg.fd, ctx->current_entry.raw_key, ctx->current_entry.raw_value);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to read Register entry: %s\n", strerror(ret));
+        pr_err("failed to read Register entry: %s\n", strerror(ret));
         return NULL;
     }
 
@@ -238,6 +264,8 @@ psabpf_register_entry_t * psabpf_register_get_next(psabpf_register_context_t *ct
 
 int psabpf_register_get(psabpf_register_context_t *ctx, psabpf_register_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_REGISTER_GET);
+
     if (allocate_key_buffer(ctx, entry) == NULL)
         return ENOMEM;
 
@@ -248,10 +276,10 @@ int psabpf_register_get(psabpf_register_context_t *ctx, psabpf_register_entry_t
     if (allocate_value_buffer(ctx, entry) == NULL)
         return ENOMEM;
 
-    ret = bpf_map_lookup_elem(ctx->reg.fd, entry->raw_key, entry->raw_value);
+    ret = map_ops->lookup_elem(ctx->reg.fd, entry->raw_key, entry->raw_value);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to read Register entry: %s\n", strerror(ret));
+        pr_err("failed to read Register entry: %s\n", strerror(ret));
         return ret;
     }
 
@@ -259,6 +287,8 @@ int psabpf_register_get(psabpf_register_context_t *ctx, psabpf_register_entry_t
 }
 
 int psabpf_register_set(psabpf_register_context_t *ctx, psabpf_register_entry_t *entry) {
+    STATS_SCOPE(PSABPF_STATS_REGISTER_SET);
+
     if (allocate_key_buffer(ctx, entry) == NULL)
         return ENOMEM;
 
@@ -273,9 +303,9 @@ int psabpf_register_set(psabpf_register_context_t *ctx, psabpf_register_entry_t
     if (ret != NO_ERROR)
         return ret;
 
-    ret = bpf_map_update_elem(ctx->reg.fd, entry->raw_key, entry->raw_value, 0);
+    ret = txn_map_update_elem(ctx->reg.fd, entry->raw_key, entry->raw_value, 0);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to set a register: %s\n", strerror(ret));
+        pr_err("failed to set a register: %s\n", strerror(ret));
         return ret;
     }
 
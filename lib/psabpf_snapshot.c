@@ -0,0 +1,516 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bpf/bpf.h>
+#include <bpf/btf.h>
+#include <linux/bpf.h>
+
+#include <psabpf.h>
+#include <psabpf_pipeline.h>
+#include "btf.h"
+#include "common.h"
+#include "psabpf_table.h"
+#include "psabpf_txn.h"
+#include "psabpf_map_ops.h"
+
+/*
+ * Snapshot file, all numbers in the host byte order, every item is padded to 8 bytes:
+ *   snapshot_header_t
+ *   n_maps times:
+ *     snapshot_map_header_t, name
+ *     map of maps: n_entries times key and record of inner map (without name)
+ *     other maps: all keys, then all values
+ */
+
+#define SNAPSHOT_MAGIC "PSABPFSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_WRITE_BATCH_SIZE 65536
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_maps;
+    uint64_t btf_hash;  /* hash of the pipeline BTF, 0 when not available */
+} snapshot_header_t;
+
+typedef struct snapshot_map_header {
+    uint32_t name_len;    /* 0 for inner maps */
+    uint32_t type;
+    uint32_t key_size;
+    uint32_t value_size;  /* size of value returned by lookup */
+    uint32_t max_entries;
+    uint32_t map_flags;
+    uint64_t n_entries;
+} snapshot_map_header_t;
+
+typedef struct snapshot_reader {
+    const char *data;
+    size_t size;
+    size_t offset;
+} snapshot_reader_t;
+
+static size_t pad8(size_t size)
+{
+    return (size + 7) & ~((size_t) 7);
+}
+
+static bool is_map_of_maps(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_ARRAY_OF_MAPS || type == BPF_MAP_TYPE_HASH_OF_MAPS;
+}
+
+static bool is_array_map(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_ARRAY || type == BPF_MAP_TYPE_PERCPU_ARRAY;
+}
+
+static uint64_t get_pipeline_btf_hash(psabpf_context_t *ctx)
+{
+    psabpf_btf_t btf;
+    init_btf(&btf);
+    if (load_btf(ctx, &btf) != NO_ERROR)
+        return 0;
+
+    uint32_t size = 0;
+    const uint8_t *data = btf__get_raw_data(btf.btf, &size);
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; data != NULL && i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    free_btf(&btf);
+
+    return data != NULL ? hash : 0;
+}
+
+static int write_padded(FILE *file, const void *data, size_t size)
+{
+    static const char zeros[8] = {0};
+    size_t padding = pad8(size) - size;
+
+    if (size > 0 && fwrite(data, 1, size, file) != size)
+        return EIO;
+    if (padding > 0 && fwrite(zeros, 1, padding, file) != padding)
+        return EIO;
+
+    return NO_ERROR;
+}
+
+static int save_map(FILE *file, int fd, const char *name)
+{
+    struct bpf_map_info info = {};
+    uint32_t info_len = sizeof(info);
+    if (map_ops->obj_get_info_by_fd(fd, &info, &info_len) != 0)
+        return errno;
+
+    uint32_t value_size = 0;
+    int ret = get_map_lookup_value_size(&info, &value_size);
+    if (ret != NO_ERROR)
+        return ret;
+
+    psabpf_bpf_map_descriptor_t md = {
+            .fd = fd,
+            .type = info.type,
+            .key_size = info.key_size,
+            .value_size = value_size,
+            .max_entries = info.max_entries,
+    };
+    char *keys = NULL, *values = NULL;
+    size_t n_entries = 0;
+    ret = read_all_map_entries(&md, &keys, &values, &n_entries);
+    if (ret != NO_ERROR)
+        return ret;
+
+    snapshot_map_header_t header = {
+            .name_len = name != NULL ? strlen(name) : 0,
+            .type = info.type,
+            .key_size = info.key_size,
+            .value_size = value_size,
+            .max_entries = info.max_entries,
+            .map_flags = info.map_flags,
+            .n_entries = n_entries,
+    };
+    ret = write_padded(file, &header, sizeof(header));
+    if (ret == NO_ERROR)
+        ret = write_padded(file, name, header.name_len);
+    if (ret != NO_ERROR)
+        goto clean_up;
+
+    if (!is_map_of_maps(info.type)) {
+        ret = write_padded(file, keys, n_entries * info.key_size);
+        if (ret == NO_ERROR)
+            ret = write_padded(file, values, n_entries * value_size);
+        goto clean_up;
+    }
+
+    for (size_t i = 0; i < n_entries; i++) {
+        uint32_t inner_id;
+        memcpy(&inner_id, values + i * value_size, sizeof(inner_id));
+        int inner_fd = map_ops->get_fd_by_id(inner_id);
+        if (inner_fd < 0) {
+            ret = errno;
+            goto clean_up;
+        }
+
+        ret = write_padded(file, keys + i * info.key_size, info.key_size);
+        if (ret == NO_ERROR)
+            ret = save_map(file, inner_fd, NULL);
+        close(inner_fd);
+        if (ret != NO_ERROR)
+            goto clean_up;
+    }
+
+clean_up:
+    if (keys != NULL)
+        free(keys);
+    if (values != NULL)
+        free(values);
+
+    return ret;
+}
+
+int psabpf_pipeline_snapshot_save(psabpf_context_t *ctx, const char *file_name)
+{
+    char maps_path[256];
+    int ret = NO_ERROR;
+
+    if (ctx == NULL || file_name == NULL)
+        return EINVAL;
+
+    build_ebpf_map_filename(maps_path, sizeof(maps_path), ctx, "");
+    DIR *dir = opendir(maps_path);
+    if (dir == NULL) {
+        ret = errno;
+        pr_err("failed to open pipeline maps: %s\n", strerror(ret));
+        return ret;
+    }
+
+    FILE *file = fopen(file_name, "wb");
+    if (file == NULL) {
+        ret = errno;
+        pr_err("failed to open %s: %s\n", file_name, strerror(ret));
+        closedir(dir);
+        return ret;
+    }
+
+    snapshot_header_t header = {
+            .magic = SNAPSHOT_MAGIC,
+            .version = SNAPSHOT_VERSION,
+            .n_maps = 0,
+            .btf_hash = get_pipeline_btf_hash(ctx),
+    };
+    /* number of maps is updated at the end */
+    ret = write_padded(file, &header, sizeof(header));
+
+    struct dirent *dir_entry;
+    while (ret == NO_ERROR && (dir_entry = readdir(dir)) != NULL) {
+        const char *name = dir_entry->d_name;
+        if (name[0] == '.')
+            continue;
+        /* content of caches is derived from tables */
+        if (str_ends_with(name, "_cache"))
+            continue;
+
+        psabpf_bpf_map_descriptor_t md;
+        if (open_bpf_map(ctx, name, NULL, &md) != NO_ERROR)
+            continue;
+
+        ret = save_map(file, md.fd, name);
+        close_object_fd(&md.fd);
+        if (ret == EOPNOTSUPP) {
+            /* e.g. queue or program array, they are not a part of the snapshot */
+            ret = NO_ERROR;
+            continue;
+        }
+        if (ret != NO_ERROR)
+            pr_err("failed to save map %s: %s\n", name, strerror(ret));
+        else
+            header.n_maps++;
+    }
+
+    if (ret == NO_ERROR) {
+        if (fseek(file, 0, SEEK_SET) != 0 || write_padded(file, &header, sizeof(header)) != NO_ERROR)
+            ret = EIO;
+    }
+    if (fclose(file) != 0 && ret == NO_ERROR)
+        ret = EIO;
+    closedir(dir);
+
+    if (ret != NO_ERROR) {
+        pr_err("failed to write snapshot: %s\n", strerror(ret));
+        remove(file_name);
+    }
+
+    return ret;
+}
+
+/* Returns pointer to the next item of given size, NULL if file is truncated */
+static const void *reader_take(snapshot_reader_t *reader, size_t size)
+{
+    if (size > reader->size - reader->offset || pad8(size) > reader->size - reader->offset)
+        return NULL;
+
+    const void *ptr = reader->data + reader->offset;
+    reader->offset += pad8(size);
+    return ptr;
+}
+
+/* Elements are pushed in batches straight from the mapped file */
+static int write_map_entries(int fd, const snapshot_map_header_t *header, const char *keys, const char *values)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+    size_t offset = 0;
+    bool use_batch = true;
+
+    while (offset < header->n_entries) {
+        const char *key = keys + offset * header->key_size;
+        const char *value = values + offset * header->value_size;
+
+        if (use_batch) {
+            uint32_t count = header->n_entries - offset > SNAPSHOT_WRITE_BATCH_SIZE ?
+                             SNAPSHOT_WRITE_BATCH_SIZE : (uint32_t) (header->n_entries - offset);
+            if (txn_map_update_batch(fd, (void *) key, (void *) value, &count, &opts) == 0) {
+                offset += count;
+                continue;
+            }
+            int err = errno;
+            if (offset == 0 && count == 0 && batch_ops_not_supported(err)) {
+                use_batch = false;
+                continue;
+            }
+            return err;
+        }
+
+        if (txn_map_update_elem(fd, key, value, BPF_ANY) != 0)
+            return errno;
+        offset++;
+    }
+
+    return NO_ERROR;
+}
+
+static int restore_map(snapshot_reader_t *reader, const snapshot_map_header_t *header, int fd);
+
+static int restore_map_of_maps(snapshot_reader_t *reader, const snapshot_map_header_t *header, int fd)
+{
+    for (uint64_t i = 0; i < header->n_entries; i++) {
+        const void *key = reader_take(reader, header->key_size);
+        const snapshot_map_header_t *inner_header = reader_take(reader, sizeof(snapshot_map_header_t));
+        if (key == NULL || inner_header == NULL || inner_header->name_len != 0)
+            return EINVAL;
+
+        /* map only has to be parsed */
+        if (fd < 0) {
+            int ret = restore_map(reader, inner_header, -1);
+            if (ret != NO_ERROR)
+                return ret;
+            continue;
+        }
+
+        /* inner map is created from scratch, it must be compatible with the template of outer map */
+        if (is_map_of_maps(inner_header->type)) {
+            pr_err("nested maps of maps are not supported\n");
+            return ENOTSUP;
+        }
+        if (inner_header->type == BPF_MAP_TYPE_PERCPU_HASH || inner_header->type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+            inner_header->type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+            pr_err("per-CPU inner maps are not supported\n");
+            return ENOTSUP;
+        }
+        struct bpf_create_map_attr attr = {
+                .map_type = inner_header->type,
+                .map_flags = inner_header->map_flags,
+                .key_size = inner_header->key_size,
+                .value_size = inner_header->value_size,
+                .max_entries = inner_header->max_entries,
+        };
+        int inner_fd = map_ops->create_map(&attr);
+        if (inner_fd < 0)
+            return errno;
+
+        int ret = restore_map(reader, inner_header, inner_fd);
+        if (ret == NO_ERROR && txn_map_update_elem(fd, key, &inner_fd, BPF_ANY) != 0)
+            ret = errno;
+        close(inner_fd);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    return NO_ERROR;
+}
+
+/* Reads content of the map from snapshot and writes it into the map, if FD is valid */
+static int restore_map(snapshot_reader_t *reader, const snapshot_map_header_t *header, int fd)
+{
+    if (is_map_of_maps(header->type))
+        return restore_map_of_maps(reader, header, fd);
+
+    if (header->key_size == 0 || header->n_entries > (reader->size - reader->offset) / header->key_size)
+        return EINVAL;
+    const char *keys = reader_take(reader, header->n_entries * header->key_size);
+    const char *values = reader_take(reader, header->n_entries * header->value_size);
+    if (keys == NULL || values == NULL)
+        return EINVAL;
+
+    if (fd < 0)
+        return NO_ERROR;
+
+    return write_map_entries(fd, header, keys, values);
+}
+
+/* Opens pinned map for restore, FD is -1 when map can't be restored */
+static int open_map_for_restore(psabpf_context_t *ctx, const char *name,
+                                const snapshot_map_header_t *header, psabpf_bpf_map_descriptor_t *md)
+{
+    md->fd = -1;
+    if (open_bpf_map(ctx, name, NULL, md) != NO_ERROR) {
+        pr_warn("%s: map not found, skipped\n", name);
+        md->fd = -1;
+        return NO_ERROR;
+    }
+
+    struct bpf_map_info info = { .type = md->type, .value_size = md->value_size };
+    uint32_t value_size = 0;
+    if (md->type != header->type || md->key_size != header->key_size ||
+        get_map_lookup_value_size(&info, &value_size) != NO_ERROR || value_size != header->value_size) {
+        pr_warn("%s: map layout changed, skipped\n", name);
+        close_object_fd(&md->fd);
+        return NO_ERROR;
+    }
+
+    /* Snapshot replaces content. Every index of array is written anyway,
+     * but slots of array of maps not present in the snapshot were empty. */
+    if (!is_array_map(md->type))
+        return delete_all_map_entries(md);
+
+    return NO_ERROR;
+}
+
+static void clear_map_cache(psabpf_context_t *ctx, const char *name)
+{
+    char cache_name[256];
+    psabpf_bpf_map_descriptor_t cache;
+
+    /* Truncated name would open another map */
+    int len = snprintf(cache_name, sizeof(cache_name), "%s_cache", name);
+    if (len < 0 || (size_t) len >= sizeof(cache_name))
+        return;
+    if (open_bpf_map(ctx, cache_name, NULL, &cache) != NO_ERROR)
+        return;
+    clear_table_cache(&cache);
+    close_object_fd(&cache.fd);
+}
+
+int psabpf_pipeline_snapshot_restore(psabpf_context_t *ctx, const char *file_name)
+{
+    int ret = NO_ERROR;
+
+    if (ctx == NULL || file_name == NULL)
+        return EINVAL;
+
+    int file_fd = open(file_name, O_RDONLY);
+    if (file_fd < 0) {
+        ret = errno;
+        pr_err("failed to open %s: %s\n", file_name, strerror(ret));
+        return ret;
+    }
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) != 0) {
+        ret = errno;
+        close(file_fd);
+        return ret;
+    }
+    if ((size_t) file_stat.st_size < sizeof(snapshot_header_t)) {
+        pr_err("%s: not a snapshot\n", file_name);
+        close(file_fd);
+        return EINVAL;
+    }
+
+    void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+    close(file_fd);
+    if (data == MAP_FAILED) {
+        ret = errno;
+        pr_err("failed to map %s: %s\n", file_name, strerror(ret));
+        return ret;
+    }
+    /* file is read sequentially */
+    madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+    snapshot_reader_t reader = {
+            .data = data,
+            .size = file_stat.st_size,
+            .offset = 0,
+    };
+    const snapshot_header_t *header = reader_take(&reader, sizeof(snapshot_header_t));
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION) {
+        pr_err("%s: not a snapshot or unsupported version\n", file_name);
+        ret = EINVAL;
+        goto clean_up;
+    }
+    uint64_t btf_hash = get_pipeline_btf_hash(ctx);
+    if (header->btf_hash != 0 && btf_hash != 0 && header->btf_hash != btf_hash) {
+        pr_err("snapshot was taken from another program\n");
+        ret = EINVAL;
+        goto clean_up;
+    }
+
+    for (uint32_t i = 0; i < header->n_maps; i++) {
+        const snapshot_map_header_t *map_header = reader_take(&reader, sizeof(snapshot_map_header_t));
+        if (map_header == NULL || map_header->name_len == 0 || map_header->name_len >= 256) {
+            ret = EINVAL;
+            break;
+        }
+        const char *name_ptr = reader_take(&reader, map_header->name_len);
+        if (name_ptr == NULL) {
+            ret = EINVAL;
+            break;
+        }
+        char name[256];
+        memcpy(name, name_ptr, map_header->name_len);
+        name[map_header->name_len] = '\0';
+
+        psabpf_bpf_map_descriptor_t md;
+        ret = open_map_for_restore(ctx, name, map_header, &md);
+        if (ret == NO_ERROR)
+            ret = restore_map(&reader, map_header, md.fd);
+        close_object_fd(&md.fd);
+        if (ret != NO_ERROR) {
+            pr_err("failed to restore map %s: %s\n", name, strerror(ret));
+            break;
+        }
+
+        clear_map_cache(ctx, name);
+    }
+
+clean_up:
+    munmap(data, file_stat.st_size);
+
+    return ret;
+}
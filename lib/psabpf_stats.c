@@ -0,0 +1,427 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <linux/bpf.h>
+
+#include "common.h"
+#include "stats.h"
+
+bool stats_active = false;
+
+static psabpf_stats_entry_t map_op_stats[PSABPF_STATS_MAP_OP_COUNT];
+static psabpf_stats_entry_t op_stats[PSABPF_STATS_OP_COUNT];
+
+/* Map operations issued by the current thread, high-level operations take the difference */
+static __thread uint64_t thread_map_ops;
+static __thread uint64_t thread_bytes;
+
+static const char *map_op_names[PSABPF_STATS_MAP_OP_COUNT] = {
+        [PSABPF_STATS_MAP_OBJ_GET] = "obj_get",
+        [PSABPF_STATS_MAP_OBJ_PIN] = "obj_pin",
+        [PSABPF_STATS_MAP_PATH_EXISTS] = "path_exists",
+        [PSABPF_STATS_MAP_OBJ_GET_INFO_BY_FD] = "obj_get_info_by_fd",
+        [PSABPF_STATS_MAP_GET_FD_BY_ID] = "get_fd_by_id",
+        [PSABPF_STATS_MAP_CREATE_MAP] = "create_map",
+        [PSABPF_STATS_MAP_LOOKUP_ELEM] = "lookup_elem",
+        [PSABPF_STATS_MAP_LOOKUP_ELEM_FLAGS] = "lookup_elem_flags",
+        [PSABPF_STATS_MAP_LOOKUP_AND_DELETE_ELEM] = "lookup_and_delete_elem",
+        [PSABPF_STATS_MAP_UPDATE_ELEM] = "update_elem",
+        [PSABPF_STATS_MAP_DELETE_ELEM] = "delete_elem",
+        [PSABPF_STATS_MAP_GET_NEXT_KEY] = "get_next_key",
+        [PSABPF_STATS_MAP_LOOKUP_BATCH] = "lookup_batch",
+        [PSABPF_STATS_MAP_LOOKUP_AND_DELETE_BATCH] = "lookup_and_delete_batch",
+        [PSABPF_STATS_MAP_UPDATE_BATCH] = "update_batch",
+        [PSABPF_STATS_MAP_DELETE_BATCH] = "delete_batch",
+};
+
+static const char *op_names[PSABPF_STATS_OP_COUNT] = {
+        [PSABPF_STATS_TABLE_CTX_OPEN] = "table_ctx_open",
+        [PSABPF_STATS_TABLE_ENTRY_ADD] = "table_entry_add",
+        [PSABPF_STATS_TABLE_ENTRY_UPDATE] = "table_entry_update",
+        [PSABPF_STATS_TABLE_ENTRY_DEL] = "table_entry_del",
+        [PSABPF_STATS_TABLE_ENTRY_GET] = "table_entry_get",
+        [PSABPF_STATS_TABLE_ENTRY_GET_NEXT] = "table_entry_get_next",
+        [PSABPF_STATS_TABLE_ENTRY_VIEW_NEXT] = "table_entry_view_next",
+        [PSABPF_STATS_TABLE_ENTRY_ADD_BATCH] = "table_entry_add_batch",
+        [PSABPF_STATS_TABLE_ENTRY_UPDATE_BATCH] = "table_entry_update_batch",
+        [PSABPF_STATS_TABLE_SET_DEFAULT_ENTRY] = "table_set_default_entry",
+        [PSABPF_STATS_TABLE_GET_DEFAULT_ENTRY] = "table_get_default_entry",
+        [PSABPF_STATS_COUNTER_CTX_OPEN] = "counter_ctx_open",
+        [PSABPF_STATS_COUNTER_GET] = "counter_get",
+        [PSABPF_STATS_COUNTER_GET_NEXT] = "counter_get_next",
+        [PSABPF_STATS_COUNTER_SET] = "counter_set",
+        [PSABPF_STATS_COUNTER_RESET] = "counter_reset",
+        [PSABPF_STATS_REGISTER_CTX_OPEN] = "register_ctx_open",
+        [PSABPF_STATS_REGISTER_GET] = "register_get",
+        [PSABPF_STATS_REGISTER_SET] = "register_set",
+        [PSABPF_STATS_METER_CTX_OPEN] = "meter_ctx_open",
+        [PSABPF_STATS_METER_GET] = "meter_get",
+        [PSABPF_STATS_METER_GET_NEXT] = "meter_get_next",
+        [PSABPF_STATS_METER_UPDATE] = "meter_update",
+        [PSABPF_STATS_METER_RESET] = "meter_reset",
+        [PSABPF_STATS_DIGEST_CTX_OPEN] = "digest_ctx_open",
+        [PSABPF_STATS_DIGEST_GET_NEXT] = "digest_get_next",
+        [PSABPF_STATS_ACTION_SELECTOR_CTX_OPEN] = "action_selector_ctx_open",
+        [PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER] = "action_selector_add_member",
+        [PSABPF_STATS_ACTION_SELECTOR_UPDATE_MEMBER] = "action_selector_update_member",
+        [PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER] = "action_selector_del_member",
+        [PSABPF_STATS_ACTION_SELECTOR_ADD_GROUP] = "action_selector_add_group",
+        [PSABPF_STATS_ACTION_SELECTOR_DEL_GROUP] = "action_selector_del_group",
+        [PSABPF_STATS_ACTION_SELECTOR_ADD_MEMBER_TO_GROUP] = "action_selector_add_member_to_group",
+        [PSABPF_STATS_ACTION_SELECTOR_DEL_MEMBER_FROM_GROUP] = "action_selector_del_member_from_group",
+        [PSABPF_STATS_CLONE_SESSION_CREATE] = "clone_session_create",
+        [PSABPF_STATS_CLONE_SESSION_DELETE] = "clone_session_delete",
+        [PSABPF_STATS_CLONE_SESSION_ENTRY_UPDATE] = "clone_session_entry_update",
+        [PSABPF_STATS_CLONE_SESSION_ENTRY_DELETE] = "clone_session_entry_delete",
+        [PSABPF_STATS_MCAST_GRP_CREATE] = "mcast_grp_create",
+        [PSABPF_STATS_MCAST_GRP_DELETE] = "mcast_grp_delete",
+        [PSABPF_STATS_MCAST_GRP_MEMBER_UPDATE] = "mcast_grp_member_update",
+        [PSABPF_STATS_MCAST_GRP_MEMBER_DELETE] = "mcast_grp_member_delete",
+        [PSABPF_STATS_PIPELINE_LOAD] = "pipeline_load",
+        [PSABPF_STATS_PIPELINE_UNLOAD] = "pipeline_unload",
+        [PSABPF_STATS_BTF_LOAD] = "btf_load",
+        [PSABPF_STATS_TABLE_BUFFER_BUILD] = "table_buffer_build",
+        [PSABPF_STATS_TABLE_CACHE_CLEAR] = "table_cache_clear",
+};
+
+static uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* Counters are updated with relaxed atomics, so threads don't lose updates */
+static void stats_record(psabpf_stats_entry_t *entry, uint64_t ns, uint64_t n_map_ops, uint64_t bytes, bool failed)
+{
+    unsigned bucket = ns == 0 ? 0 : 64 - (unsigned) __builtin_clzll(ns);
+    if (bucket >= PSABPF_STATS_HISTOGRAM_BUCKETS)
+        bucket = PSABPF_STATS_HISTOGRAM_BUCKETS - 1;
+
+    __atomic_fetch_add(&entry->calls, 1, __ATOMIC_RELAXED);
+    if (failed)
+        __atomic_fetch_add(&entry->errors, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->map_ops, n_map_ops, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&entry->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&entry->max_ns, &max, ns, true,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Sizes of keys and values of maps, indexed by file descriptor. They are learned when the library reads
+ * information about a map (every object context does it when opening its maps) or creates one, and forgotten
+ * when a new descriptor is returned for the same number. Larger descriptors are not tracked.
+ */
+
+#define STATS_TRACKED_FDS 4096
+
+static struct {
+    uint32_t key_size;
+    uint32_t value_size;
+} fd_sizes[STATS_TRACKED_FDS];
+
+static void set_fd_sizes(int fd, uint32_t key_size, uint32_t value_size)
+{
+    if (fd < 0 || fd >= STATS_TRACKED_FDS)
+        return;
+    fd_sizes[fd].key_size = key_size;
+    fd_sizes[fd].value_size = value_size;
+}
+
+static uint64_t fd_key_size(int fd)
+{
+    return fd >= 0 && fd < STATS_TRACKED_FDS ? fd_sizes[fd].key_size : 0;
+}
+
+static uint64_t fd_value_size(int fd)
+{
+    return fd >= 0 && fd < STATS_TRACKED_FDS ? fd_sizes[fd].value_size : 0;
+}
+
+/*
+ * Map operations
+ */
+
+static const psabpf_map_ops_t *stats_backend = &kernel_map_ops;
+
+static void map_op_done(psabpf_stats_map_op_t op, uint64_t start_ns, uint64_t bytes, bool failed)
+{
+    uint64_t ns = stats_now_ns() - start_ns;
+    thread_map_ops++;
+    thread_bytes += bytes;
+    stats_record(&map_op_stats[op], ns, 1, bytes, failed);
+}
+
+static int stats_obj_get(const char *pathname)
+{
+    uint64_t start_ns = stats_now_ns();
+    int fd = stats_backend->obj_get(pathname);
+    map_op_done(PSABPF_STATS_MAP_OBJ_GET, start_ns, 0, fd < 0);
+    set_fd_sizes(fd, 0, 0);
+    return fd;
+}
+
+static int stats_obj_pin(int fd, const char *pathname)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->obj_pin(fd, pathname);
+    map_op_done(PSABPF_STATS_MAP_OBJ_PIN, start_ns, 0, ret != 0);
+    return ret;
+}
+
+static bool stats_path_exists(const char *pathname)
+{
+    uint64_t start_ns = stats_now_ns();
+    bool ret = stats_backend->path_exists(pathname);
+    map_op_done(PSABPF_STATS_MAP_PATH_EXISTS, start_ns, 0, false);
+    return ret;
+}
+
+static int stats_obj_get_info_by_fd(int fd, void *info, uint32_t *info_len)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->obj_get_info_by_fd(fd, info, info_len);
+    map_op_done(PSABPF_STATS_MAP_OBJ_GET_INFO_BY_FD, start_ns, ret == 0 ? *info_len : 0, ret != 0);
+
+    if (ret == 0 && *info_len >= offsetof(struct bpf_map_info, value_size) + sizeof(uint32_t)) {
+        const struct bpf_map_info *map_info = info;
+        uint32_t value_size = map_info->value_size;
+        /* Per-CPU maps copy value of every CPU */
+        get_map_lookup_value_size(map_info, &value_size);
+        set_fd_sizes(fd, map_info->key_size, value_size);
+    }
+    return ret;
+}
+
+static int stats_get_fd_by_id(uint32_t id)
+{
+    uint64_t start_ns = stats_now_ns();
+    int fd = stats_backend->get_fd_by_id(id);
+    map_op_done(PSABPF_STATS_MAP_GET_FD_BY_ID, start_ns, 0, fd < 0);
+    set_fd_sizes(fd, 0, 0);
+    return fd;
+}
+
+static int stats_create_map(const struct bpf_create_map_attr *attr)
+{
+    uint64_t start_ns = stats_now_ns();
+    int fd = stats_backend->create_map(attr);
+    map_op_done(PSABPF_STATS_MAP_CREATE_MAP, start_ns, 0, fd < 0);
+    set_fd_sizes(fd, attr->key_size, attr->value_size);
+    return fd;
+}
+
+static int stats_lookup_elem(int fd, const void *key, void *value)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->lookup_elem(fd, key, value);
+    map_op_done(PSABPF_STATS_MAP_LOOKUP_ELEM, start_ns, fd_key_size(fd) + fd_value_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_lookup_elem_flags(int fd, const void *key, void *value, uint64_t flags)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->lookup_elem_flags(fd, key, value, flags);
+    map_op_done(PSABPF_STATS_MAP_LOOKUP_ELEM_FLAGS, start_ns, fd_key_size(fd) + fd_value_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_lookup_and_delete_elem(int fd, const void *key, void *value)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->lookup_and_delete_elem(fd, key, value);
+    map_op_done(PSABPF_STATS_MAP_LOOKUP_AND_DELETE_ELEM, start_ns,
+                (key != NULL ? fd_key_size(fd) : 0) + fd_value_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_update_elem(int fd, const void *key, const void *value, uint64_t flags)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->update_elem(fd, key, value, flags);
+    map_op_done(PSABPF_STATS_MAP_UPDATE_ELEM, start_ns,
+                (key != NULL ? fd_key_size(fd) : 0) + fd_value_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_delete_elem(int fd, const void *key)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->delete_elem(fd, key);
+    map_op_done(PSABPF_STATS_MAP_DELETE_ELEM, start_ns, fd_key_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_get_next_key(int fd, const void *key, void *next_key)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->get_next_key(fd, key, next_key);
+    map_op_done(PSABPF_STATS_MAP_GET_NEXT_KEY, start_ns, (key != NULL ? 2 : 1) * fd_key_size(fd), ret != 0);
+    return ret;
+}
+
+static int stats_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                              uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->lookup_batch(fd, in_batch, out_batch, keys, values, count, opts);
+    map_op_done(PSABPF_STATS_MAP_LOOKUP_BATCH, start_ns, *count * (fd_key_size(fd) + fd_value_size(fd)), ret != 0);
+    return ret;
+}
+
+static int stats_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                         uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->lookup_and_delete_batch(fd, in_batch, out_batch, keys, values, count, opts);
+    map_op_done(PSABPF_STATS_MAP_LOOKUP_AND_DELETE_BATCH, start_ns,
+                *count * (fd_key_size(fd) + fd_value_size(fd)), ret != 0);
+    return ret;
+}
+
+static int stats_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                              const struct bpf_map_batch_opts *opts)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->update_batch(fd, keys, values, count, opts);
+    map_op_done(PSABPF_STATS_MAP_UPDATE_BATCH, start_ns, *count * (fd_key_size(fd) + fd_value_size(fd)), ret != 0);
+    return ret;
+}
+
+static int stats_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    uint64_t start_ns = stats_now_ns();
+    int ret = stats_backend->delete_batch(fd, keys, count, opts);
+    map_op_done(PSABPF_STATS_MAP_DELETE_BATCH, start_ns, *count * fd_key_size(fd), ret != 0);
+    return ret;
+}
+
+static const psabpf_map_ops_t stats_map_ops = {
+        .obj_get = stats_obj_get,
+        .obj_pin = stats_obj_pin,
+        .path_exists = stats_path_exists,
+        .obj_get_info_by_fd = stats_obj_get_info_by_fd,
+        .get_fd_by_id = stats_get_fd_by_id,
+        .create_map = stats_create_map,
+        .lookup_elem = stats_lookup_elem,
+        .lookup_elem_flags = stats_lookup_elem_flags,
+        .lookup_and_delete_elem = stats_lookup_and_delete_elem,
+        .update_elem = stats_update_elem,
+        .delete_elem = stats_delete_elem,
+        .get_next_key = stats_get_next_key,
+        .lookup_batch = stats_lookup_batch,
+        .lookup_and_delete_batch = stats_lookup_and_delete_batch,
+        .update_batch = stats_update_batch,
+        .delete_batch = stats_delete_batch,
+};
+
+void stats_set_map_ops(const psabpf_map_ops_t *ops)
+{
+    if (map_ops == &stats_map_ops)
+        stats_backend = ops;
+    else
+        map_ops = ops;
+}
+
+/*
+ * High-level operations
+ */
+
+void stats_scope_begin(stats_scope_t *scope)
+{
+    scope->map_ops = thread_map_ops;
+    scope->bytes = thread_bytes;
+    scope->start_ns = stats_now_ns();
+}
+
+void stats_scope_finish(stats_scope_t *scope)
+{
+    uint64_t ns = stats_now_ns() - scope->start_ns;
+    stats_record(&op_stats[scope->op], ns, thread_map_ops - scope->map_ops, thread_bytes - scope->bytes, false);
+}
+
+/*
+ * Public API
+ */
+
+void psabpf_stats_enable(bool enable)
+{
+    if (enable && map_ops != &stats_map_ops) {
+        stats_backend = map_ops;
+        map_ops = &stats_map_ops;
+    } else if (!enable && map_ops == &stats_map_ops) {
+        map_ops = stats_backend;
+    }
+    stats_active = enable;
+}
+
+bool psabpf_stats_is_enabled(void)
+{
+    return stats_active;
+}
+
+void psabpf_stats_reset(void)
+{
+    memset(map_op_stats, 0, sizeof(map_op_stats));
+    memset(op_stats, 0, sizeof(op_stats));
+}
+
+static void copy_stats_entry(psabpf_stats_entry_t *dst, psabpf_stats_entry_t *src)
+{
+    dst->calls = __atomic_load_n(&src->calls, __ATOMIC_RELAXED);
+    dst->errors = __atomic_load_n(&src->errors, __ATOMIC_RELAXED);
+    dst->total_ns = __atomic_load_n(&src->total_ns, __ATOMIC_RELAXED);
+    dst->max_ns = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+    dst->map_ops = __atomic_load_n(&src->map_ops, __ATOMIC_RELAXED);
+    dst->bytes = __atomic_load_n(&src->bytes, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < PSABPF_STATS_HISTOGRAM_BUCKETS; i++)
+        dst->histogram[i] = __atomic_load_n(&src->histogram[i], __ATOMIC_RELAXED);
+}
+
+void psabpf_stats_get(psabpf_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    stats->enabled = stats_active;
+    for (unsigned i = 0; i < PSABPF_STATS_MAP_OP_COUNT; i++)
+        copy_stats_entry(&stats->map_ops[i], &map_op_stats[i]);
+    for (unsigned i = 0; i < PSABPF_STATS_OP_COUNT; i++)
+        copy_stats_entry(&stats->ops[i], &op_stats[i]);
+}
+
+const char *psabpf_stats_map_op_name(psabpf_stats_map_op_t op)
+{
+    if (op >= PSABPF_STATS_MAP_OP_COUNT)
+        return NULL;
+    return map_op_names[op];
+}
+
+const char *psabpf_stats_op_name(psabpf_stats_op_t op)
+{
+    if (op >= PSABPF_STATS_OP_COUNT)
+        return NULL;
+    return op_names[op];
+}
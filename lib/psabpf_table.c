@@ -17,8 +17,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <bpf/bpf.h>
 #include <bpf/btf.h>
 #include <linux/bpf.h>
@@ -28,8 +30,11 @@
 #include "btf.h"
 #include "common.h"
 #include "psabpf_table.h"
+#include "psabpf_txn.h"
 #include "psabpf_counter.h"
 #include "psabpf_meter.h"
+#include "psabpf_map_ops.h"
+#include "stats.h"
 
 void psabpf_table_entry_ctx_init(psabpf_table_entry_ctx_t *ctx)
 {
@@ -47,6 +52,23 @@ void psabpf_table_entry_ctx_init(psabpf_table_entry_ctx_t *ctx)
     ctx->cache.fd = -1;
 
     psabpf_table_entry_init(&ctx->current_entry);
+    ctx->batch_iter.batch_size = PSABPF_TABLE_DEFAULT_BATCH_SIZE;
+}
+
+static void free_batch_iterator(psabpf_table_batch_iterator_t *iter)
+{
+    if (iter->keys != NULL)
+        free(iter->keys);
+    if (iter->values != NULL)
+        free(iter->values);
+    if (iter->in_token != NULL)
+        free(iter->in_token);
+    if (iter->out_token != NULL)
+        free(iter->out_token);
+
+    uint32_t batch_size = iter->batch_size;
+    memset(iter, 0, sizeof(*iter));
+    iter->batch_size = batch_size;
 }
 
 void psabpf_table_entry_ctx_free(psabpf_table_entry_ctx_t *ctx)
@@ -54,8 +76,18 @@ void psabpf_table_entry_ctx_free(psabpf_table_entry_ctx_t *ctx)
     if (ctx == NULL)
         return;
 
+    /* unpublished shadow table is dropped */
+    free_table_shadow(ctx);
+
+    /* do not leave stale flows in the datapath */
+    psabpf_table_entry_ctx_flush_cache(ctx);
+    txn_forget_table(ctx);
+
     free_btf(&ctx->btf_metadata);
 
+    /* FD of the ternary table tuple is owned by the tuple cache */
+    if (ctx->is_ternary)
+        ctx->table.fd = -1;
     close_object_fd(&(ctx->table.fd));
     close_object_fd(&(ctx->default_entry.fd));
     close_object_fd(&(ctx->prefixes.fd));
@@ -85,7 +117,14 @@ void psabpf_table_entry_ctx_free(psabpf_table_entry_ctx_t *ctx)
         free(ctx->current_raw_key);
     ctx->current_raw_key = NULL;
 
+    if (ctx->current_raw_key_mask != NULL)
+        free(ctx->current_raw_key_mask);
+    ctx->current_raw_key_mask = NULL;
+
     psabpf_table_entry_free(&ctx->current_entry);
+    free_batch_iterator(&ctx->batch_iter);
+    free_table_layout(ctx);
+    ternary_prefixes_free(ctx);
 }
 
 static uint32_t get_table_value_type_id(psabpf_table_entry_ctx_t *ctx)
@@ -103,7 +142,7 @@ static int get_value_type(psabpf_table_entry_ctx_t *ctx, const struct btf_type *
         return EPERM;
 
     if (btf_kind(*value_type) != BTF_KIND_STRUCT) {
-        fprintf(stderr, "expected struct as a map value\n");
+        pr_err("expected struct as a map value\n");
         return EPERM;
     }
 
@@ -172,7 +211,7 @@ static int count_direct_objects(psabpf_table_entry_ctx_t *ctx)
                 continue;
             ctx->table_implementations.n_fields += 1;
         } else {
-            fprintf(stderr, "%s: unknown type direct object instance, ignored\n", member_name);
+            pr_err("%s: unknown type direct object instance, ignored\n", member_name);
             continue;
         }
     }
@@ -279,7 +318,7 @@ static int init_direct_objects_context(psabpf_table_entry_ctx_t *ctx)
 static int init_direct_objects(psabpf_table_entry_ctx_t *ctx)
 {
     if (ctx->btf_metadata.btf == NULL || ctx->table.btf_type_id == 0) {
-        fprintf(stderr, "unable to handle direct objects; resetting them if exist\n");
+        pr_err("unable to handle direct objects; resetting them if exist\n");
         return NO_ERROR;
     }
 
@@ -334,14 +373,14 @@ int open_ternary_table(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *c
     snprintf(derived_name, sizeof(derived_name), "%s_prefixes", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf_metadata, &ctx->prefixes);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
     snprintf(derived_name, sizeof(derived_name), "%s_tuples_map", name);
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf_metadata, &ctx->tuple_map);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
@@ -349,7 +388,7 @@ int open_ternary_table(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *c
     ret = open_bpf_map(psabpf_ctx, derived_name, &ctx->btf_metadata, &ctx->table);
     close_object_fd(&(ctx->table.fd));  /* We need only metadata from this map */
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open map %s: %s\n", derived_name, strerror(ret));
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
         return ret;
     }
 
@@ -360,21 +399,25 @@ int open_ternary_table(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *c
 
 int psabpf_table_entry_ctx_tblname(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *ctx, const char *name)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_CTX_OPEN);
+
     if (ctx == NULL || psabpf_ctx == NULL || name == NULL)
         return EINVAL;
 
     /* get the BTF, it is optional so print only warning */
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR)
-        fprintf(stderr, "warning: couldn't find BTF info\n");
+        pr_warn("warning: couldn't find BTF info\n");
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->table);
 
     /* if map does not exist, try the ternary table */
     if (ret == ENOENT)
         ret = open_ternary_table(psabpf_ctx, ctx, name);
+    else if (ret == NO_ERROR)
+        ret = open_table_outer_map(psabpf_ctx, ctx, name);
 
     if (ret != NO_ERROR) {
-        fprintf(stderr, "couldn't open table %s: %s\n", name, strerror(ret));
+        pr_err("couldn't open table %s: %s\n", name, strerror(ret));
         return ret;
     }
 
@@ -391,17 +434,110 @@ int psabpf_table_entry_ctx_tblname(psabpf_context_t *psabpf_ctx, psabpf_table_en
     snprintf(map_name, sizeof(map_name), "%s_cache", name);
     ret = open_bpf_map(psabpf_ctx, map_name, &ctx->btf_metadata, &ctx->cache);
     if (ret == NO_ERROR)
-        fprintf(stderr, "found cache for table: %s\n", name);
+        pr_debug("found cache for table: %s\n", name);
 
     ret = init_direct_objects(ctx);
     if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to initialize direct objects: %s\n", strerror(ret));
+        pr_err("failed to initialize direct objects: %s\n", strerror(ret));
+        return ret;
+    }
+
+    /* optional, entries are serialized with BTF walk when layout is not available */
+    compile_table_layout(ctx);
+
+    return NO_ERROR;
+}
+
+static int clone_direct_objects(psabpf_table_entry_ctx_t *dst, psabpf_table_entry_ctx_t *src)
+{
+    if (src->n_direct_counters > 0) {
+        dst->direct_counters_ctx = calloc(src->n_direct_counters, sizeof(psabpf_direct_counter_context_t));
+        if (dst->direct_counters_ctx == NULL)
+            return ENOMEM;
+        dst->n_direct_counters = src->n_direct_counters;
+        for (size_t i = 0; i < src->n_direct_counters; i++) {
+            dst->direct_counters_ctx[i] = src->direct_counters_ctx[i];
+            dst->direct_counters_ctx[i].mem_can_be_freed = true;
+            dst->direct_counters_ctx[i].name = strdup(src->direct_counters_ctx[i].name);
+            if (dst->direct_counters_ctx[i].name == NULL)
+                return ENOMEM;
+        }
+    }
+
+    if (src->n_direct_meters > 0) {
+        dst->direct_meters_ctx = calloc(src->n_direct_meters, sizeof(psabpf_direct_meter_context_t));
+        if (dst->direct_meters_ctx == NULL)
+            return ENOMEM;
+        dst->n_direct_meters = src->n_direct_meters;
+        for (size_t i = 0; i < src->n_direct_meters; i++) {
+            dst->direct_meters_ctx[i] = src->direct_meters_ctx[i];
+            dst->direct_meters_ctx[i].mem_can_be_freed = true;
+            dst->direct_meters_ctx[i].name = strdup(src->direct_meters_ctx[i].name);
+            if (dst->direct_meters_ctx[i].name == NULL)
+                return ENOMEM;
+        }
+    }
+
+    int ret = copy_struct_field_descriptor_set(&dst->table_implementations, &src->table_implementations);
+    if (ret == NO_ERROR)
+        ret = copy_struct_field_descriptor_set(&dst->table_implementation_group_marks,
+                                               &src->table_implementation_group_marks);
+    return ret;
+}
+
+int psabpf_table_entry_ctx_clone(psabpf_table_entry_ctx_t *dst, psabpf_table_entry_ctx_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src)
+        return EINVAL;
+    if (src->table.fd < 0 && !src->is_ternary)
+        return EBADF;
+
+    int ret = borrow_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR)
+        ret = clone_table_shadow(dst, src);
+    if (ret != NO_ERROR)
+        return ret;
+
+    dst->is_indirect = src->is_indirect;
+    dst->is_ternary = src->is_ternary;
+    dst->defer_cache_invalidation = src->defer_cache_invalidation;
+    dst->batch_iter.batch_size = src->batch_iter.batch_size;
+
+    /* FD of the ternary table tuple is owned by the tuple cache, which is built again for the clone */
+    ret = clone_map_descriptor(&dst->table, &src->table);
+    if (ret == NO_ERROR && dst->is_ternary)
+        close_object_fd(&dst->table.fd);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->default_entry, &src->default_entry);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->prefixes, &src->prefixes);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->tuple_map, &src->tuple_map);
+    if (ret == NO_ERROR)
+        ret = clone_map_descriptor(&dst->cache, &src->cache);
+    if (ret == NO_ERROR)
+        ret = clone_direct_objects(dst, src);
+    if (ret != NO_ERROR)
         return ret;
+
+    if (src->layout != NULL) {
+        __atomic_fetch_add(&src->layout->refcount, 1, __ATOMIC_RELAXED);
+        dst->layout = src->layout;
     }
 
     return NO_ERROR;
 }
 
+void psabpf_table_entry_ctx_set_batch_size(psabpf_table_entry_ctx_t *ctx, uint32_t batch_size)
+{
+    if (ctx == NULL)
+        return;
+
+    /* Buffers will be reallocated with the new size on next iteration */
+    free_batch_iterator(&ctx->batch_iter);
+    ctx->batch_iter.batch_size = batch_size;
+}
+
 void psabpf_table_entry_ctx_mark_indirect(psabpf_table_entry_ctx_t *ctx)
 {
     if (ctx == NULL)
@@ -434,6 +570,13 @@ void psabpf_table_entry_init(psabpf_table_entry_t *entry)
     psabpf_direct_meter_ctx_init(&entry->current_direct_meter_ctx);
 }
 
+void psabpf_table_entry_init_arena(psabpf_table_entry_t *entry, psabpf_arena_t *arena)
+{
+    psabpf_table_entry_init(entry);
+    if (entry != NULL)
+        entry->arena = arena;
+}
+
 void psabpf_table_entry_free(psabpf_table_entry_t *entry)
 {
     if (entry == NULL)
@@ -442,16 +585,16 @@ void psabpf_table_entry_free(psabpf_table_entry_t *entry)
     /* free match keys */
     for (size_t i = 0; i < entry->n_keys; i++) {
         psabpf_matchkey_free(entry->match_keys[i]);
+        arena_or_heap_free(entry->arena, entry->match_keys[i]);
     }
-    if (entry->match_keys)
-        free(entry->match_keys);
+    arena_or_heap_free(entry->arena, entry->match_keys);
     entry->match_keys = NULL;
     entry->n_keys = 0;
 
     /* free action data */
     if (entry->action != NULL) {
         psabpf_action_free(entry->action);
-        free(entry->action);
+        arena_or_heap_free(entry->arena, entry->action);
         entry->action = NULL;
     }
 
@@ -459,7 +602,7 @@ void psabpf_table_entry_free(psabpf_table_entry_t *entry)
     if (entry->direct_counters != NULL) {
         for (unsigned i = 0; i < entry->n_direct_counters; i++)
             psabpf_counter_entry_free(&entry->direct_counters[i].counter);
-        free(entry->direct_counters);
+        arena_or_heap_free(entry->arena, entry->direct_counters);
     }
     entry->direct_counters = NULL;
     entry->n_direct_counters = 0;
@@ -468,7 +611,7 @@ void psabpf_table_entry_free(psabpf_table_entry_t *entry)
     if (entry->direct_meters != NULL) {
         for (unsigned i = 0; i < entry->n_direct_meters; i++)
             psabpf_meter_entry_free(&entry->direct_meters[i].meter);
-        free(entry->direct_meters);
+        arena_or_heap_free(entry->arena, entry->direct_meters);
     }
     entry->direct_meters = NULL;
     entry->n_direct_meters = 0;
@@ -480,6 +623,16 @@ void psabpf_table_entry_free(psabpf_table_entry_t *entry)
     psabpf_direct_meter_ctx_free(&entry->current_direct_meter_ctx);
 }
 
+void psabpf_table_entry_reset(psabpf_table_entry_t *entry)
+{
+    if (entry == NULL)
+        return;
+
+    psabpf_arena_t *arena = entry->arena;
+    psabpf_table_entry_free(entry);
+    psabpf_table_entry_init_arena(entry, arena);
+}
+
 /* can be invoked multiple times */
 int psabpf_table_entry_matchkey(psabpf_table_entry_t *entry, psabpf_match_key_t *mk)
 {
@@ -491,29 +644,21 @@ int psabpf_table_entry_matchkey(psabpf_table_entry_t *entry, psabpf_match_key_t
     if (mk->type == PSABPF_LPM) {
         for (size_t i = 0; i < entry->n_keys; ++i) {
             if (entry->match_keys[i]->type == PSABPF_LPM) {
-                fprintf(stderr, "only one LPM key is allowed\n");
+                pr_err("only one LPM key is allowed\n");
                 return EPERM;
             }
         }
     }
 
-    size_t new_size = (entry->n_keys + 1) * sizeof(psabpf_match_key_t *);
-    psabpf_match_key_t ** tmp = malloc(new_size);
-    psabpf_match_key_t * new_mk = malloc(sizeof(psabpf_match_key_t));
-
-    if (tmp == NULL || new_mk == NULL) {
-        if (tmp != NULL)
-            free(tmp);
-        if (new_mk != NULL)
-            free(new_mk);
+    psabpf_match_key_t * new_mk = arena_or_heap_alloc(entry->arena, sizeof(psabpf_match_key_t));
+    if (new_mk == NULL)
+        return ENOMEM;
+    psabpf_match_key_t ** tmp = arena_or_heap_grow_array(entry->arena, entry->match_keys,
+                                                         entry->n_keys, sizeof(psabpf_match_key_t *));
+    if (tmp == NULL) {
+        arena_or_heap_free(entry->arena, new_mk);
         return ENOMEM;
     }
-
-    if (entry->n_keys != 0) {
-        memcpy(tmp, entry->match_keys, (entry->n_keys) * sizeof(psabpf_match_key_t *));
-    }
-    if (entry->match_keys != NULL)
-        free(entry->match_keys);
     entry->match_keys = tmp;
 
     memcpy(new_mk, mk, sizeof(psabpf_match_key_t));
@@ -564,7 +709,7 @@ void psabpf_table_entry_action(psabpf_table_entry_t *entry, psabpf_action_t *act
     if (entry->action != NULL)
         return;
 
-    entry->action = malloc(sizeof(psabpf_action_t));
+    entry->action = arena_or_heap_alloc(entry->arena, sizeof(psabpf_action_t));
     if (entry->action == NULL)
         return;
     move_action(entry->action, act);
@@ -593,6 +738,16 @@ void psabpf_matchkey_init(psabpf_match_key_t *mk)
     mk->mem_can_be_freed = true;
 }
 
+void psabpf_matchkey_init_arena(psabpf_match_key_t *mk, psabpf_arena_t *arena)
+{
+    if (mk == NULL)
+        return;
+    psabpf_matchkey_init(mk);
+    /* memory is owned by arena */
+    mk->arena = arena;
+    mk->mem_can_be_freed = arena == NULL;
+}
+
 void psabpf_matchkey_free(psabpf_match_key_t *mk)
 {
     if (mk == NULL)
@@ -623,7 +778,7 @@ int psabpf_matchkey_data(psabpf_match_key_t *mk, const char *data, size_t size)
     if (mk->data != NULL)
         return EEXIST;
 
-    mk->data = malloc(size);
+    mk->data = arena_or_heap_alloc(mk->arena, size);
     if (mk->data == NULL)
         return ENOMEM;
     memcpy(mk->data, data, size);
@@ -687,7 +842,7 @@ int psabpf_matchkey_mask(psabpf_match_key_t *mk, const char *mask, size_t size)
         return EEXIST;
 
     mk->u.ternary.mask_size = size;
-    mk->u.ternary.mask = malloc(size);
+    mk->u.ternary.mask = arena_or_heap_alloc(mk->arena, size);
     if (mk->u.ternary.mask == NULL)
         return ENOMEM;
     memcpy(mk->u.ternary.mask, mask, size);
@@ -730,19 +885,25 @@ int psabpf_matchkey_end(psabpf_match_key_t *mk, uint64_t end)
 }
 
 int psabpf_action_param_create(psabpf_action_param_t *param, const char *data, size_t size)
+{
+    return psabpf_action_param_create_arena(param, NULL, data, size);
+}
+
+int psabpf_action_param_create_arena(psabpf_action_param_t *param, psabpf_arena_t *arena,
+                                     const char *data, size_t size)
 {
     if (param == NULL || data == NULL)
         return EINVAL;
 
     param->is_group_reference = false;
-    param->mem_can_be_freed = true;
+    param->mem_can_be_freed = arena == NULL;
 
     param->len = size;
     if (size == 0) {
         param->data = NULL;
         return NO_ERROR;
     }
-    param->data = malloc(size);
+    param->data = arena_or_heap_alloc(arena, size);
     if (param->data == NULL)
         return ENOMEM;
     memcpy(param->data, data, size);
@@ -862,6 +1023,13 @@ void psabpf_action_init(psabpf_action_t *action)
     memset(action, 0, sizeof(psabpf_action_t));
 }
 
+void psabpf_action_init_arena(psabpf_action_t *action, psabpf_arena_t *arena)
+{
+    psabpf_action_init(action);
+    if (action != NULL)
+        action->arena = arena;
+}
+
 void psabpf_action_free(psabpf_action_t *action)
 {
     if (action == NULL)
@@ -870,8 +1038,7 @@ void psabpf_action_free(psabpf_action_t *action)
     for (size_t i = 0; i < action->n_params; i++) {
         psabpf_action_param_free(&(action->params[i]));
     }
-    if (action->params != NULL)
-        free(action->params);
+    arena_or_heap_free(action->arena, action->params);
     action->params = NULL;
     action->n_params = 0;
 }
@@ -912,21 +1079,13 @@ int psabpf_action_param(psabpf_action_t *action, psabpf_action_param_t *param)
     if (param->len == 0)
         return NO_ERROR;
 
-    size_t new_size = (action->n_params + 1) * sizeof(psabpf_action_param_t);
-    psabpf_action_param_t * tmp = malloc(new_size);
+    psabpf_action_param_t * tmp = arena_or_heap_grow_array(action->arena, action->params,
+                                                           action->n_params, sizeof(psabpf_action_param_t));
 
     if (tmp == NULL) {
-        if (param->data != NULL)
-            free(param->data);
-        param->data = NULL;
+        psabpf_action_param_free(param);
         return ENOMEM;
     }
-
-    if (action->n_params != 0) {
-        memcpy(tmp, action->params, (action->n_params) * sizeof(psabpf_action_param_t));
-    }
-    if (action->params != NULL)
-        free(action->params);
     action->params = tmp;
 
     memcpy(&(action->params[action->n_params]), param, sizeof(psabpf_action_param_t));
@@ -985,7 +1144,7 @@ static int write_buffer_btf(char * buffer, size_t buffer_len, size_t offset,
     size_t data_type_len = psabtf_get_type_size_by_id(ctx->btf_metadata.btf, dst_type_id);
 
     if (offset + data_len > buffer_len || data_len > data_type_len) {
-        fprintf(stderr, "too much data in %s "
+        pr_err("too much data in %s "
                         "(buffer len: %zu; offset: %zu; data size: %zu; type size: %zu)\n",
                 dst_type, buffer_len, offset, data_len, data_type_len);
         return EAGAIN;
@@ -1001,6 +1160,151 @@ static int write_buffer_btf(char * buffer, size_t buffer_len, size_t offset,
     return NO_ERROR;
 }
 
+static int write_buffer_layout(char * buffer, size_t buffer_len, const psabpf_table_field_layout_t *field,
+                               const void * data, size_t data_len, const char *dst_type, enum write_flags flags)
+{
+    if (field->offset + data_len > buffer_len || data_len > field->size) {
+        pr_err("too much data in %s "
+                        "(buffer len: %zu; offset: %zu; data size: %zu; type size: %zu)\n",
+                dst_type, buffer_len, field->offset, data_len, field->size);
+        return EAGAIN;
+    }
+    if (flags == WRITE_HOST_ORDER)
+        memcpy(buffer + field->offset, data, data_len);
+    else if (flags == WRITE_NETWORK_ORDER) {
+        for (size_t i = 0; i < data_len; i++) {
+            buffer[field->offset + field->size - 1 - i] = ((const char *) data)[i];
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int fill_key_layout(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
+{
+    const struct psabpf_table_layout *layout = ctx->layout;
+
+    if (layout->key_is_scalar) {
+        if (entry->n_keys != 1) {
+            pr_err("expected 1 key\n");
+            return EAGAIN;
+        }
+        if (entry->match_keys[0]->key_size > ctx->table.key_size) {
+            pr_err("too much data in key\n");
+            return EPERM;  /* byte by byte mode will not fix this */
+        }
+        memcpy(buffer, entry->match_keys[0]->data, entry->match_keys[0]->key_size);
+        return NO_ERROR;
+    }
+
+    if (entry->n_keys != layout->n_key_fields) {
+        pr_err("expected %zu keys, got %zu\n", layout->n_key_fields, entry->n_keys);
+        return EAGAIN;
+    }
+
+    for (size_t i = 0; i < layout->n_key_fields; i++) {
+        const psabpf_table_field_layout_t *field = &layout->key_fields[i];
+        psabpf_match_key_t *mk = entry->match_keys[i];
+        bool is_lpm = layout->has_lpm_prefix && mk->type == PSABPF_LPM;
+
+        int ret = write_buffer_layout(buffer, ctx->table.key_size, field, mk->data, mk->key_size,
+                                      "key", is_lpm ? WRITE_NETWORK_ORDER : WRITE_HOST_ORDER);
+        if (ret != NO_ERROR)
+            return ret;
+
+        /* write prefix value for LPM field */
+        if (is_lpm) {
+            uint32_t prefix_value = field->offset * 8 + mk->u.lpm.prefix_len - 32;
+            ret = write_buffer_layout(buffer, ctx->table.key_size, &layout->lpm_prefix,
+                                      &prefix_value, sizeof(prefix_value), "prefix", WRITE_HOST_ORDER);
+            if (ret != NO_ERROR)
+                return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int fill_value_layout(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
+{
+    const struct psabpf_table_layout *layout = ctx->layout;
+    int ret;
+
+    if (ctx->is_indirect == false) {
+        if (!layout->has_action_id) {
+            pr_err("action id entry not found\n");
+            return EAGAIN;  /* Allow fallback to byte by byte mode */
+        }
+        ret = write_buffer_layout(buffer, ctx->table.value_size, &layout->action_id,
+                                  &(entry->action->action_id), sizeof(entry->action->action_id),
+                                  "action id", WRITE_HOST_ORDER);
+        if (ret != NO_ERROR)
+            return ret;
+
+        if (!layout->has_actions) {
+            pr_err("actions data structure not found\n");
+            return ENOENT;
+        }
+        if (entry->action->action_id >= layout->n_actions) {
+            pr_err("action with id %u does not exist\n", entry->action->action_id);
+            return EPERM;  /* not fixable, invalid action ID */
+        }
+        const psabpf_table_action_layout_t *action = &layout->actions[entry->action->action_id];
+        if (entry->action->n_params != action->n_params) {
+            pr_err("expected %zu action parameters, got %zu\n",
+                    action->n_params, entry->action->n_params);
+            return EAGAIN;
+        }
+        for (size_t i = 0; i < action->n_params; i++) {
+            ret = write_buffer_layout(buffer, ctx->table.value_size, &action->params[i],
+                                      entry->action->params[i].data, entry->action->params[i].len,
+                                      "value", WRITE_HOST_ORDER);
+            if (ret != NO_ERROR)
+                return ret;
+        }
+    } else {
+        /* References are described by the table implementations, they are in the same order as in value */
+        const psabpf_struct_field_descriptor_set_t *impls = &ctx->table_implementations;
+        if (entry->action->n_params != impls->n_fields) {
+            pr_err("expected %zu member/group references, got %zu\n",
+                    impls->n_fields, entry->action->n_params);
+            return EAGAIN;
+        }
+        for (size_t i = 0; i < impls->n_fields; i++) {
+            psabpf_action_param_t *param = &entry->action->params[i];
+            psabpf_table_field_layout_t field = {
+                    .offset = impls->fields[i].data_offset,
+                    .size = impls->fields[i].data_len,
+            };
+            ret = write_buffer_layout(buffer, ctx->table.value_size, &field, param->data, param->len,
+                                      "reference", WRITE_HOST_ORDER);
+            if (ret != NO_ERROR)
+                return ret;
+
+            const psabpf_struct_field_descriptor_t *mark = &ctx->table_implementation_group_marks.fields[i];
+            if (mark->type != PSABPF_STRUCT_FIELD_TYPE_DATA)
+                continue;
+            field.offset = mark->data_offset;
+            field.size = mark->data_len;
+            ret = write_buffer_layout(buffer, ctx->table.value_size, &field, &(param->is_group_reference),
+                                      sizeof(param->is_group_reference), "reference type", WRITE_HOST_ORDER);
+            if (ret != NO_ERROR)
+                return ret;
+        }
+    }
+
+    if (ctx->is_ternary) {
+        if (!layout->has_priority) {
+            pr_err("priority entry not found\n");
+            return ENOENT;
+        }
+        return write_buffer_layout(buffer, ctx->table.value_size, &layout->priority,
+                                   &(entry->priority), sizeof(entry->priority), "priority", WRITE_HOST_ORDER);
+    }
+
+    return NO_ERROR;
+}
+
 int fill_key_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
     size_t bytes_to_write = ctx->table.key_size;
@@ -1010,7 +1314,7 @@ int fill_key_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_t
         const size_t prefix_size = 4;
         lpm_prefix = (uint32_t *) buffer;
         if (ctx->table.key_size < prefix_size) {
-            fprintf(stderr, "key size for LPM key is lower than prefix size (4B). BUG???\n");
+            pr_err("key size for LPM key is lower than prefix size (4B). BUG???\n");
             return EPERM;
         }
         buffer += prefix_size;
@@ -1020,7 +1324,7 @@ int fill_key_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_t
     for (size_t i = 0; i < entry->n_keys; i++) {
         psabpf_match_key_t *mk = entry->match_keys[i];
         if (mk->key_size > bytes_to_write) {
-            fprintf(stderr, "provided keys are too long\n");
+            pr_err("provided keys are too long\n");
             return EPERM;
         }
 
@@ -1043,7 +1347,7 @@ int fill_key_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_t
 
     /* TODO: maybe we should ignore this case */
     if (bytes_to_write > 0) {
-        fprintf(stderr, "provided keys are too short\n");
+        pr_err("provided keys are too short\n");
         return EPERM;
     }
     return NO_ERROR;
@@ -1066,6 +1370,9 @@ static bool is_table_dummy_key(psabpf_table_entry_ctx_t *ctx, const struct btf_t
 
 int fill_key_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    if (ctx->layout != NULL)
+        return fill_key_layout(buffer, ctx, entry);
+
     uint32_t key_type_id = psabtf_get_member_type_id_by_name(ctx->btf_metadata.btf, ctx->table.btf_type_id, "key");
     if (key_type_id == 0)
         return EAGAIN;
@@ -1075,11 +1382,11 @@ int fill_key_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table
 
     if (btf_kind(key_type) == BTF_KIND_INT) {
         if (entry->n_keys != 1) {
-            fprintf(stderr, "expected 1 key\n");
+            pr_err("expected 1 key\n");
             return EAGAIN;
         }
         if (entry->match_keys[0]->key_size > ctx->table.key_size) {
-            fprintf(stderr, "too much data in key\n");
+            pr_err("too much data in key\n");
             return EPERM;  /* byte by byte mode will not fix this */
         }
         memcpy(buffer, entry->match_keys[0]->data, entry->match_keys[0]->key_size);
@@ -1096,7 +1403,7 @@ int fill_key_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table
             entries = 0;
         }
         if (entry->n_keys != expected_entries) {
-            fprintf(stderr, "expected %u keys, got %zu\n", expected_entries, entry->n_keys);
+            pr_err("expected %u keys, got %zu\n", expected_entries, entry->n_keys);
             return EAGAIN;
         }
 
@@ -1132,7 +1439,7 @@ int fill_key_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table
             ++key_idx;
         }
     } else {
-        fprintf(stderr, "unexpected BTF type for key\n");
+        pr_err("unexpected BTF type for key\n");
         return EAGAIN;
     }
 
@@ -1151,7 +1458,7 @@ static int fill_value_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx,
             buffer += action_id_len;
             bytes_to_write -= action_id_len;
         } else {
-            fprintf(stderr, "action id do not fits into value\n");
+            pr_err("action id do not fits into value\n");
             return EPERM;
         }
     }
@@ -1164,7 +1471,7 @@ static int fill_value_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx,
             buffer += priority_len;
             bytes_to_write -= priority_len;
         } else {
-            fprintf(stderr, "priority do not fits into value\n");
+            pr_err("priority do not fits into value\n");
             return EPERM;
         }
     }
@@ -1172,7 +1479,7 @@ static int fill_value_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx,
     for (size_t i = 0; i < entry->action->n_params; i++) {
         psabpf_action_param_t *param = &(entry->action->params[i]);
         if (param->len > bytes_to_write) {
-            fprintf(stderr, "provided values are too long\n");
+            pr_err("provided values are too long\n");
             return EPERM;
         }
         memcpy(buffer, param->data, param->len);
@@ -1182,7 +1489,7 @@ static int fill_value_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *ctx,
 
     /* TODO: maybe we should ignore this case */
     if (bytes_to_write > 0) {
-        fprintf(stderr, "provided values are too short\n");
+        pr_err("provided values are too short\n");
         return EPERM;
     }
     return NO_ERROR;
@@ -1193,7 +1500,7 @@ static int fill_action_id(char * buffer, psabpf_table_entry_ctx_t *ctx,
 {
     psabtf_struct_member_md_t action_md = {};
     if (psabtf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "action", &action_md) != NO_ERROR) {
-        fprintf(stderr, "action id entry not found\n");
+        pr_err("action id entry not found\n");
         return EAGAIN;  /* Allow fallback to byte by byte mode */
     }
     return write_buffer_btf(buffer, ctx->table.value_size, action_md.bit_offset / 8,
@@ -1209,7 +1516,7 @@ static int fill_priority(char * buffer, psabpf_table_entry_ctx_t *ctx,
 
     psabtf_struct_member_md_t priority_md = {};
     if (psabtf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "priority", &priority_md) != NO_ERROR) {
-        fprintf(stderr, "priority entry not found\n");
+        pr_err("priority entry not found\n");
         return ENOENT;
     }
     return write_buffer_btf(buffer, ctx->table.value_size, priority_md.bit_offset / 8,
@@ -1226,7 +1533,7 @@ static int fill_action_data(char * buffer, psabpf_table_entry_ctx_t *ctx,
     /* find union with action data */
     psabtf_struct_member_md_t action_union_md = {};
     if (psabtf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "u", &action_union_md) != NO_ERROR) {
-        fprintf(stderr, "actions data structure not found\n");
+        pr_err("actions data structure not found\n");
         return ENOENT;
     }
     base_offset = action_union_md.bit_offset / 8;
@@ -1235,7 +1542,7 @@ static int fill_action_data(char * buffer, psabpf_table_entry_ctx_t *ctx,
     psabtf_struct_member_md_t action_data_md = {};
     if (psabtf_get_member_md_by_index(ctx->btf_metadata.btf, action_union_md.effective_type_id,
                                       entry->action->action_id, &action_data_md) != NO_ERROR) {
-        fprintf(stderr, "action with id %u does not exist\n", entry->action->action_id);
+        pr_err("action with id %u does not exist\n", entry->action->action_id);
         return EPERM;  /* not fixable, invalid action ID */
     }
     /* to be sure of offset, take into account offset of action data structure in the union */
@@ -1245,7 +1552,7 @@ static int fill_action_data(char * buffer, psabpf_table_entry_ctx_t *ctx,
     /* fill action data */
     unsigned entries = btf_vlen(data_type);
     if (entry->action->n_params != entries) {
-        fprintf(stderr, "expected %d action parameters, got %zu\n",
+        pr_err("expected %d action parameters, got %zu\n",
                 entries, entry->action->n_params);
         return EAGAIN;
     }
@@ -1273,7 +1580,7 @@ static int fill_action_references(char * buffer, psabpf_table_entry_ctx_t *ctx,
 
     for (int i = 0; i < entries; i++, member++) {
         if (used_params >= entry->action->n_params) {
-            fprintf(stderr, "not enough member/group references\n");
+            pr_err("not enough member/group references\n");
             return EAGAIN;
         }
         const struct btf_type * member_type = psabtf_get_type_by_id(ctx->btf_metadata.btf, member->type);
@@ -1299,7 +1606,7 @@ static int fill_action_references(char * buffer, psabpf_table_entry_ctx_t *ctx,
             entry_ref_used = false;
             current_data++; used_params++;
             if (used_params >= entry->action->n_params) {
-                fprintf(stderr, "not enough member/group references\n");
+                pr_err("not enough member/group references\n");
                 return EAGAIN;
             }
         }
@@ -1314,7 +1621,7 @@ static int fill_action_references(char * buffer, psabpf_table_entry_ctx_t *ctx,
     if (entry_ref_used)
         used_params++;
     if (used_params != entry->action->n_params) {
-        fprintf(stderr, "too many member/group references\n");
+        pr_err("too many member/group references\n");
         return EAGAIN;
     }
 
@@ -1325,6 +1632,9 @@ static int fill_value_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psa
 {
     int ret;
 
+    if (ctx->layout != NULL)
+        return fill_value_layout(buffer, ctx, entry);
+
     uint32_t value_type_id = get_table_value_type_id(ctx);
     if (value_type_id == 0)
         return EAGAIN;
@@ -1333,7 +1643,7 @@ static int fill_value_btf_info(char * buffer, psabpf_table_entry_ctx_t *ctx, psa
         return EAGAIN;
 
     if (btf_kind(value_type) != BTF_KIND_STRUCT) {
-        fprintf(stderr, "expected struct as a map value\n");
+        pr_err("expected struct as a map value\n");
         return EAGAIN;
     }
 
@@ -1366,7 +1676,7 @@ static int lpm_prefix_to_mask(char * buffer, size_t buffer_len, uint32_t prefix,
         ++bytes_to_write;
 
     if (bytes_to_write > data_len || bytes_to_write > buffer_len) {
-        fprintf(stderr, "LPM prefix too long\n");
+        pr_err("LPM prefix too long\n");
         return EINVAL;
     }
 
@@ -1387,7 +1697,7 @@ static int fill_key_mask_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *c
         size_t data_len = 0;
         if (mk->type == PSABPF_EXACT) {
             if (mk->key_size > bytes_to_write) {
-                fprintf(stderr, "provided exact keys mask are too long\n");
+                pr_err("provided exact keys mask are too long\n");
                 return EPERM;
             }
             data_len = mk->key_size;
@@ -1399,15 +1709,15 @@ static int fill_key_mask_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *c
                 return ret;
         } else if (mk->type == PSABPF_TERNARY) {
             if (mk->u.ternary.mask_size > bytes_to_write) {
-                fprintf(stderr, "provided ternary key mask is too long\n");
+                pr_err("provided ternary key mask is too long\n");
                 return EPERM;
             }
             if (mk->u.ternary.mask_size != mk->key_size)
-                fprintf(stderr, "warning: key and its mask have different length\n");
+                pr_warn("warning: key and its mask have different length\n");
             data_len = mk->u.ternary.mask_size;
             memcpy(buffer, mk->u.ternary.mask, data_len);
         } else {
-            fprintf(stderr, "unsupported key mask type\n");
+            pr_err("unsupported key mask type\n");
             return EAGAIN;
         }
 
@@ -1417,14 +1727,57 @@ static int fill_key_mask_byte_by_byte(char * buffer, psabpf_table_entry_ctx_t *c
 
     /* TODO: maybe we should ignore this case */
     if (bytes_to_write > 0) {
-        fprintf(stderr, "provided key masks are too short\n");
+        pr_err("provided key masks are too short\n");
         return EPERM;
     }
     return NO_ERROR;
 }
 
+static int fill_key_mask_layout(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
+{
+    const struct psabpf_table_layout *layout = ctx->layout;
+
+    if (layout->key_is_scalar || layout->has_lpm_prefix)
+        return EAGAIN;
+    if (entry->n_keys != layout->n_key_fields) {
+        pr_err("expected %zu keys, got %zu\n", layout->n_key_fields, entry->n_keys);
+        return EAGAIN;
+    }
+
+    for (size_t i = 0; i < layout->n_key_fields; i++) {
+        const psabpf_table_field_layout_t *field = &layout->key_fields[i];
+        psabpf_match_key_t *mk = entry->match_keys[i];
+        int ret = EAGAIN;
+
+        if (field->offset + field->size > ctx->prefixes.key_size)
+            return EAGAIN;
+
+        if (mk->type == PSABPF_EXACT) {
+            memset(buffer + field->offset, 0xFF, field->size);
+            ret = NO_ERROR;
+        } else if (mk->type == PSABPF_LPM) {
+            if (lpm_prefix_to_mask(buffer + field->offset, field->size, mk->u.lpm.prefix_len, field->size) != NO_ERROR)
+                return EAGAIN;
+            ret = NO_ERROR;
+        } else if (mk->type == PSABPF_TERNARY) {
+            ret = write_buffer_layout(buffer, ctx->prefixes.key_size, field, mk->u.ternary.mask,
+                                      mk->u.ternary.mask_size, "ternary mask key", WRITE_HOST_ORDER);
+        } else {
+            pr_err("unsupported key mask type\n");
+        }
+
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    return NO_ERROR;
+}
+
 static int fill_key_mask_btf(char * buffer, psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    if (ctx->layout != NULL)
+        return fill_key_mask_layout(buffer, ctx, entry);
+
     /* Use key type to generate mask */
     uint32_t key_type_id = psabtf_get_member_type_id_by_name(ctx->btf_metadata.btf, ctx->table.btf_type_id, "key");
     if (key_type_id == 0)
@@ -1439,7 +1792,7 @@ static int fill_key_mask_btf(char * buffer, psabpf_table_entry_ctx_t *ctx, psabp
     const struct btf_member *member = btf_members(key_type);
     unsigned entries = btf_vlen(key_type);
     if (entry->n_keys != entries) {
-        fprintf(stderr, "expected %d keys, got %zu\n", entries, entry->n_keys);
+        pr_err("expected %d keys, got %zu\n", entries, entry->n_keys);
         return EAGAIN;
     }
 
@@ -1474,7 +1827,7 @@ static int fill_key_mask_btf(char * buffer, psabpf_table_entry_ctx_t *ctx, psabp
             ret = write_buffer_btf(buffer, ctx->prefixes.key_size, offset, mk->u.ternary.mask,
                                    mk->u.ternary.mask_size, ctx, member->type, "ternary mask key", WRITE_HOST_ORDER);
         } else {
-            fprintf(stderr, "unsupported key mask type\n");
+            pr_err("unsupported key mask type\n");
         }
 
         if (ret != NO_ERROR)
@@ -1491,13 +1844,15 @@ int construct_buffer(char * buffer, size_t buffer_len,
                      int (*btf_info_func)(char *, psabpf_table_entry_ctx_t *, psabpf_table_entry_t *),
                      int (*byte_by_byte_func)(char *, psabpf_table_entry_ctx_t *, psabpf_table_entry_t *))
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_BUFFER_BUILD);
+
     /* When BTF info mode fails we can fallback to byte by byte mode */
     int return_code = EAGAIN;
     if (ctx->btf_metadata.btf != NULL && ctx->table.btf_type_id != 0) {
         memset(buffer, 0, buffer_len);
         return_code = btf_info_func(buffer, ctx, entry);
         if (return_code == EAGAIN)
-            fprintf(stderr, "falling back to byte by byte mode\n");
+            pr_debug("falling back to byte by byte mode\n");
     }
     if (return_code == EAGAIN) {
         memset(buffer, 0, buffer_len);
@@ -1522,7 +1877,7 @@ static int handle_direct_counter_write(const char *key, char *value, psabpf_bpf_
             return ENOMEM;
         memset(old_value_buffer, 0, map->value_size);
 
-        int err = bpf_map_lookup_elem(map->fd, key, old_value_buffer);
+        int err = map_ops->lookup_elem(map->fd, key, old_value_buffer);
         if (err != 0) {
             free(old_value_buffer);
             return ENOENT;
@@ -1589,16 +1944,7 @@ static int handle_direct_objects_write(const char *key, char *value, psabpf_bpf_
     return handle_direct_counter_write(key, value, map, ctx, entry, bpf_flags);
 }
 
-struct ternary_table_prefix_metadata {
-    size_t tuple_id_offset;
-    size_t tuple_id_size;
-    size_t next_mask_offset;
-    size_t next_mask_size;
-    size_t has_next_offset;
-    size_t has_next_size;
-};
-
-static int get_ternary_table_prefix_md(psabpf_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md)
+int get_ternary_table_prefix_md(psabpf_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md)
 {
     psabtf_struct_member_md_t member;
 
@@ -1640,86 +1986,37 @@ static int get_ternary_table_prefix_md(psabpf_table_entry_ctx_t *ctx, struct ter
         md->next_mask_offset + md->next_mask_size > ctx->prefixes.value_size ||
         md->has_next_offset + md->has_next_size > ctx->prefixes.value_size ||
         md->next_mask_size != ctx->table.key_size) {
-        fprintf(stderr, "BUG: invalid size or offset in the mask\n");
+        pr_err("BUG: invalid size or offset in the mask\n");
         return EPERM;
     }
 
     return NO_ERROR;
 }
 
-static int add_ternary_table_prefix(char *new_prefix, char *prefix_value,
-                                    psabpf_table_entry_ctx_t *ctx)
+int get_ternary_table_priority_md(psabpf_table_entry_ctx_t *ctx, size_t *offset, size_t *size)
 {
-    int err = NO_ERROR;
-    uint32_t tuple_id = 0;
-    struct ternary_table_prefix_metadata prefix_md;
-
-    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
-        return EPERM;
-    }
-
-    char *key = malloc(ctx->prefixes.key_size);
-    char *value = malloc(ctx->prefixes.value_size);
-    if (key == NULL || value == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        err = ENOMEM;
-        goto clean_up;
-    }
-
-    /* Process head */
-    memset(key, 0, ctx->prefixes.key_size);
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, key, value);
-    if (err != 0) {
-        /* Construct head, it will be added later */
-        memset(value, 0, ctx->prefixes.value_size);
-        *((uint32_t *) (value + prefix_md.tuple_id_offset)) = tuple_id;
-    }
-
-    /* Iterate over every prefix to the last one */
-    while (true) {
-        uint8_t has_next = *((uint8_t *) (value + prefix_md.has_next_offset));
-        if (has_next == 0)
-            break;
-
-        /* Get next prefix */
-        memcpy(key, value + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        err = bpf_map_lookup_elem(ctx->prefixes.fd, key, value);
-        if (err != 0) {
-            err = errno;
-            fprintf(stderr, "detected data inconsistency in prefixes, aborting\n");
-            goto clean_up;
-        }
-
-        /* Find highest tuple id */
-        uint32_t current_tuple_id = *((uint32_t *) (value + prefix_md.tuple_id_offset));
-        if (current_tuple_id > tuple_id)
-            tuple_id = current_tuple_id;
+    if (ctx->layout != NULL) {
+        if (!ctx->layout->has_priority)
+            return ENOENT;
+        *offset = ctx->layout->priority.offset;
+        *size = ctx->layout->priority.size;
+    } else if (ctx->btf_metadata.btf != NULL && ctx->table.btf_type_id != 0) {
+        psabtf_struct_member_md_t priority_md = {};
+        uint32_t value_type_id = get_table_value_type_id(ctx);
+        if (psabtf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "priority", &priority_md) != NO_ERROR)
+            return ENOENT;
+        *offset = priority_md.bit_offset / 8;
+        *size = psabtf_get_type_size_by_id(ctx->btf_metadata.btf, priority_md.effective_type_id);
+    } else {
+        /* Without BTF assume that priority is placed after action ID */
+        *offset = ctx->is_indirect ? 0 : sizeof(uint32_t);
+        *size = sizeof(uint32_t);
     }
 
-    /* First add new prefix to avoid data inconsistency */
-    memset(prefix_value, 0, ctx->prefixes.value_size);
-    *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset)) = ++tuple_id;
-    err = bpf_map_update_elem(ctx->prefixes.fd, new_prefix, prefix_value, BPF_NOEXIST);
-    if (err != 0)
-        goto clean_up;
-
-    /* Update previous node */
-    memcpy(value + prefix_md.next_mask_offset, new_prefix, prefix_md.next_mask_size);
-    *((uint8_t *) (value + prefix_md.has_next_offset)) = 1;
-    err = bpf_map_update_elem(ctx->prefixes.fd, key, value, BPF_ANY);
-    if (err != 0)
-        goto clean_up;
-
-    err = NO_ERROR;
-
-clean_up:
-    if (key != NULL)
-        free(key);
-    if (value != NULL)
-        free(value);
+    if (*size > sizeof(uint32_t) || *offset + *size > ctx->table.value_size)
+        return EINVAL;
 
-    return err;
+    return NO_ERROR;
 }
 
 static int ternary_table_add_tuple_and_open(psabpf_table_entry_ctx_t *ctx, const uint32_t tuple_id)
@@ -1735,21 +2032,27 @@ static int ternary_table_add_tuple_and_open(psabpf_table_entry_ctx_t *ctx, const
             .btf_key_type_id = ctx->table.key_type_id,
             .btf_value_type_id = ctx->table.value_type_id,
     };
-    ctx->table.fd = bpf_create_map_xattr(&attr);
+    ctx->table.fd = map_ops->create_map(&attr);
     if (ctx->table.fd < 0) {
         err = errno;
-        fprintf(stderr, "failed to create tuple %u: %s\n", tuple_id, strerror(err));
+        pr_err("failed to create tuple %u: %s\n", tuple_id, strerror(err));
         return err;
     }
 
     /* add tuple to tuples map */
-    err = bpf_map_update_elem(ctx->tuple_map.fd, &tuple_id, &(ctx->table.fd), 0);
+    err = txn_map_update_elem(ctx->tuple_map.fd, &tuple_id, &(ctx->table.fd), 0);
     if (err != 0) {
         err = errno;
-        fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(err));
+        pr_err("failed to add tuple %u: %s\n", tuple_id, strerror(err));
         close_object_fd(&(ctx->table.fd));
+        return err;
     }
 
+    /* from now FD is owned by the tuple cache */
+    err = ternary_prefixes_cache_tuple_fd(ctx, tuple_id, ctx->table.fd);
+    if (err != NO_ERROR)
+        ctx->table.fd = -1;
+
     return err;
 }
 
@@ -1757,29 +2060,26 @@ static int ternary_table_open_tuple(psabpf_table_entry_ctx_t *ctx, psabpf_table_
                                     char **key_mask, uint64_t bpf_flags)
 {
     if (ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0 || ctx->table.fd >= 0) {
-        fprintf(stderr, "ternary table not properly opened. BUG?\n");
+        pr_err("ternary table not properly opened. BUG?\n");
         return EINVAL;
     }
     if (ctx->table.key_size != ctx->prefixes.key_size) {
-        fprintf(stderr, "key and its mask have different length. BUG?\n");
+        pr_err("key and its mask have different length. BUG?\n");
         return EINVAL;
     }
     if (ctx->tuple_map.key_size != 4 || ctx->tuple_map.value_size != 4) {
-        fprintf(stderr, "key/value size of tuples map have to be 4B.\n");
+        pr_err("key/value size of tuples map have to be 4B.\n");
         return EINVAL;
     }
 
     int err = NO_ERROR;
-    char *value_mask = malloc(ctx->prefixes.value_size);
-    *key_mask = malloc(ctx->prefixes.key_size);
+    *key_mask = arena_or_heap_alloc(entry->arena, ctx->prefixes.key_size);
 
-    if (*key_mask == NULL || value_mask == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        err = ENOMEM;
-        goto clean_up;
+    if (*key_mask == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
     }
     memset(*key_mask, 0, ctx->prefixes.key_size);
-    memset(value_mask, 0, ctx->prefixes.value_size);
 
     err = construct_buffer(*key_mask, ctx->prefixes.key_size, ctx, entry,
                            fill_key_mask_btf, fill_key_mask_byte_by_byte);
@@ -1795,93 +2095,199 @@ static int ternary_table_open_tuple(psabpf_table_entry_ctx_t *ctx, psabpf_table_
         }
     }
     if (mask_is_valid == false) {
-        fprintf(stderr, "invalid key mask: all bytes are zeroed - use default action instead\n");
+        pr_err("invalid key mask: all bytes are zeroed - use default action instead\n");
         err = EINVAL;
         goto clean_up;
     }
 
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, *key_mask, value_mask);
+    err = ternary_prefixes_load(ctx);
+    if (err != NO_ERROR) {
+        pr_err("failed to load prefixes: %s\n", strerror(err));
+        goto clean_up;
+    }
+
+    uint32_t tuple_id;
+    err = ternary_prefixes_find(ctx, *key_mask, &tuple_id);
     /* It is not allowed to add new prefix when updating existing entry */
-    if (err != 0 && bpf_flags != BPF_EXIST) {
-        err = add_ternary_table_prefix(*key_mask, value_mask, ctx);
+    if (err != NO_ERROR && bpf_flags != BPF_EXIST) {
+        err = ternary_prefixes_add(ctx, *key_mask, entry->priority, &tuple_id);
         if (err != NO_ERROR) {
-            fprintf(stderr, "unable to add new prefix\n");
+            pr_err("unable to add new prefix\n");
             goto clean_up;
         }
-    } else if (err != 0) {
-        fprintf(stderr, "entry with prefix not found\n");
+    } else if (err != NO_ERROR) {
+        pr_err("entry with prefix not found\n");
         err = ENOENT;
         goto clean_up;
+    } else {
+        ternary_prefixes_update_priority(ctx, *key_mask, entry->priority);
     }
 
-    struct ternary_table_prefix_metadata prefix_md;
-    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
-        err = EPERM;
-        goto clean_up;
-    }
-    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
-    uint32_t inner_map_id;
-
-    err = bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id);
-    if (err == 0) {
-        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
-        err = NO_ERROR;
-    } else {
+    err = ternary_prefixes_get_tuple_fd(ctx, tuple_id, &ctx->table.fd);
+    if (err == ENOENT) {
         if (bpf_flags == BPF_EXIST) {
-            fprintf(stderr, "tuple not found\n");
-            err = ENOENT;
+            pr_err("tuple not found\n");
             goto clean_up;
         }
         err = ternary_table_add_tuple_and_open(ctx, tuple_id);
     }
 
 clean_up:
-    if (value_mask != NULL)
-        free(value_mask);
-
     return err;
 }
 
 static void ternary_table_close_tuple(psabpf_table_entry_ctx_t *ctx)
 {
-    /* Allow for reuse table context with the same table but other tuple (inner map). */
+    /* Allow for reuse table context with the same table but other tuple (inner map).
+     * FD is borrowed from the tuple cache, so it is not closed here. */
     if (ctx->is_ternary)
-        close_object_fd(&(ctx->table.fd));
+        ctx->table.fd = -1;
 }
 
-int delete_all_map_entries(psabpf_bpf_map_descriptor_t *map)
+/* Number of entries removed or reset in kernel at once */
+#define MAP_CLEAR_BATCH_SIZE 65536
+
+/* Array map entries can't be removed, so they are reset to zero value,
+ * in chunks with a single preallocated zero buffer. */
+static int zero_array_map_batch(psabpf_bpf_map_descriptor_t *map)
 {
-    fprintf(stderr, "removing all entries from table\n");
+    if (map->key_size != sizeof(uint32_t) || map->max_entries == 0)
+        return EINVAL;
 
-    char * key = malloc(map->key_size);
-    char * next_key = malloc(map->key_size);
-    char * value = calloc(1, map->value_size);
-    int error_code = NO_ERROR;
+    uint32_t chunk = map->max_entries < MAP_CLEAR_BATCH_SIZE ? map->max_entries : MAP_CLEAR_BATCH_SIZE;
+    uint32_t *keys = malloc(chunk * sizeof(uint32_t));
+    char *values = calloc(chunk, map->value_size);
+    int ret = NO_ERROR;
 
-    if (key == NULL || next_key == NULL || value == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        error_code = ENOMEM;
+    if (keys == NULL || values == NULL) {
+        ret = ENOMEM;
         goto clean_up;
     }
 
-    if (bpf_map_get_next_key(map->fd, NULL, next_key) != 0)
-        goto clean_up;  /* table empty */
-    do {
-        /* Swap buffers, so next_key will become key and next_key may be reused */
-        char * tmp_key = next_key;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+    for (uint32_t first = 0; first < map->max_entries; first += chunk) {
+        uint32_t count = map->max_entries - first;
+        if (count > chunk)
+            count = chunk;
+        for (uint32_t i = 0; i < count; i++)
+            keys[i] = first + i;
+
+        if (txn_map_update_batch(map->fd, keys, values, &count, &opts) != 0) {
+            ret = errno;
+            goto clean_up;
+        }
+    }
+
+clean_up:
+    if (keys != NULL)
+        free(keys);
+    if (values != NULL)
+        free(values);
+
+    return ret;
+}
+
+/* Removes entries from hash map in chunks, deleted values are discarded */
+static int delete_all_hash_entries_batch(psabpf_bpf_map_descriptor_t *map)
+{
+    if (map->type != BPF_MAP_TYPE_HASH && map->type != BPF_MAP_TYPE_LRU_HASH)
+        return EOPNOTSUPP;
+
+    /* Hash maps use 4B bucket index as a batch token */
+    const size_t token_size = map->key_size > sizeof(uint64_t) ? map->key_size : sizeof(uint64_t);
+    uint32_t chunk = map->max_entries > 0 && map->max_entries < MAP_CLEAR_BATCH_SIZE ?
+                     map->max_entries : MAP_CLEAR_BATCH_SIZE;
+    char *keys = NULL;
+    char *values = NULL;
+    char *in_token = calloc(1, token_size);
+    char *out_token = calloc(1, token_size);
+    bool started = false;
+    int ret = NO_ERROR;
+
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+    while (true) {
+        if (keys == NULL)
+            keys = malloc((size_t) chunk * map->key_size);
+        if (values == NULL)
+            values = malloc((size_t) chunk * map->value_size);
+        if (keys == NULL || values == NULL || in_token == NULL || out_token == NULL) {
+            ret = ENOMEM;
+            break;
+        }
+
+        uint32_t count = chunk;
+        if (txn_map_lookup_and_delete_batch(map->fd, started ? in_token : NULL, out_token,
+                                            keys, values, &count, &opts) == 0) {
+            started = true;
+            memcpy(in_token, out_token, token_size);
+            continue;
+        }
+
+        ret = errno;
+        if (ret == ENOENT) {
+            /* no more entries */
+            ret = NO_ERROR;
+            break;
+        }
+        if (ret == ENOSPC && count == 0) {
+            /* bucket does not fit into buffers */
+            chunk *= 2;
+            free(keys);
+            free(values);
+            keys = values = NULL;
+            continue;
+        }
+        break;
+    }
+
+    if (keys != NULL)
+        free(keys);
+    if (values != NULL)
+        free(values);
+    if (in_token != NULL)
+        free(in_token);
+    if (out_token != NULL)
+        free(out_token);
+
+    return ret;
+}
+
+static int delete_all_map_entries_one_by_one(psabpf_bpf_map_descriptor_t *map)
+{
+    char * key = malloc(map->key_size);
+    char * next_key = malloc(map->key_size);
+    char * value = calloc(1, map->value_size);
+    int error_code = NO_ERROR;
+
+    if (key == NULL || next_key == NULL || value == NULL) {
+        pr_err("not enough memory\n");
+        error_code = ENOMEM;
+        goto clean_up;
+    }
+
+    if (map_ops->get_next_key(map->fd, NULL, next_key) != 0)
+        goto clean_up;  /* table empty */
+    do {
+        /* Swap buffers, so next_key will become key and next_key may be reused */
+        char * tmp_key = next_key;
         next_key = key;
         key = tmp_key;
 
-        /* Ignore error(s) from bpf_map_delete_elem(). In some cases key may exist
+        /* Ignore error(s) from txn_map_delete_elem(). In some cases key may exist
          * but entry not exists (e.g. array map in map). So in any case we have to
          * iterate over all keys and try to delete it. It is not possible to remove
          * entry from array map, in such case reset entries to zero value. */
         if (map->type == BPF_MAP_TYPE_ARRAY)
-            bpf_map_update_elem(map->fd, key, value, BPF_ANY);
+            txn_map_update_elem(map->fd, key, value, BPF_ANY);
         else
-            bpf_map_delete_elem(map->fd, key);
-    } while (bpf_map_get_next_key(map->fd, key, next_key) == 0);
+            txn_map_delete_elem(map->fd, key);
+    } while (map_ops->get_next_key(map->fd, key, next_key) == 0);
 
 clean_up:
     if (key)
@@ -1893,68 +2299,590 @@ clean_up:
     return error_code;
 }
 
+int delete_all_map_entries(psabpf_bpf_map_descriptor_t *map)
+{
+    pr_debug("removing all entries from table\n");
+
+    /* Batch operations are not supported for every map type (e.g. LPM trie, map in map)
+     * and by older kernels, in such case fallback to per-key iteration. */
+    int ret = EOPNOTSUPP;
+    if (map->type == BPF_MAP_TYPE_ARRAY)
+        ret = zero_array_map_batch(map);
+    else if (map->type == BPF_MAP_TYPE_HASH || map->type == BPF_MAP_TYPE_LRU_HASH)
+        ret = delete_all_hash_entries_batch(map);
+
+    if (ret == NO_ERROR)
+        return NO_ERROR;
+
+    return delete_all_map_entries_one_by_one(map);
+}
+
 int clear_table_cache(psabpf_bpf_map_descriptor_t *map)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_CACHE_CLEAR);
+
     if (map == NULL || map->fd < 0)
         return NO_ERROR;
 
-    fprintf(stderr, "clearing table cache: ");
+    pr_debug("clearing table cache\n");
     return delete_all_map_entries(map);
 }
 
-static int psabpf_table_entry_write(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, uint64_t bpf_flags)
+/* Number of keys read from or deleted in kernel at once when cache is invalidated */
+#define CACHE_INVALIDATION_BATCH_SIZE 1024
+
+/* Reads all keys and, when values_out is not NULL, values of the map into single buffers. Batched lookup
+ * is used when supported by the kernel and map, otherwise entries are read one by one. */
+int read_all_map_entries(psabpf_bpf_map_descriptor_t *map, char **keys_out, char **values_out, size_t *n_keys_out)
 {
-    char *key_buffer = NULL;
-    char *key_mask_buffer = NULL;
-    char *value_buffer = NULL;
-    int return_code = NO_ERROR;
+    const size_t key_size = map->key_size;
+    const size_t value_size = map->value_size;
+    const size_t token_size = key_size > sizeof(uint64_t) ? key_size : sizeof(uint64_t);
+    uint32_t chunk = CACHE_INVALIDATION_BATCH_SIZE;
+    /* LPM trie does not implement batch operations */
+    bool use_batch = map->type != BPF_MAP_TYPE_LPM_TRIE;
+    bool started = false;
+    size_t capacity = 0, n_keys = 0;
+    char *keys = NULL;
+    char *values = NULL;
+    char *in_token = calloc(1, token_size);
+    char *out_token = calloc(1, token_size);
+    int ret = NO_ERROR;
+
+    if (in_token == NULL || out_token == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
 
-    if (ctx == NULL || entry == NULL)
-        return EINVAL;
+    while (use_batch) {
+        /* when values are not requested, buffer for one chunk is reused */
+        if (values == NULL && values_out == NULL)
+            values = malloc((size_t) chunk * value_size);
+        if (n_keys + chunk > capacity) {
+            char *new_keys = realloc(keys, (n_keys + chunk) * key_size);
+            if (new_keys != NULL)
+                keys = new_keys;
+            char *new_values = values;
+            if (values_out != NULL && (new_values = realloc(values, (n_keys + chunk) * value_size)) != NULL)
+                values = new_values;
+            if (new_keys != NULL && new_values != NULL)
+                capacity = n_keys + chunk;
+        }
+        if (values == NULL || n_keys + chunk > capacity) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
 
-    if (ctx->is_ternary) {
-        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, bpf_flags);
-        if (return_code != NO_ERROR)
+        uint32_t count = chunk;
+        DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+            .elem_flags = 0,
+            .flags = 0,
+        );
+        int err = NO_ERROR;
+        char *values_chunk = values_out != NULL ? values + n_keys * value_size : values;
+        if (map_ops->lookup_batch(map->fd, started ? in_token : NULL, out_token,
+                                  keys + n_keys * key_size, values_chunk, &count, &opts) != 0)
+            err = errno;
+
+        if (err != NO_ERROR && err != ENOENT) {
+            if (!started && count == 0 && batch_ops_not_supported(err)) {
+                use_batch = false;
+                break;
+            }
+            if (err == ENOSPC && count == 0) {
+                /* bucket does not fit into buffer */
+                chunk *= 2;
+                if (values_out == NULL) {
+                    free(values);
+                    values = NULL;
+                }
+                continue;
+            }
+            ret = err;
+            goto clean_up;
+        }
+
+        n_keys += count;
+        started = true;
+        memcpy(in_token, out_token, token_size);
+        if (err == ENOENT)
             goto clean_up;
     }
 
-    if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't add entry: table not opened\n");
-        return_code = EBADF;
-        goto clean_up;
+    /* fallback to the one by one iteration */
+    n_keys = 0;
+    while (true) {
+        if (n_keys + 1 > capacity) {
+            capacity = capacity > 0 ? capacity * 2 : CACHE_INVALIDATION_BATCH_SIZE;
+            char *new_keys = realloc(keys, capacity * key_size);
+            if (new_keys != NULL)
+                keys = new_keys;
+            char *new_values = values;
+            if (values_out != NULL && (new_values = realloc(values, capacity * value_size)) != NULL)
+                values = new_values;
+            if (new_keys == NULL || new_values == NULL) {
+                ret = ENOMEM;
+                goto clean_up;
+            }
+        }
+        const char *prev_key = n_keys > 0 ? keys + (n_keys - 1) * key_size : NULL;
+        if (map_ops->get_next_key(map->fd, prev_key, keys + n_keys * key_size) != 0)
+            break;
+        if (values_out != NULL &&
+            map_ops->lookup_elem(map->fd, keys + n_keys * key_size, values + n_keys * value_size) != 0) {
+            if (errno == ENOENT)
+                continue;  /* removed in the meantime */
+            ret = errno;
+            goto clean_up;
+        }
+        n_keys++;
     }
-    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
-        return_code = ENOTSUP;
-        goto clean_up;
+
+clean_up:
+    if (ret != NO_ERROR) {
+        if (keys != NULL)
+            free(keys);
+        keys = NULL;
+        n_keys = 0;
     }
-    if (entry->action == NULL) {
-        fprintf(stderr, "missing action specification\n");
-        return_code = ENODATA;
-        goto clean_up;
+    *keys_out = keys;
+    *n_keys_out = n_keys;
+
+    if (values_out != NULL && ret == NO_ERROR) {
+        *values_out = values;
+        values = NULL;
     }
+    if (values != NULL)
+        free(values);
+    if (in_token != NULL)
+        free(in_token);
+    if (out_token != NULL)
+        free(out_token);
 
-    /* prepare buffers for map key/value */
-    key_buffer = malloc(ctx->table.key_size);
-    value_buffer = malloc(ctx->table.value_size);
-    if (key_buffer == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        return_code = ENOMEM;
+    return ret;
+}
+
+static int read_all_map_keys(psabpf_bpf_map_descriptor_t *map, char **keys_out, size_t *n_keys_out)
+{
+    return read_all_map_entries(map, keys_out, NULL, n_keys_out);
+}
+
+/* Deletes given keys from the map, keys which do not exist (e.g. evicted in the meantime) are skipped */
+static int delete_map_keys(psabpf_bpf_map_descriptor_t *map, char *keys, size_t n_keys)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+    size_t offset = 0;
+    bool use_batch = true;
+
+    while (offset < n_keys) {
+        if (use_batch) {
+            uint32_t count = n_keys - offset;
+            if (count > CACHE_INVALIDATION_BATCH_SIZE)
+                count = CACHE_INVALIDATION_BATCH_SIZE;
+            if (txn_map_delete_batch(map->fd, keys + offset * map->key_size, &count, &opts) == 0) {
+                offset += count;
+                continue;
+            }
+            int err = errno;
+            if (offset == 0 && count == 0 && batch_ops_not_supported(err)) {
+                use_batch = false;
+                continue;
+            }
+            if (err != ENOENT)
+                return err;
+            /* skip not existing key */
+            offset += count + 1;
+        } else {
+            if (txn_map_delete_elem(map->fd, keys + offset * map->key_size) != 0 && errno != ENOENT)
+                return errno;
+            offset++;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* Builds mask for LPM key from its prefix length. Prefix length itself is not a part of the mask. */
+static void build_lpm_key_mask(const char *key, char *mask, size_t key_size)
+{
+    const size_t prefix_size = sizeof(uint32_t);
+    uint32_t prefix_len = *((const uint32_t *) key);
+
+    memset(mask, 0, key_size);
+    for (size_t i = prefix_size; i < key_size && prefix_len > 0; i++) {
+        unsigned bits = prefix_len >= 8 ? 8 : prefix_len;
+        mask[i] = (char) (0xFF << (8 - bits));
+        prefix_len -= bits;
+    }
+}
+
+/* Removes from cache only cached flows which may be affected by the modified entry:
+ *  - for exact match tables it is exactly the same key,
+ *  - for LPM and ternary tables flows which match the prefix/mask of the entry.
+ * When layout of the cache key is different from the table key, whole cache is cleared. */
+static int invalidate_table_cache_entry(psabpf_table_entry_ctx_t *ctx, const char *key, const char *key_mask)
+{
+    /* cache is cleared once at the end of transaction */
+    if (txn_track_table(ctx))
+        return NO_ERROR;
+
+    psabpf_bpf_map_descriptor_t *cache = &ctx->cache;
+    if (cache->fd < 0)
+        return NO_ERROR;
+
+    if (ctx->defer_cache_invalidation) {
+        ctx->cache_invalidation_pending = true;
+        return NO_ERROR;
+    }
+
+    const size_t key_size = ctx->table.key_size;
+    if (cache->key_size != key_size || key == NULL || (ctx->is_ternary && key_mask == NULL))
+        return clear_table_cache(cache);
+
+    bool is_lpm = ctx->table.type == BPF_MAP_TYPE_LPM_TRIE;
+    if (!ctx->is_ternary && !is_lpm) {
+        if (txn_map_delete_elem(cache->fd, key) != 0 && errno != ENOENT)
+            return errno;
+        return NO_ERROR;
+    }
+
+    char *lpm_mask = NULL;
+    char *keys = NULL;
+    size_t n_keys = 0;
+    int ret = NO_ERROR;
+
+    if (is_lpm) {
+        if (key_size < sizeof(uint32_t))
+            return clear_table_cache(cache);
+        lpm_mask = malloc(key_size);
+        if (lpm_mask == NULL) {
+            pr_err("not enough memory\n");
+            return ENOMEM;
+        }
+        build_lpm_key_mask(key, lpm_mask, key_size);
+        key_mask = lpm_mask;
+    }
+
+    ret = read_all_map_keys(cache, &keys, &n_keys);
+    if (ret != NO_ERROR) {
+        pr_err("failed to read cache: %s\n", strerror(ret));
         goto clean_up;
     }
 
-    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
-                                   fill_key_btf_info, fill_key_byte_by_byte);
+    /* compact matching keys at the beginning of the buffer */
+    size_t n_matched = 0;
+    for (size_t i = 0; i < n_keys; i++) {
+        char *cached_key = keys + i * key_size;
+        bool match = true;
+        for (size_t b = 0; b < key_size && match; b++)
+            match = (cached_key[b] & key_mask[b]) == (key[b] & key_mask[b]);
+        if (!match)
+            continue;
+        if (n_matched != i)
+            memcpy(keys + n_matched * key_size, cached_key, key_size);
+        n_matched++;
+    }
+
+    ret = delete_map_keys(cache, keys, n_matched);
+
+clean_up:
+    if (lpm_mask != NULL)
+        free(lpm_mask);
+    if (keys != NULL)
+        free(keys);
+
+    return ret;
+}
+
+/* Clears whole cache, e.g. after change of the default entry */
+static int invalidate_table_cache(psabpf_table_entry_ctx_t *ctx)
+{
+    if (txn_track_table(ctx))
+        return NO_ERROR;
+    if (ctx->cache.fd < 0)
+        return NO_ERROR;
+
+    if (ctx->defer_cache_invalidation) {
+        ctx->cache_invalidation_pending = true;
+        return NO_ERROR;
+    }
+
+    return clear_table_cache(&ctx->cache);
+}
+
+void psabpf_table_entry_ctx_defer_cache_invalidation(psabpf_table_entry_ctx_t *ctx, bool defer)
+{
+    if (ctx == NULL)
+        return;
+    ctx->defer_cache_invalidation = defer;
+}
+
+int psabpf_table_entry_ctx_flush_cache(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL)
+        return EINVAL;
+    if (!ctx->cache_invalidation_pending)
+        return NO_ERROR;
+
+    int ret = clear_table_cache(&ctx->cache);
+    if (ret != NO_ERROR) {
+        pr_err("failed to clear cache: %s\n", strerror(ret));
+        return ret;
+    }
+    ctx->cache_invalidation_pending = false;
+
+    return NO_ERROR;
+}
+
+static void reset_table_iteration(psabpf_table_entry_ctx_t *ctx)
+{
+    free_batch_iterator(&ctx->batch_iter);
+    if (ctx->current_raw_key != NULL)
+        free(ctx->current_raw_key);
+    ctx->current_raw_key = NULL;
+}
+
+int open_table_outer_map(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *ctx, const char *name)
+{
+    char derived_name[256];
+    psabpf_bpf_map_descriptor_t outer = {};
+
+    snprintf(derived_name, sizeof(derived_name), "%s_outer", name);
+    int ret = open_bpf_map(psabpf_ctx, derived_name, NULL, &outer);
+    if (ret == ENOENT)
+        return NO_ERROR;  /* table can't be swapped */
+    if (ret != NO_ERROR) {
+        pr_err("couldn't open map %s: %s\n", derived_name, strerror(ret));
+        return ret;
+    }
+
+    if ((outer.type != BPF_MAP_TYPE_ARRAY_OF_MAPS && outer.type != BPF_MAP_TYPE_HASH_OF_MAPS) ||
+        outer.key_size != sizeof(uint32_t) || outer.value_size != sizeof(uint32_t)) {
+        pr_err("%s: unsupported layout of outer map\n", derived_name);
+        close_object_fd(&outer.fd);
+        return EINVAL;
+    }
+
+    /* Map pinned under the table name is the template and the initial content of the table */
+    struct bpf_map_info template_info = {};
+    uint32_t info_len = sizeof(template_info);
+    if (map_ops->obj_get_info_by_fd(ctx->table.fd, &template_info, &info_len) != 0) {
+        ret = errno;
+        pr_err("can't get info for table: %s\n", strerror(ret));
+        close_object_fd(&outer.fd);
+        return ret;
+    }
+
+    struct psabpf_table_shadow *shadow = calloc(1, sizeof(struct psabpf_table_shadow));
+    if (shadow == NULL) {
+        pr_err("not enough memory\n");
+        close_object_fd(&outer.fd);
+        return ENOMEM;
+    }
+    shadow->outer = outer;
+    shadow->map_flags = template_info.map_flags;
+    shadow->live_fd = -1;
+    shadow->live_is_template = true;
+    ctx->shadow = shadow;
+
+    uint32_t slot = 0, live_id = 0;
+    if (map_ops->lookup_elem(outer.fd, &slot, &live_id) != 0 || live_id == template_info.id)
+        return NO_ERROR;  /* table not swapped yet */
+
+    psabpf_bpf_map_descriptor_t live = {};
+    live.fd = map_ops->get_fd_by_id(live_id);
+    if (live.fd < 0) {
+        ret = errno;
+        pr_err("couldn't open current instance of table %s: %s\n", name, strerror(ret));
+        return ret;
+    }
+    ret = update_map_info(&live);
+    if (ret == NO_ERROR && (live.type != ctx->table.type || live.key_size != ctx->table.key_size ||
+                            live.value_size != ctx->table.value_size))
+        ret = EINVAL;
+    if (ret != NO_ERROR) {
+        pr_err("current instance of table %s does not match its template\n", name);
+        close_object_fd(&live.fd);
+        return ret;
+    }
+
+    close_object_fd(&ctx->table.fd);
+    ctx->table.fd = live.fd;
+    ctx->table.max_entries = live.max_entries;
+    shadow->live_is_template = false;
+
+    return NO_ERROR;
+}
+
+void free_table_shadow(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx->shadow == NULL)
+        return;
+
+    psabpf_table_shadow_abort(ctx);
+    close_object_fd(&ctx->shadow->outer.fd);
+    free(ctx->shadow);
+    ctx->shadow = NULL;
+}
+
+int clone_table_shadow(psabpf_table_entry_ctx_t *dst, psabpf_table_entry_ctx_t *src)
+{
+    if (src->shadow == NULL)
+        return NO_ERROR;
+    /* Shadow table being built belongs to the source context only */
+    if (src->shadow->live_fd >= 0)
+        return EBUSY;
+
+    struct psabpf_table_shadow *shadow = calloc(1, sizeof(struct psabpf_table_shadow));
+    if (shadow == NULL)
+        return ENOMEM;
+    *shadow = *src->shadow;
+    dst->shadow = shadow;
+
+    return clone_map_descriptor(&shadow->outer, &src->shadow->outer);
+}
+
+bool psabpf_table_entry_ctx_has_shadow(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL)
+        return false;
+    return ctx->shadow != NULL;
+}
+
+int psabpf_table_shadow_begin(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL)
+        return EINVAL;
+    if (ctx->shadow == NULL) {
+        pr_err("table can't be swapped: no outer map\n");
+        return ENOTSUP;
+    }
+    struct psabpf_table_shadow *shadow = ctx->shadow;
+    if (shadow->live_fd >= 0) {
+        pr_err("shadow table already exists\n");
+        return EEXIST;
+    }
+
+    struct bpf_create_map_attr attr = {
+            .key_size = ctx->table.key_size,
+            .value_size = ctx->table.value_size,
+            .max_entries = ctx->table.max_entries,
+            .map_type = ctx->table.type,
+            .map_flags = shadow->map_flags,
+            .btf_fd = ctx->btf_metadata.btf_fd,
+            .btf_key_type_id = ctx->table.key_type_id,
+            .btf_value_type_id = ctx->table.value_type_id,
+    };
+    int fd = map_ops->create_map(&attr);
+    if (fd < 0) {
+        int err = errno;
+        pr_err("failed to create shadow table: %s\n", strerror(err));
+        return err;
+    }
+
+    shadow->live_fd = ctx->table.fd;
+    ctx->table.fd = fd;
+    reset_table_iteration(ctx);
+
+    /* Cache is not affected until the shadow table is published */
+    shadow->saved_defer_cache_invalidation = ctx->defer_cache_invalidation;
+    shadow->saved_cache_invalidation_pending = ctx->cache_invalidation_pending;
+    ctx->defer_cache_invalidation = true;
+
+    return NO_ERROR;
+}
+
+int psabpf_table_shadow_commit(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL)
+        return EINVAL;
+    struct psabpf_table_shadow *shadow = ctx->shadow;
+    if (shadow == NULL || shadow->live_fd < 0) {
+        pr_err("no shadow table to commit\n");
+        return EINVAL;
+    }
+
+    /* The only change visible to the data plane, packets see either the old or the new table */
+    uint32_t slot = 0;
+    if (txn_map_update_elem(shadow->outer.fd, &slot, &ctx->table.fd, BPF_ANY) != 0) {
+        int err = errno;
+        pr_err("failed to publish shadow table: %s\n", strerror(err));
+        return err;
+    }
+
+    /* Unpinned instance is released by the kernel when the last user drops it, the template is pinned,
+     * so drain it to free its memory. */
+    if (shadow->live_is_template) {
+        psabpf_bpf_map_descriptor_t old_table = ctx->table;
+        old_table.fd = shadow->live_fd;
+        delete_all_map_entries(&old_table);
+    }
+    close_object_fd(&shadow->live_fd);
+    shadow->live_is_template = false;
+
+    ctx->defer_cache_invalidation = shadow->saved_defer_cache_invalidation;
+    ctx->cache_invalidation_pending = shadow->saved_cache_invalidation_pending;
+    int ret = invalidate_table_cache(ctx);
+    if (ret != NO_ERROR)
+        pr_err("failed to clear cache: %s\n", strerror(ret));
+
+    return ret;
+}
+
+void psabpf_table_shadow_abort(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->shadow == NULL || ctx->shadow->live_fd < 0)
+        return;
+    struct psabpf_table_shadow *shadow = ctx->shadow;
+
+    close_object_fd(&ctx->table.fd);
+    ctx->table.fd = shadow->live_fd;
+    shadow->live_fd = -1;
+    reset_table_iteration(ctx);
+
+    ctx->defer_cache_invalidation = shadow->saved_defer_cache_invalidation;
+    ctx->cache_invalidation_pending = shadow->saved_cache_invalidation_pending;
+}
+
+static int check_table_writable(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx->table.fd < 0) {
+        pr_err("can't add entry: table not opened\n");
+        return EBADF;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        pr_err("zero-size key or value is not supported\n");
+        return ENOTSUP;
+    }
+    return NO_ERROR;
+}
+
+/* Builds map key and value of the entry into given buffers, sizes of buffers
+ * must be equal to the key and value size of the table. */
+static int build_table_entry_key_value(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
+                                       char *key_buffer, const char *key_mask_buffer,
+                                       char *value_buffer, uint64_t bpf_flags)
+{
+    if (entry->action == NULL) {
+        pr_err("missing action specification\n");
+        return ENODATA;
+    }
+
+    int return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
+                                       fill_key_btf_info, fill_key_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
-        goto clean_up;
+        pr_err("failed to construct key\n");
+        return return_code;
     }
 
     return_code = construct_buffer(value_buffer, ctx->table.value_size, ctx, entry,
                                    fill_value_btf_info, fill_value_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct value\n");
-        goto clean_up;
+        pr_err("failed to construct value\n");
+        return return_code;
     }
 
     if (ctx->is_ternary == true && key_mask_buffer != NULL)
@@ -1962,32 +2890,64 @@ static int psabpf_table_entry_write(psabpf_table_entry_ctx_t *ctx, psabpf_table_
 
     /* Handle direct objects */
     return_code = handle_direct_objects_write(key_buffer, value_buffer, &ctx->table, ctx, entry, bpf_flags);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+    if (return_code != NO_ERROR)
+        pr_err("failed to handle direct objects: %s\n", strerror(return_code));
+
+    return return_code;
+}
+
+static int psabpf_table_entry_write(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
+                                    uint64_t bpf_flags, bool invalidate_cache)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    char *value_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || entry == NULL)
+        return EINVAL;
+
+    if (ctx->is_ternary) {
+        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, bpf_flags);
+        if (return_code != NO_ERROR)
+            goto clean_up;
+    }
+
+    return_code = check_table_writable(ctx);
+    if (return_code != NO_ERROR)
+        goto clean_up;
+
+    /* prepare buffers for map key/value */
+    key_buffer = arena_or_heap_alloc(entry->arena, ctx->table.key_size);
+    value_buffer = arena_or_heap_alloc(entry->arena, ctx->table.value_size);
+    if (key_buffer == NULL || value_buffer == NULL) {
+        pr_err("not enough memory\n");
+        return_code = ENOMEM;
         goto clean_up;
     }
 
+    return_code = build_table_entry_key_value(ctx, entry, key_buffer, key_mask_buffer, value_buffer, bpf_flags);
+    if (return_code != NO_ERROR)
+        goto clean_up;
+
     /* update map */
     if (ctx->table.type == BPF_MAP_TYPE_ARRAY)
         bpf_flags = BPF_ANY;
-    return_code = bpf_map_update_elem(ctx->table.fd, key_buffer, value_buffer, bpf_flags);
+    return_code = txn_map_update_elem(ctx->table.fd, key_buffer, value_buffer, bpf_flags);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
-    } else {
-        return_code = clear_table_cache(&ctx->cache);
+        pr_err("failed to set up entry: %s\n", strerror(errno));
+    } else if (invalidate_cache) {
+        return_code = invalidate_table_cache_entry(ctx, key_buffer, key_mask_buffer);
         if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+            pr_err("failed to invalidate cache: %s\n", strerror(return_code));
         }
     }
 
 clean_up:
-    if (key_buffer != NULL)
-        free(key_buffer);
-    if (key_mask_buffer != NULL)
-        free(key_mask_buffer);
-    if (value_buffer != NULL)
-        free(value_buffer);
+    arena_or_heap_free(entry->arena, key_buffer);
+    arena_or_heap_free(entry->arena, key_mask_buffer);
+    arena_or_heap_free(entry->arena, value_buffer);
 
     if (ctx->is_ternary)
         ternary_table_close_tuple(ctx);
@@ -1997,119 +2957,535 @@ clean_up:
 
 int psabpf_table_entry_add(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
-    return psabpf_table_entry_write(ctx, entry, BPF_NOEXIST);
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_ADD);
+
+    return psabpf_table_entry_write(ctx, entry, BPF_NOEXIST, true);
 }
 
 int psabpf_table_entry_update(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
-    return psabpf_table_entry_write(ctx, entry, BPF_EXIST);
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_UPDATE);
+
+    return psabpf_table_entry_write(ctx, entry, BPF_EXIST, true);
 }
 
-static int prepare_ternary_table_delete(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, char **key_mask)
+static uint64_t hash_raw_key(const char *key, size_t size)
 {
-    if (entry->n_keys != 0)
-        return ternary_table_open_tuple(ctx, entry, key_mask, BPF_EXIST);
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (uint8_t) key[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-    delete_all_map_entries(&ctx->prefixes);
-    fprintf(stderr, "removing entries from tuples_map, this may take a while\n");
-    delete_all_map_entries(&ctx->tuple_map);
+static void set_batch_entry_status(int *status, size_t idx, int value, int *first_error)
+{
+    if (status != NULL)
+        status[idx] = value;
+    if (value != NO_ERROR && *first_error == NO_ERROR)
+        *first_error = value;
+}
 
-    /* Unpinning inner maps for our table is not required
-     * because they are not pinned by this tool. */
+/* Batch update in kernel (generic_map_update_batch) always behaves like BPF_ANY,
+ * so BPF_NOEXIST/BPF_EXIST semantic has to be checked before entry is sent. */
+static int check_batch_entry_precondition(psabpf_table_entry_ctx_t *ctx, const char *key,
+                                          char *value_scratch, uint64_t bpf_flags)
+{
+    if (ctx->table.type == BPF_MAP_TYPE_ARRAY || bpf_flags == BPF_ANY)
+        return NO_ERROR;
+
+    bool exists = map_ops->lookup_elem(ctx->table.fd, key, value_scratch) == 0;
+    if (exists && ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        int ret = lpm_trie_key_exists(ctx->table.fd, key, ctx->table.key_size, &exists);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+    if (bpf_flags == BPF_NOEXIST && exists)
+        return EEXIST;
+    if (bpf_flags == BPF_EXIST && !exists)
+        return ENOENT;
 
     return NO_ERROR;
 }
 
-static int ternary_table_remove_prefix(psabpf_table_entry_ctx_t *ctx, const char *key_mask)
+/* Entries of one batch are checked against the map before any of them is written, so a key repeated
+ * in an add batch would pass the check twice. Index holds slots of already accepted keys; returns true
+ * when key of the slot was accepted before, otherwise adds the slot to the index. */
+static bool batch_key_repeated(size_t *index, size_t index_mask, const char *keys, size_t key_size, size_t slot)
 {
-    int err = NO_ERROR;
-    char *prev_key_mask = malloc(ctx->prefixes.key_size);
-    char *prev_value_mask = malloc(ctx->prefixes.value_size);
-    char *value_mask = malloc(ctx->prefixes.value_size);
+    const char *key = keys + slot * key_size;
+    size_t pos = hash_raw_key(key, key_size) & index_mask;
 
-    if (prev_key_mask == NULL || prev_value_mask == NULL || value_mask == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        err = ENOMEM;
+    while (index[pos] != SIZE_MAX) {
+        if (memcmp(keys + index[pos] * key_size, key, key_size) == 0)
+            return true;
+        pos = (pos + 1) & index_mask;
+    }
+    index[pos] = slot;
+    return false;
+}
+
+/* Pushes serialized entries to the table, on error skips failed element and continues with the rest.
+ * Error is stored in the status of entry pointed by slot_to_entry (if not NULL). Returns number of
+ * written entries. */
+static size_t push_table_entries(psabpf_table_entry_ctx_t *ctx, char *keys, char *values, size_t n_slots,
+                                 uint64_t bpf_flags, const size_t *slot_to_entry, int *status, int *first_error)
+{
+    const size_t key_size = ctx->table.key_size;
+    const size_t value_size = ctx->table.value_size;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+    size_t offset = 0, n_written = 0;
+    bool use_batch = true;
+    int ret;
+
+    while (offset < n_slots) {
+        uint32_t count = n_slots - offset;
+        ret = NO_ERROR;
+
+        if (use_batch) {
+            if (txn_map_update_batch(ctx->table.fd, keys + offset * key_size,
+                                     values + offset * value_size, &count, &opts) == 0) {
+                n_written += count;
+                break;
+            }
+            ret = errno;
+            if (offset == 0 && count == 0 && batch_ops_not_supported(ret)) {
+                use_batch = false;
+                continue;
+            }
+            n_written += count;
+            offset += count;
+        } else {
+            uint64_t elem_flags = ctx->table.type == BPF_MAP_TYPE_ARRAY ? BPF_ANY : bpf_flags;
+            if (txn_map_update_elem(ctx->table.fd, keys + offset * key_size,
+                                    values + offset * value_size, elem_flags) == 0) {
+                n_written++;
+                offset++;
+                continue;
+            }
+            ret = errno;
+        }
+
+        pr_err("failed to set up entry: %s\n", strerror(ret));
+        set_batch_entry_status(status, slot_to_entry != NULL ? slot_to_entry[offset] : offset, ret, first_error);
+        offset++;
+    }
+
+    return n_written;
+}
+
+static int psabpf_table_entry_write_batch(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries,
+                                          size_t n_entries, int *status, uint64_t bpf_flags)
+{
+    char *keys = NULL;
+    char *values = NULL;
+    char *value_scratch = NULL;
+    size_t *slot_to_entry = NULL;
+    size_t *key_index = NULL;
+    size_t n_slots = 0;
+    size_t n_written = 0;
+    int first_error = NO_ERROR;
+    int ret;
+
+    if (ctx == NULL || (entries == NULL && n_entries > 0))
+        return EINVAL;
+    if (n_entries == 0)
+        return NO_ERROR;
+
+    /* Every entry of ternary table may go to another tuple, so there is no single
+     * map to which entries can be pushed. Only cache is cleared once. */
+    if (ctx->is_ternary) {
+        for (size_t i = 0; i < n_entries; i++) {
+            ret = psabpf_table_entry_write(ctx, entries[i], bpf_flags, false);
+            set_batch_entry_status(status, i, ret, &first_error);
+            if (ret == NO_ERROR)
+                n_written++;
+        }
+        goto invalidate_cache;
+    }
+
+    ret = check_table_writable(ctx);
+    if (ret != NO_ERROR)
+        return ret;
+
+    const size_t key_size = ctx->table.key_size;
+    const size_t value_size = ctx->table.value_size;
+    keys = malloc(n_entries * key_size);
+    values = malloc(n_entries * value_size);
+    value_scratch = malloc(value_size);
+    slot_to_entry = malloc(n_entries * sizeof(size_t));
+    /* Index of accepted keys, open addressing with at most 50% load */
+    size_t index_size = 16;
+    while (index_size < 2 * n_entries)
+        index_size *= 2;
+    key_index = malloc(index_size * sizeof(size_t));
+    if (keys == NULL || values == NULL || value_scratch == NULL || slot_to_entry == NULL || key_index == NULL) {
+        pr_err("not enough memory\n");
+        first_error = ENOMEM;
         goto clean_up;
     }
+    for (size_t i = 0; i < index_size; i++)
+        key_index[i] = SIZE_MAX;
+    /* Repeated key of an update batch overwrites the previous one, as in sequence of single updates */
+    const bool check_repeated = bpf_flags == BPF_NOEXIST && ctx->table.type != BPF_MAP_TYPE_ARRAY;
 
-    if (bpf_map_lookup_elem(ctx->prefixes.fd, key_mask, value_mask) != 0) {
-        err = errno;
-        fprintf(stderr, "unable to obtain prefix: %s\n", strerror(err));
+    /* Serialize all entries into contiguous arrays, skip invalid ones */
+    for (size_t i = 0; i < n_entries; i++) {
+        char *key = keys + n_slots * key_size;
+        char *value = values + n_slots * value_size;
+
+        if (entries[i] == NULL)
+            ret = EINVAL;
+        else
+            ret = build_table_entry_key_value(ctx, entries[i], key, NULL, value, bpf_flags);
+        if (ret == NO_ERROR)
+            ret = check_batch_entry_precondition(ctx, key, value_scratch, bpf_flags);
+        if (ret == NO_ERROR && check_repeated &&
+            batch_key_repeated(key_index, index_size - 1, keys, key_size, n_slots))
+            ret = EEXIST;
+
+        set_batch_entry_status(status, i, ret, &first_error);
+        if (ret == NO_ERROR)
+            slot_to_entry[n_slots++] = i;
+    }
+
+    n_written = push_table_entries(ctx, keys, values, n_slots, bpf_flags, slot_to_entry, status, &first_error);
+
+invalidate_cache:
+    if (n_written > 0) {
+        ret = invalidate_table_cache(ctx);
+        if (ret != NO_ERROR) {
+            pr_err("failed to clear cache: %s\n", strerror(ret));
+            if (first_error == NO_ERROR)
+                first_error = ret;
+        }
+    }
+
+clean_up:
+    if (keys != NULL)
+        free(keys);
+    if (values != NULL)
+        free(values);
+    if (value_scratch != NULL)
+        free(value_scratch);
+    if (slot_to_entry != NULL)
+        free(slot_to_entry);
+    if (key_index != NULL)
+        free(key_index);
+
+    return first_error;
+}
+
+int psabpf_table_entry_add_batch(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries,
+                                 size_t n_entries, int *status)
+{
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_ADD_BATCH);
+
+    return psabpf_table_entry_write_batch(ctx, entries, n_entries, status, BPF_NOEXIST);
+}
+
+int psabpf_table_entry_update_batch(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries,
+                                    size_t n_entries, int *status)
+{
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_UPDATE_BATCH);
+
+    return psabpf_table_entry_write_batch(ctx, entries, n_entries, status, BPF_EXIST);
+}
+
+static bool direct_counter_provided(psabpf_table_entry_t *entry, unsigned idx)
+{
+    for (size_t i = 0; i < entry->n_direct_counters; i++) {
+        if (entry->direct_counters[i].counter_idx == idx)
+            return true;
+    }
+    return false;
+}
+
+static bool direct_meter_provided(psabpf_table_entry_t *entry, unsigned idx)
+{
+    for (size_t i = 0; i < entry->n_direct_meters; i++) {
+        if (entry->direct_meters[i].meter_idx == idx)
+            return true;
+    }
+    return false;
+}
+
+/* Direct counters and meters are changed by the data plane. These not provided in the entry are taken
+ * from the current value, so they are preserved on update; state of the provided meters is not compared,
+ * only their configuration. Scratch buffer must have size of value. */
+static bool merge_and_compare_values(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
+                                     char *desired, const char *current, char *scratch)
+{
+    const size_t value_size = ctx->table.value_size;
+    if (ctx->is_indirect || ctx->btf_metadata.btf == NULL || ctx->table.btf_type_id == 0)
+        return memcmp(desired, current, value_size) == 0;
+
+    memcpy(scratch, current, value_size);
+
+    for (unsigned i = 0; i < ctx->n_direct_counters; i++) {
+        psabpf_direct_counter_context_t *dc_ctx = &ctx->direct_counters_ctx[i];
+        if (!direct_counter_provided(entry, i))
+            memcpy(desired + dc_ctx->counter_offset, current + dc_ctx->counter_offset, dc_ctx->counter_size);
+    }
+
+    const size_t meter_state_offset = offsetof(psabpf_meter_data_t, pbs_left);
+    for (unsigned i = 0; i < ctx->n_direct_meters; i++) {
+        psabpf_direct_meter_context_t *dm_ctx = &ctx->direct_meters_ctx[i];
+        if (!direct_meter_provided(entry, i))
+            memcpy(desired + dm_ctx->meter_offset, current + dm_ctx->meter_offset, dm_ctx->meter_size);
+        else if (dm_ctx->meter_size == DIRECT_METER_SIZE)
+            memcpy(scratch + dm_ctx->meter_offset + meter_state_offset,
+                   desired + dm_ctx->meter_offset + meter_state_offset, DIRECT_METER_SIZE - meter_state_offset);
+    }
+
+    return memcmp(desired, scratch, value_size) == 0;
+}
+
+static bool is_zero_buffer(const char *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+int psabpf_table_reconcile(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t **entries, size_t n_entries,
+                           psabpf_table_reconcile_stats_t *stats)
+{
+    psabpf_table_reconcile_stats_t local_stats;
+    char *desired_keys = NULL, *desired_values = NULL;
+    char *current_keys = NULL, *current_values = NULL;
+    char *delete_keys = NULL, *zero_value = NULL, *scratch = NULL;
+    size_t *index = NULL, *added_index = NULL;
+    bool *matched = NULL;
+    size_t n_current = 0, n_writes = 0, n_deletes = 0;
+    int first_error = NO_ERROR;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(psabpf_table_reconcile_stats_t));
+
+    if (ctx == NULL || (entries == NULL && n_entries > 0)) {
+        first_error = EINVAL;
+        goto clean_up;
+    }
+    if (ctx->is_ternary) {
+        pr_err("reconciliation of ternary table is not supported\n");
+        first_error = ENOTSUP;
+        goto clean_up;
+    }
+    int ret = check_table_writable(ctx);
+    if (ret != NO_ERROR) {
+        first_error = ret;
         goto clean_up;
     }
 
-    struct ternary_table_prefix_metadata prefix_md;
-    if ((err = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+    const size_t key_size = ctx->table.key_size;
+    const size_t value_size = ctx->table.value_size;
+    const bool is_array = ctx->table.type == BPF_MAP_TYPE_ARRAY;
+
+    ret = read_all_map_entries(&ctx->table, &current_keys, &current_values, &n_current);
+    if (ret != NO_ERROR) {
+        pr_err("failed to read table: %s\n", strerror(ret));
+        first_error = ret;
         goto clean_up;
     }
 
-    /* find previous prefix */
-    bool prev_prefix_found = false;
-    memset(prev_key_mask, 0, ctx->prefixes.key_size);
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask);
-    if (err != 0) {
-        err = errno;
-        fprintf(stderr, "head not found: %s\n", strerror(err));
+    /* Index of current keys, open addressing with at most 50% load */
+    size_t index_size = 16;
+    while (index_size < 2 * n_current)
+        index_size *= 2;
+    const size_t index_mask = index_size - 1;
+    /* Index of added keys, they stay in desired_keys */
+    size_t added_index_size = 16;
+    while (added_index_size < 2 * n_entries)
+        added_index_size *= 2;
+
+    /* Writes (adds, updates and clears of array elements) are placed in desired_* arrays */
+    size_t max_writes = n_entries + (is_array ? n_current : 0);
+    desired_keys = malloc((max_writes > 0 ? max_writes : 1) * key_size);
+    desired_values = malloc((max_writes > 0 ? max_writes : 1) * value_size);
+    delete_keys = malloc((n_current > 0 ? n_current : 1) * key_size);
+    zero_value = calloc(1, value_size);
+    scratch = malloc(value_size);
+    index = malloc(index_size * sizeof(size_t));
+    matched = calloc(n_current > 0 ? n_current : 1, sizeof(bool));
+    added_index = malloc(added_index_size * sizeof(size_t));
+    if (desired_keys == NULL || desired_values == NULL || delete_keys == NULL || zero_value == NULL ||
+        scratch == NULL || index == NULL || matched == NULL || added_index == NULL) {
+        pr_err("not enough memory\n");
+        first_error = ENOMEM;
         goto clean_up;
     }
 
-    while (true) {
-        /* it is an previous prefix? */
-        if (memcmp(prev_value_mask + prefix_md.next_mask_offset, key_mask, prefix_md.next_mask_size) == 0) {
-            prev_prefix_found = true;
-            break;
+    for (size_t i = 0; i < index_size; i++)
+        index[i] = SIZE_MAX;
+    for (size_t i = 0; i < n_current; i++) {
+        size_t slot = hash_raw_key(current_keys + i * key_size, key_size) & index_mask;
+        while (index[slot] != SIZE_MAX)
+            slot = (slot + 1) & index_mask;
+        index[slot] = i;
+    }
+    for (size_t i = 0; i < added_index_size; i++)
+        added_index[i] = SIZE_MAX;
+
+    /* Desired state against current one */
+    for (size_t i = 0; i < n_entries; i++) {
+        char *key = desired_keys + n_writes * key_size;
+        char *value = desired_values + n_writes * value_size;
+
+        ret = entries[i] == NULL ? EINVAL :
+              build_table_entry_key_value(ctx, entries[i], key, NULL, value, BPF_ANY);
+        if (ret != NO_ERROR) {
+            stats->n_failed++;
+            if (first_error == NO_ERROR)
+                first_error = ret;
+            continue;
         }
 
-        /* get next prefix */
-        uint8_t has_next = *((uint8_t *) (prev_value_mask + prefix_md.has_next_offset));
-        if (has_next == 0)
-            break;
-        memcpy(prev_key_mask, prev_value_mask + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask) != 0)
-            break;
+        size_t slot = hash_raw_key(key, key_size) & index_mask;
+        size_t current_idx = SIZE_MAX;
+        for (; index[slot] != SIZE_MAX; slot = (slot + 1) & index_mask) {
+            if (memcmp(current_keys + index[slot] * key_size, key, key_size) == 0) {
+                current_idx = index[slot];
+                break;
+            }
+        }
+
+        /* Desired state can't have the same key twice, the first entry is used */
+        bool repeated = current_idx == SIZE_MAX ?
+                        batch_key_repeated(added_index, added_index_size - 1, desired_keys, key_size, n_writes) :
+                        matched[current_idx];
+        if (repeated) {
+            pr_err("entry %zu repeats key of a previous entry\n", i);
+            stats->n_failed++;
+            if (first_error == NO_ERROR)
+                first_error = EINVAL;
+            continue;
+        }
+
+        if (current_idx == SIZE_MAX) {
+            stats->n_added++;
+        } else {
+            const char *current_value = current_values + current_idx * value_size;
+            matched[current_idx] = true;
+            if (merge_and_compare_values(ctx, entries[i], value, current_value, scratch)) {
+                stats->n_unchanged++;
+                continue;
+            }
+            if (is_array && is_zero_buffer(current_value, value_size))
+                stats->n_added++;
+            else
+                stats->n_updated++;
+        }
+        n_writes++;
     }
 
-    if (prev_prefix_found == false) {
-        fprintf(stderr, "detected data inconsistency in prefixes: no previous prefix\n");
-    } else {
-        /* copy next_mask and has_next to the previous prefix */
-        memcpy(prev_value_mask + prefix_md.next_mask_offset,
-               value_mask + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        memcpy(prev_value_mask + prefix_md.has_next_offset,
-               value_mask + prefix_md.has_next_offset, prefix_md.has_next_size);
+    /* Everything else is removed, elements of array are cleared */
+    for (size_t i = 0; i < n_current; i++) {
+        if (matched[i])
+            continue;
+        if (is_array) {
+            if (is_zero_buffer(current_values + i * value_size, value_size))
+                continue;
+            memcpy(desired_keys + n_writes * key_size, current_keys + i * key_size, key_size);
+            memcpy(desired_values + n_writes * value_size, zero_value, value_size);
+            n_writes++;
+        } else {
+            memcpy(delete_keys + n_deletes * key_size, current_keys + i * key_size, key_size);
+            n_deletes++;
+        }
+        stats->n_deleted++;
+    }
 
-        err = bpf_map_update_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask, BPF_EXIST);
-        if (err != 0) {
-            err = errno;
-            fprintf(stderr, "failed to update previous prefix: %s\n", strerror(err));
-            goto clean_up;
+    /* Delete first to make room for new entries */
+    if (n_deletes > 0) {
+        ret = delete_map_keys(&ctx->table, delete_keys, n_deletes);
+        if (ret != NO_ERROR) {
+            pr_err("failed to delete entries: %s\n", strerror(ret));
+            if (first_error == NO_ERROR)
+                first_error = ret;
         }
     }
+    if (n_writes > 0) {
+        size_t n_written = push_table_entries(ctx, desired_keys, desired_values, n_writes, BPF_ANY,
+                                              NULL, NULL, &first_error);
+        stats->n_failed += n_writes - n_written;
+    }
+
+    if (n_writes > 0 || n_deletes > 0) {
+        ret = invalidate_table_cache(ctx);
+        if (ret != NO_ERROR) {
+            pr_err("failed to clear cache: %s\n", strerror(ret));
+            if (first_error == NO_ERROR)
+                first_error = ret;
+        }
+    }
+
+clean_up:
+    if (desired_keys != NULL)
+        free(desired_keys);
+    if (desired_values != NULL)
+        free(desired_values);
+    if (current_keys != NULL)
+        free(current_keys);
+    if (current_values != NULL)
+        free(current_values);
+    if (delete_keys != NULL)
+        free(delete_keys);
+    if (zero_value != NULL)
+        free(zero_value);
+    if (scratch != NULL)
+        free(scratch);
+    if (index != NULL)
+        free(index);
+    if (matched != NULL)
+        free(matched);
+    if (added_index != NULL)
+        free(added_index);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->elapsed_ns = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000ULL +
+                        (uint64_t) end.tv_nsec - (uint64_t) start.tv_nsec;
+
+    return first_error;
+}
+
+static int prepare_ternary_table_delete(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, char **key_mask)
+{
+    if (entry->n_keys != 0)
+        return ternary_table_open_tuple(ctx, entry, key_mask, BPF_EXIST);
 
-    /* there are no prefixes that points to removing prefix, so it can be safely removed now */
-    if (bpf_map_delete_elem(ctx->prefixes.fd, key_mask) != 0)
-        fprintf(stderr, "warning: failed to remove prefix from prefixes list\n");
+    delete_all_map_entries(&ctx->prefixes);
+    pr_info("removing entries from tuples_map, this may take a while\n");
+    delete_all_map_entries(&ctx->tuple_map);
+    ternary_prefixes_free(ctx);
 
-    /* also remove tuple from tuple_map */
-    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
-    if (bpf_map_delete_elem(ctx->tuple_map.fd, &tuple_id) != 0)
-        fprintf(stderr, "warning: failed to remove tuple from tuples_map\n");
+    /* Unpinning inner maps for our table is not required
+     * because they are not pinned by this tool. */
 
-    /* unpinning not required - inner map is not pinned by this tool*/
+    return NO_ERROR;
+}
 
-    err = NO_ERROR;
+static int ternary_table_remove_prefix(psabpf_table_entry_ctx_t *ctx, const char *key_mask)
+{
+    int err = ternary_prefixes_load(ctx);
+    if (err != NO_ERROR) {
+        pr_err("failed to load prefixes: %s\n", strerror(err));
+        return err;
+    }
 
-clean_up:
-    if (prev_key_mask != NULL)
-        free(prev_key_mask);
-    if (prev_value_mask != NULL)
-        free(prev_value_mask);
-    if (value_mask != NULL)
-        free(value_mask);
+    /* unpinning not required - inner map is not pinned by this tool*/
 
-    return err;
+    return ternary_prefixes_remove(ctx, key_mask);
 }
 
 static int post_ternary_table_delete(psabpf_table_entry_ctx_t *ctx, const char *key_mask)
@@ -2123,12 +3499,12 @@ static int post_ternary_table_delete(psabpf_table_entry_ctx_t *ctx, const char *
     char *tuple_next_key = malloc(ctx->table.key_size);
 
     if (tuple_next_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         err = ENOMEM;
         goto clean_up;
     }
 
-    if (bpf_map_get_next_key(ctx->table.fd, NULL, tuple_next_key) != 0) {
+    if (map_ops->get_next_key(ctx->table.fd, NULL, tuple_next_key) != 0) {
         err = ternary_table_remove_prefix(ctx, key_mask);
     }
 
@@ -2136,12 +3512,14 @@ clean_up:
     if (tuple_next_key != NULL)
         free(tuple_next_key);
 
-    close_object_fd(&(ctx->table.fd));
+    ternary_table_close_tuple(ctx);
     return err;
 }
 
 int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_DEL);
+
     char *key_buffer = NULL;
     char *key_mask_buffer = NULL;
     int return_code = NO_ERROR;
@@ -2152,7 +3530,7 @@ int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     if (ctx->is_ternary) {
         return_code = prepare_ternary_table_delete(ctx, entry, &key_mask_buffer);
         if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to prepare ternary table for delete\n");
+            pr_err("failed to prepare ternary table for delete\n");
             goto clean_up;
         }
         if (entry->n_keys == 0)
@@ -2160,32 +3538,32 @@ int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     }
 
     if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't delete entry: table not opened\n");
+        pr_err("can't delete entry: table not opened\n");
         return EBADF;
     }
     if (ctx->table.key_size == 0) {
-        fprintf(stderr, "zero-size key is not supported\n");
+        pr_err("zero-size key is not supported\n");
         return ENOTSUP;
     }
 
     /* remove all entries from table if key is not present */
     if (entry->n_keys == 0) {
         if (ctx->table.type == BPF_MAP_TYPE_ARRAY)
-            fprintf(stderr, "removing entries from array map may take a while\n");
+            pr_info("removing entries from array map may take a while\n");
         return_code = delete_all_map_entries(&ctx->table);
         if (return_code == NO_ERROR) {
-            return_code = clear_table_cache(&ctx->cache);
+            return_code = invalidate_table_cache(ctx);
             if (return_code != NO_ERROR) {
-                fprintf(stderr, "failed to clear table cache: %s\n", strerror(return_code));
+                pr_err("failed to clear table cache: %s\n", strerror(return_code));
             }
         }
         return return_code;
     }
 
     /* prepare buffers for map key */
-    key_buffer = malloc(ctx->table.key_size);
+    key_buffer = arena_or_heap_alloc(entry->arena, ctx->table.key_size);
     if (key_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return_code = ENOMEM;
         goto clean_up;
     }
@@ -2193,7 +3571,7 @@ int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
                                    fill_key_btf_info, fill_key_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
+        pr_err("failed to construct key\n");
         goto clean_up;
     }
 
@@ -2201,14 +3579,14 @@ int psabpf_table_entry_del(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
         mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
 
     /* delete pointed entry */
-    return_code = bpf_map_delete_elem(ctx->table.fd, key_buffer);
+    return_code = txn_map_delete_elem(ctx->table.fd, key_buffer);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to delete entry: %s\n", strerror(errno));
+        pr_err("failed to delete entry: %s\n", strerror(errno));
     } else {
-        return_code = clear_table_cache(&ctx->cache);
+        return_code = invalidate_table_cache_entry(ctx, key_buffer, key_mask_buffer);
         if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+            pr_err("failed to invalidate cache: %s\n", strerror(return_code));
         }
     }
 
@@ -2217,16 +3595,16 @@ clean_up:
     if (ctx->is_ternary)
         post_ternary_table_delete(ctx, key_mask_buffer);
 
-    if (key_buffer != NULL)
-        free(key_buffer);
-    if (key_mask_buffer != NULL)
-        free(key_mask_buffer);
+    arena_or_heap_free(entry->arena, key_buffer);
+    arena_or_heap_free(entry->arena, key_mask_buffer);
 
     return return_code;
 }
 
 int psabpf_table_entry_set_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_SET_DEFAULT_ENTRY);
+
     /* For default entry array map is used, it always has key 32-bit width and its value is assumed to be 0. */
     const uint32_t key = 0;
     char *value_buffer = NULL;
@@ -2236,30 +3614,30 @@ int psabpf_table_entry_set_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_t
         return EINVAL;
 
     if (ctx->default_entry.fd < 0) {
-        fprintf(stderr, "can't add default entry: table not opened or table has no default entry\n");
+        pr_err("can't add default entry: table not opened or table has no default entry\n");
         return EBADF;
     }
     if (ctx->default_entry.key_size != sizeof(key) ||
             ctx->default_entry.value_size == 0 || ctx->default_entry.value_size != ctx->table.value_size) {
-        fprintf(stderr, "key size or value is not supported\n");
+        pr_err("key size or value is not supported\n");
         return ENOTSUP;
     }
     if (entry->action == NULL) {
-        fprintf(stderr, "missing action specification\n");
+        pr_err("missing action specification\n");
         return ENODATA;
     }
 
     /* prepare buffer for map value */
     value_buffer = malloc(ctx->default_entry.value_size);
     if (value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
     return_code = construct_buffer(value_buffer, ctx->default_entry.value_size, ctx, entry,
                                    fill_value_btf_info, fill_value_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct value\n");
+        pr_err("failed to construct value\n");
         goto clean_up;
     }
 
@@ -2267,19 +3645,19 @@ int psabpf_table_entry_set_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_t
      * and is treated like a regular entry, including with regards to direct resources */
     return_code = handle_direct_objects_write((void *) &key, value_buffer, &ctx->default_entry, ctx, entry, BPF_EXIST);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+        pr_err("failed to handle direct objects: %s\n", strerror(return_code));
         goto clean_up;
     }
 
     /* update map */
-    return_code = bpf_map_update_elem(ctx->default_entry.fd, &key, value_buffer, BPF_ANY);
+    return_code = txn_map_update_elem(ctx->default_entry.fd, &key, value_buffer, BPF_ANY);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
+        pr_err("failed to set up entry: %s\n", strerror(errno));
     } else {
-        return_code = clear_table_cache(&ctx->cache);
+        return_code = invalidate_table_cache(ctx);
         if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+            pr_err("failed to clear cache: %s\n", strerror(return_code));
         }
     }
 
@@ -2297,7 +3675,7 @@ static int parse_table_value_no_btf(psabpf_table_entry_ctx_t *ctx, psabpf_table_
     /* Action ID */
     if (ctx->is_indirect == false) {
         if (buffer_size < sizeof(uint32_t)) {
-            fprintf(stderr, "too small value type\n");
+            pr_err("too small value type\n");
             return EINVAL;
         }
         entry->action->action_id = *((uint32_t *) value);
@@ -2308,7 +3686,7 @@ static int parse_table_value_no_btf(psabpf_table_entry_ctx_t *ctx, psabpf_table_
     /* Priority */
     if (ctx->is_ternary) {
         if (buffer_size < sizeof(uint32_t)) {
-            fprintf(stderr, "too small value type\n");
+            pr_err("too small value type\n");
             return EINVAL;
         }
         entry->priority = *((uint32_t *) value);
@@ -2484,8 +3862,68 @@ static int parse_table_value_references(psabpf_table_entry_ctx_t *ctx, psabpf_ta
     return NO_ERROR;
 }
 
+static int parse_table_value_action_layout(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, const void *value)
+{
+    const struct psabpf_table_layout *layout = ctx->layout;
+
+    if (!layout->has_action_id)
+        return ENOENT;
+    if (layout->action_id.size > sizeof(entry->action->action_id))
+        return EINVAL;
+    entry->action->action_id = 0;
+    memcpy(&entry->action->action_id, value + layout->action_id.offset, layout->action_id.size);
+
+    if (entry->action->action_id >= layout->n_actions)
+        return EINVAL;
+    const psabpf_table_action_layout_t *action = &layout->actions[entry->action->action_id];
+    if (action->n_params == 0)
+        return NO_ERROR;
+
+    entry->action->params = malloc(action->n_params * sizeof(psabpf_action_param_t));
+    if (entry->action->params == NULL)
+        return ENOMEM;
+    entry->action->n_params = action->n_params;
+
+    for (size_t i = 0; i < action->n_params; i++) {
+        int ret = psabpf_action_param_create(&entry->action->params[i],
+                                             value + action->params[i].offset, action->params[i].size);
+        entry->action->params[i].param_id = i;
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_layout(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, const void *value)
+{
+    int ret;
+
+    if (ctx->is_indirect == false)
+        ret = parse_table_value_action_layout(ctx, entry, value);
+    else
+        ret = parse_table_value_references(ctx, entry, value);
+    if (ret != NO_ERROR)
+        return ret;
+
+    if (ctx->is_ternary) {
+        const psabpf_table_field_layout_t *priority = &ctx->layout->priority;
+        if (!ctx->layout->has_priority)
+            return ENOENT;
+        if (priority->size > sizeof(entry->priority))
+            return EINVAL;
+        entry->priority = 0;
+        memcpy(&entry->priority, value + priority->offset, priority->size);
+    }
+
+    return parse_table_value_direct_objects(ctx, entry, value);
+}
+
 static int parse_table_value_btf_info(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, const void *value)
 {
+    if (ctx->layout != NULL)
+        return parse_table_value_layout(ctx, entry, value);
+
     int ret;
     uint32_t value_type_id = get_table_value_type_id(ctx);
     if (value_type_id == 0)
@@ -2514,7 +3952,7 @@ static int parse_table_value_btf_info(psabpf_table_entry_ctx_t *ctx, psabpf_tabl
 
 static int parse_table_value(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry, const void *value)
 {
-    entry->action = malloc(sizeof(psabpf_action_t));
+    entry->action = arena_or_heap_alloc(entry->arena, sizeof(psabpf_action_t));
     if (entry->action == NULL)
         return ENOMEM;
     psabpf_action_init(entry->action);
@@ -2527,6 +3965,8 @@ static int parse_table_value(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t
 
 int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_GET);
+
     char *key_buffer = NULL;
     char *key_mask_buffer = NULL;
     char *value_buffer = NULL;
@@ -2536,7 +3976,7 @@ int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
         return EINVAL;
 
     if (entry->n_keys == 0 || entry->match_keys == NULL) {
-        fprintf(stderr, "can't get entry: missing key\n");
+        pr_err("can't get entry: missing key\n");
         return ENODATA;
     }
 
@@ -2547,12 +3987,12 @@ int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     }
 
     if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't get entry: table not opened\n");
+        pr_err("can't get entry: table not opened\n");
         return_code = EBADF;
         goto clean_up;
     }
     if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
+        pr_err("zero-size key or value is not supported\n");
         return_code = EINVAL;
         goto clean_up;
     }
@@ -2562,16 +4002,15 @@ int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     entry->n_keys = 0;
     void *tmp_keys = entry->match_keys;
     entry->match_keys = NULL;
-    psabpf_table_entry_free(entry);
-    psabpf_table_entry_init(entry);
+    psabpf_table_entry_reset(entry);
     entry->n_keys = tmp_n_keys;
     entry->match_keys = tmp_keys;
 
     /* prepare buffers for map key/value */
-    key_buffer = malloc(ctx->table.key_size);
-    value_buffer = malloc(ctx->table.value_size);
+    key_buffer = arena_or_heap_alloc(entry->arena, ctx->table.key_size);
+    value_buffer = arena_or_heap_alloc(entry->arena, ctx->table.value_size);
     if (key_buffer == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return_code = ENOMEM;
         goto clean_up;
     }
@@ -2579,16 +4018,16 @@ int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
                                    fill_key_btf_info, fill_key_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
+        pr_err("failed to construct key\n");
         goto clean_up;
     }
     if (ctx->is_ternary == true && key_mask_buffer != NULL)
         mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
 
-    return_code = bpf_map_lookup_elem(ctx->table.fd, key_buffer, value_buffer);
+    return_code = map_ops->lookup_elem(ctx->table.fd, key_buffer, value_buffer);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+        pr_err("failed to get entry: %s\n", strerror(return_code));
         goto clean_up;
     }
 
@@ -2597,15 +4036,12 @@ int psabpf_table_entry_get(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *
     /* Parse value */
     return_code = parse_table_value(ctx, entry, value_buffer);
     if (return_code != NO_ERROR)
-        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
+        pr_err("failed to parse entry: %s\n", strerror(return_code));
 
 clean_up:
-    if (key_buffer != NULL)
-        free(key_buffer);
-    if (key_mask_buffer != NULL)
-        free(key_mask_buffer);
-    if (value_buffer != NULL)
-        free(value_buffer);
+    arena_or_heap_free(entry->arena, key_buffer);
+    arena_or_heap_free(entry->arena, key_mask_buffer);
+    arena_or_heap_free(entry->arena, value_buffer);
 
     if (ctx->is_ternary)
         ternary_table_close_tuple(ctx);
@@ -2689,9 +4125,47 @@ static int parse_table_key_add_key_field(psabpf_table_entry_t *entry, int field_
     return ret;
 }
 
+static int parse_table_key_layout(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
+                                  const void *key, const void *key_mask)
+{
+    const struct psabpf_table_layout *layout = ctx->layout;
+
+    if (layout->key_is_scalar) {
+        int field_type = decode_key_field_type_btf_info(ctx, key_mask, ctx->table.key_size, 1, 0);
+        uint32_t prefix = 0;
+        if (field_type == PSABPF_LPM) {
+            prefix = *((uint32_t *) key);
+            key = key + sizeof(uint32_t);
+        }
+        return parse_table_key_add_key_field(entry, field_type, key, key_mask, prefix, ctx->table.key_size);
+    }
+
+    uint32_t global_prefix = 0;
+    if (layout->has_lpm_prefix)
+        global_prefix = *((uint32_t *) (key + layout->lpm_prefix.offset));
+
+    for (size_t i = 0; i < layout->n_key_fields; i++) {
+        const psabpf_table_field_layout_t *field = &layout->key_fields[i];
+        int field_type = field->match_kind;
+        if (ctx->is_ternary)
+            field_type = decode_key_field_type_btf_info(ctx, key_mask + field->offset, field->size, 0, 0);
+        uint32_t prefix = global_prefix + 32 - field->offset * 8;
+
+        int ret = parse_table_key_add_key_field(entry, field_type, key + field->offset,
+                                                key_mask + field->offset, prefix, field->size);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    return NO_ERROR;
+}
+
 static int parse_table_key_btf_info(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
                                     const void *key, const void *key_mask)
 {
+    if (ctx->layout != NULL)
+        return parse_table_key_layout(ctx, entry, key, key_mask);
+
     uint32_t key_type_id = psabtf_get_member_type_id_by_name(ctx->btf_metadata.btf, ctx->table.btf_type_id, "key");
     if (key_type_id == 0)
         return EINVAL;
@@ -2754,11 +4228,12 @@ static int get_next_ternary_table_key_mask(psabpf_table_entry_ctx_t *ctx)
     void *next_key = NULL;
     uint8_t has_next_mask;
     uint32_t tuple_id;
-    uint32_t inner_map_id;
     struct ternary_table_prefix_metadata prefix_md;
 
-    if ((ret_code = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR)
+    /* metadata of prefixes are cached in the mirror */
+    if ((ret_code = ternary_prefixes_load(ctx)) != NO_ERROR)
         return ret_code;
+    prefix_md = ctx->prefixes_mirror->md;
 
     prefix_value = malloc(ctx->prefixes.value_size);
     next_key = malloc(ctx->table.key_size);
@@ -2775,12 +4250,12 @@ static int get_next_ternary_table_key_mask(psabpf_table_entry_ctx_t *ctx)
     for (unsigned i = 0; i < ctx->prefixes.max_entries; ++i) {
         /* Let's see if current mask has next key entry. */
         if (ctx->table.fd >= 0) {
-            if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) == 0)
+            if (map_ops->get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) == 0)
                 break;
         }
 
         /* No next key, get current mask metadata. */
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+        if (map_ops->lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
             ret_code = ENOENT;
             break;
         }
@@ -2797,16 +4272,15 @@ static int get_next_ternary_table_key_mask(psabpf_table_entry_ctx_t *ctx)
         /* Go to the next tuple. */
         ternary_table_close_tuple(ctx);
         memcpy(ctx->current_raw_key_mask, prefix_value + prefix_md.next_mask_offset, ctx->prefixes.key_size);
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+        if (map_ops->lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
             ret_code = ENOENT;
             break;
         }
         tuple_id = *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset));
-        if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0) {
+        if (ternary_prefixes_get_tuple_fd(ctx, tuple_id, &ctx->table.fd) != NO_ERROR) {
             ret_code = ENOENT;
             break;
         }
-        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
     }
 
 clean_up:
@@ -2833,27 +4307,27 @@ int psabpf_table_entry_goto_next_key(psabpf_table_entry_ctx_t *ctx) {
         if (get_next_ternary_table_key_mask(ctx) != NO_ERROR) {
             if (ctx->table.fd < 0)
                 return NO_ERROR;  /* Silently ignore error when table is empty */
-            fprintf(stderr, "failed to iterate over table key masks\n");
+            pr_err("failed to iterate over table key masks\n");
             return ENODATA;
         }
     }
 
     if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't get entry: table not opened\n");
+        pr_err("can't get entry: table not opened\n");
         return ENODATA;
     }
     if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
+        pr_err("zero-size key or value is not supported\n");
         return ENODATA;
     }
 
     next_key = malloc(ctx->table.key_size);
     if (next_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
-    if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) != 0) {
+    if (map_ops->get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) != 0) {
         /* restart iteration */
         if (ctx->is_ternary)
             ternary_table_close_tuple(ctx);
@@ -2874,14 +4348,189 @@ int psabpf_table_entry_goto_next_key(psabpf_table_entry_ctx_t *ctx) {
     return NO_ERROR;
 }
 
+static size_t batch_iterator_token_size(psabpf_table_entry_ctx_t *ctx)
+{
+    /* Hash and array maps use 4B bucket/index as a batch token, other maps use the key */
+    return ctx->table.key_size > sizeof(uint64_t) ? ctx->table.key_size : sizeof(uint64_t);
+}
+
+static int batch_iterator_reserve(psabpf_table_entry_ctx_t *ctx, uint32_t capacity)
+{
+    psabpf_table_batch_iterator_t *iter = &ctx->batch_iter;
+
+    if (iter->keys != NULL && iter->capacity >= capacity)
+        return NO_ERROR;
+
+    void *keys = realloc(iter->keys, (size_t) capacity * ctx->table.key_size);
+    if (keys != NULL)
+        iter->keys = keys;
+    void *values = realloc(iter->values, (size_t) capacity * ctx->table.value_size);
+    if (values != NULL)
+        iter->values = values;
+    if (iter->in_token == NULL)
+        iter->in_token = calloc(1, batch_iterator_token_size(ctx));
+    if (iter->out_token == NULL)
+        iter->out_token = calloc(1, batch_iterator_token_size(ctx));
+
+    if (keys == NULL || values == NULL || iter->in_token == NULL || iter->out_token == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+    iter->capacity = capacity;
+
+    return NO_ERROR;
+}
+
+static void batch_iterator_restart(psabpf_table_batch_iterator_t *iter)
+{
+    iter->count = 0;
+    iter->position = 0;
+    iter->started = false;
+    iter->finished = false;
+}
+
+/* Returns EAGAIN when batch lookup is not supported and iteration should be done key by key */
+static int batch_iterator_fetch(psabpf_table_entry_ctx_t *ctx)
+{
+    psabpf_table_batch_iterator_t *iter = &ctx->batch_iter;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+        .elem_flags = 0,
+        .flags = 0,
+    );
+
+    int ret = batch_iterator_reserve(ctx, iter->batch_size);
+    if (ret != NO_ERROR)
+        return ret;
+
+    while (true) {
+        uint32_t count = iter->capacity;
+        void *in_batch = iter->started ? iter->in_token : NULL;
+
+        ret = map_ops->lookup_batch(ctx->table.fd, in_batch, iter->out_token,
+                                    iter->keys, iter->values, &count, &opts);
+        ret = ret != 0 ? errno : NO_ERROR;
+
+        /* ENOENT means that there are no more entries after this batch */
+        if (ret == NO_ERROR || ret == ENOENT) {
+            iter->count = count;
+            iter->position = 0;
+            iter->started = true;
+            iter->finished = ret == ENOENT;
+            memcpy(iter->in_token, iter->out_token, batch_iterator_token_size(ctx));
+            return NO_ERROR;
+        }
+
+        if (!iter->started && batch_ops_not_supported(ret)) {
+            iter->not_supported = true;
+            return EAGAIN;
+        }
+
+        /* Single hash bucket does not fit into buffers */
+        if (ret == ENOSPC && count == 0 && iter->capacity < ctx->table.max_entries) {
+            ret = batch_iterator_reserve(ctx, iter->capacity * 2);
+            if (ret != NO_ERROR)
+                return ret;
+            continue;
+        }
+
+        pr_err("failed to get entries: %s\n", strerror(ret));
+        return ret;
+    }
+}
+
+static int batch_iterator_next(psabpf_table_entry_ctx_t *ctx, void **key, void **value)
+{
+    psabpf_table_batch_iterator_t *iter = &ctx->batch_iter;
+
+    while (iter->position >= iter->count) {
+        if (iter->finished) {
+            batch_iterator_restart(iter);
+            return ENODATA;
+        }
+        int ret = batch_iterator_fetch(ctx);
+        if (ret != NO_ERROR) {
+            batch_iterator_restart(iter);
+            return ret;
+        }
+    }
+
+    *key = (char *) iter->keys + (size_t) iter->position * ctx->table.key_size;
+    *value = (char *) iter->values + (size_t) iter->position * ctx->table.value_size;
+    iter->position++;
+
+    return NO_ERROR;
+}
+
+static bool batch_iteration_enabled(psabpf_table_entry_ctx_t *ctx)
+{
+    return ctx->batch_iter.batch_size > 0 && !ctx->batch_iter.not_supported && !ctx->is_ternary;
+}
+
+static psabpf_table_entry_t *parse_current_entry(psabpf_table_entry_ctx_t *ctx, const void *key,
+                                                 const void *key_mask, const void *value)
+{
+    psabpf_table_entry_free(&ctx->current_entry);
+    psabpf_table_entry_init(&ctx->current_entry);
+
+    /* Parse key */
+    int return_code = parse_table_key(ctx, &ctx->current_entry, key, key_mask);
+    if (return_code != NO_ERROR) {
+        pr_err("failed to parse entry: %s\n", strerror(return_code));
+        return NULL;
+    }
+
+    /* Parse value */
+    return_code = parse_table_value(ctx, &ctx->current_entry, value);
+    if (return_code != NO_ERROR) {
+        pr_err("failed to parse entry: %s\n", strerror(return_code));
+        return NULL;
+    }
+
+    return &ctx->current_entry;
+}
+
+static psabpf_table_entry_t *get_next_entry_batched(psabpf_table_entry_ctx_t *ctx, bool *fallback)
+{
+    void *key = NULL, *value = NULL;
+
+    *fallback = false;
+    if (ctx->table.fd < 0) {
+        pr_err("can't get entry: table not opened\n");
+        return NULL;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        pr_err("zero-size key or value is not supported\n");
+        return NULL;
+    }
+
+    int ret = batch_iterator_next(ctx, &key, &value);
+    if (ret == EAGAIN) {
+        *fallback = true;
+        return NULL;
+    }
+    if (ret != NO_ERROR)
+        return NULL;
+
+    return parse_current_entry(ctx, key, NULL, value);
+}
+
 psabpf_table_entry_t *psabpf_table_entry_get_next(psabpf_table_entry_ctx_t *ctx)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_GET_NEXT);
+
     psabpf_table_entry_t *ret_instance = NULL;
     void *value_buffer = NULL;
 
     if (ctx == NULL)
         return NULL;
 
+    if (batch_iteration_enabled(ctx)) {
+        bool fallback;
+        ret_instance = get_next_entry_batched(ctx, &fallback);
+        if (!fallback)
+            return ret_instance;
+    }
+
     if (psabpf_table_entry_goto_next_key(ctx) != NO_ERROR) {
         /* Error or no next key */
         return NULL;
@@ -2889,45 +4538,180 @@ psabpf_table_entry_t *psabpf_table_entry_get_next(psabpf_table_entry_ctx_t *ctx)
 
     value_buffer = malloc(ctx->table.value_size);
     if (value_buffer == NULL || ctx->current_raw_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         goto clean_up;
     }
 
-    int return_code = bpf_map_lookup_elem(ctx->table.fd, ctx->current_raw_key, value_buffer);
+    int return_code = map_ops->lookup_elem(ctx->table.fd, ctx->current_raw_key, value_buffer);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+        pr_err("failed to get entry: %s\n", strerror(return_code));
         goto clean_up;
     }
 
-    psabpf_table_entry_free(&ctx->current_entry);
-    psabpf_table_entry_init(&ctx->current_entry);
+    ret_instance = parse_current_entry(ctx, ctx->current_raw_key, ctx->current_raw_key_mask, value_buffer);
 
-    /* Parse key */
-    return_code = parse_table_key(ctx, &ctx->current_entry, ctx->current_raw_key, ctx->current_raw_key_mask);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
-        goto clean_up;
+clean_up:
+    if (value_buffer)
+        free(value_buffer);
+
+    return ret_instance;
+}
+
+int psabpf_table_entry_view_next(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view)
+{
+    STATS_SCOPE(PSABPF_STATS_TABLE_ENTRY_VIEW_NEXT);
+
+    void *key = NULL, *value = NULL;
+
+    if (ctx == NULL || view == NULL)
+        return EINVAL;
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        pr_err("zero-size key or value is not supported\n");
+        return ENOTSUP;
     }
 
-    /* Parse value */
-    return_code = parse_table_value(ctx, &ctx->current_entry, value_buffer);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
-        goto clean_up;
+    if (batch_iteration_enabled(ctx)) {
+        if (ctx->table.fd < 0) {
+            pr_err("can't get entry: table not opened\n");
+            return EBADF;
+        }
+        int ret = batch_iterator_next(ctx, &key, &value);
+        if (ret != EAGAIN) {
+            if (ret != NO_ERROR)
+                return ret;
+            view->key = key;
+            view->mask = NULL;
+            view->value = value;
+            view->key_size = ctx->table.key_size;
+            view->value_size = ctx->table.value_size;
+            return NO_ERROR;
+        }
     }
 
-    ret_instance = &ctx->current_entry;
+    /* Key by key, value is stored in the buffer of batch iterator */
+    int ret = psabpf_table_entry_goto_next_key(ctx);
+    if (ret != NO_ERROR)
+        return ret;
+    if (ctx->current_raw_key == NULL)
+        return ENODATA;
+    if ((ret = batch_iterator_reserve(ctx, 1)) != NO_ERROR)
+        return ret;
 
-clean_up:
-    if (value_buffer)
-        free(value_buffer);
+    if (map_ops->lookup_elem(ctx->table.fd, ctx->current_raw_key, ctx->batch_iter.values) != 0) {
+        ret = errno;
+        pr_err("failed to get entry: %s\n", strerror(ret));
+        return ret;
+    }
 
-    return ret_instance;
+    view->key = ctx->current_raw_key;
+    view->mask = ctx->is_ternary ? ctx->current_raw_key_mask : NULL;
+    view->value = ctx->batch_iter.values;
+    view->key_size = ctx->table.key_size;
+    view->value_size = ctx->table.value_size;
+
+    return NO_ERROR;
+}
+
+uint32_t psabpf_table_entry_view_get_action_id(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view)
+{
+    if (ctx == NULL || view == NULL || view->value == NULL || ctx->is_indirect)
+        return PSABPF_INVALID_ACTION_ID;
+
+    size_t offset = 0, size = sizeof(uint32_t);
+    if (ctx->layout != NULL) {
+        if (!ctx->layout->has_action_id)
+            return PSABPF_INVALID_ACTION_ID;
+        offset = ctx->layout->action_id.offset;
+        size = ctx->layout->action_id.size;
+    }
+    if (size > sizeof(uint32_t) || offset + size > view->value_size)
+        return PSABPF_INVALID_ACTION_ID;
+
+    uint32_t action_id = 0;
+    memcpy(&action_id, (const char *) view->value + offset, size);
+    return action_id;
+}
+
+uint32_t psabpf_table_entry_view_get_priority(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view)
+{
+    if (ctx == NULL || view == NULL || view->value == NULL || !ctx->is_ternary)
+        return 0;
+
+    size_t offset, size;
+    if (get_ternary_table_priority_md(ctx, &offset, &size) != NO_ERROR)
+        return 0;
+
+    uint32_t priority = 0;
+    memcpy(&priority, (const char *) view->value + offset, size);
+    return priority;
+}
+
+int psabpf_table_entry_view_get_key_field(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                          size_t index, const void **data, size_t *size)
+{
+    if (ctx == NULL || view == NULL || data == NULL || size == NULL)
+        return EINVAL;
+    if (ctx->layout == NULL)
+        return ENOTSUP;
+
+    const struct psabpf_table_layout *layout = ctx->layout;
+    if (layout->key_is_scalar) {
+        if (index != 0)
+            return ENOENT;
+        *data = view->key;
+        *size = view->key_size;
+        return NO_ERROR;
+    }
+    if (index >= layout->n_key_fields)
+        return ENOENT;
+
+    *data = (const char *) view->key + layout->key_fields[index].offset;
+    *size = layout->key_fields[index].size;
+    return NO_ERROR;
+}
+
+int psabpf_table_entry_view_get_action_param(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                             size_t index, const void **data, size_t *size)
+{
+    if (ctx == NULL || view == NULL || data == NULL || size == NULL)
+        return EINVAL;
+    if (ctx->layout == NULL)
+        return ENOTSUP;
+
+    uint32_t action_id = psabpf_table_entry_view_get_action_id(ctx, view);
+    if (action_id >= ctx->layout->n_actions)
+        return ENOENT;
+    const psabpf_table_action_layout_t *action = &ctx->layout->actions[action_id];
+    if (index >= action->n_params)
+        return ENOENT;
+
+    *data = (const char *) view->value + action->params[index].offset;
+    *size = action->params[index].size;
+    return NO_ERROR;
+}
+
+int psabpf_table_entry_view_decode(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_view_t *view,
+                                   psabpf_table_entry_t *entry)
+{
+    if (ctx == NULL || view == NULL || entry == NULL)
+        return EINVAL;
+
+    psabpf_table_entry_reset(entry);
+
+    int ret = parse_table_key(ctx, entry, view->key, view->mask);
+    if (ret == NO_ERROR)
+        ret = parse_table_value(ctx, entry, view->value);
+    if (ret != NO_ERROR)
+        pr_err("failed to parse entry: %s\n", strerror(ret));
+
+    return ret;
 }
 
 int psabpf_table_entry_get_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry)
 {
+    STATS_SCOPE(PSABPF_STATS_TABLE_GET_DEFAULT_ENTRY);
+
     if (ctx == NULL || entry == NULL)
         return EINVAL;
 
@@ -2939,28 +4723,27 @@ int psabpf_table_entry_get_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_t
         return EINVAL;
 
     if (ctx->default_entry.fd < 0) {
-        fprintf(stderr, "can't get default entry: table not opened or not exists\n");
+        pr_err("can't get default entry: table not opened or not exists\n");
         return EBADF;
     }
     if (ctx->default_entry.value_size == 0 || ctx->default_entry.value_size != ctx->table.value_size) {
-        fprintf(stderr, "invalid value size for a default entry\n");
+        pr_err("invalid value size for a default entry\n");
         return EINVAL;
     }
 
     /* Prepare entry - remove everything from entry */
-    psabpf_table_entry_free(entry);
-    psabpf_table_entry_init(entry);
+    psabpf_table_entry_reset(entry);
 
     value_buffer = malloc(ctx->table.value_size);
     if (value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return ENOMEM;
     }
 
-    return_code = bpf_map_lookup_elem(ctx->default_entry.fd, &key_buffer, value_buffer);
+    return_code = map_ops->lookup_elem(ctx->default_entry.fd, &key_buffer, value_buffer);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to get default entry: %s\n", strerror(return_code));
+        pr_err("failed to get default entry: %s\n", strerror(return_code));
         goto clean_up;
     }
 
@@ -2969,7 +4752,7 @@ int psabpf_table_entry_get_default_entry(psabpf_table_entry_ctx_t *ctx, psabpf_t
     /* Parse value */
     return_code = parse_table_value(ctx, entry, value_buffer);
     if (return_code != NO_ERROR)
-        fprintf(stderr, "failed to parse default entry: %s\n", strerror(return_code));
+        pr_err("failed to parse default entry: %s\n", strerror(return_code));
 
 clean_up:
     if (value_buffer != NULL)
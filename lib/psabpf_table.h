@@ -25,6 +25,8 @@ int clear_table_cache(psabpf_bpf_map_descriptor_t *map);
 
 void move_action(psabpf_action_t *dst, psabpf_action_t *src);
 int delete_all_map_entries(psabpf_bpf_map_descriptor_t *map);
+/* Value buffer is sized with value_size of the descriptor, set it properly for per-CPU maps */
+int read_all_map_entries(psabpf_bpf_map_descriptor_t *map, char **keys_out, char **values_out, size_t *n_keys_out);
 int construct_buffer(char * buffer, size_t buffer_len,
                      psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
                      int (*btf_info_func)(char *, psabpf_table_entry_ctx_t *, psabpf_table_entry_t *),
@@ -36,4 +38,117 @@ int parse_table_key(psabpf_table_entry_ctx_t *ctx, psabpf_table_entry_t *entry,
 int open_ternary_table(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *ctx, const char *name);
 int psabpf_table_entry_goto_next_key(psabpf_table_entry_ctx_t *ctx);
 
+/* Flat layout of table key and value, compiled once from BTF in psabpf_table_entry_ctx_tblname() */
+typedef struct psabpf_table_field_layout {
+    size_t offset;
+    size_t size;
+    enum psabpf_matchkind_t match_kind;
+    bool network_order;
+} psabpf_table_field_layout_t;
+
+typedef struct psabpf_table_action_layout {
+    size_t n_params;
+    psabpf_table_field_layout_t *params;
+} psabpf_table_action_layout_t;
+
+struct psabpf_table_layout {
+    /* Read-only after it is compiled, cloned contexts share it */
+    unsigned refcount;
+
+    /* key */
+    bool key_is_scalar;
+    bool has_lpm_prefix;
+    psabpf_table_field_layout_t lpm_prefix;
+    size_t n_key_fields;
+    psabpf_table_field_layout_t *key_fields;
+
+    /* value, offsets of direct objects and references are stored in the table context */
+    bool has_action_id;
+    psabpf_table_field_layout_t action_id;
+    bool has_priority;
+    psabpf_table_field_layout_t priority;
+    bool has_actions;
+    size_t n_actions;  /* indexed by action ID */
+    psabpf_table_action_layout_t *actions;
+};
+
+/* Table published to the data plane through slot 0 of the "<name>_outer" map (map-in-map) */
+struct psabpf_table_shadow {
+    psabpf_bpf_map_descriptor_t outer;
+    uint32_t map_flags;
+    /* Instance visible to the data plane while shadow table is being built, -1 otherwise.
+     * When it is valid, ctx->table refers to the shadow table. */
+    int live_fd;
+    /* live instance is the map pinned under the table name */
+    bool live_is_template;
+    bool saved_defer_cache_invalidation;
+    bool saved_cache_invalidation_pending;
+};
+
+int open_table_outer_map(psabpf_context_t *psabpf_ctx, psabpf_table_entry_ctx_t *ctx, const char *name);
+void free_table_shadow(psabpf_table_entry_ctx_t *ctx);
+int clone_table_shadow(psabpf_table_entry_ctx_t *dst, psabpf_table_entry_ctx_t *src);
+
+int compile_table_layout(psabpf_table_entry_ctx_t *ctx);
+void free_table_layout(psabpf_table_entry_ctx_t *ctx);
+
+/* Ternary table: layout of the value in the prefixes map */
+struct ternary_table_prefix_metadata {
+    size_t tuple_id_offset;
+    size_t tuple_id_size;
+    size_t next_mask_offset;
+    size_t next_mask_size;
+    size_t has_next_offset;
+    size_t has_next_size;
+};
+
+int get_ternary_table_prefix_md(psabpf_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md);
+int get_ternary_table_priority_md(psabpf_table_entry_ctx_t *ctx, size_t *offset, size_t *size);
+
+/* Ternary table: userspace mirror of the list of masks, loaded once from the prefixes map */
+typedef struct psabpf_ternary_prefix_node {
+    char *mask;
+    uint32_t tuple_id;
+    uint32_t max_priority;
+    size_t prev;
+    size_t next;
+} psabpf_ternary_prefix_node_t;
+
+struct psabpf_ternary_prefixes {
+    struct ternary_table_prefix_metadata md;
+    size_t mask_size;
+
+    /* node 0 is the list head (all-zero mask) */
+    size_t n_nodes;
+    size_t capacity;
+    psabpf_ternary_prefix_node_t *nodes;
+    size_t tail;
+
+    /* mask -> node, open addressing */
+    size_t *index;
+    size_t index_mask;
+
+    /* max_priority of nodes is valid only after tuples were scanned or when there were no masks on load */
+    bool priorities_known;
+
+    uint32_t max_tuple_id;
+    size_t n_free_tuple_ids;
+    size_t free_tuple_ids_capacity;
+    uint32_t *free_tuple_ids;
+
+    /* tuple ID -> FD of the inner map, -1 when not opened yet */
+    size_t n_tuple_fds;
+    int *tuple_fds;
+};
+
+int ternary_prefixes_load(psabpf_table_entry_ctx_t *ctx);
+void ternary_prefixes_free(psabpf_table_entry_ctx_t *ctx);
+int ternary_prefixes_find(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t *tuple_id);
+int ternary_prefixes_add(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t priority, uint32_t *tuple_id);
+void ternary_prefixes_update_priority(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t priority);
+int ternary_prefixes_remove(psabpf_table_entry_ctx_t *ctx, const char *mask);
+/* Returned FD is owned by the mirror, it is valid until the tuple is removed or the mirror is freed */
+int ternary_prefixes_get_tuple_fd(psabpf_table_entry_ctx_t *ctx, uint32_t tuple_id, int *fd);
+int ternary_prefixes_cache_tuple_fd(psabpf_table_entry_ctx_t *ctx, uint32_t tuple_id, int fd);
+
 #endif  /* P4C_PSABPF_TABLE_H */
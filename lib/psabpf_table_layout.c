@@ -0,0 +1,229 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bpf/btf.h>
+#include <linux/bpf.h>
+#include <linux/btf.h>
+
+#include <psabpf.h>
+#include "btf.h"
+#include "psabpf_table.h"
+
+static int compile_member_layout(struct btf *btf, uint32_t type_id, const char *name,
+                                 psabpf_table_field_layout_t *field)
+{
+    psabtf_struct_member_md_t md = {};
+    if (psabtf_get_member_md_by_name(btf, type_id, name, &md) != NO_ERROR)
+        return ENOENT;
+
+    field->offset = md.bit_offset / 8;
+    field->size = psabtf_get_type_size_by_id(btf, md.effective_type_id);
+    field->match_kind = PSABPF_EXACT;
+    field->network_order = false;
+
+    return NO_ERROR;
+}
+
+static int compile_key_layout(psabpf_table_entry_ctx_t *ctx, struct psabpf_table_layout *layout)
+{
+    struct btf *btf = ctx->btf_metadata.btf;
+    uint32_t key_type_id = psabtf_get_member_type_id_by_name(btf, ctx->table.btf_type_id, "key");
+    const struct btf_type *key_type = psabtf_get_type_by_id(btf, key_type_id);
+    if (key_type == NULL)
+        return ENOENT;
+
+    if (btf_kind(key_type) == BTF_KIND_INT) {
+        layout->key_is_scalar = true;
+        return NO_ERROR;
+    }
+    if (btf_kind(key_type) != BTF_KIND_STRUCT)
+        return EINVAL;
+
+    unsigned entries = btf_vlen(key_type);
+    if (entries == 1) {
+        psabtf_struct_member_md_t dummy_md = {};
+        if (psabtf_get_member_md_by_name(btf, key_type_id, "__dummy_table_key", &dummy_md) == NO_ERROR)
+            return NO_ERROR;  /* table do not define key */
+    }
+
+    unsigned first_field = 0;
+    if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        psabtf_struct_member_md_t prefix_md = {};
+        if (psabtf_get_member_md_by_index(btf, key_type_id, 0, &prefix_md) != NO_ERROR)
+            return EINVAL;
+        layout->has_lpm_prefix = true;
+        layout->lpm_prefix.offset = prefix_md.bit_offset / 8;
+        layout->lpm_prefix.size = psabtf_get_type_size_by_id(btf, prefix_md.effective_type_id);
+        first_field = 1;
+    }
+    if (entries <= first_field)
+        return NO_ERROR;
+
+    layout->key_fields = calloc(entries - first_field, sizeof(psabpf_table_field_layout_t));
+    if (layout->key_fields == NULL)
+        return ENOMEM;
+    layout->n_key_fields = entries - first_field;
+
+    const struct btf_member *member = btf_members(key_type) + first_field;
+    for (unsigned i = first_field; i < entries; i++, member++) {
+        psabpf_table_field_layout_t *field = &layout->key_fields[i - first_field];
+
+        /* assume that every field is byte aligned */
+        field->offset = btf_member_bit_offset(key_type, i) / 8;
+        field->size = psabtf_get_type_size_by_id(btf, member->type);
+        if (field->size == 0 || field->offset + field->size > ctx->table.key_size)
+            return EINVAL;
+
+        /* Match kind can't be determined from BTF for every table type, this is only a hint */
+        field->match_kind = PSABPF_EXACT;
+        if (ctx->is_ternary) {
+            field->match_kind = PSABPF_TERNARY;
+        } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE && i + 1 == entries) {
+            /* Last field is lpm, stored in the network byte order */
+            field->match_kind = PSABPF_LPM;
+            field->network_order = true;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int compile_action_layout(struct btf *btf, uint32_t union_type_id, size_t union_offset,
+                                 uint16_t action_id, psabpf_table_action_layout_t *action, size_t value_size)
+{
+    psabtf_struct_member_md_t action_md = {};
+    if (psabtf_get_member_md_by_index(btf, union_type_id, action_id, &action_md) != NO_ERROR)
+        return EINVAL;
+
+    const struct btf_type *action_type = psabtf_get_type_by_id(btf, action_md.effective_type_id);
+    if (action_type == NULL || !btf_is_struct(action_type))
+        return EINVAL;
+
+    unsigned n_params = btf_vlen(action_type);
+    if (n_params == 0)
+        return NO_ERROR;
+
+    action->params = calloc(n_params, sizeof(psabpf_table_field_layout_t));
+    if (action->params == NULL)
+        return ENOMEM;
+    action->n_params = n_params;
+
+    const size_t base_offset = union_offset + action_md.bit_offset / 8;
+    for (unsigned i = 0; i < n_params; i++) {
+        psabtf_struct_member_md_t param_md = {};
+        if (psabtf_get_member_md_by_index(btf, action_md.effective_type_id, i, &param_md) != NO_ERROR)
+            return EINVAL;
+
+        action->params[i].offset = base_offset + param_md.bit_offset / 8;
+        action->params[i].size = psabtf_get_type_size_by_id(btf, param_md.effective_type_id);
+        action->params[i].match_kind = PSABPF_EXACT;
+        if (action->params[i].offset + action->params[i].size > value_size)
+            return EINVAL;
+    }
+
+    return NO_ERROR;
+}
+
+static int compile_value_layout(psabpf_table_entry_ctx_t *ctx, struct psabpf_table_layout *layout)
+{
+    struct btf *btf = ctx->btf_metadata.btf;
+    uint32_t value_type_id = psabtf_get_member_type_id_by_name(btf, ctx->table.btf_type_id, "value");
+    const struct btf_type *value_type = psabtf_get_type_by_id(btf, value_type_id);
+    if (value_type == NULL || btf_kind(value_type) != BTF_KIND_STRUCT)
+        return EINVAL;
+
+    /* All of them are optional, e.g. indirect tables have no action */
+    layout->has_action_id = compile_member_layout(btf, value_type_id, "action", &layout->action_id) == NO_ERROR;
+    layout->has_priority = compile_member_layout(btf, value_type_id, "priority", &layout->priority) == NO_ERROR;
+
+    psabtf_struct_member_md_t union_md = {};
+    if (psabtf_get_member_md_by_name(btf, value_type_id, "u", &union_md) != NO_ERROR)
+        return NO_ERROR;
+
+    const struct btf_type *union_type = psabtf_get_type_by_id(btf, union_md.effective_type_id);
+    if (union_type == NULL || btf_kind(union_type) != BTF_KIND_UNION)
+        return EINVAL;
+
+    unsigned n_actions = btf_vlen(union_type);
+    layout->has_actions = true;
+    if (n_actions == 0)
+        return NO_ERROR;
+
+    layout->actions = calloc(n_actions, sizeof(psabpf_table_action_layout_t));
+    if (layout->actions == NULL)
+        return ENOMEM;
+    layout->n_actions = n_actions;
+
+    for (unsigned i = 0; i < n_actions; i++) {
+        int ret = compile_action_layout(btf, union_md.effective_type_id, union_md.bit_offset / 8,
+                                        i, &layout->actions[i], ctx->table.value_size);
+        if (ret != NO_ERROR)
+            return ret;
+    }
+
+    return NO_ERROR;
+}
+
+int compile_table_layout(psabpf_table_entry_ctx_t *ctx)
+{
+    free_table_layout(ctx);
+
+    if (ctx->btf_metadata.btf == NULL || ctx->table.btf_type_id == 0)
+        return ENOENT;
+
+    struct psabpf_table_layout *layout = calloc(1, sizeof(struct psabpf_table_layout));
+    if (layout == NULL)
+        return ENOMEM;
+    layout->refcount = 1;
+    ctx->layout = layout;
+
+    int ret = compile_key_layout(ctx, layout);
+    if (ret == NO_ERROR)
+        ret = compile_value_layout(ctx, layout);
+
+    /* Without layout table still works, but every entry is serialized using BTF */
+    if (ret != NO_ERROR)
+        free_table_layout(ctx);
+
+    return ret;
+}
+
+void free_table_layout(psabpf_table_entry_ctx_t *ctx)
+{
+    struct psabpf_table_layout *layout = ctx->layout;
+    if (layout == NULL)
+        return;
+    ctx->layout = NULL;
+    if (__atomic_sub_fetch(&layout->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    if (layout->key_fields != NULL)
+        free(layout->key_fields);
+    if (layout->actions != NULL) {
+        for (size_t i = 0; i < layout->n_actions; i++) {
+            if (layout->actions[i].params != NULL)
+                free(layout->actions[i].params);
+        }
+        free(layout->actions);
+    }
+
+    free(layout);
+}
@@ -0,0 +1,709 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <bpf/bpf.h>
+
+#include <psabpf.h>
+#include "common.h"
+#include "psabpf_txn.h"
+#include "psabpf_table.h"
+#include "psabpf_map_ops.h"
+
+/*
+ * Userspace copy of the list of masks stored in the <table>_prefixes map. The data plane
+ * iterates over masks starting from the head (all-zero mask) using next_tuple_mask field,
+ * so every change of the list requires update of the predecessor. The mirror allows to find
+ * predecessor, tail and free tuple ID without walking the list in the kernel.
+ */
+
+#define NO_NODE ((size_t) -1)
+
+static size_t hash_mask(const char *mask, size_t size)
+{
+    /* FNV-1a */
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char) mask[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int rebuild_index(struct psabpf_ternary_prefixes *p)
+{
+    size_t slots = 16;
+    while (slots < p->n_nodes * 2)
+        slots *= 2;
+
+    size_t *index = malloc(slots * sizeof(size_t));
+    if (index == NULL)
+        return ENOMEM;
+    for (size_t i = 0; i < slots; i++)
+        index[i] = NO_NODE;
+
+    for (size_t n = 0; n < p->n_nodes; n++) {
+        size_t slot = hash_mask(p->nodes[n].mask, p->mask_size) & (slots - 1);
+        while (index[slot] != NO_NODE)
+            slot = (slot + 1) & (slots - 1);
+        index[slot] = n;
+    }
+
+    if (p->index != NULL)
+        free(p->index);
+    p->index = index;
+    p->index_mask = slots - 1;
+
+    return NO_ERROR;
+}
+
+static size_t find_node(struct psabpf_ternary_prefixes *p, const char *mask)
+{
+    size_t slot = hash_mask(mask, p->mask_size) & p->index_mask;
+    while (p->index[slot] != NO_NODE) {
+        size_t n = p->index[slot];
+        if (memcmp(p->nodes[n].mask, mask, p->mask_size) == 0)
+            return n;
+        slot = (slot + 1) & p->index_mask;
+    }
+    return NO_NODE;
+}
+
+static int append_node(struct psabpf_ternary_prefixes *p, const char *mask, uint32_t tuple_id)
+{
+    if (p->n_nodes == p->capacity) {
+        size_t capacity = p->capacity > 0 ? p->capacity * 2 : 16;
+        psabpf_ternary_prefix_node_t *nodes = realloc(p->nodes, capacity * sizeof(psabpf_ternary_prefix_node_t));
+        if (nodes == NULL)
+            return ENOMEM;
+        p->nodes = nodes;
+        p->capacity = capacity;
+    }
+
+    psabpf_ternary_prefix_node_t *node = &p->nodes[p->n_nodes];
+    node->mask = malloc(p->mask_size);
+    if (node->mask == NULL)
+        return ENOMEM;
+    memcpy(node->mask, mask, p->mask_size);
+    node->tuple_id = tuple_id;
+    node->max_priority = 0;
+    node->prev = NO_NODE;
+    node->next = NO_NODE;
+    p->n_nodes++;
+
+    if (p->n_nodes * 2 > p->index_mask + 1)
+        return rebuild_index(p);
+
+    size_t slot = hash_mask(mask, p->mask_size) & p->index_mask;
+    while (p->index[slot] != NO_NODE)
+        slot = (slot + 1) & p->index_mask;
+    p->index[slot] = p->n_nodes - 1;
+
+    return NO_ERROR;
+}
+
+static int push_free_tuple_id(struct psabpf_ternary_prefixes *p, uint32_t tuple_id)
+{
+    if (p->n_free_tuple_ids == p->free_tuple_ids_capacity) {
+        size_t capacity = p->free_tuple_ids_capacity > 0 ? p->free_tuple_ids_capacity * 2 : 16;
+        uint32_t *ids = realloc(p->free_tuple_ids, capacity * sizeof(uint32_t));
+        if (ids == NULL)
+            return ENOMEM;
+        p->free_tuple_ids = ids;
+        p->free_tuple_ids_capacity = capacity;
+    }
+    p->free_tuple_ids[p->n_free_tuple_ids++] = tuple_id;
+    return NO_ERROR;
+}
+
+/* Builds value of the prefixes map for given node, the rest of the value is zeroed like in the data plane */
+static void build_prefix_value(struct psabpf_ternary_prefixes *p, size_t n, char *value, size_t value_size)
+{
+    psabpf_ternary_prefix_node_t *node = &p->nodes[n];
+
+    memset(value, 0, value_size);
+    *((uint32_t *) (value + p->md.tuple_id_offset)) = node->tuple_id;
+    if (node->next != NO_NODE) {
+        memcpy(value + p->md.next_mask_offset, p->nodes[node->next].mask, p->md.next_mask_size);
+        *((uint8_t *) (value + p->md.has_next_offset)) = 1;
+    }
+}
+
+/* Walks list in the kernel once and finds free tuple IDs */
+static int load_prefixes(psabpf_table_entry_ctx_t *ctx, struct psabpf_ternary_prefixes *p)
+{
+    char *key = calloc(1, ctx->prefixes.key_size);
+    char *value = calloc(1, ctx->prefixes.value_size);
+    uint8_t *used_ids = NULL;
+    int err = NO_ERROR;
+
+    if (key == NULL || value == NULL) {
+        err = ENOMEM;
+        goto clean_up;
+    }
+
+    /* head always exists in the mirror, even if it is not present in the map yet */
+    if ((err = append_node(p, key, 0)) != NO_ERROR)
+        goto clean_up;
+    p->tail = 0;
+
+    if (map_ops->lookup_elem(ctx->prefixes.fd, key, value) != 0) {
+        /* no prefixes, so also no priorities to read */
+        p->priorities_known = true;
+        goto clean_up;
+    }
+
+    /* number of prefixes is limited by the map size, use it to detect loops */
+    for (unsigned i = 0; i < ctx->prefixes.max_entries; i++) {
+        uint8_t has_next = *((uint8_t *) (value + p->md.has_next_offset));
+        if (has_next == 0)
+            break;
+
+        memcpy(key, value + p->md.next_mask_offset, p->md.next_mask_size);
+        if (map_ops->lookup_elem(ctx->prefixes.fd, key, value) != 0 || find_node(p, key) != NO_NODE) {
+            pr_err("detected data inconsistency in prefixes, aborting\n");
+            err = EPERM;
+            goto clean_up;
+        }
+
+        uint32_t tuple_id = *((uint32_t *) (value + p->md.tuple_id_offset));
+        if ((err = append_node(p, key, tuple_id)) != NO_ERROR)
+            goto clean_up;
+
+        size_t n = p->n_nodes - 1;
+        p->nodes[n].prev = p->tail;
+        p->nodes[p->tail].next = n;
+        p->tail = n;
+        if (tuple_id > p->max_tuple_id)
+            p->max_tuple_id = tuple_id;
+    }
+
+    /* IDs not used by any prefix below the highest one are free */
+    used_ids = calloc((size_t) p->max_tuple_id + 1, sizeof(uint8_t));
+    if (used_ids == NULL) {
+        err = ENOMEM;
+        goto clean_up;
+    }
+    for (size_t n = 0; n < p->n_nodes; n++)
+        used_ids[p->nodes[n].tuple_id] = 1;
+    for (uint32_t id = p->max_tuple_id; id > 0; id--) {
+        if (used_ids[id] == 0 && (err = push_free_tuple_id(p, id)) != NO_ERROR)
+            goto clean_up;
+    }
+
+clean_up:
+    if (key != NULL)
+        free(key);
+    if (value != NULL)
+        free(value);
+    if (used_ids != NULL)
+        free(used_ids);
+
+    return err;
+}
+
+int ternary_prefixes_load(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx->prefixes_mirror != NULL)
+        return NO_ERROR;
+
+    struct psabpf_ternary_prefixes *p = calloc(1, sizeof(struct psabpf_ternary_prefixes));
+    if (p == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+    ctx->prefixes_mirror = p;
+
+    int err = get_ternary_table_prefix_md(ctx, &p->md);
+    if (err != NO_ERROR) {
+        pr_err("failed to obtain offsets and sizes of prefix\n");
+        goto err;
+    }
+    p->mask_size = ctx->prefixes.key_size;
+
+    if ((err = rebuild_index(p)) != NO_ERROR || (err = load_prefixes(ctx, p)) != NO_ERROR)
+        goto err;
+
+    return NO_ERROR;
+
+err:
+    ternary_prefixes_free(ctx);
+    return err;
+}
+
+void ternary_prefixes_free(psabpf_table_entry_ctx_t *ctx)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    if (p == NULL)
+        return;
+
+    if (p->nodes != NULL) {
+        for (size_t n = 0; n < p->n_nodes; n++)
+            free(p->nodes[n].mask);
+        free(p->nodes);
+    }
+    if (p->index != NULL)
+        free(p->index);
+    if (p->free_tuple_ids != NULL)
+        free(p->free_tuple_ids);
+    if (p->tuple_fds != NULL) {
+        for (size_t i = 0; i < p->n_tuple_fds; i++)
+            close_object_fd(&p->tuple_fds[i]);
+        free(p->tuple_fds);
+    }
+
+    free(p);
+    ctx->prefixes_mirror = NULL;
+}
+
+int ternary_prefixes_find(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t *tuple_id)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    size_t n = find_node(p, mask);
+
+    /* head is not a real prefix */
+    if (n == NO_NODE || n == 0)
+        return ENOENT;
+
+    *tuple_id = p->nodes[n].tuple_id;
+    return NO_ERROR;
+}
+
+/* Reads every entry of the tuple with batch lookups, returns number of entries and the highest priority */
+static int scan_tuple(psabpf_table_entry_ctx_t *ctx, uint32_t tuple_id, uint32_t *n_entries, uint32_t *max_priority)
+{
+    size_t priority_offset, priority_size;
+    char *keys = NULL, *values = NULL;
+    size_t n = 0;
+    int fd = -1;
+    int err = get_ternary_table_priority_md(ctx, &priority_offset, &priority_size);
+    if (err != NO_ERROR)
+        return err;
+    *n_entries = 0;
+    *max_priority = 0;
+    err = ternary_prefixes_get_tuple_fd(ctx, tuple_id, &fd);
+    if (err == ENOENT)
+        return NO_ERROR;  /* tuple not created yet */
+    if (err != NO_ERROR)
+        return err;
+
+    /* tuples have the layout of the table */
+    psabpf_bpf_map_descriptor_t tuple = ctx->table;
+    tuple.fd = fd;
+    err = read_all_map_entries(&tuple, &keys, &values, &n);
+    if (err != NO_ERROR)
+        return err;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t priority = 0;
+        memcpy(&priority, values + i * tuple.value_size + priority_offset, priority_size);
+        if (priority > *max_priority)
+            *max_priority = priority;
+    }
+    *n_entries = n;
+
+    if (keys != NULL)
+        free(keys);
+    if (values != NULL)
+        free(values);
+
+    return NO_ERROR;
+}
+
+static int scan_all_tuples(psabpf_table_entry_ctx_t *ctx, psabpf_table_tuple_stats_t *stats)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    size_t i = 0;
+
+    /* in the data plane order */
+    for (size_t n = p->nodes[0].next; n != NO_NODE; n = p->nodes[n].next) {
+        uint32_t n_entries = 0;
+        int err = scan_tuple(ctx, p->nodes[n].tuple_id, &n_entries, &p->nodes[n].max_priority);
+        if (err != NO_ERROR)
+            return err;
+        if (stats != NULL) {
+            stats[i].tuple_id = p->nodes[n].tuple_id;
+            stats[i].n_entries = n_entries;
+            stats[i].max_priority = p->nodes[n].max_priority;
+        }
+        i++;
+    }
+    p->priorities_known = true;
+
+    return NO_ERROR;
+}
+
+static int write_node(psabpf_table_entry_ctx_t *ctx, size_t n, char *value, uint64_t flags)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+
+    build_prefix_value(p, n, value, ctx->prefixes.value_size);
+    if (txn_map_update_elem(ctx->prefixes.fd, p->nodes[n].mask, value, flags) != 0)
+        return errno;
+
+    return NO_ERROR;
+}
+
+int ternary_prefixes_add(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t priority, uint32_t *tuple_id)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    char *value = malloc(ctx->prefixes.value_size);
+    int err = NO_ERROR;
+
+    if (value == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+
+    uint32_t new_tuple_id;
+    if (p->n_free_tuple_ids > 0)
+        new_tuple_id = p->free_tuple_ids[p->n_free_tuple_ids - 1];
+    else
+        new_tuple_id = p->max_tuple_id + 1;
+    if (ctx->tuple_map.max_entries != 0 && new_tuple_id >= ctx->tuple_map.max_entries) {
+        pr_err("no free tuple for new prefix\n");
+        err = ENOSPC;
+        goto clean_up;
+    }
+
+    /* New mask goes after the last tuple with not lower priority. Reading priorities of existing tuples
+     * would cost a read of the whole table, so until they are known (the table has no masks yet or they
+     * were read by psabpf_table_ternary_reorder() or stats) the mask is added at the end. */
+    size_t prev = 0;
+    if (p->priorities_known) {
+        while (p->nodes[prev].next != NO_NODE && p->nodes[p->nodes[prev].next].max_priority >= priority)
+            prev = p->nodes[prev].next;
+    } else {
+        prev = p->tail;
+    }
+
+    if ((err = append_node(p, mask, new_tuple_id)) != NO_ERROR)
+        goto clean_up;
+    size_t n = p->n_nodes - 1;
+    size_t next = p->nodes[prev].next;
+    p->nodes[n].max_priority = priority;
+    p->nodes[n].prev = prev;
+    p->nodes[n].next = next;
+
+    /* First add new prefix pointing to the successor, so it becomes visible at once in the next step */
+    if ((err = write_node(ctx, n, value, BPF_NOEXIST)) != NO_ERROR)
+        goto inconsistent;
+
+    /* Update previous node (it might be head which does not exist yet) */
+    p->nodes[prev].next = n;
+    if (next != NO_NODE)
+        p->nodes[next].prev = n;
+    else
+        p->tail = n;
+    if ((err = write_node(ctx, prev, value, BPF_ANY)) != NO_ERROR)
+        goto inconsistent;
+
+    if (p->n_free_tuple_ids > 0)
+        p->n_free_tuple_ids--;
+    else
+        p->max_tuple_id = new_tuple_id;
+    *tuple_id = new_tuple_id;
+    goto clean_up;
+
+inconsistent:
+    /* Other process may have modified prefixes, mirror will be reloaded on next use */
+    ternary_prefixes_free(ctx);
+
+clean_up:
+    free(value);
+    return err;
+}
+
+void ternary_prefixes_update_priority(psabpf_table_entry_ctx_t *ctx, const char *mask, uint32_t priority)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    size_t n = find_node(p, mask);
+    if (n == NO_NODE)
+        return;
+
+    /* order is restored by psabpf_table_ternary_reorder() */
+    if (priority > p->nodes[n].max_priority)
+        p->nodes[n].max_priority = priority;
+}
+
+static void remove_node(struct psabpf_ternary_prefixes *p, size_t n)
+{
+    psabpf_ternary_prefix_node_t *node = &p->nodes[n];
+    if (node->prev != NO_NODE)
+        p->nodes[node->prev].next = node->next;
+    if (node->next != NO_NODE)
+        p->nodes[node->next].prev = node->prev;
+    if (p->tail == n)
+        p->tail = node->prev;
+    free(node->mask);
+
+    /* move the last node into the gap */
+    size_t last = p->n_nodes - 1;
+    if (n != last) {
+        p->nodes[n] = p->nodes[last];
+        if (p->nodes[n].prev != NO_NODE)
+            p->nodes[p->nodes[n].prev].next = n;
+        if (p->nodes[n].next != NO_NODE)
+            p->nodes[p->nodes[n].next].prev = n;
+        if (p->tail == last)
+            p->tail = n;
+    }
+    p->n_nodes--;
+}
+
+int ternary_prefixes_remove(psabpf_table_entry_ctx_t *ctx, const char *mask)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    size_t n = find_node(p, mask);
+    if (n == NO_NODE || n == 0) {
+        pr_err("detected data inconsistency in prefixes: no previous prefix\n");
+        return ENOENT;
+    }
+
+    char *value = malloc(ctx->prefixes.value_size);
+    if (value == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+
+    /* predecessor takes over successor of the removed prefix */
+    size_t prev = p->nodes[n].prev;
+    size_t next = p->nodes[n].next;
+    p->nodes[prev].next = next;
+    build_prefix_value(p, prev, value, ctx->prefixes.value_size);
+    p->nodes[prev].next = n;
+
+    int err = NO_ERROR;
+    if (txn_map_update_elem(ctx->prefixes.fd, p->nodes[prev].mask, value, BPF_EXIST) != 0) {
+        err = errno;
+        pr_err("failed to update previous prefix: %s\n", strerror(err));
+        ternary_prefixes_free(ctx);
+        goto clean_up;
+    }
+
+    /* there are no prefixes that points to removing prefix, so it can be safely removed now */
+    if (txn_map_delete_elem(ctx->prefixes.fd, mask) != 0)
+        pr_warn("warning: failed to remove prefix from prefixes list\n");
+
+    /* also remove tuple from tuple_map */
+    uint32_t tuple_id = p->nodes[n].tuple_id;
+    if (txn_map_delete_elem(ctx->tuple_map.fd, &tuple_id) != 0)
+        pr_warn("warning: failed to remove tuple from tuples_map\n");
+    if (tuple_id < p->n_tuple_fds)
+        close_object_fd(&p->tuple_fds[tuple_id]);
+
+    remove_node(p, n);
+    if (rebuild_index(p) != NO_ERROR || push_free_tuple_id(p, tuple_id) != NO_ERROR) {
+        /* mirror can't be kept, load it again on next use */
+        ternary_prefixes_free(ctx);
+    }
+
+clean_up:
+    free(value);
+    return err;
+}
+
+int ternary_prefixes_cache_tuple_fd(psabpf_table_entry_ctx_t *ctx, uint32_t tuple_id, int fd)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+
+    if (tuple_id >= p->n_tuple_fds) {
+        size_t n = p->n_tuple_fds > 0 ? p->n_tuple_fds * 2 : 16;
+        if (n <= tuple_id)
+            n = (size_t) tuple_id + 1;
+        int *fds = realloc(p->tuple_fds, n * sizeof(int));
+        if (fds == NULL) {
+            pr_err("not enough memory\n");
+            close_object_fd(&fd);
+            return ENOMEM;
+        }
+        for (size_t i = p->n_tuple_fds; i < n; i++)
+            fds[i] = -1;
+        p->tuple_fds = fds;
+        p->n_tuple_fds = n;
+    }
+
+    close_object_fd(&p->tuple_fds[tuple_id]);
+    p->tuple_fds[tuple_id] = fd;
+
+    return NO_ERROR;
+}
+
+int ternary_prefixes_get_tuple_fd(psabpf_table_entry_ctx_t *ctx, uint32_t tuple_id, int *fd)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+
+    if (tuple_id < p->n_tuple_fds && p->tuple_fds[tuple_id] >= 0) {
+        *fd = p->tuple_fds[tuple_id];
+        return NO_ERROR;
+    }
+
+    uint32_t inner_map_id;
+    if (map_ops->lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0)
+        return ENOENT;
+
+    int new_fd = map_ops->get_fd_by_id(inner_map_id);
+    if (new_fd < 0) {
+        int err = errno;
+        pr_err("failed to open tuple %u: %s\n", tuple_id, strerror(err));
+        return err;
+    }
+
+    int err = ternary_prefixes_cache_tuple_fd(ctx, tuple_id, new_fd);
+    if (err == NO_ERROR)
+        *fd = new_fd;
+
+    return err;
+}
+
+/* Moves node n after node dst, which is before n in the list. Every mask has a single node (mask is
+ * the key), so the node can't be copied; instead the tail is linked to the successor of dst first.
+ * Until the last step the walk from head ends in a cycle which goes through every mask, so the data
+ * plane may visit some masks twice (up to its limit of tuples per lookup), but never misses one.
+ *   before:  dst -> d1 .. p -> n -> nx .. tail
+ *   after:   dst -> n -> d1 .. p -> nx .. tail  */
+static int move_node_after(psabpf_table_entry_ctx_t *ctx, size_t n, size_t dst, char *value)
+{
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    size_t prev = p->nodes[n].prev;
+    size_t next = p->nodes[n].next;
+    size_t dst_next = p->nodes[dst].next;
+    size_t tail = p->tail;
+    int err;
+
+    /* 1. tail -> d1, when n is the tail this already links it at the new place */
+    p->nodes[tail].next = dst_next;
+    if ((err = write_node(ctx, tail, value, BPF_EXIST)) != NO_ERROR)
+        return err;
+
+    /* 2. dst -> n, masks from d1 to p are still reached through the tail */
+    p->nodes[dst].next = n;
+    if ((err = write_node(ctx, dst, value, BPF_ANY)) != NO_ERROR)
+        return err;
+
+    /* 3. p -> nx, p becomes the tail when n was the last one */
+    p->nodes[prev].next = next;
+    if ((err = write_node(ctx, prev, value, BPF_EXIST)) != NO_ERROR)
+        return err;
+
+    if (next != NO_NODE) {
+        /* 4. n -> d1 */
+        p->nodes[n].next = dst_next;
+        if ((err = write_node(ctx, n, value, BPF_EXIST)) != NO_ERROR)
+            return err;
+
+        /* 5. tail ends the list again */
+        p->nodes[tail].next = NO_NODE;
+        if ((err = write_node(ctx, tail, value, BPF_EXIST)) != NO_ERROR)
+            return err;
+        p->nodes[next].prev = prev;
+    } else {
+        p->tail = prev;
+    }
+    p->nodes[n].prev = dst;
+    p->nodes[dst_next].prev = n;
+
+    return NO_ERROR;
+}
+
+int psabpf_table_ternary_reorder(psabpf_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || !ctx->is_ternary)
+        return EINVAL;
+
+    int err = ternary_prefixes_load(ctx);
+    if (err != NO_ERROR)
+        return err;
+    if ((err = scan_all_tuples(ctx, NULL)) != NO_ERROR) {
+        pr_err("failed to read tuples: %s\n", strerror(err));
+        return err;
+    }
+
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    char *value = malloc(ctx->prefixes.value_size);
+    if (value == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+
+    /* Selection sort on the list, stable for equal priorities: after every step nodes up to
+     * `sorted` are in the final order, the highest priority node from the rest goes after it. */
+    size_t sorted = 0;
+    while (p->nodes[sorted].next != NO_NODE) {
+        size_t best = p->nodes[sorted].next;
+        for (size_t n = p->nodes[best].next; n != NO_NODE; n = p->nodes[n].next) {
+            if (p->nodes[n].max_priority > p->nodes[best].max_priority)
+                best = n;
+        }
+
+        if (best != p->nodes[sorted].next) {
+            err = move_node_after(ctx, best, sorted, value);
+            if (err != NO_ERROR) {
+                pr_err("failed to reorder prefixes: %s\n", strerror(err));
+                ternary_prefixes_free(ctx);
+                break;
+            }
+        }
+        sorted = best;
+    }
+
+    free(value);
+    return err;
+}
+
+int psabpf_table_ternary_get_stats(psabpf_table_entry_ctx_t *ctx, psabpf_table_ternary_stats_t *stats)
+{
+    if (ctx == NULL || stats == NULL || !ctx->is_ternary)
+        return EINVAL;
+    memset(stats, 0, sizeof(*stats));
+
+    int err = ternary_prefixes_load(ctx);
+    if (err != NO_ERROR)
+        return err;
+
+    struct psabpf_ternary_prefixes *p = ctx->prefixes_mirror;
+    stats->chain_length = p->n_nodes - 1;  /* without head */
+    if (stats->chain_length == 0)
+        return NO_ERROR;
+
+    stats->tuples = calloc(stats->chain_length, sizeof(psabpf_table_tuple_stats_t));
+    if (stats->tuples == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+
+    err = scan_all_tuples(ctx, stats->tuples);
+    if (err != NO_ERROR) {
+        pr_err("failed to read tuples: %s\n", strerror(err));
+        psabpf_table_ternary_stats_free(stats);
+    }
+
+    return err;
+}
+
+void psabpf_table_ternary_stats_free(psabpf_table_ternary_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+    if (stats->tuples != NULL)
+        free(stats->tuples);
+    stats->tuples = NULL;
+    stats->chain_length = 0;
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <bpf/bpf.h>
+#include <linux/bpf.h>
+
+#include <psabpf.h>
+#include "common.h"
+#include "psabpf_table.h"
+#include "psabpf_txn.h"
+#include "psabpf_map_ops.h"
+
+/* Map modified in transaction */
+typedef struct txn_map {
+    uint32_t id;
+    int fd;  /* own FD keeps map alive until transaction is finished */
+    uint32_t type;
+    uint32_t key_size;
+    uint32_t value_size;  /* size of value returned by lookup, e.g. for all CPUs */
+} txn_map_t;
+
+/* Previous content of one modified element */
+typedef struct txn_record {
+    size_t map;
+    bool existed;
+    int old_inner_fd;  /* maps of maps: previous inner map, -1 if none */
+    char *key;
+    char *old_value;   /* NULL for maps of maps */
+} txn_record_t;
+
+typedef struct txn_journal {
+    size_t n_maps;
+    size_t maps_capacity;
+    txn_map_t *maps;
+
+    size_t n_records;
+    size_t records_capacity;
+    txn_record_t *records;
+
+    size_t n_tables;
+    size_t tables_capacity;
+    psabpf_table_entry_ctx_t **tables;
+} txn_journal_t;
+
+/* Transaction in progress in the current thread */
+static _Thread_local psabpf_txn_t *current_txn = NULL;
+
+static txn_journal_t *current_journal(void)
+{
+    if (current_txn == NULL)
+        return NULL;
+    return current_txn->journal;
+}
+
+static int reserve_array(void **array, size_t *capacity, size_t n, size_t elem_size)
+{
+    if (n < *capacity)
+        return NO_ERROR;
+
+    size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+    void *new_array = realloc(*array, new_capacity * elem_size);
+    if (new_array == NULL)
+        return ENOMEM;
+    *array = new_array;
+    *capacity = new_capacity;
+
+    return NO_ERROR;
+}
+
+static bool is_map_of_maps(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_ARRAY_OF_MAPS || type == BPF_MAP_TYPE_HASH_OF_MAPS;
+}
+
+static int journal_get_map(txn_journal_t *journal, int fd, size_t *index)
+{
+    struct bpf_map_info info = {};
+    uint32_t info_len = sizeof(info);
+    if (map_ops->obj_get_info_by_fd(fd, &info, &info_len) != 0)
+        return errno;
+
+    /* FDs can be reused during transaction, IDs not */
+    for (size_t i = 0; i < journal->n_maps; i++) {
+        if (journal->maps[i].id == info.id) {
+            *index = i;
+            return NO_ERROR;
+        }
+    }
+
+    uint32_t value_size = 0;
+    int ret = get_map_lookup_value_size(&info, &value_size);
+    if (ret != NO_ERROR)
+        return ret;
+
+    if (reserve_array((void **) &journal->maps, &journal->maps_capacity,
+                      journal->n_maps, sizeof(txn_map_t)) != NO_ERROR)
+        return ENOMEM;
+
+    txn_map_t *map = &journal->maps[journal->n_maps];
+    map->fd = dup(fd);
+    if (map->fd < 0)
+        return errno;
+    map->id = info.id;
+    map->type = info.type;
+    map->key_size = info.key_size;
+    map->value_size = value_size;
+
+    *index = journal->n_maps++;
+    return NO_ERROR;
+}
+
+static void free_record(txn_record_t *record)
+{
+    close_object_fd(&record->old_inner_fd);
+    if (record->key != NULL)
+        free(record->key);
+    record->key = NULL;
+    record->old_value = NULL;
+}
+
+static int journal_record_in_map(txn_journal_t *journal, size_t map_idx, const void *key)
+{
+    int ret = NO_ERROR;
+    txn_map_t *map = &journal->maps[map_idx];
+
+    if (reserve_array((void **) &journal->records, &journal->records_capacity,
+                      journal->n_records, sizeof(txn_record_t)) != NO_ERROR)
+        return ENOMEM;
+
+    txn_record_t *record = &journal->records[journal->n_records];
+    record->map = map_idx;
+    record->existed = false;
+    record->old_inner_fd = -1;
+    /* key and value in one allocation */
+    record->key = malloc(map->key_size + map->value_size);
+    if (record->key == NULL)
+        return ENOMEM;
+    memcpy(record->key, key, map->key_size);
+    record->old_value = record->key + map->key_size;
+
+    if (map_ops->lookup_elem(map->fd, key, record->old_value) == 0) {
+        record->existed = true;
+    } else if (errno != ENOENT) {
+        ret = errno;
+        goto err;
+    }
+
+    if (record->existed && map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        ret = lpm_trie_key_exists(map->fd, key, map->key_size, &record->existed);
+        if (ret != NO_ERROR)
+            goto err;
+    }
+
+    if (is_map_of_maps(map->type)) {
+        if (record->existed) {
+            /* Lookup returns ID of the inner map, hold it, because it might be released after change */
+            uint32_t inner_id;
+            memcpy(&inner_id, record->old_value, sizeof(inner_id));
+            record->old_inner_fd = map_ops->get_fd_by_id(inner_id);
+            if (record->old_inner_fd < 0) {
+                ret = errno;
+                goto err;
+            }
+        }
+        record->old_value = NULL;
+    }
+
+    journal->n_records++;
+    return NO_ERROR;
+
+err:
+    free_record(record);
+    return ret;
+}
+
+static int journal_record(txn_journal_t *journal, int fd, const void *key)
+{
+    size_t map_idx;
+    int ret = journal_get_map(journal, fd, &map_idx);
+    if (ret != NO_ERROR)
+        return ret;
+
+    return journal_record_in_map(journal, map_idx, key);
+}
+
+/* Removes last records, used when the change was not applied */
+static void journal_drop_records(txn_journal_t *journal, size_t n)
+{
+    while (n > 0 && journal->n_records > 0) {
+        free_record(&journal->records[--journal->n_records]);
+        n--;
+    }
+}
+
+static int journal_undo_record(txn_journal_t *journal, txn_record_t *record)
+{
+    txn_map_t *map = &journal->maps[record->map];
+    int ret;
+
+    if (record->existed && is_map_of_maps(map->type))
+        ret = map_ops->update_elem(map->fd, record->key, &record->old_inner_fd, BPF_ANY);
+    else if (record->existed)
+        ret = map_ops->update_elem(map->fd, record->key, record->old_value, BPF_ANY);
+    else
+        ret = map_ops->delete_elem(map->fd, record->key);
+
+    if (ret != 0 && !(errno == ENOENT && !record->existed))
+        return errno;
+
+    return NO_ERROR;
+}
+
+static void journal_free(txn_journal_t *journal)
+{
+    journal_drop_records(journal, journal->n_records);
+    if (journal->records != NULL)
+        free(journal->records);
+
+    for (size_t i = 0; i < journal->n_maps; i++)
+        close_object_fd(&journal->maps[i].fd);
+    if (journal->maps != NULL)
+        free(journal->maps);
+
+    if (journal->tables != NULL)
+        free(journal->tables);
+
+    free(journal);
+}
+
+/* Table caches may contain flows derived from any version of tables, so they are cleared in both cases */
+static int journal_flush_tables(txn_journal_t *journal, bool rolled_back)
+{
+    int first_error = NO_ERROR;
+
+    for (size_t i = 0; i < journal->n_tables; i++) {
+        psabpf_table_entry_ctx_t *ctx = journal->tables[i];
+
+        /* mirror of ternary table prefixes is not valid after rollback, reload it on next use */
+        if (rolled_back && ctx->is_ternary)
+            ternary_prefixes_free(ctx);
+
+        int ret = psabpf_table_entry_ctx_flush_cache(ctx);
+        if (ret != NO_ERROR && first_error == NO_ERROR)
+            first_error = ret;
+    }
+    journal->n_tables = 0;
+
+    return first_error;
+}
+
+void psabpf_txn_init(psabpf_txn_t *txn)
+{
+    if (txn == NULL)
+        return;
+    memset(txn, 0, sizeof(psabpf_txn_t));
+}
+
+void psabpf_txn_free(psabpf_txn_t *txn)
+{
+    if (txn == NULL)
+        return;
+
+    if (txn->journal != NULL)
+        psabpf_txn_rollback(txn);
+}
+
+int psabpf_txn_begin(psabpf_txn_t *txn)
+{
+    if (txn == NULL)
+        return EINVAL;
+    if (current_txn != NULL) {
+        pr_err("another transaction is in progress\n");
+        return EBUSY;
+    }
+
+    txn->journal = calloc(1, sizeof(txn_journal_t));
+    if (txn->journal == NULL) {
+        pr_err("not enough memory\n");
+        return ENOMEM;
+    }
+    current_txn = txn;
+
+    return NO_ERROR;
+}
+
+static int finish_txn(psabpf_txn_t *txn, txn_journal_t **journal)
+{
+    if (txn == NULL)
+        return EINVAL;
+    if (txn->journal == NULL || current_txn != txn) {
+        pr_err("transaction not in progress\n");
+        return EINVAL;
+    }
+
+    *journal = txn->journal;
+    txn->journal = NULL;
+    current_txn = NULL;
+
+    return NO_ERROR;
+}
+
+int psabpf_txn_commit(psabpf_txn_t *txn)
+{
+    txn_journal_t *journal = NULL;
+    int ret = finish_txn(txn, &journal);
+    if (ret != NO_ERROR)
+        return ret;
+
+    ret = journal_flush_tables(journal, false);
+    if (ret != NO_ERROR)
+        pr_err("failed to clear cache: %s\n", strerror(ret));
+    journal_free(journal);
+
+    return ret;
+}
+
+int psabpf_txn_rollback(psabpf_txn_t *txn)
+{
+    txn_journal_t *journal = NULL;
+    int ret = finish_txn(txn, &journal);
+    if (ret != NO_ERROR)
+        return ret;
+
+    /* In reverse order, so element changed many times gets its oldest content */
+    int first_error = NO_ERROR;
+    for (size_t i = journal->n_records; i > 0; i--) {
+        ret = journal_undo_record(journal, &journal->records[i - 1]);
+        if (ret != NO_ERROR && first_error == NO_ERROR)
+            first_error = ret;
+    }
+    if (first_error != NO_ERROR)
+        pr_err("failed to restore some entries: %s\n", strerror(first_error));
+
+    ret = journal_flush_tables(journal, true);
+    if (ret != NO_ERROR) {
+        pr_err("failed to clear cache: %s\n", strerror(ret));
+        if (first_error == NO_ERROR)
+            first_error = ret;
+    }
+    journal_free(journal);
+
+    return first_error;
+}
+
+int txn_map_update_elem(int fd, const void *key, const void *value, uint64_t flags)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return map_ops->update_elem(fd, key, value, flags);
+
+    int ret = journal_record(journal, fd, key);
+    if (ret != NO_ERROR) {
+        errno = ret;
+        return -1;
+    }
+
+    ret = map_ops->update_elem(fd, key, value, flags);
+    if (ret != 0) {
+        int err = errno;
+        journal_drop_records(journal, 1);
+        errno = err;
+    }
+
+    return ret;
+}
+
+int txn_map_delete_elem(int fd, const void *key)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return map_ops->delete_elem(fd, key);
+
+    int ret = journal_record(journal, fd, key);
+    if (ret != NO_ERROR) {
+        errno = ret;
+        return -1;
+    }
+
+    ret = map_ops->delete_elem(fd, key);
+    if (ret != 0) {
+        int err = errno;
+        journal_drop_records(journal, 1);
+        errno = err;
+    }
+
+    return ret;
+}
+
+/* Elements are processed by kernel in order, so records of these which were not changed are at the end */
+static int journal_record_batch(txn_journal_t *journal, int fd, const char *keys, uint32_t count)
+{
+    size_t map_idx;
+    int ret = journal_get_map(journal, fd, &map_idx);
+    if (ret != NO_ERROR)
+        return ret;
+    const size_t key_size = journal->maps[map_idx].key_size;
+
+    for (uint32_t i = 0; i < count; i++) {
+        ret = journal_record_in_map(journal, map_idx, keys + i * key_size);
+        if (ret != NO_ERROR) {
+            journal_drop_records(journal, i);
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+int txn_map_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                         const struct bpf_map_batch_opts *opts)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return map_ops->update_batch(fd, keys, values, count, opts);
+
+    const uint32_t requested = *count;
+    int ret = journal_record_batch(journal, fd, keys, requested);
+    if (ret != NO_ERROR) {
+        *count = 0;
+        errno = ret;
+        return -1;
+    }
+
+    ret = map_ops->update_batch(fd, keys, values, count, opts);
+    if (ret != 0) {
+        int err = errno;
+        journal_drop_records(journal, requested - *count);
+        errno = err;
+    }
+
+    return ret;
+}
+
+int txn_map_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return map_ops->delete_batch(fd, keys, count, opts);
+
+    const uint32_t requested = *count;
+    int ret = journal_record_batch(journal, fd, keys, requested);
+    if (ret != NO_ERROR) {
+        *count = 0;
+        errno = ret;
+        return -1;
+    }
+
+    ret = map_ops->delete_batch(fd, keys, count, opts);
+    if (ret != 0) {
+        int err = errno;
+        journal_drop_records(journal, requested - *count);
+        errno = err;
+    }
+
+    return ret;
+}
+
+int txn_map_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                    uint32_t *count, const struct bpf_map_batch_opts *opts)
+{
+    if (current_journal() == NULL)
+        return map_ops->lookup_and_delete_batch(fd, in_batch, out_batch, keys, values, count, opts);
+
+    *count = 0;
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+bool txn_track_table(psabpf_table_entry_ctx_t *ctx)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return false;
+
+    for (size_t i = 0; i < journal->n_tables; i++) {
+        if (journal->tables[i] == ctx)
+            goto mark_cache;
+    }
+
+    if (reserve_array((void **) &journal->tables, &journal->tables_capacity,
+                      journal->n_tables, sizeof(psabpf_table_entry_ctx_t *)) != NO_ERROR)
+        return false;
+    journal->tables[journal->n_tables++] = ctx;
+
+mark_cache:
+    if (ctx->cache.fd >= 0)
+        ctx->cache_invalidation_pending = true;
+
+    return true;
+}
+
+void txn_forget_table(psabpf_table_entry_ctx_t *ctx)
+{
+    txn_journal_t *journal = current_journal();
+    if (journal == NULL)
+        return;
+
+    for (size_t i = 0; i < journal->n_tables; i++) {
+        if (journal->tables[i] == ctx) {
+            journal->tables[i] = journal->tables[--journal->n_tables];
+            return;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef P4C_PSABPF_TXN_H
+#define P4C_PSABPF_TXN_H
+
+#include <bpf/bpf.h>
+
+#include "psabpf.h"
+
+/* Replacements of map operations which modify maps. Without transaction in progress they only call map_ops,
+ * otherwise previous content of elements is recorded first. Return value and errno follow libbpf. */
+int txn_map_update_elem(int fd, const void *key, const void *value, uint64_t flags);
+int txn_map_delete_elem(int fd, const void *key);
+int txn_map_update_batch(int fd, void *keys, void *values, uint32_t *count,
+                         const struct bpf_map_batch_opts *opts);
+int txn_map_delete_batch(int fd, void *keys, uint32_t *count, const struct bpf_map_batch_opts *opts);
+/* Not available in transaction, fails with EOPNOTSUPP, so caller falls back to per-element calls */
+int txn_map_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values,
+                                    uint32_t *count, const struct bpf_map_batch_opts *opts);
+
+/* Returns true when table is modified in transaction, then its cache is cleared when transaction is finished */
+bool txn_track_table(psabpf_table_entry_ctx_t *ctx);
+void txn_forget_table(psabpf_table_entry_ctx_t *ctx);
+
+#endif  /* P4C_PSABPF_TXN_H */
@@ -26,6 +26,7 @@
 #include <psabpf_value_set.h>
 #include "psabpf_table.h"
 #include "common.h"
+#include "psabpf_txn.h"
 #include "btf.h"
 
 void psabpf_value_set_context_init(psabpf_value_set_context_t *ctx) {
@@ -65,7 +66,7 @@ int psabpf_value_set_context_name(psabpf_context_t *psabpf_ctx, psabpf_value_set
         return EINVAL;
 
     if (load_btf(psabpf_ctx, &ctx->btf_metadata) != NO_ERROR) {
-        fprintf(stderr, "couldn't find a BTF info\n");
+        pr_err("couldn't find a BTF info\n");
     }
 
     int ret = open_bpf_map(psabpf_ctx, name, &ctx->btf_metadata, &ctx->set_map);
@@ -76,7 +77,7 @@ int psabpf_value_set_context_name(psabpf_context_t *psabpf_ctx, psabpf_value_set
         ret = open_ternary_table(psabpf_ctx, &tbl_entry_ctx, name);
 
         if (ret != NO_ERROR) {
-            fprintf(stderr, "couldn't open a value_set %s\n", name);
+            pr_err("couldn't open a value_set %s\n", name);
             psabpf_table_entry_ctx_free(&tbl_entry_ctx);
             return ret;
         }
@@ -89,7 +90,7 @@ int psabpf_value_set_context_name(psabpf_context_t *psabpf_ctx, psabpf_value_set
 
 
     if (parse_key_type(ctx) != NO_ERROR) {
-        fprintf(stderr, "%s: couldn't parse structure of a value_set instance\n", name);
+        pr_err("%s: couldn't parse structure of a value_set instance\n", name);
         return EOPNOTSUPP;
     }
 
@@ -134,12 +135,16 @@ psabpf_table_entry_t *psabpf_value_set_get_next_entry(psabpf_value_set_context_t
 
     int return_code = parse_table_key(&tec, new_entry, tec.current_raw_key, tec.current_raw_key_mask);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
+        pr_err("failed to parse entry: %s\n", strerror(return_code));
         goto clean_up;
     }
 
 clean_up:
-    psabpf_table_entry_ctx_free(&tec);
+    /* BTF and map are borrowed from value_set context, so free only iteration state */
+    if (tec.current_raw_key != NULL)
+        free(tec.current_raw_key);
+    if (tec.current_raw_key_mask != NULL)
+        free(tec.current_raw_key_mask);
 
     return new_entry;
 }
@@ -156,7 +161,7 @@ int psabpf_value_set_insert(psabpf_value_set_context_t *ctx, psabpf_table_entry_
     key_buffer = malloc(ctx->set_map.key_size);
     value_buffer = calloc(1, ctx->set_map.value_size);
     if (key_buffer == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
+        pr_err("not enough memory\n");
         return_code = ENOMEM;
         goto clean_up;
     }
@@ -169,7 +174,7 @@ int psabpf_value_set_insert(psabpf_value_set_context_t *ctx, psabpf_table_entry_
     return_code = construct_buffer(key_buffer, ctx->set_map.key_size, &tec, entry,
                                    fill_key_btf_info, fill_key_byte_by_byte);
     if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
+        pr_err("failed to construct key\n");
         goto clean_up;
     }
 
@@ -177,10 +182,10 @@ int psabpf_value_set_insert(psabpf_value_set_context_t *ctx, psabpf_table_entry_
     uint64_t bpf_flags = BPF_NOEXIST;
     if (ctx->set_map.type == BPF_MAP_TYPE_ARRAY)
         bpf_flags = BPF_ANY;
-    return_code = bpf_map_update_elem(ctx->set_map.fd, key_buffer, value_buffer, bpf_flags);
+    return_code = txn_map_update_elem(ctx->set_map.fd, key_buffer, value_buffer, bpf_flags);
     if (return_code != 0) {
         return_code = errno;
-        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
+        pr_err("failed to set up entry: %s\n", strerror(errno));
     }
 
 clean_up:
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef P4C_PSABPF_STATS_INTERNAL_H
+#define P4C_PSABPF_STATS_INTERNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <psabpf_stats.h>
+#include "psabpf_map_ops.h"
+
+/* While stats are enabled map_ops points to a table which counts calls and forwards them to the backend */
+extern bool stats_active;
+
+/* Selects backend, used instead of assigning map_ops, so enabled stats keep wrapping it */
+void stats_set_map_ops(const psabpf_map_ops_t *ops);
+
+typedef struct stats_scope {
+    bool active;
+    psabpf_stats_op_t op;
+    uint64_t start_ns;
+    uint64_t map_ops;
+    uint64_t bytes;
+} stats_scope_t;
+
+void stats_scope_begin(stats_scope_t *scope);
+void stats_scope_finish(stats_scope_t *scope);
+
+static inline void stats_scope_end(stats_scope_t *scope)
+{
+    if (__builtin_expect(scope->active, 0))
+        stats_scope_finish(scope);
+}
+
+/* Measures high-level operation from this point until the end of the enclosing block */
+#define STATS_SCOPE(stats_op)                                                          \
+    stats_scope_t stats_scope __attribute__((cleanup(stats_scope_end))) = {           \
+            .active = stats_active, .op = (stats_op) };                               \
+    if (__builtin_expect(stats_scope.active, 0))                                      \
+        stats_scope_begin(&stats_scope)
+
+#endif  /* P4C_PSABPF_STATS_INTERNAL_H */
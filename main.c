@@ -15,6 +15,7 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 
@@ -29,6 +30,9 @@
 #include "CLI/counter.h"
 #include "CLI/register.h"
 #include "CLI/value_set.h"
+#include "CLI/stats.h"
+#include "CLI/daemon.h"
+#include "CLI/batch.h"
 
 const char *program_name;
 
@@ -73,10 +77,19 @@ static int do_help(int argc, char **argv)
             "                   digest |\n"
             "                   counter |\n"
             "                   register |\n"
-            "                   value-set }\n"
-            "       OPTIONS := {}\n"
+            "                   value-set |\n"
+            "                   stats |\n"
+            "                   daemon |\n"
+            "                   client }\n"
+            "       %s -b FILE\n"
+            "       OPTIONS := { --ndjson | --socket PATH | --log-level LEVEL }\n"
+            "\n"
+            "       --ndjson           print every entry as a separate line of compact JSON\n"
+            "       --socket PATH      execute command by daemon listening on PATH\n"
+            "       --log-level LEVEL  messages of the library to print: error, warning, info (default) or debug\n"
+            "       -b FILE            execute commands from FILE (- for standard input), one per line\n"
             "",
-            program_name, program_name);
+            program_name, program_name, program_name);
 
     return 0;
 }
@@ -152,6 +165,11 @@ static int do_value_set(int argc, char **argv)
     return cmd_select(value_set_cmds, argc, argv, do_value_set_help);
 }
 
+static int do_stats(int argc, char **argv)
+{
+    return cmd_select(stats_cmds, argc, argv, do_stats_help);
+}
+
 static const struct cmd cmds[] = {
         { "help",            do_help },
         { "pipeline",        do_pipeline },
@@ -166,17 +184,90 @@ static const struct cmd cmds[] = {
         { "counter",         do_counter },
         { "register",        do_register },
         { "value-set",       do_value_set },
+        { "stats",           do_stats },
+        { "daemon",          do_daemon },
+        { "client",          do_client },
         { 0 }
 };
 
+int run_command(int argc, char **argv)
+{
+    return cmd_select(cmds, argc, argv, do_help);
+}
+
+static int parse_log_level(const char *str)
+{
+    static const struct {
+        const char *name;
+        psabpf_log_level_t level;
+    } levels[] = {
+            { "error", PSABPF_LOG_ERROR },
+            { "warning", PSABPF_LOG_WARNING },
+            { "info", PSABPF_LOG_INFO },
+            { "debug", PSABPF_LOG_DEBUG },
+    };
+
+    for (unsigned i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (is_keyword(str, levels[i].name)) {
+            psabpf_set_log_level(levels[i].level);
+            return NO_ERROR;
+        }
+    }
+
+    fprintf(stderr, "%s: unknown log level\n", str);
+    return EINVAL;
+}
+
 int main(int argc, char **argv)
 {
+    static const struct option options[] = {
+            { "ndjson", no_argument, NULL, 'n' },
+            { "socket", required_argument, NULL, 's' },
+            { "batch", required_argument, NULL, 'b' },
+            { "log-level", required_argument, NULL, 'l' },
+            { 0 }
+    };
+    const char *socket_path = NULL;
+    const char *batch_file = NULL;
+    int opt;
+
     program_name = argv[0];
 
-    // TODO: parse program options
+    /* Stop at the first non-option, arguments of commands may start with '-' */
+    while ((opt = getopt_long(argc, argv, "+b:", options, NULL)) >= 0) {
+        switch (opt) {
+            case 'n':
+                output_ndjson = true;
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'b':
+                batch_file = optarg;
+                break;
+            case 'l':
+                if (parse_log_level(optarg) != NO_ERROR)
+                    return EINVAL;
+                break;
+            default:
+                do_help(argc, argv);
+                return -1;
+        }
+    }
 
     argc -= optind;
     argv += optind;
 
+    if (batch_file != NULL) {
+        if (argc > 0 || socket_path != NULL) {
+            fprintf(stderr, "batch mode doesn't accept command or --socket, use client instead\n");
+            return EINVAL;
+        }
+        return run_batch(batch_file);
+    }
+
+    if (socket_path != NULL && argc > 0)
+        return daemon_forward_command(socket_path, argc, argv);
+
     return cmd_select(cmds, argc, argv, do_help);
 }
\ No newline at end of file